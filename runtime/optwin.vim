@@ -773,6 +773,10 @@ call append("$", "undofile\tautomatically save and restore undo history")
 call <SID>BinOptionG("udf", &udf)
 call append("$", "undodir\tlist of directories for undo files")
 call <SID>OptionG("udir", &udir)
+if has("persistent_undo")
+  call append("$", "undomemory\tmaximum memory in Kbyte for the text of changes")
+  call append("$", " \tset umm=" . &umm)
+endif
 call append("$", "undoreload\tmaximum number lines to save for undo on a buffer reload")
 call append("$", " \tset ur=" . &ur)
 call append("$", "modified\tchanges have been made and not written to a file")
@@ -1039,10 +1043,21 @@ call <SID>BinOptionG("wa", &wa)
 call append("$", "autoread\tautomatically read a file when it was modified outside of Vim")
 call append("$", "\t(global or local to buffer)")
 call <SID>BinOptionG("ar", &ar)
+if has("filewatch")
+  call append("$", "filewatch\twatch files with inotify for changes: \"local\" or \"all\"")
+  call <SID>OptionG("fw", &fw)
+endif
+call append("$", "followtail\tkeep the cursor at the end when appended text is read")
+call append("$", "\t(local to buffer)")
+call <SID>BinOptionL("fot")
 call append("$", "patchmode\tkeep oldest version of a file; specifies file name extension")
 call <SID>OptionG("pm", &pm)
 call append("$", "fsync\tforcibly sync the file to disk after writing it")
 call <SID>BinOptionG("fs", &fs)
+if has("asyncwrite")
+  call append("$", "asyncwrite\tminimal size in Kbyte to write a buffer in the background")
+  call append("$", " \tset asw=" . &asw)
+endif
 call append("$", "shortname\tuse 8.3 file names")
 call append("$", "\t(local to buffer)")
 call <SID>BinOptionL("sn")
@@ -1059,6 +1074,10 @@ call append("$", "\t(local to buffer)")
 call <SID>BinOptionL("swf")
 call append("$", "swapsync\t\"sync\", \"fsync\" or empty; how to flush a swap file to disk")
 call <SID>OptionG("sws", &sws)
+if has("swapthread")
+  call append("$", "swapthread\twrite the swap file in a separate thread")
+  call <SID>BinOptionG("swt", &swt)
+endif
 call append("$", "updatecount\tnumber of characters typed to cause a swap file update")
 call append("$", " \tset uc=" . &uc)
 call append("$", "updatetime\ttime in msec after which the swap file will be updated")
@@ -842,6 +842,9 @@ buf_freeall(buf_T *buf, int flags)
 #endif
     ml_close(buf, TRUE);	    /* close and delete the memline/memfile */
     buf->b_ml.ml_line_count = 0;    /* no lines in buffer */
+#ifdef FEAT_FILEWATCH
+    mch_unwatch_buf(buf);	    /* no need to check the file */
+#endif
     if ((flags & BFA_KEEP_UNDO) == 0)
     {
 	u_blockfree(buf);	    /* free the memory allocated for undo */
@@ -3247,6 +3250,11 @@ buf_set_name(int fnum, char_u *name)
     void
 buf_name_changed(buf_T *buf)
 {
+#ifdef FEAT_FILEWATCH
+    /* Stop watching the file with the old name. */
+    mch_unwatch_buf(buf);
+#endif
+
     /*
      * If the file name changed, also change the name of the swapfile
      */
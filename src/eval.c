@@ -3167,7 +3167,7 @@ pattern_match(char_u *pat, char_u *text, int ic)
     /* avoid 'l' flag in 'cpoptions' */
     save_cpo = p_cpo;
     p_cpo = (char_u *)"";
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING + RE_CACHE);
     if (regmatch.regprog != NULL)
     {
 	regmatch.rm_ic = ic;
@@ -9942,7 +9942,7 @@ do_string_sub(
     do_all = (flags[0] == 'g');
 
     regmatch.rm_ic = p_ic;
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING + RE_CACHE);
     if (regmatch.regprog != NULL)
     {
 	tail = str;
@@ -59,6 +59,7 @@ static void f_asin(typval_T *argvars, typval_T *rettv);
 static void f_atan(typval_T *argvars, typval_T *rettv);
 static void f_atan2(typval_T *argvars, typval_T *rettv);
 #endif
+static void f_autocmdtime(typval_T *argvars, typval_T *rettv);
 #ifdef FEAT_BEVAL
 static void f_balloon_show(typval_T *argvars, typval_T *rettv);
 #endif
@@ -266,6 +267,7 @@ static void f_matchlist(typval_T *argvars, typval_T *rettv);
 static void f_matchstr(typval_T *argvars, typval_T *rettv);
 static void f_matchstrpos(typval_T *argvars, typval_T *rettv);
 static void f_max(typval_T *argvars, typval_T *rettv);
+static void f_memstats(typval_T *argvars, typval_T *rettv);
 static void f_min(typval_T *argvars, typval_T *rettv);
 #ifdef vim_mkdir
 static void f_mkdir(typval_T *argvars, typval_T *rettv);
@@ -298,6 +300,7 @@ static void f_pyxeval(typval_T *argvars, typval_T *rettv);
 #endif
 static void f_range(typval_T *argvars, typval_T *rettv);
 static void f_readfile(typval_T *argvars, typval_T *rettv);
+static void f_regcachestats(typval_T *argvars, typval_T *rettv);
 static void f_reltime(typval_T *argvars, typval_T *rettv);
 #ifdef FEAT_FLOAT
 static void f_reltimefloat(typval_T *argvars, typval_T *rettv);
@@ -490,6 +493,7 @@ static struct fst
     {"atan",		1, 1, f_atan},
     {"atan2",		2, 2, f_atan2},
 #endif
+    {"autocmdtime",	0, 0, f_autocmdtime},
 #ifdef FEAT_BEVAL
     {"balloon_show",	1, 1, f_balloon_show},
 #endif
@@ -702,6 +706,7 @@ static struct fst
     {"matchstr",	2, 4, f_matchstr},
     {"matchstrpos",	2, 4, f_matchstrpos},
     {"max",		1, 1, f_max},
+    {"memstats",	0, 1, f_memstats},
     {"min",		1, 1, f_min},
 #ifdef vim_mkdir
     {"mkdir",		1, 3, f_mkdir},
@@ -734,6 +739,7 @@ static struct fst
 #endif
     {"range",		1, 3, f_range},
     {"readfile",	1, 3, f_readfile},
+    {"regcachestats",	0, 0, f_regcachestats},
     {"reltime",		0, 2, f_reltime},
 #ifdef FEAT_FLOAT
     {"reltimefloat",	1, 1, f_reltimefloat},
@@ -1397,6 +1403,20 @@ f_atan2(typval_T *argvars, typval_T *rettv)
 }
 #endif
 
+/*
+ * "autocmdtime()" function
+ */
+    static void
+f_autocmdtime(typval_T *argvars UNUSED, typval_T *rettv)
+{
+    if (rettv_list_alloc(rettv) == OK)
+    {
+#if defined(FEAT_AUTOCMD) && defined(FEAT_PROFILE)
+	autocmdtime_list(rettv->vval.v_list);
+#endif
+    }
+}
+
 /*
  * "balloon_show()" function
  */
@@ -5579,6 +5599,9 @@ f_has(typval_T *argvars, typval_T *rettv)
 #ifdef FEAT_ARABIC
 	"arabic",
 #endif
+#ifdef FEAT_ASYNC_WRITE
+	"asyncwrite",
+#endif
 #ifdef FEAT_AUTOCMD
 	"autocmd",
 #endif
@@ -5675,6 +5698,9 @@ f_has(typval_T *argvars, typval_T *rettv)
 #ifdef FEAT_SEARCHPATH
 	"file_in_path",
 #endif
+#ifdef FEAT_FILEWATCH
+	"filewatch",
+#endif
 #ifdef FEAT_FILTERPIPE
 	"filterpipe",
 #endif
@@ -5913,6 +5939,9 @@ f_has(typval_T *argvars, typval_T *rettv)
 #ifdef FEAT_SPELL
 	"spell",
 #endif
+#ifdef FEAT_SWAP_THREAD
+	"swapthread",
+#endif
 #ifdef FEAT_SYN_HL
 	"syntax",
 #endif
@@ -7367,7 +7396,7 @@ find_some_match(typval_T *argvars, typval_T *rettv, int type)
 	    goto theend;
     }
 
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING + RE_CACHE);
     if (regmatch.regprog != NULL)
     {
 	regmatch.rm_ic = p_ic;
@@ -7770,6 +7799,51 @@ f_max(typval_T *argvars, typval_T *rettv)
     max_min(argvars, rettv, TRUE);
 }
 
+/*
+ * "memstats()" function
+ */
+    static void
+f_memstats(typval_T *argvars, typval_T *rettv)
+{
+    buf_T	*buf = curbuf;
+    long	hits;
+    long	misses;
+    long	reads;
+    long_u	used;
+    long_u	ziptext;
+    long_u	zipsize;
+
+    if (rettv_dict_alloc(rettv) == FAIL)
+	return;
+
+    if (argvars[0].v_type != VAR_UNKNOWN)
+    {
+	(void)get_tv_number(&argvars[0]);   /* issue errmsg if type error */
+	++emsg_off;
+	buf = get_buf_tv(&argvars[0], FALSE);
+	--emsg_off;
+	if (buf == NULL)
+	    return;
+    }
+
+    ml_cache_stats(buf, &hits, &misses);
+    dict_add_nr_str(rettv->vval.v_dict, "cachehits", hits, NULL);
+    dict_add_nr_str(rettv->vval.v_dict, "cachemisses", misses, NULL);
+
+    mf_stats(&hits, &reads, &misses, &used);
+    dict_add_nr_str(rettv->vval.v_dict, "hits", hits, NULL);
+    dict_add_nr_str(rettv->vval.v_dict, "reads", reads, NULL);
+    dict_add_nr_str(rettv->vval.v_dict, "evictions", misses, NULL);
+    dict_add_nr_str(rettv->vval.v_dict, "used", (long)used, NULL);
+
+    mf_zip_stats(&hits, &ziptext, &zipsize);
+    dict_add_nr_str(rettv->vval.v_dict, "unzips", hits, NULL);
+    dict_add_nr_str(rettv->vval.v_dict, "zipped", (long)ziptext, NULL);
+    dict_add_nr_str(rettv->vval.v_dict, "zipsize", (long)zipsize, NULL);
+    dict_add_nr_str(rettv->vval.v_dict, "zipratio", zipsize == 0 ? 0L
+			     : (long)((double)ziptext * 100 / zipsize), NULL);
+}
+
 /*
  * "min()" function
  */
@@ -8478,6 +8552,16 @@ list2proftime(typval_T *arg, proftime_T *tm)
 }
 #endif /* FEAT_RELTIME */
 
+/*
+ * "regcachestats()" function
+ */
+    static void
+f_regcachestats(typval_T *argvars UNUSED, typval_T *rettv)
+{
+    if (rettv_dict_alloc(rettv) != FAIL)
+	regcache_stats(rettv->vval.v_dict);
+}
+
 /*
  * "reltime()" function
  */
@@ -11171,7 +11255,7 @@ f_split(typval_T *argvars, typval_T *rettv)
     if (typeerr)
 	return;
 
-    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING);
+    regmatch.regprog = vim_regcomp(pat, RE_MAGIC + RE_STRING + RE_CACHE);
     if (regmatch.regprog != NULL)
     {
 	regmatch.rm_ic = FALSE;
@@ -12494,6 +12578,8 @@ f_test_override(typval_T *argvars, typval_T *rettv UNUSED)
 	    disable_redraw_for_testing = val;
 	else if (STRCMP(name, (char_u *)"char_avail") == 0)
 	    disable_char_avail_for_testing = val;
+	else if (STRCMP(name, (char_u *)"memzip") == 0)
+	    always_zip_for_testing = val;
 	else if (STRCMP(name, (char_u *)"starting") == 0)
 	{
 	    if (val)
@@ -12512,6 +12598,7 @@ f_test_override(typval_T *argvars, typval_T *rettv UNUSED)
 	{
 	    disable_char_avail_for_testing = FALSE;
 	    disable_redraw_for_testing = FALSE;
+	    always_zip_for_testing = FALSE;
 	    if (save_starting >= 0)
 	    {
 		starting = save_starting;
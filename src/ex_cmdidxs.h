@@ -6,31 +6,31 @@
 static const unsigned short cmdidxs1[26] =
 {
   /* a */ 0,
-  /* b */ 19,
-  /* c */ 42,
-  /* d */ 103,
-  /* e */ 125,
-  /* f */ 145,
-  /* g */ 161,
-  /* h */ 167,
-  /* i */ 176,
-  /* j */ 194,
-  /* k */ 196,
-  /* l */ 201,
-  /* m */ 259,
-  /* n */ 279,
-  /* o */ 299,
-  /* p */ 311,
-  /* q */ 350,
-  /* r */ 353,
-  /* s */ 372,
-  /* t */ 439,
-  /* u */ 475,
-  /* v */ 486,
-  /* w */ 504,
-  /* x */ 519,
-  /* y */ 528,
-  /* z */ 529
+  /* b */ 20,
+  /* c */ 43,
+  /* d */ 104,
+  /* e */ 126,
+  /* f */ 146,
+  /* g */ 162,
+  /* h */ 168,
+  /* i */ 177,
+  /* j */ 195,
+  /* k */ 197,
+  /* l */ 202,
+  /* m */ 260,
+  /* n */ 280,
+  /* o */ 300,
+  /* p */ 312,
+  /* q */ 351,
+  /* r */ 354,
+  /* s */ 373,
+  /* t */ 440,
+  /* u */ 476,
+  /* v */ 487,
+  /* w */ 505,
+  /* x */ 520,
+  /* y */ 529,
+  /* z */ 530
 };
 
 /*
@@ -69,4 +69,4 @@ static const unsigned char cmdidxs2[26][26] =
   /* z */ {  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0 }
 };
 
-static const int command_count = 542;
+static const int command_count = 543;
@@ -614,8 +614,7 @@ ex_sort(exarg_T *eap)
 
     /* delete the original lines if appending worked */
     if (i == count)
-	for (i = 0; i < count; ++i)
-	    ml_delete(eap->line1, FALSE);
+	ml_delete_range(eap->line1, (long)count, FALSE);
     else
 	count = 0;
 
@@ -880,8 +879,7 @@ do_move(linenr_T line1, linenr_T line2, linenr_T dest)
     if (u_save(line1 + extra - 1, line2 + extra + 1) == FAIL)
 	return FAIL;
 
-    for (l = line1; l <= line2; l++)
-	ml_delete(line1 + extra, TRUE);
+    ml_delete_range(line1 + extra, num_lines, TRUE);
 
     if (!global_busy && num_lines > p_report)
     {
@@ -154,6 +154,9 @@ EX(CMD_ascii,		"ascii",	do_ascii,
 EX(CMD_autocmd,		"autocmd",	ex_autocmd,
 			BANG|EXTRA|NOTRLCOM|USECTRLV|CMDWIN,
 			ADDR_LINES),
+EX(CMD_autocmdtime,	"autocmdtime",	ex_autocmdtime,
+			NEEDARG|EXTRA|TRLBAR|CMDWIN,
+			ADDR_LINES),
 EX(CMD_augroup,		"augroup",	ex_autocmd,
 			BANG|WORD1|TRLBAR|CMDWIN,
 			ADDR_LINES),
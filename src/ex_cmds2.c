@@ -1420,7 +1420,8 @@ timer_free_all()
 #  endif
 # endif
 
-#if defined(FEAT_SYN_HL) && defined(FEAT_RELTIME) && defined(FEAT_FLOAT)
+#if (defined(FEAT_SYN_HL) || defined(FEAT_AUTOCMD)) && defined(FEAT_RELTIME) \
+	&& defined(FEAT_FLOAT)
 # if defined(HAVE_MATH_H)
 #  include <math.h>
 # endif
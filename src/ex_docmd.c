@@ -256,6 +256,9 @@ static void	ex_popup(exarg_T *eap);
 #if !defined(FEAT_SYN_HL) || !defined(FEAT_PROFILE)
 # define ex_syntime		ex_ni
 #endif
+#if !defined(FEAT_AUTOCMD) || !defined(FEAT_PROFILE)
+# define ex_autocmdtime		ex_ni
+#endif
 #ifndef FEAT_SPELL
 # define ex_spell		ex_ni
 # define ex_mkspell		ex_ni
@@ -4340,6 +4343,7 @@ set_one_cmd_context(
 #endif
 #if defined(FEAT_PROFILE)
 	case CMD_syntime:
+	case CMD_autocmdtime:
 	    xp->xp_context = EXPAND_SYNTIME;
 	    xp->xp_pattern = arg;
 	    break;
@@ -9651,10 +9655,7 @@ ex_wundo(exarg_T *eap)
     static void
 ex_rundo(exarg_T *eap)
 {
-    char_u hash[UNDO_HASH_SIZE];
-
-    u_compute_hash(hash);
-    u_read_undo(eap->arg, hash, NULL);
+    u_read_undo(eap->arg, NULL, NULL);
 }
 #endif
 
@@ -591,6 +591,31 @@
 # define FEAT_CRYPT
 #endif
 
+/*
+ * +swapthread		Unix only: write the swap file in a separate thread,
+ *			when 'swapthread' is set.  Needs pthread_create().
+ */
+#if defined(FEAT_NORMAL) && defined(UNIX) && defined(HAVE_PTHREAD)
+# define FEAT_SWAP_THREAD
+#endif
+
+/*
+ * +asyncwrite		Unix only: write a large buffer in a separate thread,
+ *			when 'asyncwrite' is set.  Needs pthread_create().
+ */
+#if defined(FEAT_NORMAL) && defined(UNIX) && defined(HAVE_PTHREAD)
+# define FEAT_ASYNC_WRITE
+#endif
+
+/*
+ * +filewatch		Linux only: use inotify to find out which files were
+ *			changed, when 'filewatch' is set.
+ */
+#if defined(FEAT_NORMAL) && defined(HAVE_SYS_INOTIFY_H) \
+	&& defined(HAVE_INOTIFY_INIT1)
+# define FEAT_FILEWATCH
+#endif
+
 /*
  * +mksession		":mksession" command.
  *			Requires +windows and +vertsplit.
@@ -21,13 +21,27 @@
 # include <utime.h>		/* for struct utimbuf */
 #endif
 
+#ifdef HAVE_COPY_FILE_RANGE
+# include <sys/syscall.h>	/* for SYS_copy_file_range */
+#endif
+#ifdef HAVE_FICLONE
+# include <sys/ioctl.h>
+# include <linux/fs.h>		/* for FICLONE */
+#endif
+#ifdef FEAT_ASYNC_WRITE
+# include <pthread.h>
+#endif
+
 #define BUFSIZE		8192	/* size of normal write buffer */
+#define WRITEBUFSIZE	65536	/* size of buffer for writing the text */
+#define WRITELINES	256	/* nr of lines to get at once for writing */
 #define SMBUFSIZE	256	/* size of emergency write buffer */
 
 /* Is there any system that doesn't have access()? */
 #define USE_MCH_ACCESS
 
 #ifdef FEAT_MBYTE
+static long ascii_len(char_u *p, long len);
 static char_u *next_fenc(char_u **pp);
 # ifdef FEAT_EVAL
 static char_u *readfile_charconvert(char_u *fname, char_u *fenc, int *fdp);
@@ -116,6 +130,113 @@ struct bw_info
 };
 
 static int  buf_write_bytes(struct bw_info *ip);
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_FICLONE)
+static int  copy_file_fast(int from_fd, int to_fd);
+#endif
+
+#ifdef FEAT_ASYNC_WRITE
+/*
+ * When 'asyncwrite' is set, ":write" of a large buffer returns after the file
+ * was opened.  The text is copied from the memline in chunks while waiting
+ * for the user to type and a separate thread writes the chunks to the file.
+ * What still needs to be copied is kept as a list of segments: ranges of
+ * lines in the buffer and text that was saved.  Before lines that were not
+ * copied yet are changed or deleted their text is saved, thus the file gets
+ * the text as it was at the ":write" and a change only copies the lines it
+ * changes.  When all text was
+ * written the file is closed and the rest of what buf_write() does is done,
+ * including triggering BufWritePost.
+ * The queue of chunks, wa_copied, wa_written and the results of the writer
+ * thread are protected by wa_mutex.
+ */
+# define WA_CHUNKSIZE	(1024L * 1024L)	    /* bytes in one chunk */
+# define WA_COPYSIZE	(8L * WA_CHUNKSIZE) /* bytes copied at a time */
+# define WA_MAXQUEUED	(64L * WA_CHUNKSIZE) /* max bytes waiting to be
+						written */
+
+typedef struct wa_chunk_S wa_chunk_T;
+
+struct wa_chunk_S
+{
+    wa_chunk_T	*ch_next;	/* next chunk in queue */
+    size_t	ch_len;		/* number of bytes in ch_data */
+    char_u	ch_data[1];	/* the text, actually longer */
+};
+
+typedef struct wa_seg_S wa_seg_T;
+
+/*
+ * A part of the file that still needs to be copied: "sg_count" lines of the
+ * buffer from "sg_lnum", or when "sg_count" is zero text of the buffer that
+ * was saved before it was changed.
+ */
+struct wa_seg_S
+{
+    wa_seg_T	*sg_next;	/* next part of the file */
+    linenr_T	sg_lnum;	/* first line in the buffer */
+    linenr_T	sg_count;	/* number of lines, zero for saved text */
+    wa_chunk_T	*sg_first;	/* first chunk of saved text */
+    wa_chunk_T	*sg_last;	/* last chunk of saved text */
+};
+
+typedef struct write_async_S write_async_T;
+
+struct write_async_S
+{
+    write_async_T *wa_next;	/* next buffer being written */
+    buf_T	*wa_buf;	/* the buffer */
+    int		wa_fd;		/* the file being written */
+    char_u	*wa_fname;	/* name of the file, allocated */
+    char_u	*wa_backup;	/* backup file or NULL, allocated */
+    stat_T	wa_st_old;	/* stat() of the original file */
+    long	wa_perm;	/* permissions of the original file or -1 */
+    int		wa_made_writable; /* 'w' bit has been set */
+    int		wa_newfile;	/* the file didn't exist yet */
+# ifdef HAVE_ACL
+    vim_acl_T	wa_acl;		/* ACL of the original file */
+# endif
+    int		wa_write_undo_file; /* also write the undo file */
+    varnumber_T	wa_changedtick;	/* b:changedtick at the ":write" */
+
+    int		wa_fileformat;	/* EOL_UNIX, EOL_DOS or EOL_MAC */
+    int		wa_no_eol;	/* no end-of-line after the last line */
+    wa_seg_T	*wa_segs;	/* text still to be copied */
+    linenr_T	wa_end;		/* number of lines written */
+    off_T	wa_nchars;	/* number of bytes copied */
+    off_T	wa_size;	/* size of the text in the memline */
+    int		wa_copying;	/* busy copying text */
+    int		wa_percent;	/* percentage in b:writestatus */
+
+    wa_chunk_T	*wa_first;	/* first chunk to be written */
+    wa_chunk_T	*wa_last;	/* last chunk to be written */
+    off_T	wa_queued;	/* number of bytes in the queue */
+    off_T	wa_written;	/* number of bytes written */
+    int		wa_copied;	/* all text was copied */
+    int		wa_fsync;	/* fsync() the file at the end */
+    int		wa_error;	/* errno for failed write() */
+    int		wa_fsync_failed; /* fsync() failed */
+    int		wa_done;	/* the writer thread has finished */
+    volatile int wa_abandoned;	/* Vim is exiting on a signal, wa_fd was
+				   closed */
+};
+
+static pthread_mutex_t	wa_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	wa_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	wa_finished = PTHREAD_COND_INITIALIZER;
+static write_async_T	*first_write_async = NULL;
+
+static write_async_T *write_async_start(buf_T *buf, int fd, char_u *fname, char_u *backup, stat_T *st_old);
+static long write_async_line(write_async_T *wa, char_u *ptr, int eol, wa_chunk_T **firstp, wa_chunk_T **lastp);
+static long write_async_lines(write_async_T *wa, linenr_T lnum, linenr_T count, int last, wa_chunk_T **firstp, wa_chunk_T **lastp);
+static void write_async_free_chunks(wa_chunk_T *chunk);
+static void write_async_nomem(write_async_T *wa);
+static void write_async_copy(write_async_T *wa, off_T maxsize);
+static void write_async_queue(write_async_T *wa, wa_chunk_T *chunk, int last);
+static void *write_async_writer(void *arg);
+static void write_async_finish(write_async_T *wa, int normal);
+static void write_async_abandon(write_async_T *wa);
+static void write_async_status(buf_T *buf, char *status);
+#endif
 
 #ifdef FEAT_MBYTE
 static linenr_T readfile_linenr(linenr_T linecnt, char_u *p, char_u *endp);
@@ -132,6 +253,17 @@ static int get_mac_fio_flags(char_u *ptr);
 # endif
 #endif
 static int move_lines(buf_T *frombuf, buf_T *tobuf);
+static int buf_reload_plain(buf_T *buf);
+#define RELOAD_MAX_EDITS 500	/* max nr of inserted and deleted lines that
+				   buf_reload_diff() looks for */
+static int reload_diff_lines(hash_T *h_old, long n, hash_T *h_new, long m, char_u *del, char_u *ins);
+static int buf_reload_diff(buf_T *buf, int orig_mode);
+static void buf_reload_post(void);
+#ifdef UNIX
+# define TAIL_CHECK_SIZE 4096	/* bytes checked before the old end */
+static int tail_matches(buf_T *buf, char_u *ptr, long len, int dos);
+static int buf_reload_tail(buf_T *buf, off_T orig_size, stat_T *st);
+#endif
 #ifdef TEMPDIRNAMES
 static void vim_settempdir(char_u *tempdir);
 #endif
@@ -239,6 +371,7 @@ readfile(
     char_u	*buffer = NULL;		/* read buffer */
     char_u	*new_buffer = NULL;	/* init to shut up gcc */
     char_u	*line_start = NULL;	/* init to shut up gcc */
+    char_u	*eol;			/* end of line found with memchr() */
     int		wasempty;		/* buffer was empty before reading */
     colnr_T	len;
     long	size = 0;
@@ -250,7 +383,6 @@ readfile(
     int		did_ask_for_key = FALSE;
 #endif
 #ifdef FEAT_PERSISTENT_UNDO
-    context_sha256_T sha_ctx;
     int		read_undo_file = FALSE;
 #endif
     int		split = 0;		/* number of split lines */
@@ -278,6 +410,9 @@ readfile(
     int		try_dos;
     int		try_unix;
     int		file_rewind = FALSE;
+#ifdef UNIX
+    int		backing = FALSE;	/* text may be read back from file */
+#endif
 #ifdef FEAT_MBYTE
     int		can_retry;
     linenr_T	conv_error = 0;		/* line nr with conversion error */
@@ -1182,8 +1317,6 @@ retry:
 				  && !read_fifo
 				  && !read_stdin
 				  && !read_buffer);
-	if (read_undo_file)
-	    sha256_start(&sha_ctx);
 #endif
 #ifdef FEAT_CRYPT
 	if (curbuf->b_cryptstate != NULL)
@@ -1193,6 +1326,21 @@ retry:
 	    crypt_free_state(curbuf->b_cryptstate);
 	    curbuf->b_cryptstate = NULL;
 	}
+#endif
+#ifdef UNIX
+	/* When reading a whole file into a new read-only buffer the memfile
+	 * may drop blocks that were not changed and read them back from the
+	 * file later, see ml_backing_start().  Decided below when the
+	 * fileformat is known. */
+	if (backing == TRUE)
+	    ml_backing_end(curbuf);
+	backing = (newfile && wasempty && from == 0 && curbuf->b_p_ro
+				  && lines_to_skip == 0
+				  && lines_to_read == MAXLNUM
+				  && !filtering
+				  && !read_fifo
+				  && !read_stdin
+				  && !read_buffer) ? MAYBE : FALSE;
 #endif
     }
 
@@ -1813,7 +1961,11 @@ retry:
 	    }
 	    else
 # endif
-	    if (fio_flags != 0)
+	    /* Latin1 and UTF-8 are the same as ASCII, nothing to do when
+	     * there are no other characters. */
+	    if (fio_flags != 0
+		    && !((fio_flags == FIO_LATIN1 || fio_flags == FIO_UTF8)
+					       && ascii_len(ptr, size) == size))
 	    {
 		int	u8c;
 		char_u	*dest;
@@ -2043,7 +2195,12 @@ retry:
 
 		    if (todo <= 0)
 			break;
-		    if (*p >= 0x80)
+		    if (*p < 0x80)
+		    {
+			/* ASCII is always valid, skip over it quickly. */
+			p += ascii_len(p, (long)todo) - 1;
+		    }
+		    else
 		    {
 			/* A length of 1 means it's an illegal byte.  Accept
 			 * an incomplete character at the end though, the next
@@ -2189,6 +2346,19 @@ rewind_retry:
 	    }
 	}
 
+#ifdef UNIX
+	if (backing == MAYBE)
+	    backing = fileformat != EOL_MAC
+# ifdef FEAT_MBYTE
+		&& !converted && !curbuf->b_p_bomb
+# endif
+# ifdef FEAT_CRYPT
+		&& cryptkey == NULL
+# endif
+		&& ml_backing_start(curbuf, fname, fd, fileformat == EOL_DOS)
+									  == OK;
+#endif
+
 	/*
 	 * This loop is executed once for every character read.
 	 * Keep it fast!
@@ -2216,10 +2386,6 @@ rewind_retry:
 			    error = TRUE;
 			    break;
 			}
-#ifdef FEAT_PERSISTENT_UNDO
-			if (read_undo_file)
-			    sha256_update(&sha_ctx, line_start, len);
-#endif
 			++lnum;
 			if (--read_count == 0)
 			{
@@ -2236,72 +2402,78 @@ rewind_retry:
 	}
 	else
 	{
-	    --ptr;
-	    while (++ptr, --size >= 0)
+	    for (;;)
 	    {
-		if ((c = *ptr) != NUL && c != NL)  /* catch most common case */
-		    continue;
-		if (c == NUL)
-		    *ptr = NL;	/* NULs are replaced by newlines! */
-		else
+		/* Find the end of the line with memchr(), it is much faster
+		 * than checking every byte.  NULs are replaced by newlines! */
+		eol = (char_u *)memchr(ptr, NL, (size_t)size);
+		p = eol == NULL ? ptr + size : eol;
+		size -= (long)(p - ptr);
+		while ((ptr = (char_u *)memchr(ptr, NUL, (size_t)(p - ptr)))
+								      != NULL)
+		    *ptr++ = NL;
+		ptr = p;
+		if (eol == NULL)
+		    break;
+		--size;
+
+		if (skip_count == 0)
 		{
-		    if (skip_count == 0)
+		    *ptr = NUL;		/* end of line */
+		    len = (colnr_T)(ptr - line_start + 1);
+		    if (fileformat == EOL_DOS)
 		    {
-			*ptr = NUL;		/* end of line */
-			len = (colnr_T)(ptr - line_start + 1);
-			if (fileformat == EOL_DOS)
+			if (ptr > line_start && ptr[-1] == CAR)
 			{
-			    if (ptr > line_start && ptr[-1] == CAR)
-			    {
-				/* remove CR before NL */
-				ptr[-1] = NUL;
-				--len;
-			    }
-			    /*
-			     * Reading in Dos format, but no CR-LF found!
-			     * When 'fileformats' includes "unix", delete all
-			     * the lines read so far and start all over again.
-			     * Otherwise give an error message later.
-			     */
-			    else if (ff_error != EOL_DOS)
-			    {
-				if (   try_unix
-				    && !read_stdin
-				    && (read_buffer
-					|| vim_lseek(fd, (off_T)0L, SEEK_SET)
-									  == 0))
-				{
-				    fileformat = EOL_UNIX;
-				    if (set_options)
-					set_fileformat(EOL_UNIX, OPT_LOCAL);
-				    file_rewind = TRUE;
-				    keep_fileformat = TRUE;
-				    goto retry;
-				}
-				ff_error = EOL_DOS;
-			    }
+			    /* remove CR before NL */
+			    ptr[-1] = NUL;
+			    --len;
 			}
-			if (ml_append(lnum, line_start, len, newfile) == FAIL)
+			/*
+			 * Reading in Dos format, but no CR-LF found!
+			 * When 'fileformats' includes "unix", delete all
+			 * the lines read so far and start all over again.
+			 * Otherwise give an error message later.
+			 */
+			else if (ff_error != EOL_DOS)
 			{
-			    error = TRUE;
-			    break;
+			    if (   try_unix
+				&& !read_stdin
+				&& (read_buffer
+				    || vim_lseek(fd, (off_T)0L, SEEK_SET) == 0))
+			    {
+				fileformat = EOL_UNIX;
+				if (set_options)
+				    set_fileformat(EOL_UNIX, OPT_LOCAL);
+				file_rewind = TRUE;
+				keep_fileformat = TRUE;
+				goto retry;
+			    }
+			    ff_error = EOL_DOS;
 			}
-#ifdef FEAT_PERSISTENT_UNDO
-			if (read_undo_file)
-			    sha256_update(&sha_ctx, line_start, len);
+		    }
+		    if (ml_append(lnum, line_start, len, newfile) == FAIL)
+		    {
+			error = TRUE;
+			break;
+		    }
+		    ++lnum;
+#ifdef UNIX
+		    if (backing == TRUE)
+			ml_backing_add(curbuf, lnum,
+					       (long)(ptr - line_start) + 1);
 #endif
-			++lnum;
-			if (--read_count == 0)
-			{
-			    error = TRUE;	    /* break loop */
-			    line_start = ptr;	/* nothing left to write */
-			    break;
-			}
+		    if (--read_count == 0)
+		    {
+			error = TRUE;	    /* break loop */
+			line_start = ptr;   /* nothing left to write */
+			break;
 		    }
-		    else
-			--skip_count;
-		    line_start = ptr + 1;
 		}
+		else
+		    --skip_count;
+		line_start = ptr + 1;
+		++ptr;
 	    }
 	}
 	linerest = (long)(ptr - line_start);
@@ -2313,6 +2485,13 @@ failed:
     if (error && read_count == 0)
 	error = FALSE;
 
+#ifdef UNIX
+    /* The last block also holds the line that was in the empty buffer, it
+     * is never read back. */
+    if (backing == TRUE)
+	ml_backing_end(curbuf);
+#endif
+
     /*
      * If we get EOF in the middle of a line, note the fact and
      * complete the line ourselves.
@@ -2334,13 +2513,7 @@ failed:
 	if (ml_append(lnum, line_start, len, newfile) == FAIL)
 	    error = TRUE;
 	else
-	{
-#ifdef FEAT_PERSISTENT_UNDO
-	    if (read_undo_file)
-		sha256_update(&sha_ctx, line_start, len);
-#endif
 	    read_no_eol_lnum = ++lnum;
-	}
     }
 
     if (set_options)
@@ -2672,12 +2845,7 @@ failed:
      * When opening a new file locate undo info and read it.
      */
     if (read_undo_file)
-    {
-	char_u	hash[UNDO_HASH_SIZE];
-
-	sha256_finish(&sha_ctx, hash);
-	u_read_undo(NULL, hash, fname);
-    }
+	u_read_undo(NULL, NULL, fname);
 #endif
 
 #ifdef FEAT_AUTOCMD
@@ -2749,6 +2917,30 @@ is_dev_fd_file(char_u *fname)
 
 #ifdef FEAT_MBYTE
 
+/*
+ * Return the number of bytes at the start of "p[len]" that are ASCII.
+ * Used for every byte of a file that is read, thus checks a word at a time.
+ */
+    static long
+ascii_len(char_u *p, long len)
+{
+    char_u	*s = p;
+    char_u	*e = p + len;
+    long_u	w;
+    long_u	mask = ~(long_u)0 / 0xff * 0x80;    /* 0x80 in every byte */
+
+    while (e - s >= (long)sizeof(long_u))
+    {
+	memcpy(&w, s, sizeof(long_u));
+	if (w & mask)
+	    break;
+	s += sizeof(long_u);
+    }
+    while (s < e && *s < 0x80)
+	++s;
+    return (long)(s - p);
+}
+
 /*
  * From the current line count and characters read after that, estimate the
  * line number where we are now.
@@ -3148,6 +3340,10 @@ buf_write(
     char_u	    *ptr;
     char_u	    c;
     int		    len;
+    int		    n;
+    char_u	    *lines[WRITELINES];
+    int		    line_idx;
+    int		    line_count;
     linenr_T	    lnum;
     long	    nchars;
     char_u	    *errmsg = NULL;
@@ -3196,12 +3392,27 @@ buf_write(
 #endif
 #ifdef FEAT_PERSISTENT_UNDO
     int		    write_undo_file = FALSE;
-    context_sha256_T sha_ctx;
 #endif
     unsigned int    bkc = get_bkc_value(buf);
+#ifdef FEAT_ASYNC_WRITE
+    write_async_T   *wa;
+#endif
 
     if (fname == NULL || *fname == NUL)	/* safety check */
 	return FAIL;
+#ifdef FEAT_ASYNC_WRITE
+    /* First finish writing this buffer in the background.  That triggers
+     * autocommands, which may delete the buffer. */
+    if (buf->b_write_async != NULL)
+    {
+	bufref_T    bufref;
+
+	set_bufref(&bufref, buf);
+	write_async_wait(buf, TRUE);
+	if (!bufref_valid(&bufref))
+	    return FAIL;
+    }
+#endif
     if (buf->b_ml.ml_mfp == NULL)
     {
 	/* This can happen during startup when there is a stray "w" in the
@@ -3536,7 +3747,7 @@ buf_write(
 		    (char_u *)"", 0);	/* show that we are busy */
     msg_scroll = FALSE;		    /* always overwrite the file message now */
 
-    buffer = alloc(BUFSIZE);
+    buffer = alloc(WRITEBUFSIZE);
     if (buffer == NULL)		    /* can't allocate big buffer, use small
 				     * one (to be able to write when out of
 				     * memory) */
@@ -3545,7 +3756,7 @@ buf_write(
 	bufsize = SMBUFSIZE;
     }
     else
-	bufsize = BUFSIZE;
+	bufsize = WRITEBUFSIZE;
 
     /*
      * Get information about original file (if there is one).
@@ -4012,6 +4223,11 @@ buf_write(
 			write_info.bw_buf = copybuf;
 #ifdef HAS_BW_FLAGS
 			write_info.bw_flags = FIO_NOCONVERT;
+#endif
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_FICLONE)
+			if (copy_file_fast(fd, bfd) == OK)
+			    write_info.bw_len = 0;
+			else
 #endif
 			while ((write_info.bw_len = read_eintr(fd, copybuf,
 								BUFSIZE)) > 0)
@@ -4564,9 +4780,6 @@ restore_backup:
 			    && !filtering
 			    && reset_changed
 			    && !checking_conversion);
-	if (write_undo_file)
-	    /* Prepare for computing the hash value of the text. */
-	    sha256_start(&sha_ctx);
 #endif
 
 	write_info.bw_len = bufsize;
@@ -4574,30 +4787,106 @@ restore_backup:
 	write_info.bw_flags = wb_flags;
 #endif
 	fileformat = get_fileformat_force(buf, eap);
+#ifdef FEAT_ASYNC_WRITE
+	/*
+	 * A large buffer is written in the background for a typed ":write"
+	 * when nothing special is done with the text or the file.  When there
+	 * is a backup the original file was renamed, it is still there when
+	 * writing fails.
+	 */
+	if (!checking_conversion && end > 0 && p_asw > 0
+		&& reset_changed && whole && overwriting && !append
+		&& !filtering && !device && *p_pm == NUL
+# ifdef FEAT_MBYTE
+		&& !converted && wfname == fname
+# endif
+# ifdef HAS_BW_FLAGS
+		&& wb_flags == 0
+# endif
+		&& (newfile || (backup != NULL && !backup_copy))
+		&& eap != NULL && eap->nextcmd == NULL
+		&& (eap->cmdidx == CMD_write || eap->cmdidx == CMD_update)
+		&& getline_equal(eap->getline, eap->cookie, getexline)
+		&& ml_find_line_or_offset(buf, end + 1, NULL)
+							    >= p_asw * 1024L
+		&& (wa = write_async_start(buf, fd, fname, backup,
+							     &st_old)) != NULL)
+	{
+	    backup = NULL;	/* now owned by "wa" */
+	    wa->wa_perm = perm;
+# ifdef UNIX
+	    wa->wa_made_writable = made_writable;
+# endif
+	    wa->wa_newfile = newfile;
+# ifdef HAVE_ACL
+	    wa->wa_acl = acl;
+	    acl = NULL;
+# endif
+# ifdef FEAT_PERSISTENT_UNDO
+	    wa->wa_write_undo_file = write_undo_file;
+	    write_undo_file = FALSE;
+# endif
+	    wa->wa_fileformat = fileformat;
+	    wa->wa_no_eol = (write_bin || !buf->b_p_fixeol)
+					    && (end == buf->b_no_eol_lnum
+							      || !buf->b_p_eol);
+	    wa->wa_nchars = nchars;
+	    wa->wa_size = nchars + ml_find_line_or_offset(buf, end + 1, NULL);
+
+	    --no_wait_return;	    /* may wait for return now */
+	    msg_add_fname(buf, fname);
+	    STRCAT(IObuff, _("writing in the background"));
+	    set_keep_msg(msg_trunc_attr(IObuff, FALSE, 0), 0);
+	    goto nofail;
+	}
+#endif
 	s = buffer;
 	len = 0;
+	line_idx = 0;
+	line_count = 0;
 	for (lnum = start; lnum <= end; ++lnum)
 	{
+	    /* Get the lines of a data block at once. */
+	    if (line_idx == line_count)
+	    {
+		line_count = ml_get_buf_lines(buf, lnum, WRITELINES, lines);
+		line_idx = 0;
+	    }
+	    if (line_count == 0)
+		ptr = ml_get_buf(buf, lnum, FALSE);  /* gives an error */
+	    else
+		ptr = lines[line_idx++];
+
 	    /*
-	     * The next while loop is done once for each character written.
-	     * Keep it fast!
+	     * The next while loop is done once for each piece of text that
+	     * doesn't need to be translated, and for each character that
+	     * does.  Keep it fast!
 	     */
-	    ptr = ml_get_buf(buf, lnum, FALSE) - 1;
-#ifdef FEAT_PERSISTENT_UNDO
-	    if (write_undo_file)
-		sha256_update(&sha_ctx, ptr + 1,
-					      (UINT32_T)(STRLEN(ptr + 1) + 1));
-#endif
-	    while ((c = *++ptr) != NUL)
+	    while ((c = *ptr) != NUL)
 	    {
 		if (c == NL)
+		{
 		    *s = NUL;		/* replace newlines with NULs */
+		    n = 1;
+		}
 		else if (c == CAR && fileformat == EOL_MAC)
+		{
 		    *s = NL;		/* Mac: replace CRs with NLs */
+		    n = 1;
+		}
 		else
-		    *s = c;
-		++s;
-		if (++len != bufsize)
+		{
+		    /* Copy up to the next character to translate at once. */
+		    n = (int)strcspn((char *)ptr,
+					 fileformat == EOL_MAC ? "\n\r" : "\n");
+		    if (n > bufsize - len)
+			n = bufsize - len;
+		    mch_memmove(s, ptr, (size_t)n);
+		}
+		ptr += n;
+		s += n;
+		len += n;
+		if (len != bufsize)
 		    continue;
 		if (buf_write_bytes(&write_info) == FAIL)
 		{
@@ -4661,6 +4950,10 @@ restore_backup:
 		    end = 0;		/* Interrupted, break loop */
 		    break;
 		}
+		/* The text may have been moved while checking for typed
+		 * keys, get the lines again. */
+		line_count = 0;
+		line_idx = 0;
 	    }
 #ifdef VMS
 	    /*
@@ -5078,8 +5371,12 @@ fail:
     --no_wait_return;		/* may wait for return now */
 nofail:
 
-    /* Done saving, we accept changed buffer warnings again */
-    buf->b_saving = FALSE;
+    /* Done saving, we accept changed buffer warnings again.  Not yet when
+     * writing continues in the background. */
+#ifdef FEAT_ASYNC_WRITE
+    if (buf->b_write_async == NULL)
+#endif
+	buf->b_saving = FALSE;
 
     vim_free(backup);
     if (buffer != smallbuf)
@@ -5152,18 +5449,26 @@ nofail:
     if (retval == OK && write_undo_file)
     {
 	char_u	    hash[UNDO_HASH_SIZE];
+	buf_T	    *save_curbuf = curbuf;
 
-	sha256_finish(&sha_ctx, hash);
+	curbuf = buf;
+	u_compute_hash(hash);
+	curbuf = save_curbuf;
 	u_write_undo(NULL, FALSE, buf, hash);
     }
 #endif
 
 #ifdef FEAT_AUTOCMD
 #ifdef FEAT_EVAL
-    if (!should_abort(retval))
+    if (!should_abort(retval)
 #else
-    if (!got_int)
+    if (!got_int
 #endif
+# ifdef FEAT_ASYNC_WRITE
+	    /* when writing in the background this is done at the end */
+	    && buf->b_write_async == NULL
+# endif
+	    )
     {
 	aco_save_T	aco;
 
@@ -5211,89 +5516,958 @@ nofail:
     return retval;
 }
 
+#ifdef FEAT_ASYNC_WRITE
 /*
- * Set the name of the current buffer.  Use when the buffer doesn't have a
- * name and a ":r" or ":w" command with a file name is used.
+ * Start writing buffer "buf" to the file "fname", opened as "fd", in the
+ * background.  "backup" is the name of the backup file or NULL, it is owned
+ * by the returned struct.
+ * Returns NULL when the writer thread can't be started, the caller then
+ * writes the file as usual.
  */
-    static int
-set_rw_fname(char_u *fname, char_u *sfname)
+    static write_async_T *
+write_async_start(
+    buf_T	*buf,
+    int		fd,
+    char_u	*fname,
+    char_u	*backup,
+    stat_T	*st_old)
 {
-#ifdef FEAT_AUTOCMD
-    buf_T	*buf = curbuf;
+    write_async_T   *wa;
+    pthread_t	    thread;
+    pthread_attr_t  attr;
+    int		    started = FALSE;
 
-    /* It's like the unnamed buffer is deleted.... */
-    if (curbuf->b_p_bl)
-	apply_autocmds(EVENT_BUFDELETE, NULL, NULL, FALSE, curbuf);
-    apply_autocmds(EVENT_BUFWIPEOUT, NULL, NULL, FALSE, curbuf);
-# ifdef FEAT_EVAL
-    if (aborting())	    /* autocmds may abort script processing */
-	return FAIL;
-# endif
-    if (curbuf != buf)
+    wa = (write_async_T *)alloc_clear((unsigned)sizeof(write_async_T));
+    if (wa == NULL)
+	return NULL;
+    wa->wa_fname = vim_strsave(fname);
+    if (wa->wa_fname == NULL)
     {
-	/* We are in another buffer now, don't do the renaming. */
-	EMSG(_(e_auchangedbuf));
-	return FAIL;
+	vim_free(wa);
+	return NULL;
     }
-#endif
-
-    if (setfname(curbuf, fname, sfname, FALSE) == OK)
-	curbuf->b_flags |= BF_NOTEDITED;
-
-#ifdef FEAT_AUTOCMD
-    /* ....and a new named one is created */
-    apply_autocmds(EVENT_BUFNEW, NULL, NULL, FALSE, curbuf);
-    if (curbuf->b_p_bl)
-	apply_autocmds(EVENT_BUFADD, NULL, NULL, FALSE, curbuf);
-# ifdef FEAT_EVAL
-    if (aborting())	    /* autocmds may abort script processing */
-	return FAIL;
+    wa->wa_buf = buf;
+    wa->wa_fd = fd;
+    wa->wa_st_old = *st_old;
+    wa->wa_perm = -1;
+    wa->wa_changedtick = CHANGEDTICK(buf);
+    wa->wa_end = buf->b_ml.ml_line_count;
+    wa->wa_segs = (wa_seg_T *)alloc_clear((unsigned)sizeof(wa_seg_T));
+    if (wa->wa_segs == NULL)
+    {
+	vim_free(wa->wa_fname);
+	vim_free(wa);
+	return NULL;
+    }
+    wa->wa_segs->sg_lnum = 1;
+    wa->wa_segs->sg_count = wa->wa_end;
+# ifdef HAVE_FSYNC
+    wa->wa_fsync = p_fs;
 # endif
 
-    /* Do filetype detection now if 'filetype' is empty. */
-    if (*curbuf->b_p_ft == NUL)
+    if (pthread_attr_init(&attr) == 0)
     {
-	if (au_has_group((char_u *)"filetypedetect"))
-	    (void)do_doautocmd((char_u *)"filetypedetect BufRead", FALSE, NULL);
-	do_modelines(0);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	started = (pthread_create(&thread, &attr, write_async_writer, wa) == 0);
+	pthread_attr_destroy(&attr);
+    }
+    if (!started)
+    {
+	vim_free(wa->wa_segs);
+	vim_free(wa->wa_fname);
+	vim_free(wa);
+	return NULL;
     }
-#endif
 
-    return OK;
+    wa->wa_backup = backup;
+    wa->wa_next = first_write_async;
+    first_write_async = wa;
+    buf->b_write_async = wa;
+    write_async_status(buf, "writing 0%");
+    return wa;
 }
 
 /*
- * Put file name into IObuff with quotes.
+ * Translate line "ptr" like buf_write() does and add it to the chunks
+ * "*firstp" to "*lastp".  Without "eol" no end-of-line is added, for the last
+ * line of a file without one.
+ * Returns the number of bytes added, -1 when out of memory.
  */
-    void
-msg_add_fname(buf_T *buf, char_u *fname)
+    static long
+write_async_line(
+    write_async_T   *wa,
+    char_u	    *ptr,
+    int		    eol,
+    wa_chunk_T	    **firstp,
+    wa_chunk_T	    **lastp)
 {
-    if (fname == NULL)
-	fname = (char_u *)"-stdin-";
-    home_replace(buf, fname, IObuff + 1, IOSIZE - 4, TRUE);
-    IObuff[0] = '"';
-    STRCAT(IObuff, "\" ");
+    wa_chunk_T	*chunk = *lastp;
+    char_u	*s;
+    size_t	n;
+    long	added = 0;
+
+    while (*ptr != NUL || eol)
+    {
+	if (chunk == NULL || chunk->ch_len + 2 > WA_CHUNKSIZE)
+	{
+	    /* Not alloc(), the writer thread frees it. */
+	    chunk = (wa_chunk_T *)malloc(sizeof(wa_chunk_T) + WA_CHUNKSIZE);
+	    if (chunk == NULL)
+		return -1;
+	    chunk->ch_next = NULL;
+	    chunk->ch_len = 0;
+	    if (*lastp == NULL)
+		*firstp = chunk;
+	    else
+		(*lastp)->ch_next = chunk;
+	    *lastp = chunk;
+	}
+	s = chunk->ch_data + chunk->ch_len;
+
+	if (*ptr == NUL)
+	{
+	    /* end of the line */
+	    if (wa->wa_fileformat == EOL_UNIX)
+		*s++ = NL;
+	    else
+	    {
+		*s++ = CAR;
+		if (wa->wa_fileformat == EOL_DOS)
+		    *s++ = NL;
+	    }
+	    n = s - (chunk->ch_data + chunk->ch_len);
+	    chunk->ch_len += n;
+	    added += (long)n;
+	    break;
+	}
+	if (*ptr == NL)
+	{
+	    *s = NUL;		/* replace newlines with NULs */
+	    n = 1;
+	}
+	else if (*ptr == CAR && wa->wa_fileformat == EOL_MAC)
+	{
+	    *s = NL;		/* Mac: replace CRs with NLs */
+	    n = 1;
+	}
+	else
+	{
+	    n = strcspn((char *)ptr,
+				wa->wa_fileformat == EOL_MAC ? "\n\r" : "\n");
+	    if (n > WA_CHUNKSIZE - chunk->ch_len)
+		n = WA_CHUNKSIZE - chunk->ch_len;
+	    mch_memmove(s, ptr, n);
+	}
+	ptr += n;
+	chunk->ch_len += n;
+	added += (long)n;
+    }
+    return added;
 }
 
 /*
- * Append message for text mode to IObuff.
- * Return TRUE if something appended.
+ * Translate "count" lines of the buffer from "lnum" and add them to the
+ * chunks "*firstp" to "*lastp".  "last" is TRUE when the last of them is the
+ * last line of the file.
+ * Returns the number of bytes added, -1 when out of memory.
  */
-    static int
-msg_add_fileformat(int eol_type)
+    static long
+write_async_lines(
+    write_async_T   *wa,
+    linenr_T	    lnum,
+    linenr_T	    count,
+    int		    last,
+    wa_chunk_T	    **firstp,
+    wa_chunk_T	    **lastp)
 {
-#ifndef USE_CRNL
-    if (eol_type == EOL_DOS)
+    char_u	*lines[WRITELINES];
+    int		line_count;
+    int		i;
+    long	len;
+    long	added = 0;
+
+    while (count > 0)
     {
-	STRCAT(IObuff, shortmess(SHM_TEXT) ? _("[dos]") : _("[dos format]"));
-	return TRUE;
+	/* Get the lines of a data block at once. */
+	line_count = ml_get_buf_lines(wa->wa_buf, lnum,
+			   count < WRITELINES ? (int)count : WRITELINES, lines);
+	if (line_count == 0)
+	{
+	    lines[0] = ml_get_buf(wa->wa_buf, lnum, FALSE); /* error */
+	    line_count = 1;
+	}
+	for (i = 0; i < line_count; ++i)
+	{
+	    len = write_async_line(wa, lines[i],
+			  !last || i + 1 < count || !wa->wa_no_eol, firstp, lastp);
+	    if (len < 0)
+		return -1;
+	    added += len;
+	}
+	lnum += line_count;
+	count -= line_count;
     }
-#endif
-#ifndef USE_CR
-    if (eol_type == EOL_MAC)
+    return added;
+}
+
+/*
+ * Free the list of chunks starting with "chunk".
+ */
+    static void
+write_async_free_chunks(wa_chunk_T *chunk)
+{
+    wa_chunk_T	*next;
+
+    for ( ; chunk != NULL; chunk = next)
     {
-	STRCAT(IObuff, shortmess(SHM_TEXT) ? _("[mac]") : _("[mac format]"));
-	return TRUE;
+	next = chunk->ch_next;
+	free(chunk);
+    }
+}
+
+/*
+ * Out of memory while copying the text of "wa": the write fails, drop what
+ * was not copied yet.
+ */
+    static void
+write_async_nomem(write_async_T *wa)
+{
+    wa_seg_T	*seg;
+
+    pthread_mutex_lock(&wa_mutex);
+    if (wa->wa_error == 0)
+	wa->wa_error = ENOMEM;
+    pthread_mutex_unlock(&wa_mutex);
+
+    while ((seg = wa->wa_segs) != NULL)
+    {
+	wa->wa_segs = seg->sg_next;
+	write_async_free_chunks(seg->sg_first);
+	vim_free(seg);
+    }
+    write_async_queue(wa, NULL, TRUE);
+}
+
+/*
+ * Copy the text that still needs to be written for the writer thread, until
+ * at least "maxsize" bytes were copied or everything was done.  When
+ * "maxsize" is zero copy everything.
+ */
+    static void
+write_async_copy(write_async_T *wa, off_T maxsize)
+{
+    wa_seg_T	*seg;
+    wa_chunk_T	*first = NULL;
+    wa_chunk_T	*last = NULL;
+    wa_chunk_T	*chunk;
+    linenr_T	count;
+    long	len;
+    off_T	copied = 0;
+
+    /* Getting the lines may change the memline, but not the text. */
+    if (wa->wa_copying || wa->wa_copied)
+	return;
+    wa->wa_copying = TRUE;
+
+    while ((seg = wa->wa_segs) != NULL && (maxsize == 0 || copied < maxsize))
+    {
+	if (seg->sg_count == 0)
+	{
+	    /* Text that was saved before it was changed, it was already
+	     * counted in wa_nchars. */
+	    if (last == NULL)
+		first = seg->sg_first;
+	    else
+		last->ch_next = seg->sg_first;
+	    last = seg->sg_last;
+	    for (chunk = seg->sg_first; chunk != NULL; chunk = chunk->ch_next)
+		copied += chunk->ch_len;
+	}
+	else
+	{
+	    count = seg->sg_count < WRITELINES ? seg->sg_count : WRITELINES;
+	    len = write_async_lines(wa, seg->sg_lnum, count,
+		     seg->sg_next == NULL && count == seg->sg_count, &first, &last);
+	    if (len < 0)
+	    {
+		write_async_free_chunks(first);
+		write_async_nomem(wa);
+		wa->wa_copying = FALSE;
+		return;
+	    }
+	    wa->wa_nchars += len;
+	    copied += len;
+	    seg->sg_lnum += count;
+	    seg->sg_count -= count;
+	}
+	if (seg->sg_count == 0)
+	{
+	    wa->wa_segs = seg->sg_next;
+	    vim_free(seg);
+	}
+
+	/* Queue the chunks that are full. */
+	while (first != last)
+	{
+	    chunk = first;
+	    first = first->ch_next;
+	    write_async_queue(wa, chunk, FALSE);
+	}
+    }
+
+    write_async_queue(wa, first, wa->wa_segs == NULL);
+    wa->wa_copying = FALSE;
+}
+
+/*
+ * Add "chunk" to the queue of the writer thread, unless it is NULL.  When
+ * "last" is TRUE all text was copied.
+ */
+    static void
+write_async_queue(write_async_T *wa, wa_chunk_T *chunk, int last)
+{
+    pthread_mutex_lock(&wa_mutex);
+    if (chunk != NULL)
+    {
+	chunk->ch_next = NULL;
+	if (wa->wa_last == NULL)
+	    wa->wa_first = chunk;
+	else
+	    wa->wa_last->ch_next = chunk;
+	wa->wa_last = chunk;
+	wa->wa_queued += chunk->ch_len;
+    }
+    if (last)
+	wa->wa_copied = TRUE;
+    pthread_cond_broadcast(&wa_work);
+    pthread_mutex_unlock(&wa_mutex);
+}
+
+/*
+ * The writer thread: write the queued chunks of "arg" to the file until all
+ * text was written, then fsync() it.
+ * This runs in parallel with the main thread, thus it must not use Vim
+ * functions or variables, only the queue and wa_fd.
+ */
+    static void *
+write_async_writer(void *arg)
+{
+    write_async_T   *wa = (write_async_T *)arg;
+    wa_chunk_T	    *chunk;
+    sigset_t	    set;
+    char_u	    *p;
+    size_t	    left;
+    ssize_t	    n;
+    int		    error;
+    int		    fsync_failed = FALSE;
+
+    /* Signals are handled by the main thread. */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    pthread_mutex_lock(&wa_mutex);
+    for (;;)
+    {
+	while (wa->wa_first == NULL && !wa->wa_copied)
+	    pthread_cond_wait(&wa_work, &wa_mutex);
+	chunk = wa->wa_first;
+	if (chunk == NULL)
+	    break;		/* all text was written */
+	wa->wa_first = chunk->ch_next;
+	if (wa->wa_first == NULL)
+	    wa->wa_last = NULL;
+	error = wa->wa_error;
+	pthread_mutex_unlock(&wa_mutex);
+
+	/* After an error the rest of the text is dropped.  When abandoned
+	 * wa_fd may have been reused for another file. */
+	p = chunk->ch_data;
+	left = chunk->ch_len;
+	while (error == 0 && !wa->wa_abandoned && left > 0)
+	{
+	    n = write(wa->wa_fd, p, left);
+	    if (n < 0 && errno == EINTR)
+		continue;
+	    if (n <= 0)
+		error = n < 0 ? errno : ENOSPC;
+	    else
+	    {
+		p += n;
+		left -= n;
+	    }
+	}
+
+	pthread_mutex_lock(&wa_mutex);
+	wa->wa_queued -= chunk->ch_len;
+	wa->wa_written += chunk->ch_len - left;
+	if (wa->wa_error == 0)
+	    wa->wa_error = error;
+	free(chunk);
+    }
+    error = wa->wa_error;
+    pthread_mutex_unlock(&wa_mutex);
+
+# ifdef HAVE_FSYNC
+    if (error == 0 && wa->wa_fsync && !wa->wa_abandoned
+					       && fsync(wa->wa_fd) != 0)
+	fsync_failed = TRUE;
+# endif
+
+    /* The main thread may free "wa" as soon as wa_done is set. */
+    pthread_mutex_lock(&wa_mutex);
+    wa->wa_fsync_failed = fsync_failed;
+    wa->wa_done = TRUE;
+    pthread_cond_broadcast(&wa_finished);
+    pthread_mutex_unlock(&wa_mutex);
+    return NULL;
+}
+
+/*
+ * Finish writing in the background when the writer thread is done: close the
+ * file, set its permissions and remove the backup file, or put the backup
+ * back after a failure.
+ * When "normal" is TRUE the buffer is marked as not modified, if it didn't
+ * change since the ":write", the undo file is written and BufWritePost is
+ * triggered.  It is FALSE when the buffer is being unloaded.
+ */
+    static void
+write_async_finish(write_async_T *wa, int normal)
+{
+    buf_T	    *buf = wa->wa_buf;
+    char_u	    *fname = wa->wa_fname;
+    char_u	    *errmsg = NULL;
+    long	    perm = wa->wa_perm;
+    int		    restored = FALSE;
+    int		    unchanged_text;
+    int		    c;
+    stat_T	    st;
+    write_async_T   **pp;
+
+    /* Remove it from the list first, autocommands may write again. */
+    for (pp = &first_write_async; *pp != wa; pp = &(*pp)->wa_next)
+	;
+    *pp = wa->wa_next;
+    buf->b_write_async = NULL;
+    unchanged_text = (CHANGEDTICK(buf) == wa->wa_changedtick);
+
+    if (wa->wa_error != 0)
+	errmsg = (char_u *)_("E514: write error (file system full?)");
+    else if (wa->wa_fsync_failed)
+	errmsg = (char_u *)_("E667: Fsync failed");
+
+# if defined(HAVE_SELINUX) || defined(HAVE_SMACK)
+    if (wa->wa_backup != NULL)
+	mch_copy_sec(wa->wa_backup, fname);
+# endif
+# ifdef HAVE_FCHOWN
+    /* Set the owner and group to that of the original file, see
+     * buf_write(). */
+    if (wa->wa_backup != NULL
+	    && (mch_stat((char *)fname, &st) < 0
+		|| st.st_uid != wa->wa_st_old.st_uid
+		|| st.st_gid != wa->wa_st_old.st_gid))
+    {
+	ignored = fchown(wa->wa_fd, wa->wa_st_old.st_uid,
+						       wa->wa_st_old.st_gid);
+	if (perm >= 0)
+	    (void)mch_setperm(fname, perm);
+    }
+# endif
+    if (close(wa->wa_fd) != 0 && errmsg == NULL)
+	errmsg = (char_u *)_("E512: Close failed");
+    if (wa->wa_made_writable)
+	perm &= ~0200;		/* reset 'w' bit for security reasons */
+    if (perm >= 0)
+	(void)mch_setperm(fname, perm);
+# ifdef HAVE_ACL
+    mch_set_acl(fname, wa->wa_acl);
+    mch_free_acl(wa->wa_acl);
+# endif
+
+    if (errmsg != NULL)
+    {
+	/* The new file is probably incomplete, put the original file, which
+	 * was renamed to the backup file, back in its place. */
+	if (wa->wa_backup != NULL && vim_rename(wa->wa_backup, fname) == 0)
+	    restored = TRUE;
+	else if (mch_stat((char *)fname, &st) >= 0)
+	{
+	    /* Avoid an "overwrite changed file" prompt when writing again. */
+	    buf_store_time(buf, &st, fname);
+	    buf->b_mtime_read = buf->b_mtime;
+	}
+
+	msg_add_fname(buf, fname);	/* put fname in IObuff with quotes */
+	if (STRLEN(IObuff) + STRLEN(errmsg) >= IOSIZE)
+	    IObuff[IOSIZE - STRLEN(errmsg) - 1] = NUL;
+	STRCAT(IObuff, errmsg);
+	emsg(IObuff);
+	if (!restored)
+	{
+	    MSG_PUTS_ATTR(_("\nWARNING: Original file may be lost or damaged\n"),
+		    HL_ATTR(HLF_E) | MSG_HIST);
+	    MSG_PUTS_ATTR(_("don't quit the editor until the file is successfully written!"),
+		    HL_ATTR(HLF_E) | MSG_HIST);
+	}
+    }
+    else
+    {
+	msg_add_fname(buf, fname);	/* put fname in IObuff with quotes */
+	c = FALSE;
+	if (wa->wa_newfile)
+	{
+	    STRCAT(IObuff, shortmess(SHM_NEW) ? _("[New]") : _("[New File]"));
+	    c = TRUE;
+	}
+	if (wa->wa_no_eol)
+	{
+	    msg_add_eol();
+	    c = TRUE;
+	}
+	/* may add [unix/dos/mac] */
+	if (msg_add_fileformat(wa->wa_fileformat))
+	    c = TRUE;
+	msg_add_lines(c, (long)wa->wa_end, wa->wa_nchars);
+	if (!shortmess(SHM_WRITE))
+	    STRCAT(IObuff, shortmess(SHM_WRI) ? _(" [w]") : _(" written"));
+	set_keep_msg(msg_trunc_attr(IObuff, FALSE, 0), 0);
+
+	/* Remove the backup unless 'backup' option is set. */
+	if (!p_bk && wa->wa_backup != NULL && mch_remove(wa->wa_backup) != 0)
+	    EMSG(_("E207: Can't delete backup file"));
+
+	buf_setino(buf);
+	if (normal)
+	{
+	    /* Update the timestamp of the swap file, also sets b_mtime. */
+	    ml_timestamp(buf);
+	    buf->b_flags &= ~BF_WRITE_MASK;
+	}
+    }
+    buf->b_saving = FALSE;
+
+    if (normal)
+    {
+	/* When the buffer was changed while writing it remains modified. */
+	if (errmsg == NULL && unchanged_text)
+	{
+	    unchanged(buf, TRUE);
+# ifdef FEAT_AUTOCMD
+	    /* b:changedtick is always incremented in unchanged() but that
+	     * should not trigger a TextChanged event. */
+	    if (last_changedtick + 1 == CHANGEDTICK(buf)
+					       && last_changedtick_buf == buf)
+		last_changedtick = CHANGEDTICK(buf);
+# endif
+	    u_unchanged(buf);
+	    u_update_save_nr(buf);
+	}
+	write_async_status(buf, errmsg == NULL ? "written" : "failed");
+
+# ifdef FEAT_PERSISTENT_UNDO
+	if (errmsg == NULL && unchanged_text && wa->wa_write_undo_file)
+	{
+	    char_u	    hash[UNDO_HASH_SIZE];
+	    buf_T	    *save_curbuf = curbuf;
+
+	    curbuf = buf;
+	    u_compute_hash(hash);
+	    curbuf = save_curbuf;
+	    u_write_undo(NULL, FALSE, buf, hash);
+	}
+# endif
+
+# ifdef FEAT_AUTOCMD
+	if (errmsg == NULL)
+	{
+	    aco_save_T	aco;
+
+	    buf->b_no_eol_lnum = 0;
+	    aucmd_prepbuf(&aco, buf);
+	    apply_autocmds_exarg(EVENT_BUFWRITEPOST, fname, fname,
+							 FALSE, curbuf, NULL);
+	    aucmd_restbuf(&aco);
+	}
+# endif
+    }
+
+    vim_free(wa->wa_fname);
+    vim_free(wa->wa_backup);
+    vim_free(wa);
+}
+
+/*
+ * Give up writing in the background when Vim exits on a deadly signal.  This
+ * is called from preserve_exit(), thus it must not lock wa_mutex, which the
+ * interrupted main thread may hold, nor use the memline or give messages.
+ * The original file is put back if there is a backup and the writer thread
+ * wasn't done yet.  "wa" is not freed, the writer thread may still use it.
+ */
+    static void
+write_async_abandon(write_async_T *wa)
+{
+    write_async_T   **pp;
+
+    for (pp = &first_write_async; *pp != wa; pp = &(*pp)->wa_next)
+	;
+    *pp = wa->wa_next;
+    wa->wa_buf->b_write_async = NULL;
+
+    wa->wa_abandoned = TRUE;
+    close(wa->wa_fd);
+    if (wa->wa_backup != NULL && !wa->wa_done)
+	mch_rename((char *)wa->wa_backup, (char *)wa->wa_fname);
+}
+
+/*
+ * Set b:writestatus of "buf" to "status" and redraw its status lines.
+ */
+    static void
+write_async_status(buf_T *buf, char *status UNUSED)
+{
+# ifdef FEAT_EVAL
+    dictitem_T	*di;
+
+    di = dict_find(buf->b_vars, (char_u *)"writestatus", -1);
+    if (di == NULL)
+	dict_add_nr_str(buf->b_vars, "writestatus", 0L, (char_u *)status);
+    else
+    {
+	clear_tv(&di->di_tv);
+	di->di_tv.v_type = VAR_STRING;
+	di->di_tv.vval.v_string = vim_strsave((char_u *)status);
+    }
+# endif
+# ifdef FEAT_WINDOWS
+    status_redraw_buf(buf);
+# endif
+}
+
+/*
+ * Called before lines of "buf", which is being written in the background,
+ * are changed: "count" lines from "lnum" are changed or deleted and the lines
+ * below them move "extra" lines.  "count" is zero when lines are inserted
+ * above "lnum".
+ * The text of the changed lines that was not copied yet is saved.
+ */
+    void
+write_async_change(
+    buf_T	*buf,
+    linenr_T	lnum,
+    linenr_T	count,
+    long	extra)
+{
+    write_async_T   *wa = buf->b_write_async;
+    wa_seg_T	    **pp = &wa->wa_segs;
+    wa_seg_T	    *seg;
+    wa_seg_T	    *prev = NULL;
+    wa_seg_T	    *save;
+    wa_seg_T	    *after;
+    wa_chunk_T	    *first;
+    wa_chunk_T	    *last;
+    linenr_T	    end;
+    linenr_T	    from;
+    linenr_T	    to;
+    long	    len;
+
+    if (really_exiting)
+    {
+	write_async_abandon(wa);
+	return;
+    }
+
+    while ((seg = *pp) != NULL)
+    {
+	end = seg->sg_lnum + seg->sg_count;
+	if (seg->sg_count == 0 || end <= lnum)
+	{
+	    /* saved text or lines above the change */
+	    prev = seg;
+	    pp = &seg->sg_next;
+	    continue;
+	}
+	if (seg->sg_lnum >= lnum + count)
+	{
+	    /* lines below the change */
+	    if (extra == 0)
+		break;
+	    seg->sg_lnum += extra;
+	    prev = seg;
+	    pp = &seg->sg_next;
+	    continue;
+	}
+
+	/* Save the text of the lines "from" up to "to" and split off the
+	 * lines below them. */
+	from = lnum > seg->sg_lnum ? lnum : seg->sg_lnum;
+	to = lnum + count < end ? lnum + count : end;
+	first = NULL;
+	last = NULL;
+	save = NULL;
+	after = NULL;
+	len = write_async_lines(wa, from, to - from,
+				 seg->sg_next == NULL && to == end, &first, &last);
+	if (len >= 0 && first != NULL && (from > seg->sg_lnum
+					|| prev == NULL || prev->sg_count > 0))
+	{
+	    save = (wa_seg_T *)alloc_clear((unsigned)sizeof(wa_seg_T));
+	    if (save == NULL)
+		len = -1;
+	}
+	if (len >= 0 && to < end)
+	{
+	    after = (wa_seg_T *)alloc_clear((unsigned)sizeof(wa_seg_T));
+	    if (after == NULL)
+		len = -1;
+	}
+	if (len < 0)
+	{
+	    write_async_free_chunks(first);
+	    vim_free(save);
+	    write_async_nomem(wa);
+	    return;
+	}
+	wa->wa_nchars += len;
+
+	if (after != NULL)
+	{
+	    after->sg_lnum = to + extra;
+	    after->sg_count = end - to;
+	    after->sg_next = seg->sg_next;
+	    seg->sg_next = after;
+	}
+	if (save != NULL)
+	{
+	    save->sg_first = first;
+	    save->sg_last = last;
+	    save->sg_next = seg->sg_next;
+	    seg->sg_next = save;
+	}
+	else if (first != NULL)
+	{
+	    /* append to the saved text just above */
+	    prev->sg_last->ch_next = first;
+	    prev->sg_last = last;
+	}
+
+	if (from > seg->sg_lnum)
+	{
+	    seg->sg_count = from - seg->sg_lnum;
+	    prev = seg;
+	}
+	else
+	{
+	    *pp = seg->sg_next;
+	    vim_free(seg);
+	}
+	/* continue below the parts that were just done */
+	if (save != NULL)
+	    prev = save;
+	if (after != NULL)
+	    prev = after;
+	if (prev != NULL)
+	    pp = &prev->sg_next;
+    }
+}
+
+/*
+ * Wait for writing "buf" in the background to be done and finish it.  See
+ * write_async_finish() for "normal".
+ * When exiting on a deadly signal the write is abandoned instead, waiting
+ * might hang.
+ */
+    void
+write_async_wait(buf_T *buf, int normal)
+{
+    write_async_T   *wa = buf->b_write_async;
+
+    if (really_exiting)
+    {
+	write_async_abandon(wa);
+	return;
+    }
+    write_async_copy(wa, (off_T)0);
+    pthread_mutex_lock(&wa_mutex);
+    while (!wa->wa_done)
+	pthread_cond_wait(&wa_finished, &wa_mutex);
+    pthread_mutex_unlock(&wa_mutex);
+    write_async_finish(wa, normal);
+}
+
+/*
+ * Wait for all buffers being written in the background, e.g. before
+ * executing a shell command that may use the files.
+ */
+    void
+write_async_wait_all(void)
+{
+    while (first_write_async != NULL)
+	write_async_wait(first_write_async->wa_buf, TRUE);
+}
+
+/*
+ * Return TRUE when a buffer is being written in the background, then
+ * write_async_check() needs to be called often.
+ */
+    int
+write_async_pending(void)
+{
+    return first_write_async != NULL;
+}
+
+/*
+ * Return the percentage of "buf" written in the background, -1 when it is
+ * not being written.
+ */
+    int
+write_async_percent(buf_T *buf)
+{
+    return buf->b_write_async == NULL ? -1 : buf->b_write_async->wa_percent;
+}
+
+/*
+ * Called while waiting for the user to type: copy more text of the buffers
+ * being written in the background and finish writing when it's done.
+ */
+    void
+write_async_check(void)
+{
+    static int	    busy = FALSE;
+    write_async_T   *wa;
+    off_T	    queued;
+    off_T	    written;
+    int		    done;
+    int		    percent;
+    int		    redraw = FALSE;
+    char	    status[20];
+
+    /* Autocommands may wait for a character. */
+    if (busy)
+	return;
+    busy = TRUE;
+
+    for (wa = first_write_async; wa != NULL; wa = wa->wa_next)
+    {
+	pthread_mutex_lock(&wa_mutex);
+	queued = wa->wa_queued;
+	pthread_mutex_unlock(&wa_mutex);
+	if (queued < WA_MAXQUEUED)
+	    write_async_copy(wa, WA_COPYSIZE);
+
+	pthread_mutex_lock(&wa_mutex);
+	written = wa->wa_written;
+	done = wa->wa_done;
+	pthread_mutex_unlock(&wa_mutex);
+	if (done)
+	{
+	    /* Autocommands may change the list, check the rest the next
+	     * time. */
+	    write_async_finish(wa, TRUE);
+	    redraw = TRUE;
+	    break;
+	}
+
+	percent = wa->wa_size <= 0 ? 0 : (int)(written * 100 / wa->wa_size);
+	if (percent > 99)
+	    percent = 99;
+	if (percent != wa->wa_percent)
+	{
+	    wa->wa_percent = percent;
+	    vim_snprintf(status, sizeof(status), "writing %d%%", percent);
+	    write_async_status(wa->wa_buf, status);
+	    redraw = TRUE;
+	}
+    }
+
+    busy = FALSE;
+    if (redraw)
+	redraw_after_callback();
+}
+#endif
+
+/*
+ * Set the name of the current buffer.  Use when the buffer doesn't have a
+ * name and a ":r" or ":w" command with a file name is used.
+ */
+    static int
+set_rw_fname(char_u *fname, char_u *sfname)
+{
+#ifdef FEAT_AUTOCMD
+    buf_T	*buf = curbuf;
+
+    /* It's like the unnamed buffer is deleted.... */
+    if (curbuf->b_p_bl)
+	apply_autocmds(EVENT_BUFDELETE, NULL, NULL, FALSE, curbuf);
+    apply_autocmds(EVENT_BUFWIPEOUT, NULL, NULL, FALSE, curbuf);
+# ifdef FEAT_EVAL
+    if (aborting())	    /* autocmds may abort script processing */
+	return FAIL;
+# endif
+    if (curbuf != buf)
+    {
+	/* We are in another buffer now, don't do the renaming. */
+	EMSG(_(e_auchangedbuf));
+	return FAIL;
+    }
+#endif
+
+    if (setfname(curbuf, fname, sfname, FALSE) == OK)
+	curbuf->b_flags |= BF_NOTEDITED;
+
+#ifdef FEAT_AUTOCMD
+    /* ....and a new named one is created */
+    apply_autocmds(EVENT_BUFNEW, NULL, NULL, FALSE, curbuf);
+    if (curbuf->b_p_bl)
+	apply_autocmds(EVENT_BUFADD, NULL, NULL, FALSE, curbuf);
+# ifdef FEAT_EVAL
+    if (aborting())	    /* autocmds may abort script processing */
+	return FAIL;
+# endif
+
+    /* Do filetype detection now if 'filetype' is empty. */
+    if (*curbuf->b_p_ft == NUL)
+    {
+	if (au_has_group((char_u *)"filetypedetect"))
+	    (void)do_doautocmd((char_u *)"filetypedetect BufRead", FALSE, NULL);
+	do_modelines(0);
+    }
+#endif
+
+    return OK;
+}
+
+/*
+ * Put file name into IObuff with quotes.
+ */
+    void
+msg_add_fname(buf_T *buf, char_u *fname)
+{
+    if (fname == NULL)
+	fname = (char_u *)"-stdin-";
+    home_replace(buf, fname, IObuff + 1, IOSIZE - 4, TRUE);
+    IObuff[0] = '"';
+    STRCAT(IObuff, "\" ");
+}
+
+/*
+ * Append message for text mode to IObuff.
+ * Return TRUE if something appended.
+ */
+    static int
+msg_add_fileformat(int eol_type)
+{
+#ifndef USE_CRNL
+    if (eol_type == EOL_DOS)
+    {
+	STRCAT(IObuff, shortmess(SHM_TEXT) ? _("[dos]") : _("[dos format]"));
+	return TRUE;
+    }
+#endif
+#ifndef USE_CR
+    if (eol_type == EOL_MAC)
+    {
+	STRCAT(IObuff, shortmess(SHM_TEXT) ? _("[mac]") : _("[mac format]"));
+	return TRUE;
     }
 #endif
 #if defined(USE_CRNL) || defined(USE_CR)
@@ -5385,6 +6559,48 @@ time_differs(long t1, long t2)
 #endif
 }
 
+#if defined(HAVE_COPY_FILE_RANGE) || defined(HAVE_FICLONE)
+/*
+ * Copy the contents of the file "from_fd" to the empty file "to_fd" without
+ * reading it into memory: share the blocks when the file system supports it,
+ * otherwise let the kernel copy them.
+ * Returns OK when the whole file was copied.  Otherwise the file offsets are
+ * just after what was copied, the caller can copy the rest.
+ */
+    static int
+copy_file_fast(int from_fd, int to_fd)
+{
+# ifdef HAVE_COPY_FILE_RANGE
+    long	n;
+# endif
+
+# ifdef HAVE_FICLONE
+    if (ioctl(to_fd, FICLONE, from_fd) == 0)
+	return OK;
+# endif
+# ifdef HAVE_COPY_FILE_RANGE
+    for (;;)
+    {
+	/* Copy a Gbyte at a time, to be able to check for an interrupt. */
+	n = (long)syscall(SYS_copy_file_range, from_fd, NULL, to_fd, NULL,
+							(size_t)0x40000000L, 0);
+	if (n == 0)
+	    return OK;
+	if (n < 0)
+	{
+	    if (errno == EINTR)
+		continue;
+	    break;	/* e.g. not supported, fall back to read() */
+	}
+	ui_breakcheck();
+	if (got_int)
+	    break;
+    }
+# endif
+    return FAIL;
+}
+#endif
+
 /*
  * Call write() to write a number of bytes to the file.
  * Handles encryption and 'encoding' conversion.
@@ -6727,6 +7943,9 @@ static int already_warned = FALSE;
 #ifdef FEAT_GUI_MACVIM
 static int default_reload_choice = 0;
 #endif
+#ifdef FEAT_FILEWATCH
+static int watch_events_read = FALSE;	/* inotify events were read */
+#endif
 
 /*
  * Check if any not hidden buffer has been changed.
@@ -6771,6 +7990,12 @@ check_timestamps(
 	already_warned = FALSE;
 #ifdef FEAT_GUI_MACVIM
 	default_reload_choice = 0;
+#endif
+#ifdef FEAT_FILEWATCH
+	/* Find out which watched files changed, only these need to be
+	 * checked. */
+	mch_watch_read();
+	watch_events_read = TRUE;
 #endif
 	FOR_ALL_BUFFERS(buf)
 	{
@@ -6792,6 +8017,9 @@ check_timestamps(
 		}
 	    }
 	}
+#ifdef FEAT_FILEWATCH
+	watch_events_read = FALSE;
+#endif
 #ifdef FEAT_GUI_MACVIM
 	default_reload_choice = 0;
 #endif
@@ -6807,6 +8035,32 @@ check_timestamps(
     return didit;
 }
 
+#if defined(FEAT_FILEWATCH) || defined(PROTO)
+/*
+ * Called while waiting for a character: when inotify reported a change in
+ * the file of a buffer with 'autoread' check the timestamps right away.
+ * Only done when a CursorHold event could be triggered, not halfway a
+ * command.
+ */
+    void
+check_timestamps_watched(void)
+{
+    int		state;
+
+    if (typebuf.tb_len != 0 || Recording
+# ifdef FEAT_INS_EXPAND
+	    || ins_compl_active()
+# endif
+	    )
+	return;
+    state = get_real_state();
+    if ((state == NORMAL_BUSY || (state & INSERT) != 0)
+	    && mch_watch_autoread()
+	    && check_timestamps(FALSE) > 0)
+	redraw_after_callback();
+}
+#endif
+
 /*
  * Move all the lines from buffer "frombuf" to buffer "tobuf".
  * Return OK or FAIL.  When FAIL "tobuf" is incomplete and/or "frombuf" is not
@@ -6865,7 +8119,7 @@ buf_check_timestamp(
     int		focus UNUSED)	/* called for GUI focus event */
 {
     stat_T	st;
-    int		stat_res;
+    int		stat_res = -1;
     int		retval = 0;
     char_u	*path;
     char_u	*tbuf;
@@ -6907,6 +8161,16 @@ buf_check_timestamp(
 	    )
 	return 0;
 
+#ifdef FEAT_FILEWATCH
+    /* When the file is watched and no change was reported there is no need
+     * to stat() it, that can be slow on a network file system. */
+    if (!watch_events_read)
+	mch_watch_read();
+    if (buf->b_watch_wd > 0 && buf->b_mtime != 0 && !buf->b_watch_changed)
+	return 0;
+    buf->b_watch_changed = FALSE;
+#endif
+
     if (       !(buf->b_flags & BF_NOTEDITED)
 	    && buf->b_mtime != 0
 	    && ((stat_res = mch_stat((char *)buf->b_ffname, &st)) < 0
@@ -7139,8 +8403,27 @@ buf_check_timestamp(
 
     if (reload)
     {
-	/* Reload the buffer. */
-	buf_reload(buf, orig_mode);
+	/* Reload the buffer.  When text was only appended to the file read
+	 * just that, otherwise try changing only the lines that differ. */
+	if (
+#ifdef UNIX
+		(stat_res < 0 || buf_reload_tail(buf, orig_size, &st) == FAIL) &&
+#endif
+		buf_reload_diff(buf, orig_mode) == FAIL)
+	    buf_reload(buf, orig_mode);
+#ifdef UNIX
+	/* Remember the inode, the next reload may only need the tail. */
+	if (stat_res >= 0
+# ifdef FEAT_AUTOCMD
+		&& bufref_valid(&bufref)
+# endif
+		)
+	{
+	    buf->b_dev_valid = TRUE;
+	    buf->b_dev = st.st_dev;
+	    buf->b_ino = st.st_ino;
+	}
+#endif
 #ifdef FEAT_PERSISTENT_UNDO
 	if (buf->b_p_udf && buf->b_ffname != NULL)
 	{
@@ -7153,24 +8436,588 @@ buf_check_timestamp(
 	    u_write_undo(NULL, FALSE, buf, hash);
 	    curbuf = save_curbuf;
 	}
-#endif
+#endif
+    }
+
+#ifdef FEAT_AUTOCMD
+    /* Trigger FileChangedShell when the file was changed in any way. */
+    if (bufref_valid(&bufref) && retval != 0)
+	(void)apply_autocmds(EVENT_FILECHANGEDSHELLPOST,
+				      buf->b_fname, buf->b_fname, FALSE, buf);
+#endif
+#ifdef FEAT_GUI
+    /* restore this in case an autocommand has set it; it would break
+     * 'mousefocus' */
+    need_mouse_correct = save_mouse_correct;
+#endif
+
+    return retval;
+}
+
+#ifdef UNIX
+/*
+ * Return TRUE when the "len" bytes at "ptr", which were read from the file
+ * just before where it ended when it was last read or written, are equal to
+ * the text at the end of buffer "buf".
+ */
+    static int
+tail_matches(buf_T *buf, char_u *ptr, long len, int dos)
+{
+    char_u	*p = ptr + len;
+    char_u	*line;
+    char_u	*s;
+    linenr_T	lnum;
+
+    for (lnum = buf->b_ml.ml_line_count; lnum > 0 && p > ptr; --lnum)
+    {
+	if (lnum < buf->b_ml.ml_line_count || buf->b_p_eol)
+	{
+	    if (*--p != NL)
+		return FALSE;
+	    if (dos && p > ptr && *--p != CAR)
+		return FALSE;
+	}
+	line = ml_get_buf(buf, lnum, FALSE);
+	for (s = line + STRLEN(line); s > line && p > ptr; )
+	{
+	    --s;
+	    --p;
+	    /* A NUL in the file is a NL in the buffer. */
+	    if (*p != (*s == NL ? NUL : *s))
+		return FALSE;
+	}
+    }
+    return p == ptr;
+}
+
+/*
+ * Reload buffer "buf" by only reading the text that was appended to its
+ * file.  Used for 'autoread' on a log file that keeps growing.
+ * Only done when it is still the same file, it got bigger than "orig_size",
+ * the size when it was last read or written, and the text just before that
+ * position matches the end of the buffer.  "st" is the result of stat() on
+ * the file.  The undo history, marks, folds and syntax state are kept.
+ * Returns FAIL when the file needs to be read the normal way.
+ */
+    static int
+buf_reload_tail(buf_T *buf, off_T orig_size, stat_T *st)
+{
+    int		dos = (get_fileformat(buf) == EOL_DOS);
+    int		fd;
+    char_u	*ptr;
+    char_u	*text;
+    char_u	*p;
+    char_u	*e;
+    char_u	*s;
+    char_u	*d;
+    char_u	*end;
+    char_u	*joined = NULL;
+    long	size;
+    long	done;
+    long	len;
+    off_T	checkpos;
+    linenr_T	old_count = buf->b_ml.ml_line_count;
+    linenr_T	lnum;
+    int		join;
+    int		eol;
+    int		save_did_warn;
+    int		save_keepjumps;
+    aco_save_T	aco;
+    win_T	*wp;
+    win_T	*save_curwin;
+
+    if (orig_size <= 0 || st->st_size <= orig_size
+	    || !buf->b_dev_valid
+	    || buf->b_dev != st->st_dev || buf->b_ino != st->st_ino
+	    || bufIsChanged(buf)
+	    || (buf->b_ml.ml_flags & ML_EMPTY)
+	    || get_fileformat(buf) == EOL_MAC
+#ifdef FEAT_MBYTE
+	    || need_conversion(buf->b_p_fenc)
+#endif
+	    || !buf_reload_plain(buf))
+	return FAIL;
+
+    fd = mch_open((char *)buf->b_ffname, O_RDONLY | O_EXTRA, 0);
+    if (fd < 0)
+	return FAIL;
+    ptr = alloc(TAIL_CHECK_SIZE);
+    checkpos = orig_size > TAIL_CHECK_SIZE ? orig_size - TAIL_CHECK_SIZE : 0;
+    if (ptr == NULL
+	    || vim_lseek(fd, checkpos, SEEK_SET) != checkpos
+	    || read_eintr(fd, ptr, (size_t)(orig_size - checkpos))
+						  != (long)(orig_size - checkpos)
+	    || !tail_matches(buf, ptr, (long)(orig_size - checkpos), dos))
+    {
+	vim_free(ptr);
+	close(fd);
+	return FAIL;
+    }
+    vim_free(ptr);
+
+    /* Read all the appended text before changing the buffer, so that
+     * nothing has changed when reading it fails.  Room for a NUL at the
+     * end. */
+    size = (long)(st->st_size - orig_size);
+    text = lalloc((long_u)size + 1, FALSE);
+    done = 0;
+    if (text != NULL)
+	for ( ; done < size; done += len)
+	{
+	    len = read_eintr(fd, text + done, (size_t)(size - done));
+	    if (len <= 0)
+		break;
+	}
+    close(fd);
+    if (done < size)
+    {
+	vim_free(text);
+	return FAIL;
+    }
+
+    /* Turn the text into NUL terminated lines in place: a NUL in the file
+     * is a NL in the buffer. */
+    eol = (text[size - 1] == NL);
+    d = text;
+    for (p = text; p < text + size; p = e + 1)
+    {
+	e = (char_u *)memchr(p, NL, (size_t)(text + size - p));
+	if (e == NULL)
+	    e = text + size;	/* the file doesn't end in a line break */
+	end = e;
+	if (dos && e < text + size && e > p && e[-1] == CAR)
+	    --end;
+	for (s = p; s < end; ++s)
+	    *d++ = *s == NUL ? NL : *s;
+	*d++ = NUL;
+    }
+
+    /* When the last line had no line break the new text is appended to
+     * it. */
+    join = !buf->b_p_eol;
+    if (join)
+    {
+	joined = concat_str(ml_get_buf(buf, old_count, FALSE), text);
+	if (joined == NULL)
+	{
+	    vim_free(text);
+	    return FAIL;
+	}
+    }
+
+    /* set curwin/curbuf for "buf" and save some things */
+    aucmd_prepbuf(&aco, buf);
+
+    u_sync(FALSE);
+    (void)u_savecommon(old_count - join, old_count + 1, 0, TRUE);
+
+    lnum = old_count;
+    p = text;
+    if (join)
+    {
+	ml_replace(old_count, joined, FALSE);
+	p += STRLEN(p) + 1;
+    }
+    for ( ; p < d; p += STRLEN(p) + 1)
+	ml_append(lnum++, p, (colnr_T)0, FALSE);
+    curbuf->b_p_eol = eol;
+    vim_free(text);
+
+    /* This is not a change made by the user: don't warn for a read-only
+     * file and don't set the '. mark. */
+    save_did_warn = curbuf->b_did_warn;
+    save_keepjumps = cmdmod.keepjumps;
+    curbuf->b_did_warn = TRUE;
+    cmdmod.keepjumps = TRUE;
+    if (join)
+	changed_lines(old_count, 0, old_count + 1, (long)(lnum - old_count));
+    else if (lnum > old_count)
+	appended_lines_mark(old_count, (long)(lnum - old_count));
+    curbuf->b_did_warn = save_did_warn;
+    cmdmod.keepjumps = save_keepjumps;
+    u_clearline();
+
+    unchanged(curbuf, TRUE);
+    u_unchanged(curbuf);
+    curbuf->b_mtime_read = curbuf->b_mtime;
+
+    /* restore curwin/curbuf and a few other things */
+    aucmd_restbuf(&aco);
+
+    /* With 'followtail' a window that showed the last line keeps showing
+     * it. */
+    if (buf->b_p_fot && lnum > old_count)
+	FOR_ALL_WINDOWS(wp)
+	    if (wp->w_buffer == buf && wp->w_cursor.lnum == old_count)
+	    {
+		wp->w_cursor.lnum = buf->b_ml.ml_line_count;
+		wp->w_cursor.col = 0;
+		save_curwin = curwin;
+		curwin = wp;
+		curbuf = curwin->w_buffer;
+		scroll_cursor_bot(0, FALSE);
+		curwin = save_curwin;
+		curbuf = curwin->w_buffer;
+	    }
+
+    aucmd_prepbuf(&aco, buf);
+    buf_reload_post();
+    aucmd_restbuf(&aco);
+
+    return OK;
+}
+#endif
+
+/*
+ * Return TRUE when the file of "buf" can be read without autocommands that
+ * change the text, such as for a compressed file, and it is not encrypted.
+ * Then the buffer can be updated with only the text that changed.
+ */
+    static int
+buf_reload_plain(buf_T *buf UNUSED)
+{
+#ifdef FEAT_CRYPT
+    if (*buf->b_p_key != NUL)
+	return FALSE;
+#endif
+#ifdef FEAT_AUTOCMD
+    /* e.g., the gzip plugin */
+    if (has_autocmd(EVENT_BUFREADCMD, buf->b_fname, buf)
+	    || has_autocmd(EVENT_BUFREADPRE, buf->b_fname, buf)
+	    || has_autocmd(EVENT_FILEREADCMD, buf->b_fname, buf)
+	    || has_autocmd(EVENT_FILEREADPRE, buf->b_fname, buf))
+	return FALSE;
+#endif
+    return TRUE;
+}
+
+/*
+ * Find the lines to delete from "n" old lines and insert from "m" new lines
+ * to make them equal, using the line hashes in "h_old" and "h_new".  Uses
+ * the O(ND) algorithm by Eugene W. Myers.
+ * Sets the flag in "del" for each deleted old line and in "ins" for each
+ * inserted new line.
+ * Returns FAIL when more than RELOAD_MAX_EDITS lines differ or out of memory.
+ */
+    static int
+reload_diff_lines(
+    hash_T	*h_old,
+    long	n,
+    hash_T	*h_new,
+    long	m,
+    char_u	*del,
+    char_u	*ins)
+{
+    long	max_d = n + m < RELOAD_MAX_EDITS ? n + m : RELOAD_MAX_EDITS;
+    long	*trace;
+    long	*v;
+    long	*pv = NULL;
+    long	d;
+    long	k = 0;
+    long	x;
+    long	y;
+    int		found = FALSE;
+
+    /* For each "d" keep the furthest "x" reached on diagonals -d to d,
+     * starting at index d * d. */
+    trace = (long *)lalloc((long_u)((max_d + 1) * (max_d + 1) * sizeof(long)),
+									FALSE);
+    if (trace == NULL)
+	return FAIL;
+    for (d = 0; d <= max_d && !found; ++d)
+    {
+	v = trace + d * d + d;
+	for (k = -d; k <= d; k += 2)
+	{
+	    if (d == 0)
+		x = 0;
+	    else if (k == -d || (k != d && pv[k - 1] < pv[k + 1]))
+		x = pv[k + 1];		/* a new line inserted */
+	    else
+		x = pv[k - 1] + 1;	/* an old line deleted */
+	    y = x - k;
+	    while (x < n && y < m && h_old[x] == h_new[y])
+	    {
+		++x;
+		++y;
+	    }
+	    v[k] = x;
+	    if (x >= n && y >= m)
+	    {
+		found = TRUE;
+		break;
+	    }
+	}
+	pv = v;
+    }
+
+    if (found)
+    {
+	/* Go back along the path, "d" is one more than the number of
+	 * edits. */
+	for (--d; d > 0; --d)
+	{
+	    pv = trace + (d - 1) * (d - 1) + (d - 1);
+	    if (k == -d || (k != d && pv[k - 1] < pv[k + 1]))
+	    {
+		++k;
+		ins[pv[k] - k] = TRUE;
+	    }
+	    else
+	    {
+		--k;
+		del[pv[k]] = TRUE;
+	    }
+	}
+    }
+    vim_free(trace);
+    return found ? OK : FAIL;
+}
+
+/*
+ * Reload buffer "buf" by reading the file into a hidden buffer, comparing it
+ * with the lines in "buf" and only replacing the lines that differ.  This
+ * works like making the changes in the buffer: undo history, marks, folds
+ * and syntax state are kept.
+ * When more lines differ than RELOAD_MAX_EDITS all lines between the first
+ * and the last difference are replaced.
+ * Returns FAIL when the buffer needs to be reloaded the normal way.  The
+ * buffer has not been changed then.
+ */
+    static int
+buf_reload_diff(buf_T *buf, int orig_mode)
+{
+    buf_T	*newbuf;
+    exarg_T	ea;
+    aco_save_T	aco;
+    int		read_ok = FALSE;
+    int		retval = FAIL;
+    linenr_T	old_count = buf->b_ml.ml_line_count;
+    linenr_T	new_count;
+    linenr_T	top;		/* nr of equal lines at the start */
+    linenr_T	bot;		/* nr of equal lines at the end */
+    long	n;
+    long	m;
+    long	i;
+    long	j;
+    hash_T	*h_old = NULL;
+    hash_T	*h_new = NULL;
+    char_u	*del = NULL;
+    char_u	*ins = NULL;
+    garray_T	hunks;		/* four line numbers for each hunk */
+    linenr_T	*h;
+    linenr_T	lnum;
+    long	count_old;
+    long	count_new;
+    int		save_undo = (p_ur != 0);
+    int		save_did_warn;
+    int		save_keepjumps;
+
+    if (orig_mode != buf->b_orig_mode
+	    || (buf->b_ml.ml_flags & ML_EMPTY)
+	    || !buf_reload_plain(buf))
+	return FAIL;
+
+    /* Allocate a buffer without putting it in the buffer list. */
+    newbuf = buflist_new(NULL, NULL, (linenr_T)1, BLN_DUMMY);
+    if (newbuf == NULL)
+	return FAIL;
+
+    /* Force the 'fileencoding' and 'fileformat' to be equal. */
+    if (prep_exarg(&ea, buf) == FAIL)
+    {
+	wipe_buffer(newbuf, FALSE);
+	return FAIL;
+    }
+
+    /* set curwin/curbuf to newbuf and save a few things */
+    aucmd_prepbuf(&aco, newbuf);
+#ifdef FEAT_AUTOCMD
+    /* Avoid detecting the filetype and loading syntax for the hidden
+     * buffer. */
+    block_autocmds();
+#endif
+    if (ml_open(curbuf) == OK
+	    && readfile(buf->b_ffname, buf->b_fname,
+				  (linenr_T)0, (linenr_T)0, (linenr_T)MAXLNUM,
+					    &ea, READ_NEW | READ_DUMMY) == OK
+	    && !(curbuf->b_ml.ml_flags & ML_EMPTY))
+	read_ok = TRUE;
+#ifdef FEAT_AUTOCMD
+    unblock_autocmds();
+#endif
+    vim_free(ea.cmd);
+    aucmd_restbuf(&aco);
+    if (curbuf == newbuf)	/* safety check */
+	return FAIL;
+    if (!read_ok || !buf_valid(buf) || buf->b_ml.ml_mfp == NULL
+				   || buf->b_ml.ml_line_count != old_count)
+    {
+	wipe_buffer(newbuf, FALSE);
+	return FAIL;
+    }
+    new_count = newbuf->b_ml.ml_line_count;
+
+    /* Skip the equal lines at the start and at the end. */
+    for (top = 0; top < old_count && top < new_count; ++top)
+	if (STRCMP(ml_get_buf(buf, top + 1, FALSE),
+				    ml_get_buf(newbuf, top + 1, FALSE)) != 0)
+	    break;
+    for (bot = 0; bot < old_count - top && bot < new_count - top; ++bot)
+	if (STRCMP(ml_get_buf(buf, old_count - bot, FALSE),
+			     ml_get_buf(newbuf, new_count - bot, FALSE)) != 0)
+	    break;
+    n = old_count - top - bot;
+    m = new_count - top - bot;
+
+    /* Find the differences in the lines in between, comparing hashes.
+     * When there are too many of them replace all the lines. */
+    ga_init2(&hunks, (int)sizeof(linenr_T) * 4, 10);
+    if (n > 0 || m > 0)
+    {
+	h_old = (hash_T *)lalloc((long_u)((n + 1) * sizeof(hash_T)), FALSE);
+	h_new = (hash_T *)lalloc((long_u)((m + 1) * sizeof(hash_T)), FALSE);
+	del = lalloc_clear((long_u)(n + 1), FALSE);
+	ins = lalloc_clear((long_u)(m + 1), FALSE);
+	if (h_old == NULL || h_new == NULL || del == NULL || ins == NULL)
+	    goto theend;
+	for (i = 0; i < n; ++i)
+	    h_old[i] = hash_hash(ml_get_buf(buf, top + 1 + i, FALSE));
+	for (j = 0; j < m; ++j)
+	    h_new[j] = hash_hash(ml_get_buf(newbuf, top + 1 + j, FALSE));
+	if (reload_diff_lines(h_old, n, h_new, m, del, ins) == FAIL)
+	{
+	    vim_memset(del, TRUE, (size_t)n);
+	    vim_memset(ins, TRUE, (size_t)m);
+	}
+
+	/* Collect the hunks.  Lines with an equal hash must really be equal,
+	 * otherwise give up. */
+	for (i = 0, j = 0; i < n || j < m; )
+	{
+	    if (i < n && j < m && !del[i] && !ins[j])
+	    {
+		if (STRCMP(ml_get_buf(buf, top + 1 + i, FALSE),
+			      ml_get_buf(newbuf, top + 1 + j, FALSE)) != 0)
+		    goto theend;
+		++i;
+		++j;
+		continue;
+	    }
+	    if (ga_grow(&hunks, 1) == FAIL)
+		goto theend;
+	    h = (linenr_T *)hunks.ga_data + hunks.ga_len * 4;
+	    h[0] = top + 1 + i;
+	    h[2] = top + 1 + j;
+	    while ((i < n && del[i]) || (j < m && ins[j]))
+	    {
+		if (i < n && del[i])
+		    ++i;
+		else
+		    ++j;
+	    }
+	    h[1] = top + 1 + i - h[0];
+	    h[3] = top + 1 + j - h[2];
+	    ++hunks.ga_len;
+	}
     }
 
-#ifdef FEAT_AUTOCMD
-    /* Trigger FileChangedShell when the file was changed in any way. */
-    if (bufref_valid(&bufref) && retval != 0)
-	(void)apply_autocmds(EVENT_FILECHANGEDSHELLPOST,
-				      buf->b_fname, buf->b_fname, FALSE, buf);
+    /* set curwin/curbuf for "buf" and save some things */
+    aucmd_prepbuf(&aco, buf);
+
+    /* This is not a change made by the user: don't warn for a read-only
+     * file and don't set the '. mark. */
+    save_did_warn = curbuf->b_did_warn;
+    save_keepjumps = cmdmod.keepjumps;
+    curbuf->b_did_warn = TRUE;
+    cmdmod.keepjumps = TRUE;
+    if (save_undo)
+	u_sync(FALSE);
+
+    /* Change the hunks from the last one up, so that the line numbers of
+     * the hunks above them remain valid. */
+    for (j = hunks.ga_len - 1; j >= 0; --j)
+    {
+	h = (linenr_T *)hunks.ga_data + j * 4;
+	lnum = h[0];
+	count_old = h[1];
+	count_new = h[3];
+	if (save_undo)
+	    (void)u_savecommon(lnum - 1, lnum + count_old, 0, TRUE);
+	for (i = 0; i < count_old && i < count_new; ++i)
+	    ml_replace(lnum + i, ml_get_buf(newbuf, h[2] + i, FALSE), TRUE);
+	for ( ; i < count_new; ++i)
+	    ml_append(lnum + i - 1, ml_get_buf(newbuf, h[2] + i, FALSE),
+							     (colnr_T)0, FALSE);
+	for ( ; i < count_old; ++i)
+	    ml_delete(lnum + count_new, FALSE);
+	if (count_new < count_old)
+	    mark_adjust(lnum + count_new, lnum + count_old - 1,
+					 (long)MAXLNUM, count_new - count_old);
+	else if (count_new > count_old)
+	    mark_adjust(lnum + count_old, (linenr_T)MAXLNUM,
+						   count_new - count_old, 0L);
+	changed_lines(lnum, 0, lnum + count_old, count_new - count_old);
+    }
+    curbuf->b_did_warn = save_did_warn;
+    cmdmod.keepjumps = save_keepjumps;
+    u_clearline();
+
+    curbuf->b_p_eol = newbuf->b_p_eol;
+#ifdef FEAT_MBYTE
+    curbuf->b_p_bomb = newbuf->b_p_bomb;
 #endif
-#ifdef FEAT_GUI
-    /* restore this in case an autocommand has set it; it would break
-     * 'mousefocus' */
-    need_mouse_correct = save_mouse_correct;
+    unchanged(curbuf, TRUE);
+    if (save_undo)
+	u_unchanged(curbuf);
+    else
+    {
+	u_blockfree(curbuf);
+	u_clearall(curbuf);
+    }
+    curbuf->b_mtime_read = curbuf->b_mtime;
+#ifdef FEAT_DIFF
+    diff_invalidate(curbuf);
 #endif
+    buf_reload_post();
+
+    /* restore curwin/curbuf and a few other things */
+    aucmd_restbuf(&aco);
+    retval = OK;
 
+theend:
+    ga_clear(&hunks);
+    vim_free(h_old);
+    vim_free(h_new);
+    vim_free(del);
+    vim_free(ins);
+    wipe_buffer(newbuf, FALSE);
     return retval;
 }
 
+/*
+ * Called after the current buffer was reloaded by only changing the text
+ * that differs: trigger the BufReadPost autocommands and apply modelines, as
+ * it happens when buf_reload() reads the whole file.
+ * Careful: autocommands may make the buffer invalid!
+ */
+    static void
+buf_reload_post(void)
+{
+#ifdef FEAT_AUTOCMD
+    keep_filetype = TRUE;		/* don't detect 'filetype' */
+    au_did_filetype = FALSE;
+    apply_autocmds(EVENT_BUFREADPOST, NULL, curbuf->b_fname, FALSE, curbuf);
+    if (!au_did_filetype && *curbuf->b_p_ft != NUL)
+	/* Trigger FileType with the existing filetype, like readfile(). */
+	apply_autocmds(EVENT_FILETYPE, curbuf->b_p_ft, curbuf->b_fname,
+								TRUE, curbuf);
+    keep_filetype = FALSE;
+#endif
+    /* Modelines must override settings done by autocommands. */
+    do_modelines(0);
+}
+
 /*
  * Reload a buffer that is already loaded.
  * Used when the file was changed outside of Vim.
@@ -7341,6 +9188,9 @@ buf_store_time(buf_T *buf, stat_T *st, char_u *fname UNUSED)
 #else
     buf->b_orig_mode = mch_getperm(fname);
 #endif
+#ifdef FEAT_FILEWATCH
+    mch_watch_buf(buf);
+#endif
 }
 
 /*
@@ -7723,6 +9573,11 @@ typedef struct AutoCmd
     char	    last;		/* last command in list */
 #ifdef FEAT_EVAL
     scid_T	    scriptID;		/* script ID where defined */
+#endif
+#ifdef FEAT_PROFILE
+    int		    time_count;		/* nr of times executed */
+    proftime_T	    time_total;		/* total time spent executing */
+    proftime_T	    time_max;		/* longest time for one execution */
 #endif
     struct AutoCmd  *next;		/* Next AutoCmd in list */
 } AutoCmd;
@@ -7739,8 +9594,43 @@ typedef struct AutoPat
     int		    buflocal_nr;	/* !=0 for buffer-local AutoPat */
     char	    allow_dirs;		/* Pattern may match whole path */
     char	    last;		/* last pattern for apply_autocmds() */
+    char	    kind;		/* AP_ values */
 } AutoPat;
 
+/*
+ * Values for AutoPat.kind.  For the simple patterns matching is done with a
+ * string compare, without a regprog.
+ */
+#define AP_REGEX	0	/* use "reg_prog" */
+#define AP_ANY		1	/* "*": matches any name */
+#define AP_NAME		2	/* "name": tail is "name" */
+#define AP_TAIL		3	/* "*text": tail ends in "text" */
+#define AP_PATH		4	/* "*dir/text": name ends in "dir/text" */
+
+/*
+ * For each event an index of the patterns, used to quickly find out that no
+ * pattern matches a file name.  The text that the tail of a matching name
+ * must be equal to, or end in when it starts with a dot, is stored in a
+ * hashtable, in lower case.  E.g., "ext" for "*.ext" and "name" for
+ * "*dir/name".  The item holds the number of patterns with that text.
+ * Other patterns are only counted, when there is one of them each file name
+ * needs to be checked.
+ */
+typedef struct aulit_S
+{
+    int		al_count;	/* nr of patterns with this text */
+    char_u	al_text[1];	/* text of the pattern, actually longer */
+} aulit_T;
+
+#define AL_KEY_OFF  offsetof(aulit_T, al_text)
+#define HI2AL(hi)   ((aulit_T *)((hi)->hi_key - AL_KEY_OFF))
+
+typedef struct
+{
+    hashtab_T	ai_lits;	/* aulit_T items */
+    int		ai_other;	/* nr of other patterns */
+} auindex_T;
+
 static struct event_name
 {
     char	*name;	/* event name */
@@ -7865,11 +9755,18 @@ typedef struct AutoPatCmd
     event_T	event;		/* current event */
     int		arg_bufnr;	/* initially equal to <abuf>, set to zero when
 				   buf is deleted */
+#ifdef FEAT_PROFILE
+    AutoCmd	*timed_cmd;	/* command being timed or NULL */
+    proftime_T	timed_start;	/* when "timed_cmd" was started */
+#endif
     struct AutoPatCmd   *next;	/* chain of active apc-s for auto-invalidation*/
 } AutoPatCmd;
 
 static AutoPatCmd *active_apc_list = NULL; /* stack of active autocommands */
 
+static auindex_T au_index[NUM_EVENTS];
+static int au_index_init = FALSE;
+
 /*
  * augroups stores a list of autocmd group names.
  */
@@ -7885,8 +9782,18 @@ static int current_augroup = AUGROUP_DEFAULT;
 
 static int au_need_clean = FALSE;   /* need to delete marked patterns */
 
+#ifdef FEAT_PROFILE
+static int au_time_on = FALSE;	    /* ":autocmdtime on" used */
+#endif
+
 static void show_autocmd(AutoPat *ap, event_T event);
-static void au_remove_pat(AutoPat *ap);
+static int au_pat_kind(char_u *pat);
+static void au_lit_key(char_u *key, char_u *text, int len);
+static void au_index_add(event_T event, AutoPat *ap, int add);
+static int au_index_may_match(event_T event, char_u *tail);
+static int au_name_ends_in(char_u *name, char_u *text, int len);
+static int au_match_pat(AutoPat *ap, char_u *fname, char_u *sfname, char_u *tail);
+static void au_remove_pat(AutoPat *ap, event_T event);
 static void au_remove_cmds(AutoPat *ap);
 static void au_cleanup(void);
 static int au_new_group(char_u *name);
@@ -7899,6 +9806,18 @@ static int au_get_grouparg(char_u **argp);
 static int do_autocmd_event(event_T event, char_u *pat, int nested, char_u *cmd, int forceit, int group);
 static int apply_autocmds_group(event_T event, char_u *fname, char_u *fname_io, int force, int group, buf_T *buf, exarg_T *eap);
 static void auto_next_pat(AutoPatCmd *apc, int stop_at_last);
+#ifdef FEAT_PROFILE
+static void au_time_end(AutoPatCmd *apc);
+static void autocmdtime_clear(void);
+static garray_T *autocmdtime_entries(int sort_on);
+#ifdef __BORLANDC__
+static int _RTLENTRYF autocmdtime_compare(const void *s1, const void *s2);
+#else
+static int autocmdtime_compare(const void *s1, const void *s2);
+#endif
+static char_u *autocmdtime_group(AutoPat *ap);
+static void autocmdtime_report(int sort_on);
+#endif
 #if defined(FEAT_AUTOCMD) || defined(FEAT_WILDIGN)
 static int match_file_pat(char_u *pattern, regprog_T **prog, char_u *fname, char_u *sfname, char_u *tail, int allow_dirs);
 #endif
@@ -7980,12 +9899,194 @@ show_autocmd(AutoPat *ap, event_T event)
     }
 }
 
+/*
+ * Return the AP_ value for file pattern "pat".  Only patterns with plain
+ * characters, which don't have a special meaning in the regexp made by
+ * file_pat_to_reg_pat(), can be matched with a string compare.
+ */
+    static int
+au_pat_kind(char_u *pat)
+{
+    char_u	*p = pat;
+    int		has_slash = FALSE;
+
+    if (*p == '*')
+    {
+	while (*p == '*')
+	    ++p;
+	if (*p == NUL)
+	    return AP_ANY;
+	if (p > pat + 1)
+	    return AP_REGEX;
+    }
+    for ( ; *p != NUL; ++p)
+    {
+	if (*p == '/')
+	    has_slash = TRUE;
+	else if (!ASCII_ISALNUM(*p)
+			       && vim_strchr((char_u *)"._-+", *p) == NULL)
+	    return AP_REGEX;
+    }
+    if (*pat != '*')
+	return has_slash ? AP_REGEX : AP_NAME;
+    return has_slash ? AP_PATH : AP_TAIL;
+}
+
+/*
+ * Copy "len" bytes of "text" to "key" in lower case, for the pattern index.
+ */
+    static void
+au_lit_key(char_u *key, char_u *text, int len)
+{
+    int		i;
+
+    for (i = 0; i < len; ++i)
+	key[i] = TOLOWER_ASC(text[i]);
+    key[len] = NUL;
+}
+
+/*
+ * Add pattern "ap" to the index for "event" when "add" is TRUE, remove it
+ * when "add" is FALSE.
+ */
+    static void
+au_index_add(event_T event, AutoPat *ap, int add)
+{
+    auindex_T	*ai = &au_index[(int)event];
+    char_u	*text;
+    int		len;
+    aulit_T	*al;
+    hashitem_T	*hi;
+    hash_T	hash;
+    char_u	key[MAXPATHL];
+
+    if (!au_index_init)
+    {
+	for (len = 0; len < (int)NUM_EVENTS; ++len)
+	    hash_init(&au_index[len].ai_lits);
+	au_index_init = TRUE;
+    }
+    /* The text the tail of a matching name is or ends in, if any. */
+    text = NULL;
+    if (ap->buflocal_nr == 0 && ap->patlen < MAXPATHL)
+    {
+	if (ap->kind == AP_NAME
+		|| (ap->kind == AP_TAIL && ap->pat[1] == '.'))
+	    text = ap->pat + (ap->kind == AP_TAIL);
+	else if (ap->kind == AP_PATH)
+	    text = gettail(ap->pat);
+    }
+    if (text == NULL || *text == NUL)
+    {
+	ai->ai_other += add ? 1 : -1;
+	return;
+    }
+    len = ap->patlen - (int)(text - ap->pat);
+    au_lit_key(key, text, len);
+    hash = hash_hash(key);
+    hi = hash_lookup(&ai->ai_lits, key, hash);
+    if (!HASHITEM_EMPTY(hi))
+    {
+	al = HI2AL(hi);
+	if (add)
+	    ++al->al_count;
+	else if (--al->al_count == 0)
+	{
+	    hash_remove(&ai->ai_lits, hi);
+	    vim_free(al);
+	}
+    }
+    else if (add)
+    {
+	al = (aulit_T *)alloc((unsigned)(sizeof(aulit_T) + len));
+	if (al == NULL)
+	{
+	    /* can't index it, check this pattern for every name */
+	    ap->kind = AP_REGEX;
+	    ++ai->ai_other;
+	    return;
+	}
+	al->al_count = 1;
+	STRCPY(al->al_text, key);
+	hash_add_item(&ai->ai_lits, hi, al->al_text, hash);
+    }
+}
+
+/*
+ * Return TRUE when a pattern for "event" may match a file name with tail
+ * "tail".  Return FALSE when none of the patterns can match.
+ */
+    static int
+au_index_may_match(event_T event, char_u *tail)
+{
+    auindex_T	*ai = &au_index[(int)event];
+    char_u	*p;
+    int		len = (int)STRLEN(tail);
+    char_u	key[MAXPATHL];
+
+    if (ai->ai_other > 0 || len >= MAXPATHL)
+	return TRUE;
+    if (!au_index_init || ai->ai_lits.ht_used == 0)
+	return FALSE;
+
+    /* Try the whole tail for "name" and every part starting with a dot for
+     * "*.ext". */
+    au_lit_key(key, tail, len);
+    for (p = key; p != NULL; p = vim_strchr(p + 1, '.'))
+	if (!HASHITEM_EMPTY(hash_find(&ai->ai_lits, p)))
+	    return TRUE;
+    return FALSE;
+}
+
+/*
+ * Return TRUE when "name" ends in "len" bytes "text", at a character
+ * boundary.
+ */
+    static int
+au_name_ends_in(char_u *name, char_u *text, int len)
+{
+    int		nlen = (int)STRLEN(name);
+    char_u	*p = name + nlen - len;
+
+    if (nlen < len || (p_fic ? STRNICMP(p, text, len)
+					       : STRNCMP(p, text, len)) != 0)
+	return FALSE;
+#ifdef FEAT_MBYTE
+    if (has_mbyte && p > name && (*mb_head_off)(name, p) != 0)
+	return FALSE;
+#endif
+    return TRUE;
+}
+
+/*
+ * Return TRUE when autocommand pattern "ap" matches the file name "fname",
+ * "sfname" or "tail".  Uses a string compare for simple patterns.
+ */
+    static int
+au_match_pat(AutoPat *ap, char_u *fname, char_u *sfname, char_u *tail)
+{
+    if (ap->kind == AP_ANY)
+	return TRUE;
+    if (ap->kind == AP_NAME)
+	return (p_fic ? STRICMP(tail, ap->pat) : STRCMP(tail, ap->pat)) == 0;
+    if (ap->kind == AP_TAIL)
+	return au_name_ends_in(tail, ap->pat + 1, ap->patlen - 1);
+    if (ap->kind == AP_PATH)
+	return au_name_ends_in(fname, ap->pat + 1, ap->patlen - 1)
+		    || (sfname != NULL
+			&& au_name_ends_in(sfname, ap->pat + 1, ap->patlen - 1));
+    return match_file_pat(NULL, &ap->reg_prog, fname, sfname, tail,
+							       ap->allow_dirs);
+}
+
 /*
  * Mark an autocommand pattern for deletion.
  */
     static void
-au_remove_pat(AutoPat *ap)
+au_remove_pat(AutoPat *ap, event_T event)
 {
+    if (ap->pat != NULL)
+	au_index_add(event, ap, FALSE);
     vim_free(ap->pat);
     ap->pat = NULL;
     ap->buflocal_nr = -1;
@@ -8084,7 +10185,7 @@ aubuflocal_remove(buf_T *buf)
 	for (ap = first_autopat[(int)event]; ap != NULL; ap = ap->next)
 	    if (ap->buflocal_nr == buf->b_fnum)
 	    {
-		au_remove_pat(ap);
+		au_remove_pat(ap, event);
 		if (p_verbose >= 6)
 		{
 		    verbose_enter();
@@ -8649,7 +10750,7 @@ do_autocmd_event(
 	    if (forceit)  /* delete the AutoPat, if it's in the current group */
 	    {
 		if (ap->group == findgroup)
-		    au_remove_pat(ap);
+		    au_remove_pat(ap, event);
 	    }
 	    else if (group == AUGROUP_ALL || ap->group == group)
 		show_autocmd(ap, event);
@@ -8746,7 +10847,7 @@ do_autocmd_event(
 			    au_remove_cmds(ap);
 			    break;
 			}
-			au_remove_pat(ap);
+			au_remove_pat(ap, event);
 		    }
 
 		    /*
@@ -8797,11 +10898,19 @@ do_autocmd_event(
 		    return FAIL;
 		}
 
+		ap->kind = AP_REGEX;
 		if (is_buflocal)
 		{
 		    ap->buflocal_nr = buflocal_nr;
 		    ap->reg_prog = NULL;
 		}
+		else if ((ap->kind = au_pat_kind(ap->pat)) != AP_REGEX)
+		{
+		    /* matched with a string compare, no regprog needed */
+		    ap->buflocal_nr = 0;
+		    ap->reg_prog = NULL;
+		    ap->allow_dirs = FALSE;
+		}
 		else
 		{
 		    char_u	*reg_pat;
@@ -8822,6 +10931,7 @@ do_autocmd_event(
 		ap->cmds = NULL;
 		*prev_ap = ap;
 		ap->next = NULL;
+		au_index_add(event, ap, TRUE);
 		if (group == AUGROUP_ALL)
 		    ap->group = current_augroup;
 		else
@@ -8840,6 +10950,11 @@ do_autocmd_event(
 	    ac->cmd = vim_strsave(cmd);
 #ifdef FEAT_EVAL
 	    ac->scriptID = current_SID;
+#endif
+#ifdef FEAT_PROFILE
+	    ac->time_count = 0;
+	    profile_zero(&ac->time_total);
+	    profile_zero(&ac->time_max);
 #endif
 	    if (ac->cmd == NULL)
 	    {
@@ -9587,6 +11702,26 @@ apply_autocmds_group(
     vms_remove_version(fname);
 #endif
 
+    /*
+     * Quickly return when the pattern index shows that no pattern can match.
+     * Only did_filetype is changed like when executing autocommands.
+     */
+    tail = gettail(fname);
+    if (!au_index_may_match(event, tail))
+    {
+	vim_free(autocmd_fname);
+	autocmd_fname = save_autocmd_fname;
+	autocmd_fname_full = save_autocmd_fname_full;
+	autocmd_bufnr = save_autocmd_bufnr;
+	vim_free(fname);
+	vim_free(sfname);
+	if (!autocmd_busy)
+	    did_filetype = FALSE;
+	else if (event == EVENT_FILETYPE)
+	    did_filetype = TRUE;
+	goto BYPASS_AU;
+    }
+
     /*
      * Set the name to be used for <amatch>.
      */
@@ -9639,8 +11774,6 @@ apply_autocmds_group(
     if (event == EVENT_FILETYPE)
 	did_filetype = TRUE;
 
-    tail = gettail(fname);
-
     /* Find first autocommand that matches */
     patcmd.curpat = first_autopat[(int)event];
     patcmd.nextcmd = NULL;
@@ -9650,6 +11783,9 @@ apply_autocmds_group(
     patcmd.tail = tail;
     patcmd.event = event;
     patcmd.arg_bufnr = autocmd_bufnr;
+#ifdef FEAT_PROFILE
+    patcmd.timed_cmd = NULL;
+#endif
     patcmd.next = NULL;
     auto_next_pat(&patcmd, FALSE);
 
@@ -9680,6 +11816,9 @@ apply_autocmds_group(
 	check_lnums(TRUE);	/* make sure cursor and topline are valid */
 	do_cmdline(NULL, getnextac, (void *)&patcmd,
 				     DOCMD_NOWAIT|DOCMD_VERBOSE|DOCMD_REPEAT);
+#ifdef FEAT_PROFILE
+	au_time_end(&patcmd);
+#endif
 #ifdef FEAT_EVAL
 	if (eap != NULL)
 	{
@@ -9841,8 +11980,7 @@ auto_next_pat(
 	{
 	    /* execution-condition */
 	    if (ap->buflocal_nr == 0
-		    ? (match_file_pat(NULL, &ap->reg_prog, apc->fname,
-				      apc->sfname, apc->tail, ap->allow_dirs))
+		    ? au_match_pat(ap, apc->fname, apc->sfname, apc->tail)
 		    : ap->buflocal_nr == apc->arg_bufnr)
 	    {
 		name = event_nr2name(apc->event);
@@ -9889,6 +12027,11 @@ getnextac(int c UNUSED, void *cookie, int indent UNUSED)
     char_u	    *retval;
     AutoCmd	    *ac;
 
+#ifdef FEAT_PROFILE
+    /* The previous command has finished. */
+    au_time_end(acp);
+#endif
+
     /* Can be called again after returning the last line. */
     if (acp->curpat == NULL)
 	return NULL;
@@ -9935,9 +12078,307 @@ getnextac(int c UNUSED, void *cookie, int indent UNUSED)
 	acp->nextcmd = NULL;
     else
 	acp->nextcmd = ac->next;
+#ifdef FEAT_PROFILE
+    if (au_time_on && retval != NULL)
+    {
+	acp->timed_cmd = ac;
+	profile_start(&acp->timed_start);
+    }
+#endif
     return retval;
 }
 
+#if defined(FEAT_PROFILE) || defined(PROTO)
+/*
+ * Add the time since the command of "apc" was started to its counters.
+ * This includes the time of autocommands triggered by the command.
+ */
+    static void
+au_time_end(AutoPatCmd *apc)
+{
+    AutoCmd	*ac = apc->timed_cmd;
+
+    if (ac == NULL)
+	return;
+    apc->timed_cmd = NULL;
+    profile_end(&apc->timed_start);
+    profile_add(&ac->time_total, &apc->timed_start);
+    if (profile_cmp(&apc->timed_start, &ac->time_max) < 0)
+	ac->time_max = apc->timed_start;
+    ++ac->time_count;
+}
+
+/*
+ * ":autocmdtime {on,off,clear,report}".
+ * ":autocmdtime report" can be followed by "count" or "max" to sort on that
+ * instead of the total time.
+ */
+    void
+ex_autocmdtime(exarg_T *eap)
+{
+    char_u	*arg = eap->arg;
+    char_u	*p = skiptowhite(arg);
+    char_u	*sort_arg = skipwhite(p);
+    int		len = (int)(p - arg);
+
+    if (len == 2 && STRNCMP(arg, "on", 2) == 0 && *sort_arg == NUL)
+	au_time_on = TRUE;
+    else if (len == 3 && STRNCMP(arg, "off", 3) == 0 && *sort_arg == NUL)
+	au_time_on = FALSE;
+    else if (len == 5 && STRNCMP(arg, "clear", 5) == 0 && *sort_arg == NUL)
+	autocmdtime_clear();
+    else if (len == 6 && STRNCMP(arg, "report", 6) == 0)
+    {
+	if (*sort_arg == NUL || STRCMP(sort_arg, "total") == 0)
+	    autocmdtime_report('t');
+	else if (STRCMP(sort_arg, "count") == 0)
+	    autocmdtime_report('c');
+	else if (STRCMP(sort_arg, "max") == 0)
+	    autocmdtime_report('m');
+	else
+	    EMSG2(_(e_invarg2), sort_arg);
+    }
+    else
+	EMSG2(_(e_invarg2), arg);
+}
+
+/*
+ * Set the counters of all autocommands to zero.
+ */
+    static void
+autocmdtime_clear(void)
+{
+    event_T	event;
+    AutoPat	*ap;
+    AutoCmd	*ac;
+
+    for (event = (event_T)0; (int)event < (int)NUM_EVENTS;
+					    event = (event_T)((int)event + 1))
+	for (ap = first_autopat[(int)event]; ap != NULL; ap = ap->next)
+	    for (ac = ap->cmds; ac != NULL; ac = ac->next)
+	    {
+		ac->time_count = 0;
+		profile_zero(&ac->time_total);
+		profile_zero(&ac->time_max);
+	    }
+}
+
+typedef struct
+{
+    event_T	event;
+    AutoPat	*pat;
+    AutoCmd	*cmd;
+} autime_entry_T;
+
+static int autocmdtime_sort_on;	    /* 't', 'c' or 'm' */
+
+/*
+ * Compare two autime_entry_T items, the most expensive one first.
+ */
+    static int
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+autocmdtime_compare(const void *s1, const void *s2)
+{
+    AutoCmd	*ac1 = ((autime_entry_T *)s1)->cmd;
+    AutoCmd	*ac2 = ((autime_entry_T *)s2)->cmd;
+
+    if (autocmdtime_sort_on == 'c')
+	return ac2->time_count - ac1->time_count;
+    if (autocmdtime_sort_on == 'm')
+	return profile_cmp(&ac1->time_max, &ac2->time_max);
+    return profile_cmp(&ac1->time_total, &ac2->time_total);
+}
+
+/*
+ * Get the autocommands that were executed while timing, sorted on "sort_on".
+ * Returns NULL when out of memory.  The caller must free the growarray.
+ */
+    static garray_T *
+autocmdtime_entries(int sort_on)
+{
+    garray_T	    *gap;
+    event_T	    event;
+    AutoPat	    *ap;
+    AutoCmd	    *ac;
+    autime_entry_T  *p;
+
+    gap = (garray_T *)alloc((unsigned)sizeof(garray_T));
+    if (gap == NULL)
+	return NULL;
+    ga_init2(gap, (int)sizeof(autime_entry_T), 50);
+    for (event = (event_T)0; (int)event < (int)NUM_EVENTS;
+					    event = (event_T)((int)event + 1))
+	for (ap = first_autopat[(int)event]; ap != NULL; ap = ap->next)
+	    for (ac = ap->cmds; ac != NULL; ac = ac->next)
+		if (ap->pat != NULL && ac->cmd != NULL && ac->time_count > 0
+						     && ga_grow(gap, 1) == OK)
+		{
+		    p = (autime_entry_T *)gap->ga_data + gap->ga_len++;
+		    p->event = event;
+		    p->pat = ap;
+		    p->cmd = ac;
+		}
+
+    /* Skip if there are no items to avoid passing NULL pointer to qsort(). */
+    autocmdtime_sort_on = sort_on;
+    if (gap->ga_len > 1)
+	qsort(gap->ga_data, (size_t)gap->ga_len, sizeof(autime_entry_T),
+							 autocmdtime_compare);
+    return gap;
+}
+
+/*
+ * Return the name of the group of "ap", NULL for the default group.
+ */
+    static char_u *
+autocmdtime_group(AutoPat *ap)
+{
+    if (ap->group == AUGROUP_DEFAULT)
+	return NULL;
+    if (AUGROUP_NAME(ap->group) == NULL)
+	return get_deleted_augroup();
+    return AUGROUP_NAME(ap->group);
+}
+
+/*
+ * ":autocmdtime report": list the executed autocommands, the most expensive
+ * one first.
+ */
+    static void
+autocmdtime_report(int sort_on)
+{
+    garray_T	    *gap;
+    autime_entry_T  *p;
+    int		    idx;
+    int		    len;
+    char_u	    *group;
+    proftime_T	    total_total;
+    int		    total_count = 0;
+# ifdef FEAT_FLOAT
+    proftime_T	    tm;
+# endif
+
+    gap = autocmdtime_entries(sort_on);
+    if (gap == NULL)
+	return;
+
+    profile_zero(&total_total);
+    MSG_PUTS_TITLE(_("  TOTAL      COUNT   SLOWEST     AVERAGE   EVENT  GROUP  PATTERN  COMMAND"));
+    MSG_PUTS("\n");
+    for (idx = 0; idx < gap->ga_len && !got_int; ++idx)
+    {
+	p = (autime_entry_T *)gap->ga_data + idx;
+	profile_add(&total_total, &p->cmd->time_total);
+	total_count += p->cmd->time_count;
+
+	MSG_PUTS(profile_msg(&p->cmd->time_total));
+	MSG_PUTS(" "); /* make sure there is always a separating space */
+	msg_advance(13);
+	msg_outnum(p->cmd->time_count);
+	MSG_PUTS(" ");
+	msg_advance(21);
+	MSG_PUTS(profile_msg(&p->cmd->time_max));
+	MSG_PUTS(" ");
+	msg_advance(33);
+# ifdef FEAT_FLOAT
+	profile_divide(&p->cmd->time_total, p->cmd->time_count, &tm);
+	MSG_PUTS(profile_msg(&tm));
+	MSG_PUTS(" ");
+# endif
+	msg_advance(45);
+	msg_puts_attr(event_nr2name(p->event), HL_ATTR(HLF_T));
+	MSG_PUTS("  ");
+	group = autocmdtime_group(p->pat);
+	if (group != NULL)
+	{
+	    msg_outtrans(group);
+	    MSG_PUTS("  ");
+	}
+	msg_outtrans(p->pat->pat);
+	MSG_PUTS("  ");
+	len = Columns - msg_col - 1;
+	if (len < 20)
+	    len = 20; /* will wrap anyway */
+	if (len > (int)STRLEN(p->cmd->cmd))
+	    len = (int)STRLEN(p->cmd->cmd);
+	msg_outtrans_len(p->cmd->cmd, len);
+	MSG_PUTS("\n");
+    }
+    ga_clear(gap);
+    vim_free(gap);
+    if (!got_int)
+    {
+	MSG_PUTS("\n");
+	MSG_PUTS(profile_msg(&total_total));
+	msg_advance(13);
+	msg_outnum(total_count);
+	MSG_PUTS("\n");
+    }
+}
+
+# if defined(FEAT_EVAL) || defined(PROTO)
+/*
+ * Add a Dictionary for each executed autocommand to "list", the most
+ * expensive one first.  For autocmdtime().
+ */
+    void
+autocmdtime_list(list_T *list)
+{
+    garray_T	    *gap;
+    autime_entry_T  *p;
+    int		    idx;
+    dict_T	    *dict;
+    char_u	    *group;
+#  ifdef FEAT_FLOAT
+    dictitem_T	    *di;
+#  endif
+    proftime_T	    *tmp;
+    int		    i;
+    static char	    *(time_keys[2]) = {"total", "max"};
+
+    gap = autocmdtime_entries('t');
+    if (gap == NULL)
+	return;
+    for (idx = 0; idx < gap->ga_len; ++idx)
+    {
+	p = (autime_entry_T *)gap->ga_data + idx;
+	dict = dict_alloc();
+	if (dict == NULL || list_append_dict(list, dict) == FAIL)
+	    break;
+	group = autocmdtime_group(p->pat);
+	dict_add_nr_str(dict, "event", 0L, event_nr2name(p->event));
+	dict_add_nr_str(dict, "group", 0L,
+				   group == NULL ? (char_u *)"" : group);
+	dict_add_nr_str(dict, "pattern", 0L, p->pat->pat);
+	dict_add_nr_str(dict, "cmd", 0L, p->cmd->cmd);
+	dict_add_nr_str(dict, "count", (varnumber_T)p->cmd->time_count, NULL);
+	for (i = 0; i < 2; ++i)
+	{
+	    /* the time in seconds, as a Float when possible */
+	    tmp = i == 0 ? &p->cmd->time_total : &p->cmd->time_max;
+#  ifdef FEAT_FLOAT
+	    di = dictitem_alloc((char_u *)time_keys[i]);
+	    if (di == NULL)
+		break;
+	    di->di_tv.v_type = VAR_FLOAT;
+	    di->di_tv.v_lock = 0;
+	    di->di_tv.vval.v_float = profile_float(tmp);
+	    if (dict_add(dict, di) == FAIL)
+		dictitem_free(di);
+#  else
+	    dict_add_nr_str(dict, time_keys[i], 0L,
+					       skipwhite(profile_msg(tmp)));
+#  endif
+	}
+    }
+    ga_clear(gap);
+    vim_free(gap);
+}
+# endif
+#endif
+
 /*
  * Return TRUE if there is a matching autocommand for "fname".
  * To account for buffer-local autocommands, function needs to know
@@ -9951,6 +12392,8 @@ has_autocmd(event_T event, char_u *sfname, buf_T *buf)
     char_u	*tail = gettail(sfname);
     int		retval = FALSE;
 
+    if (!au_index_may_match(event, tail))
+	return FALSE;
     fname = FullName_save(sfname, FALSE);
     if (fname == NULL)
 	return FALSE;
@@ -9969,8 +12412,7 @@ has_autocmd(event_T event, char_u *sfname, buf_T *buf)
     for (ap = first_autopat[(int)event]; ap != NULL; ap = ap->next)
 	if (ap->pat != NULL && ap->cmds != NULL
 	      && (ap->buflocal_nr == 0
-		? match_file_pat(NULL, &ap->reg_prog,
-					  fname, sfname, tail, ap->allow_dirs)
+		? au_match_pat(ap, fname, sfname, tail)
 		: buf != NULL && ap->buflocal_nr == buf->b_fnum
 	   ))
 	{
@@ -319,7 +319,8 @@
 # define PLINES_NOFILL(x) plines(x)
 #endif
 
-#if defined(FEAT_JOB_CHANNEL) || defined(FEAT_CLIENTSERVER)
+#if defined(FEAT_JOB_CHANNEL) || defined(FEAT_CLIENTSERVER) \
+	|| defined(FEAT_ASYNC_WRITE)
 # define MESSAGE_QUEUE
 #endif
 
@@ -65,15 +65,80 @@ extern int dos2;			/* this is in os_amiga.c */
 # endif
 #endif
 
+#ifdef FEAT_SWAP_THREAD
+# include <pthread.h>
+#endif
+
 #define MEMFILE_PAGE_SIZE 4096		/* default page size */
 
 static long_u	total_mem_used = 0;	/* total memory used for memfiles */
+static long_u	mf_use_count = 0;	/* incremented when a block is used */
+static long	mf_hit_count = 0;	/* nr of times a block was in memory */
+static long	mf_read_count = 0;	/* nr of blocks read back into memory */
+static long	mf_evict_count = 0;	/* nr of blocks released from memory */
+static long	mf_unzip_count = 0;	/* nr of blocks uncompressed */
+static long_u	total_zip_text = 0;	/* bytes of compressed blocks */
+static long_u	total_zip_size = 0;	/* bytes used for compressed blocks */
+
+/*
+ * Compressing a block with mf_zip_compress() uses a hash table with the
+ * position of three bytes, matches are at most MF_ZIP_MAX_OFF bytes back and
+ * MF_ZIP_MAX_LEN bytes long.
+ */
+#define MF_ZIP_HASH_BITS 12
+#define MF_ZIP_MAX_OFF	8192
+#define MF_ZIP_MAX_LEN	(2 + 7 + 255)
+
+#ifdef HAVE_GETTIMEOFDAY
+/*
+ * Keeping a compressed copy of a block is only useful when reading it back
+ * takes much longer than compressing it, e.g. when the swap file is on a slow
+ * disk and not in the system cache.  A running average of the time to read
+ * and to compress a block is kept, in microseconds times eight.
+ */
+static long	mf_read_time = 0;
+static long	mf_zip_time = 0;
+#endif
+
+#ifdef FEAT_SWAP_THREAD
+/*
+ * When 'swapthread' is set mf_sync() puts a copy of the dirty blocks in a
+ * queue and a separate thread writes them to the swap file.  The queue and
+ * mf_async_pending and mf_async_error of each memfile are protected by
+ * mf_wr_mutex.
+ */
+# define MF_WR_WRITE	0	/* write wr_data at wr_offset */
+# define MF_WR_FSYNC	1	/* fsync() the swap file */
+# define MF_WR_SYNC	2	/* sync() */
+
+typedef struct mf_wreq_S mf_wreq_T;
+
+struct mf_wreq_S
+{
+    mf_wreq_T	*wr_next;	/* next request in queue */
+    memfile_T	*wr_mfp;	/* memfile the request is for */
+    int		wr_how;		/* MF_WR_WRITE, MF_WR_FSYNC or MF_WR_SYNC */
+    off_T	wr_offset;	/* offset in the swap file */
+    unsigned	wr_size;	/* number of bytes in wr_data */
+    char_u	wr_data[1];	/* the block, actually longer */
+};
+
+static pthread_mutex_t	mf_wr_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	mf_wr_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	mf_wr_done = PTHREAD_COND_INITIALIZER;
+static mf_wreq_T	*mf_wr_first = NULL;	/* first request in queue */
+static mf_wreq_T	*mf_wr_last = NULL;	/* last request in queue */
+static int		mf_wr_started = FALSE;	/* writer thread is running */
+static int		mf_wr_active = FALSE;	/* mf_write_block() queues */
+static volatile int	mf_wr_abandon = FALSE;	/* exiting on a signal */
+#endif
 
 static void mf_ins_hash(memfile_T *, bhdr_T *);
 static void mf_rem_hash(memfile_T *, bhdr_T *);
 static bhdr_T *mf_find_hash(memfile_T *, blocknr_T);
 static void mf_ins_used(memfile_T *, bhdr_T *);
 static void mf_rem_used(memfile_T *, bhdr_T *);
+static bhdr_T *mf_find_release(memfile_T *, NR_BACKING **);
 static bhdr_T *mf_release(memfile_T *, int);
 static bhdr_T *mf_alloc_bhdr(memfile_T *, int);
 static void mf_free_bhdr(bhdr_T *);
@@ -83,6 +148,18 @@ static int  mf_read(memfile_T *, bhdr_T *);
 static int  mf_write(memfile_T *, bhdr_T *);
 static int  mf_write_block(memfile_T *mfp, bhdr_T *hp, off_T offset, unsigned size);
 static int  mf_trans_add(memfile_T *, bhdr_T *);
+static NR_BACKING *mf_backing_find(memfile_T *mfp, blocknr_T nr);
+static void mf_backing_del(memfile_T *mfp, blocknr_T nr);
+static void mf_zip_add(memfile_T *mfp, bhdr_T *hp);
+static void mf_zip_del(memfile_T *mfp, NR_ZIPPED *nzp);
+static void mf_zip_forget(memfile_T *mfp, blocknr_T nr);
+static int mf_zip_clear(memfile_T *mfp);
+static unsigned mf_zip_compress(char_u *src, unsigned len, char_u *dst, unsigned maxlen);
+static int mf_zip_expand(char_u *src, unsigned len, char_u *dst, unsigned dstlen);
+static void mf_digest_forget(memfile_T *mfp, blocknr_T nr);
+#ifdef HAVE_GETTIMEOFDAY
+static void mf_add_time(long *avgp, struct timeval *start);
+#endif
 static void mf_do_open(memfile_T *, char_u *, int);
 static void mf_hash_init(mf_hashtab_T *);
 static void mf_hash_free(mf_hashtab_T *);
@@ -91,6 +168,11 @@ static mf_hashitem_T *mf_hash_find(mf_hashtab_T *, blocknr_T);
 static void mf_hash_add_item(mf_hashtab_T *, mf_hashitem_T *);
 static void mf_hash_rem_item(mf_hashtab_T *, mf_hashitem_T *);
 static int mf_hash_grow(mf_hashtab_T *);
+#ifdef FEAT_SWAP_THREAD
+static int mf_writer_start(void);
+static int mf_async_write(memfile_T *mfp, char_u *data, off_T offset, unsigned size, int how);
+static void *mf_writer(void *arg);
+#endif
 
 /*
  * The functions for using a memfile:
@@ -103,8 +185,12 @@ static int mf_hash_grow(mf_hashtab_T *);
  * mf_put()	    unlock a block, may be marked for writing
  * mf_free()	    remove a block
  * mf_sync()	    sync changed parts of memfile to disk
+ * mf_sync_wait()   wait for the writer thread to write the blocks
  * mf_release_all() release as much memory as possible
+ * mf_stats()	    get statistics about blocks kept in memory
  * mf_trans_del()   may translate negative to positive block number
+ * mf_backing_add() remember where in the original file a data block is
+ * mf_backing_clear() forget about the original file
  * mf_fullname()    make file name full path (use before first :cd)
  */
 
@@ -154,10 +240,25 @@ mf_open(char_u *fname, int flags)
     mfp->mf_free_first = NULL;		/* free list is empty */
     mfp->mf_used_first = NULL;		/* used list is empty */
     mfp->mf_used_last = NULL;
+    mfp->mf_used_cold = NULL;
     mfp->mf_dirty = FALSE;
     mfp->mf_used_count = 0;
+    mfp->mf_hot_count = 0;
     mf_hash_init(&mfp->mf_hash);
     mf_hash_init(&mfp->mf_trans);
+    mf_hash_init(&mfp->mf_backing);
+    mf_hash_init(&mfp->mf_zip);
+    mf_hash_init(&mfp->mf_digest);
+    mfp->mf_zip_first = NULL;
+    mfp->mf_zip_last = NULL;
+    mfp->mf_zip_size = 0;
+    mfp->mf_orig_fd = -1;
+    mfp->mf_orig_dos = FALSE;
+#ifdef FEAT_SWAP_THREAD
+    mfp->mf_async_pending = 0;
+    mfp->mf_async_error = FALSE;
+    mfp->mf_async_abandoned = FALSE;
+#endif
     mfp->mf_page_size = MEMFILE_PAGE_SIZE;
 #ifdef FEAT_CRYPT
     mfp->mf_old_key = NULL;
@@ -242,6 +343,7 @@ mf_close(memfile_T *mfp, int del_file)
 
     if (mfp == NULL)		    /* safety check */
 	return;
+    mf_sync_wait(mfp);
     if (mfp->mf_fd >= 0)
     {
 	if (close(mfp->mf_fd) < 0)
@@ -258,8 +360,14 @@ mf_close(memfile_T *mfp, int del_file)
     }
     while (mfp->mf_free_first != NULL)	    /* free entries in free list */
 	vim_free(mf_rem_free(mfp));
+    (void)mf_zip_clear(mfp);
     mf_hash_free(&mfp->mf_hash);
+    mf_hash_free(&mfp->mf_zip);
     mf_hash_free_all(&mfp->mf_trans);	    /* free hashtable and its items */
+    mf_hash_free_all(&mfp->mf_backing);
+    mf_hash_free_all(&mfp->mf_digest);
+    if (mfp->mf_orig_fd >= 0)
+	close(mfp->mf_orig_fd);
     vim_free(mfp->mf_fname);
     vim_free(mfp->mf_ffname);
     vim_free(mfp);
@@ -290,6 +398,7 @@ mf_close_file(
 	/* TODO: should check if all blocks are really in core */
     }
 
+    mf_sync_wait(mfp);
     if (close(mfp->mf_fd) < 0)			/* close the file */
 	EMSG(_(e_swapclose));
     mfp->mf_fd = -1;
@@ -426,7 +535,21 @@ mf_get(memfile_T *mfp, blocknr_T nr, int page_count)
     hp = mf_find_hash(mfp, nr);
     if (hp == NULL)	/* not in the hash list */
     {
-	if (nr < 0 || nr >= mfp->mf_infile_count)   /* can't be in the file */
+	NR_BACKING  *nbp = NULL;
+	NR_ZIPPED   *nzp;
+	int	    unzipped = FALSE;
+#ifdef HAVE_GETTIMEOFDAY
+	struct timeval	start;
+#endif
+
+	if (nr < 0)
+	{
+	    /* Only a dropped block can be read back from the original file. */
+	    nbp = mf_backing_find(mfp, nr);
+	    if (nbp == NULL || !nbp->nb_dropped)
+		return NULL;
+	}
+	else if (nr >= mfp->mf_infile_count)	/* can't be in the file */
 	    return NULL;
 
 	/* could check here if the block is in the free list */
@@ -443,20 +566,66 @@ mf_get(memfile_T *mfp, blocknr_T nr, int page_count)
 	hp->bh_bnum = nr;
 	hp->bh_flags = 0;
 	hp->bh_page_count = page_count;
-	if (mf_read(mfp, hp) == FAIL)	    /* cannot read the block! */
+#ifdef HAVE_GETTIMEOFDAY
+	gettimeofday(&start, NULL);
+#endif
+
+	/* When a compressed copy was kept, uncompress it instead of reading
+	 * the block.  Look it up only now, mf_release() may have dropped it.
+	 * The copy is kept until the block is changed. */
+	nzp = (NR_ZIPPED *)mf_hash_find(&mfp->mf_zip, nr);
+	if (nzp != NULL)
+	{
+	    unzipped = mf_zip_expand(nzp->nz_data, nzp->nz_size,
+			  hp->bh_data, mfp->mf_page_size * page_count) == OK;
+	    if (!unzipped)
+		mf_zip_del(mfp, nzp);
+	}
+	if (unzipped)
+	{
+	    /* Used again soon after it was released, keep it longer. */
+	    hp->bh_flags = BH_HOT;
+	    if (nbp != NULL)
+	    {
+		/* Still not in the swap file, like in ml_backing_read(). */
+		hp->bh_flags |= BH_DIRTY;
+		nbp->nb_dropped = FALSE;
+	    }
+	    ++mf_unzip_count;
+	}
+	else if (nbp != NULL)
+	{
+	    /* Like when it was first filled, the block is not in the swap
+	     * file.  When the text can't be read back the block no longer
+	     * matches the file. */
+	    hp->bh_flags = BH_DIRTY;
+	    nbp->nb_dropped = FALSE;
+	    if (ml_backing_read(mfp, hp, nbp) == FAIL)
+		mf_backing_del(mfp, nr);
+	}
+	else if (mf_read(mfp, hp) == FAIL)	/* cannot read the block! */
 	{
 	    mf_free_bhdr(hp);
 	    return NULL;
 	}
+	if (!unzipped)
+	{
+	    ++mf_read_count;
+#ifdef HAVE_GETTIMEOFDAY
+	    mf_add_time(&mf_read_time, &start);
+#endif
+	}
     }
     else
     {
+	++mf_hit_count;
 	mf_rem_used(mfp, hp);	/* remove from list, insert in front below */
 	mf_rem_hash(mfp, hp);
+	hp->bh_flags |= BH_HOT;	/* used again while in memory */
     }
 
     hp->bh_flags |= BH_LOCKED;
-    mf_ins_used(mfp, hp);	/* put in front of used list */
+    mf_ins_used(mfp, hp);	/* put in front of (cold part of) used list */
     mf_ins_hash(mfp, hp);	/* put in front of hash list */
 
     return hp;
@@ -488,6 +657,12 @@ mf_put(
     {
 	flags |= BH_DIRTY;
 	mfp->mf_dirty = TRUE;
+	/* The text no longer matches the original file or the compressed
+	 * copy. */
+	if (hp->bh_bnum < 0 && mfp->mf_backing.mht_count > 0)
+	    mf_backing_del(mfp, hp->bh_bnum);
+	mf_zip_forget(mfp, hp->bh_bnum);
+	mf_digest_forget(mfp, hp->bh_bnum);
     }
     hp->bh_flags = flags;
     if (infile)
@@ -503,8 +678,11 @@ mf_free(memfile_T *mfp, bhdr_T *hp)
     vim_free(hp->bh_data);	/* free the memory */
     mf_rem_hash(mfp, hp);	/* get *hp out of the hash list */
     mf_rem_used(mfp, hp);	/* get *hp out of the used list */
+    mf_zip_forget(mfp, hp->bh_bnum);
+    mf_digest_forget(mfp, hp->bh_bnum);
     if (hp->bh_bnum < 0)
     {
+	mf_backing_del(mfp, hp->bh_bnum);
 	vim_free(hp);		/* don't want negative numbers in free list */
 	mfp->mf_neg_count--;
     }
@@ -529,7 +707,8 @@ fdtofh(int filedescriptor)
  *  MFS_ALL	If not given, blocks with negative numbers are not synced,
  *		even when they are dirty!
  *  MFS_STOP	Stop syncing when a character becomes available, but sync at
- *		least one block.
+ *		least one block.  When 'swapthread' is set the writer thread
+ *		does the writing.
  *  MFS_FLUSH	Make sure buffers are flushed to disk, so they will survive a
  *		system crash.
  *  MFS_ZERO	Only write block 0.
@@ -552,6 +731,15 @@ mf_sync(memfile_T *mfp, int flags)
 	return FAIL;
     }
 
+#ifdef FEAT_SWAP_THREAD
+    /* When typing don't wait for the file system, let the writer thread
+     * write copies of the blocks. */
+    mf_wr_active = p_swt && (flags & MFS_STOP) && !really_exiting
+						  && mf_writer_start() == OK;
+    if (!mf_wr_active)
+#endif
+	mf_sync_wait(mfp);
+
     /* Only a CTRL-C while writing will break us here, not one typed
      * previously. */
     got_int = FALSE;
@@ -596,6 +784,20 @@ mf_sync(memfile_T *mfp, int flags)
     if (hp == NULL || status == FAIL)
 	mfp->mf_dirty = FALSE;
 
+#ifdef FEAT_SWAP_THREAD
+    if (mf_wr_active)
+    {
+	/* The writer thread syncs after writing the blocks. */
+	if ((flags & MFS_FLUSH) && *p_sws != NUL
+		&& mf_async_write(mfp, NULL, (off_T)0, 0,
+			    STRCMP(p_sws, "fsync") == 0 ? MF_WR_FSYNC
+							: MF_WR_SYNC) == FAIL)
+	    status = FAIL;
+	flags &= ~MFS_FLUSH;
+	mf_wr_active = FALSE;
+    }
+#endif
+
     if ((flags & MFS_FLUSH) && *p_sws != NUL)
     {
 #if defined(UNIX)
@@ -700,6 +902,52 @@ mf_set_dirty(memfile_T *mfp)
     mfp->mf_dirty = TRUE;
 }
 
+/*
+ * Wait for the writer thread to finish writing the blocks of memfile "mfp".
+ * Must be done before reading from the swap file, writing to it in another
+ * way or closing it.
+ * When writing failed the blocks are marked dirty, to be written again.
+ * When exiting on a deadly signal the blocks are also marked dirty, without
+ * waiting.
+ */
+    void
+mf_sync_wait(memfile_T *mfp UNUSED)
+{
+#ifdef FEAT_SWAP_THREAD
+    int		failed;
+
+    if (!mf_wr_started)
+	return;
+    if (really_exiting)
+    {
+	/* Called from preserve_exit(), the interrupted main thread may hold
+	 * mf_wr_mutex.  Stop the writer thread and write the blocks that may
+	 * still be in the queue from memory. */
+	mf_wr_abandon = TRUE;
+	if (mfp->mf_async_pending > 0 && !mfp->mf_async_abandoned)
+	{
+	    mfp->mf_async_abandoned = TRUE;
+	    mf_set_dirty(mfp);
+	}
+	return;
+    }
+    pthread_mutex_lock(&mf_wr_mutex);
+    while (mfp->mf_async_pending > 0)
+	pthread_cond_wait(&mf_wr_done, &mf_wr_mutex);
+    failed = mfp->mf_async_error;
+    mfp->mf_async_error = FALSE;
+    pthread_mutex_unlock(&mf_wr_mutex);
+
+    if (failed)
+    {
+	mf_set_dirty(mfp);
+	if (!did_swapwrite_msg)
+	    EMSG(_("E297: Write error in swap file"));
+	did_swapwrite_msg = TRUE;
+    }
+#endif
+}
+
 /*
  * insert block *hp in front of hashlist of memfile *mfp
  */
@@ -728,20 +976,49 @@ mf_find_hash(memfile_T *mfp, blocknr_T nr)
 }
 
 /*
- * insert block *hp in front of used list of memfile *mfp
+ * insert block *hp in used list of memfile *mfp: a hot block in front of the
+ * list, a cold block in front of the cold part
  */
     static void
 mf_ins_used(memfile_T *mfp, bhdr_T *hp)
 {
-    hp->bh_next = mfp->mf_used_first;
-    mfp->mf_used_first = hp;
-    hp->bh_prev = NULL;
-    if (hp->bh_next == NULL)	    /* list was empty, adjust last pointer */
+    bhdr_T	*next;
+
+    next = (hp->bh_flags & BH_HOT) ? mfp->mf_used_first : mfp->mf_used_cold;
+    hp->bh_next = next;
+    if (next == NULL)		    /* insert at the end of the list */
+    {
+	hp->bh_prev = mfp->mf_used_last;
 	mfp->mf_used_last = hp;
+    }
     else
-	hp->bh_next->bh_prev = hp;
+    {
+	hp->bh_prev = next->bh_prev;
+	next->bh_prev = hp;
+    }
+    if (hp->bh_prev == NULL)	    /* insert at the start of the list */
+	mfp->mf_used_first = hp;
+    else
+	hp->bh_prev->bh_next = hp;
+    if (hp->bh_flags & BH_HOT)
+	mfp->mf_hot_count += hp->bh_page_count;
+    else
+	mfp->mf_used_cold = hp;
     mfp->mf_used_count += hp->bh_page_count;
     total_mem_used += hp->bh_page_count * mfp->mf_page_size;
+    hp->bh_used = ++mf_use_count;
+
+    /* Keep at least a quarter of the pages in the cold part, otherwise a
+     * new block would be released soon after it was read.  The least
+     * recently used hot blocks become the first cold blocks. */
+    while (mfp->mf_hot_count * 4 > mfp->mf_used_count * 3)
+    {
+	hp = mfp->mf_used_cold == NULL ? mfp->mf_used_last
+						 : mfp->mf_used_cold->bh_prev;
+	hp->bh_flags &= ~BH_HOT;
+	mfp->mf_hot_count -= hp->bh_page_count;
+	mfp->mf_used_cold = hp;
+    }
 }
 
 /*
@@ -750,6 +1027,10 @@ mf_ins_used(memfile_T *mfp, bhdr_T *hp)
     static void
 mf_rem_used(memfile_T *mfp, bhdr_T *hp)
 {
+    if (hp == mfp->mf_used_cold)
+	mfp->mf_used_cold = hp->bh_next;
+    if (hp->bh_flags & BH_HOT)
+	mfp->mf_hot_count -= hp->bh_page_count;
     if (hp->bh_next == NULL)	    /* last block in used list */
 	mfp->mf_used_last = hp->bh_prev;
     else
@@ -762,9 +1043,41 @@ mf_rem_used(memfile_T *mfp, bhdr_T *hp)
     total_mem_used -= hp->bh_page_count * mfp->mf_page_size;
 }
 
+/*
+ * Find the least recently used block of memfile "mfp" that can be released,
+ * cold blocks come before hot blocks.  When it is to be read back from the
+ * original file "*nbpp" is set to its backing entry, otherwise to NULL.
+ *
+ * Returns NULL if no block can be released.
+ */
+    static bhdr_T *
+mf_find_release(memfile_T *mfp, NR_BACKING **nbpp)
+{
+    bhdr_T	*hp;
+
+    *nbpp = NULL;
+    if (mfp->mf_fd < 0 && mfp->mf_backing.mht_count == 0)
+	return NULL;
+
+    for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
+	if (!(hp->bh_flags & BH_LOCKED))
+	{
+	    if (mfp->mf_fd >= 0)
+		break;
+	    /* Without a swap file only a block that is in the original file
+	     * can be released. */
+	    if (hp->bh_bnum < 0
+		    && (*nbpp = mf_backing_find(mfp, hp->bh_bnum)) != NULL)
+		break;
+	}
+    return hp;
+}
+
 /*
  * Release the least recently used block from the used list if the number
  * of used memory blocks gets to big.
+ * When it's 'maxmemtot' that is reached, the block may be taken from the
+ * memfile of another buffer.
  *
  * Return the block header to the caller, including the memory block, so
  * it can be re-used. Make sure the page_count is right.
@@ -775,8 +1088,12 @@ mf_rem_used(memfile_T *mfp, bhdr_T *hp)
 mf_release(memfile_T *mfp, int page_count)
 {
     bhdr_T	*hp;
+    int		over_max;
     int		need_release;
     buf_T	*buf;
+    memfile_T	*relmfp;
+    NR_BACKING	*nbp;
+    static int	releasing_more = FALSE;
 
     /* don't release while in mf_close_file() */
     if (mf_dont_release)
@@ -784,16 +1101,18 @@ mf_release(memfile_T *mfp, int page_count)
 
     /*
      * Need to release a block if the number of blocks for this memfile is
-     * higher than the maximum or total memory used is over 'maxmemtot'
+     * higher than the maximum or total memory used is over 'maxmemtot'.
+     * The compressed blocks count for the pages they fill.
      */
-    need_release = ((mfp->mf_used_count >= mfp->mf_used_count_max)
-				  || (total_mem_used >> 10) >= (long_u)p_mmt);
+    over_max = mfp->mf_used_count + mfp->mf_zip_size / mfp->mf_page_size
+						   >= mfp->mf_used_count_max;
+    need_release = (over_max || (total_mem_used >> 10) >= (long_u)p_mmt);
 
     /*
      * Try to create a swap file if the amount of memory used is getting too
-     * high.
+     * high.  Not when blocks can be read back from the original file.
      */
-    if (mfp->mf_fd < 0 && need_release && p_uc)
+    if (mfp->mf_fd < 0 && mfp->mf_orig_fd < 0 && need_release && p_uc)
     {
 	/* find for which buffer this memfile is */
 	FOR_ALL_BUFFERS(buf)
@@ -803,38 +1122,94 @@ mf_release(memfile_T *mfp, int page_count)
 	    ml_open_file(buf);
     }
 
-    /*
-     * don't release a block if
-     *	there is no file for this memfile
-     * or
-     *	the number of blocks for this memfile is lower than the maximum
-     *	  and
-     *	total memory used is not up to 'maxmemtot'
-     */
-    if (mfp->mf_fd < 0 || !need_release)
+    if (!need_release)
 	return NULL;
 
-    for (hp = mfp->mf_used_last; hp != NULL; hp = hp->bh_prev)
-	if (!(hp->bh_flags & BH_LOCKED))
+    for (;;)
+    {
+	relmfp = mfp;
+	hp = mf_find_release(mfp, &nbp);
+
+	/*
+	 * When this memfile isn't over 'maxmem' then all memfiles together
+	 * are over 'maxmemtot'.  Release the block that was used longest ago
+	 * in any of them, so that the text of buffers that are used stays in
+	 * memory.
+	 */
+	if (!over_max)
+	    FOR_ALL_BUFFERS(buf)
+	    {
+		memfile_T	*bmfp = buf->b_ml.ml_mfp;
+		bhdr_T		*bhp;
+		NR_BACKING	*bnbp;
+
+		if (bmfp == NULL || bmfp == mfp)
+		    continue;
+		bhp = mf_find_release(bmfp, &bnbp);
+		if (bhp != NULL && (hp == NULL
+			|| ((bhp->bh_flags & BH_HOT) == (hp->bh_flags & BH_HOT)
+			    ? bhp->bh_used < hp->bh_used
+			    : (hp->bh_flags & BH_HOT) != 0)))
+		{
+		    hp = bhp;
+		    nbp = bnbp;
+		    relmfp = bmfp;
+		}
+	    }
+
+	if (hp == NULL)	/* not a single one that can be released */
+	{
+	    /* Make some room by dropping a compressed block. */
+	    if (mfp->mf_zip_last != NULL)
+		mf_zip_del(mfp, mfp->mf_zip_last);
+	    return NULL;
+	}
+	if (nbp == NULL || ml_backing_drop(hp, nbp) == OK)
 	    break;
-    if (hp == NULL)	/* not a single one that can be released */
-	return NULL;
+	/* The block doesn't match the original file, try another one. */
+	mf_backing_del(relmfp, hp->bh_bnum);
+    }
 
     /*
-     * If the block is dirty, write it.
+     * If the block is dirty, write it.  Not when it can be read back from
+     * the original file.  When the writer thread failed to write it, it is
+     * dirty again.
      * If the write fails we don't free it.
      */
-    if ((hp->bh_flags & BH_DIRTY) && mf_write(mfp, hp) == FAIL)
+    mf_sync_wait(relmfp);
+    if (nbp == NULL && (hp->bh_flags & BH_DIRTY)
+					       && mf_write(relmfp, hp) == FAIL)
 	return NULL;
 
-    mf_rem_used(mfp, hp);
-    mf_rem_hash(mfp, hp);
+    /* Keep a compressed copy, that is faster than reading it back. */
+    mf_zip_add(relmfp, hp);
+
+    mf_rem_used(relmfp, hp);
+    mf_rem_hash(relmfp, hp);
+    ++mf_evict_count;
+
+    /*
+     * The compressed copy takes room too.  Release more blocks while this
+     * memfile is still over 'maxmem'.
+     */
+    if (relmfp == mfp && !releasing_more)
+    {
+	bhdr_T	*xhp;
+
+	releasing_more = TRUE;
+	while (mfp->mf_used_count + page_count
+				   + mfp->mf_zip_size / mfp->mf_page_size
+						    > mfp->mf_used_count_max
+		&& (xhp = mf_release(mfp, 1)) != NULL)
+	    mf_free_bhdr(xhp);
+	releasing_more = FALSE;
+    }
 
     /*
-     * If a bhdr_T is returned, make sure that the page_count of bh_data is
-     * right
+     * If a bhdr_T is returned, make sure that the size of bh_data is right
      */
-    if (hp->bh_page_count != page_count)
+    if (hp->bh_page_count * relmfp->mf_page_size
+					    != page_count * mfp->mf_page_size)
     {
 	vim_free(hp->bh_data);
 	if ((hp->bh_data = alloc(mfp->mf_page_size * page_count)) == NULL)
@@ -842,8 +1217,8 @@ mf_release(memfile_T *mfp, int page_count)
 	    vim_free(hp);
 	    return NULL;
 	}
-	hp->bh_page_count = page_count;
     }
+    hp->bh_page_count = page_count;
     return hp;
 }
 
@@ -866,22 +1241,39 @@ mf_release_all(void)
 	mfp = buf->b_ml.ml_mfp;
 	if (mfp != NULL)
 	{
+	    if (mf_zip_clear(mfp))
+		retval = TRUE;
+
 	    /* If no swap file yet, may open one */
-	    if (mfp->mf_fd < 0 && buf->b_may_swap)
+	    if (mfp->mf_fd < 0 && mfp->mf_orig_fd < 0 && buf->b_may_swap)
 		ml_open_file(buf);
 
-	    /* only if there is a swapfile */
-	    if (mfp->mf_fd >= 0)
+	    /* only if there is a swapfile or the original file can be used */
+	    if (mfp->mf_fd >= 0 || mfp->mf_backing.mht_count > 0)
 	    {
+		mf_sync_wait(mfp);
 		for (hp = mfp->mf_used_last; hp != NULL; )
 		{
+		    NR_BACKING	*nbp = NULL;
+
+		    if (mfp->mf_fd < 0 && hp->bh_bnum < 0
+					       && !(hp->bh_flags & BH_LOCKED))
+			nbp = mf_backing_find(mfp, hp->bh_bnum);
+		    if (nbp != NULL && ml_backing_drop(hp, nbp) == FAIL)
+		    {
+			mf_backing_del(mfp, hp->bh_bnum);
+			nbp = NULL;
+		    }
 		    if (!(hp->bh_flags & BH_LOCKED)
-			    && (!(hp->bh_flags & BH_DIRTY)
-				|| mf_write(mfp, hp) != FAIL))
+			    && (nbp != NULL
+				|| (mfp->mf_fd >= 0
+				    && (!(hp->bh_flags & BH_DIRTY)
+					|| mf_write(mfp, hp) != FAIL))))
 		    {
 			mf_rem_used(mfp, hp);
 			mf_rem_hash(mfp, hp);
 			mf_free_bhdr(hp);
+			++mf_evict_count;
 			hp = mfp->mf_used_last;	/* re-start, list was changed */
 			retval = TRUE;
 		    }
@@ -894,6 +1286,33 @@ mf_release_all(void)
     return retval;
 }
 
+/*
+ * Get statistics about the blocks of all memfiles: the number of times a
+ * block was found in memory, was read back into memory and was released
+ * from memory, and the number of bytes in memory.
+ */
+    void
+mf_stats(long *hits, long *reads, long *evictions, long_u *used)
+{
+    *hits = mf_hit_count;
+    *reads = mf_read_count;
+    *evictions = mf_evict_count;
+    *used = total_mem_used;
+}
+
+/*
+ * Get statistics about the compressed blocks of all memfiles: the number of
+ * times a block was uncompressed, the number of bytes of the blocks that are
+ * kept compressed and the number of bytes used for that.
+ */
+    void
+mf_zip_stats(long *unzips, long_u *text, long_u *size)
+{
+    *unzips = mf_unzip_count;
+    *text = total_zip_text;
+    *size = total_zip_size;
+}
+
 /*
  * Allocate a block header and a block of memory for it
  */
@@ -963,6 +1382,7 @@ mf_read(memfile_T *mfp, bhdr_T *hp)
 
     if (mfp->mf_fd < 0)	    /* there is no file, can't read */
 	return FAIL;
+    mf_sync_wait(mfp);
 
     page_size = mfp->mf_page_size;
     offset = (off_T)page_size * hp->bh_bnum;
@@ -1005,6 +1425,10 @@ mf_write(memfile_T *mfp, bhdr_T *hp)
 
     if (mfp->mf_fd < 0)	    /* there is no file, can't write */
 	return FAIL;
+#ifdef FEAT_SWAP_THREAD
+    if (!mf_wr_active)
+#endif
+	mf_sync_wait(mfp);
 
     if (hp->bh_bnum < 0)	/* must assign file block number */
 	if (mf_trans_add(mfp, hp) == FAIL)
@@ -1090,6 +1514,11 @@ mf_write_block(
     }
 #endif
 
+#ifdef FEAT_SWAP_THREAD
+    if (mf_wr_active)
+	result = mf_async_write(mfp, data, offset, size, MF_WR_WRITE);
+    else
+#endif
     if ((unsigned)write_eintr(mfp->mf_fd, data, size) != size)
 	result = FAIL;
 
@@ -1154,10 +1583,28 @@ mf_trans_add(memfile_T *mfp, bhdr_T *hp)
     np->nt_old_bnum = hp->bh_bnum;	    /* adjust number */
     np->nt_new_bnum = new_bnum;
 
+    /* The block will be in the swap file from now on. */
+    mf_backing_del(mfp, hp->bh_bnum);
+    mf_zip_forget(mfp, hp->bh_bnum);
+
     mf_rem_hash(mfp, hp);		    /* remove from old hash list */
     hp->bh_bnum = new_bnum;
     mf_ins_hash(mfp, hp);		    /* insert in new hash list */
 
+    /* The digest doesn't change, only the key. */
+    if (mfp->mf_digest.mht_count > 0)
+    {
+	NR_DIGEST	*ndp;
+
+	ndp = (NR_DIGEST *)mf_hash_find(&mfp->mf_digest, np->nt_old_bnum);
+	if (ndp != NULL)
+	{
+	    mf_hash_rem_item(&mfp->mf_digest, (mf_hashitem_T *)ndp);
+	    ndp->nd_bnum = new_bnum;
+	    mf_hash_add_item(&mfp->mf_digest, (mf_hashitem_T *)ndp);
+	}
+    }
+
     /* Insert "np" into "mf_trans" hashtable with key "np->nt_old_bnum" */
     mf_hash_add_item(&mfp->mf_trans, (mf_hashitem_T *)np);
 
@@ -1191,6 +1638,489 @@ mf_trans_del(memfile_T *mfp, blocknr_T old_nr)
     return new_bnum;
 }
 
+/*
+ * Remember that the data block with negative number "nr" and "page_count"
+ * pages holds the "line_count" lines found in "size" bytes at "offset" in
+ * the original file.
+ * When the block is not locked it may be dropped from memory instead of
+ * writing it to the swap file.
+ */
+    void
+mf_backing_add(
+    memfile_T	*mfp,
+    blocknr_T	nr,
+    off_T	offset,
+    long	size,
+    linenr_T	line_count,
+    int		page_count)
+{
+    NR_BACKING	*nbp;
+
+    if (nr >= 0 || mfp->mf_orig_fd < 0)
+	return;
+    nbp = mf_backing_find(mfp, nr);
+    if (nbp == NULL)
+    {
+	if ((nbp = (NR_BACKING *)alloc((unsigned)sizeof(NR_BACKING))) == NULL)
+	    return;
+	nbp->nb_bnum = nr;
+	mf_hash_add_item(&mfp->mf_backing, (mf_hashitem_T *)nbp);
+    }
+    nbp->nb_offset = offset;
+    nbp->nb_size = size;
+    nbp->nb_line_count = line_count;
+    nbp->nb_page_count = page_count;
+    nbp->nb_dropped = FALSE;
+    nbp->nb_sum = 0;
+}
+
+/*
+ * Lookup the backing entry for negative block number "nr".
+ * Returns NULL when not found.
+ */
+    static NR_BACKING *
+mf_backing_find(memfile_T *mfp, blocknr_T nr)
+{
+    if (mfp->mf_backing.mht_count == 0)
+	return NULL;
+    return (NR_BACKING *)mf_hash_find(&mfp->mf_backing, nr);
+}
+
+/*
+ * Forget that block "nr" can be read from the original file.  Used when it
+ * was changed, freed or got a positive number.
+ */
+    static void
+mf_backing_del(memfile_T *mfp, blocknr_T nr)
+{
+    NR_BACKING	*nbp;
+
+    nbp = mf_backing_find(mfp, nr);
+    if (nbp == NULL)
+	return;
+    mf_hash_rem_item(&mfp->mf_backing, (mf_hashitem_T *)nbp);
+    vim_free(nbp);
+}
+
+/*
+ * Forget about all blocks that can be read from the original file and close
+ * the file.  Blocks that were dropped are read back first.  When there is a
+ * swap file they may be written to it to make room for the next one.
+ */
+    void
+mf_backing_clear(memfile_T *mfp)
+{
+    long_u	idx = 0;
+    NR_BACKING	*nbp;
+    bhdr_T	*hp;
+    int		dont_release_save = mf_dont_release;
+
+    if (mfp->mf_backing.mht_count > 0)
+    {
+	/* Without a swap file a block would be dropped again. */
+	if (mfp->mf_fd < 0)
+	    mf_dont_release = TRUE;
+	while (idx <= mfp->mf_backing.mht_mask)
+	{
+	    for (nbp = (NR_BACKING *)mfp->mf_backing.mht_buckets[idx];
+		    nbp != NULL && !nbp->nb_dropped;
+			       nbp = (NR_BACKING *)nbp->nb_hashitem.mhi_next)
+		;
+	    if (nbp == NULL)
+	    {
+		++idx;
+		continue;
+	    }
+
+	    /* Get the text back in memory while the file can still be read.
+	     * Writing other blocks to the swap file may remove entries, thus
+	     * start at the head of the bucket again. */
+	    hp = mf_get(mfp, nbp->nb_bnum, nbp->nb_page_count);
+	    if (hp != NULL)
+		mf_put(mfp, hp, FALSE, FALSE);
+	    else
+		mf_backing_del(mfp, nbp->nb_bnum);   /* text is lost */
+	}
+	mf_dont_release = dont_release_save;
+	mf_hash_free_all(&mfp->mf_backing);
+	mf_hash_init(&mfp->mf_backing);
+    }
+    if (mfp->mf_orig_fd >= 0)
+    {
+	close(mfp->mf_orig_fd);
+	mfp->mf_orig_fd = -1;
+    }
+}
+
+/*
+ * Keep a compressed copy of block "hp", which is being released from memory.
+ * Not when it doesn't get much smaller or reading it back is faster than
+ * compressing it.  When it still has the copy it was
+ * uncompressed from that one is used.  The least recently released blocks
+ * are dropped to use at most half of 'maxmem' for them.
+ */
+    static void
+mf_zip_add(memfile_T *mfp, bhdr_T *hp)
+{
+    NR_ZIPPED	*nzp;
+    NR_ZIPPED	*p;
+    unsigned	len = mfp->mf_page_size * hp->bh_page_count;
+    unsigned	size;
+    long_u	limit;
+#ifdef HAVE_GETTIMEOFDAY
+    struct timeval	start;
+#endif
+
+    nzp = (NR_ZIPPED *)mf_hash_find(&mfp->mf_zip, hp->bh_bnum);
+    if (nzp != NULL)
+    {
+	/* Not changed since it was uncompressed, the copy can be used again.
+	 * Move it to the front of the list. */
+	if (nzp != mfp->mf_zip_first)
+	{
+	    nzp->nz_prev->nz_next = nzp->nz_next;
+	    if (nzp->nz_next == NULL)
+		mfp->mf_zip_last = nzp->nz_prev;
+	    else
+		nzp->nz_next->nz_prev = nzp->nz_prev;
+	    nzp->nz_prev = NULL;
+	    nzp->nz_next = mfp->mf_zip_first;
+	    mfp->mf_zip_first->nz_prev = nzp;
+	    mfp->mf_zip_first = nzp;
+	}
+	return;
+    }
+
+    limit = (long_u)mfp->mf_used_count_max * mfp->mf_page_size / 2;
+    if (len > limit)
+	return;
+#ifdef HAVE_GETTIMEOFDAY
+    /* Not when reading the block back is fast. */
+    if (mf_read_time < 4 * mf_zip_time
+# ifdef FEAT_EVAL
+	    && !always_zip_for_testing
+# endif
+	    )
+	return;
+    gettimeofday(&start, NULL);
+#endif
+    nzp = (NR_ZIPPED *)alloc((unsigned)sizeof(NR_ZIPPED) + len);
+    if (nzp == NULL)
+	return;
+    size = mf_zip_compress(hp->bh_data, len, nzp->nz_data, len / 4 * 3);
+#ifdef HAVE_GETTIMEOFDAY
+    mf_add_time(&mf_zip_time, &start);
+#endif
+    if (size == 0)
+    {
+	vim_free(nzp);
+	return;
+    }
+    p = (NR_ZIPPED *)vim_realloc(nzp, sizeof(NR_ZIPPED) + size);
+    if (p != NULL)
+	nzp = p;
+    nzp->nz_bnum = hp->bh_bnum;
+    nzp->nz_page_count = hp->bh_page_count;
+    nzp->nz_size = size;
+
+    mf_hash_add_item(&mfp->mf_zip, (mf_hashitem_T *)nzp);
+    nzp->nz_prev = NULL;
+    nzp->nz_next = mfp->mf_zip_first;
+    if (mfp->mf_zip_first == NULL)
+	mfp->mf_zip_last = nzp;
+    else
+	mfp->mf_zip_first->nz_prev = nzp;
+    mfp->mf_zip_first = nzp;
+    mfp->mf_zip_size += size;
+    total_zip_text += len;
+    total_zip_size += size;
+    total_mem_used += size;
+
+    while (mfp->mf_zip_size > limit)
+	mf_zip_del(mfp, mfp->mf_zip_last);
+}
+
+/*
+ * Remove compressed block "nzp" from the zip lists and free it.
+ */
+    static void
+mf_zip_del(memfile_T *mfp, NR_ZIPPED *nzp)
+{
+    mf_hash_rem_item(&mfp->mf_zip, (mf_hashitem_T *)nzp);
+    if (nzp->nz_prev == NULL)
+	mfp->mf_zip_first = nzp->nz_next;
+    else
+	nzp->nz_prev->nz_next = nzp->nz_next;
+    if (nzp->nz_next == NULL)
+	mfp->mf_zip_last = nzp->nz_prev;
+    else
+	nzp->nz_next->nz_prev = nzp->nz_prev;
+    mfp->mf_zip_size -= nzp->nz_size;
+    total_zip_text -= mfp->mf_page_size * nzp->nz_page_count;
+    total_zip_size -= nzp->nz_size;
+    total_mem_used -= nzp->nz_size;
+    vim_free(nzp);
+}
+
+/*
+ * Forget the compressed copy of block "nr", if there is one.  Used when the
+ * block was changed, freed or got a positive number.
+ */
+    static void
+mf_zip_forget(memfile_T *mfp, blocknr_T nr)
+{
+    NR_ZIPPED	*nzp;
+
+    if (mfp->mf_zip.mht_count == 0)
+	return;
+    nzp = (NR_ZIPPED *)mf_hash_find(&mfp->mf_zip, nr);
+    if (nzp != NULL)
+	mf_zip_del(mfp, nzp);
+}
+
+/*
+ * Free all compressed blocks of memfile "mfp".
+ * Returns TRUE if there were any.
+ */
+    static int
+mf_zip_clear(memfile_T *mfp)
+{
+    int		retval = (mfp->mf_zip_first != NULL);
+
+    while (mfp->mf_zip_first != NULL)
+	mf_zip_del(mfp, mfp->mf_zip_first);
+    return retval;
+}
+
+#ifdef HAVE_GETTIMEOFDAY
+/*
+ * Add the time since "start" to the running average "*avgp".
+ */
+    static void
+mf_add_time(long *avgp, struct timeval *start)
+{
+    struct timeval  now;
+    long	    usec;
+
+    gettimeofday(&now, NULL);
+    usec = (now.tv_sec - start->tv_sec) * 1000000L
+					      + now.tv_usec - start->tv_usec;
+    if (usec < 0 || usec > 1000000L)	/* clock changed? */
+	return;
+    *avgp += usec - *avgp / 8;
+}
+#endif
+
+/*
+ * Compress "len" bytes at "src" into "dst", which has room for "maxlen"
+ * bytes.  This is a simple LZ77 compression, fast enough to do it for every
+ * block that is released.  The result is a sequence of:
+ * - a byte 0 - 31, the number of literal bytes that follow minus one
+ * - a match of earlier text: a byte with the length minus two in the upper
+ *   three bits, when 7 another byte follows to add to the length, and the
+ *   upper five bits of the offset minus one in the lower bits, followed by
+ *   a byte with the lower eight bits of the offset minus one.
+ * Returns the compressed size, zero when it doesn't fit in "maxlen".
+ */
+    static unsigned
+mf_zip_compress(char_u *src, unsigned len, char_u *dst, unsigned maxlen)
+{
+    /* Position of three bytes at the hash of them.  Not cleared, an entry
+     * from a previous block is checked like any other. */
+    static unsigned htab[1 << MF_ZIP_HASH_BITS];
+    unsigned	ip = 0;		/* next byte to compress */
+    unsigned	lit = 0;	/* start of literal bytes */
+    unsigned	op = 0;		/* next byte to produce */
+    unsigned	h;
+    unsigned	ref;
+    unsigned	off;
+    unsigned	mlen;
+    unsigned	maxm;
+    unsigned	n;
+
+    for (;;)
+    {
+	if (ip + 2 < len)
+	{
+	    h = ((unsigned)src[ip] << 16) | ((unsigned)src[ip + 1] << 8)
+							      | src[ip + 2];
+	    h = ((h * 2654435761U) >> (32 - MF_ZIP_HASH_BITS))
+					    & ((1 << MF_ZIP_HASH_BITS) - 1);
+	    ref = htab[h];
+	    htab[h] = ip;
+	    if (ref >= ip || ip - ref > MF_ZIP_MAX_OFF
+		    || src[ref] != src[ip] || src[ref + 1] != src[ip + 1]
+		    || src[ref + 2] != src[ip + 2])
+	    {
+		/* Skip faster over bytes that don't compress. */
+		ip += 1 + ((ip - lit) >> 5);
+		continue;
+	    }
+	}
+	else
+	{
+	    ip = len;
+	    ref = 0;
+	}
+
+	/* Output the literal bytes before the match or at the end. */
+	while (lit < ip)
+	{
+	    n = ip - lit;
+	    if (n > 32)
+		n = 32;
+	    if (op + 1 + n > maxlen)
+		return 0;
+	    dst[op++] = n - 1;
+	    mch_memmove(dst + op, src + lit, (size_t)n);
+	    op += n;
+	    lit += n;
+	}
+	if (ip == len)
+	    break;
+
+	maxm = len - ip;
+	if (maxm > MF_ZIP_MAX_LEN)
+	    maxm = MF_ZIP_MAX_LEN;
+	for (mlen = 3; mlen < maxm && src[ref + mlen] == src[ip + mlen];
+									++mlen)
+	    ;
+	if (op + 3 > maxlen)
+	    return 0;
+	off = ip - ref - 1;
+	if (mlen - 2 < 7)
+	    dst[op++] = ((mlen - 2) << 5) + (off >> 8);
+	else
+	{
+	    dst[op++] = (7 << 5) + (off >> 8);
+	    dst[op++] = mlen - 2 - 7;
+	}
+	dst[op++] = off & 0xff;
+	ip += mlen;
+	lit = ip;
+    }
+    return op;
+}
+
+/*
+ * Uncompress "len" bytes at "src", compressed with mf_zip_compress(), into
+ * "dst", which must be filled with "dstlen" bytes.
+ * Returns FAIL when the data is invalid or doesn't have the right size.
+ */
+    static int
+mf_zip_expand(char_u *src, unsigned len, char_u *dst, unsigned dstlen)
+{
+    unsigned	ip = 0;
+    unsigned	op = 0;
+    unsigned	c;
+    unsigned	n;
+    unsigned	off;
+
+    while (ip < len)
+    {
+	c = src[ip++];
+	if (c < 32)
+	{
+	    n = c + 1;
+	    if (ip + n > len || op + n > dstlen)
+		return FAIL;
+	    mch_memmove(dst + op, src + ip, (size_t)n);
+	    ip += n;
+	    op += n;
+	}
+	else
+	{
+	    n = c >> 5;
+	    if (n == 7)
+	    {
+		if (ip >= len)
+		    return FAIL;
+		n += src[ip++];
+	    }
+	    n += 2;
+	    if (ip >= len)
+		return FAIL;
+	    off = ((c & 31) << 8) + src[ip++] + 1;
+	    if (off > op || op + n > dstlen)
+		return FAIL;
+	    if (off == 1)
+		vim_memset(dst + op, dst[op - 1], (size_t)n);
+	    else if (off >= n)
+		mch_memmove(dst + op, dst + op - off, (size_t)n);
+	    else
+	    {
+		unsigned    i;
+
+		/* Copy byte by byte, the match overlaps. */
+		for (i = 0; i < n; ++i)
+		    dst[op + i] = dst[op + i - off];
+	    }
+	    op += n;
+	}
+    }
+    return op == dstlen ? OK : FAIL;
+}
+
+/*
+ * Remember "digest[MF_DIGEST_LEN]" for block "nr".  It must be computed from
+ * the contents of the block, the memfile doesn't know how.
+ * Fails silently when out of memory, the digest is computed again next time.
+ */
+    void
+mf_set_digest(memfile_T *mfp, blocknr_T nr, UINT32_T *digest)
+{
+    NR_DIGEST	*ndp;
+
+    ndp = (NR_DIGEST *)mf_hash_find(&mfp->mf_digest, nr);
+    if (ndp == NULL)
+    {
+	ndp = (NR_DIGEST *)alloc((unsigned)sizeof(NR_DIGEST));
+	if (ndp == NULL)
+	    return;
+	ndp->nd_bnum = nr;
+	mf_hash_add_item(&mfp->mf_digest, (mf_hashitem_T *)ndp);
+    }
+    mch_memmove(ndp->nd_digest, digest, sizeof(ndp->nd_digest));
+}
+
+/*
+ * Get the digest stored with mf_set_digest() for block "nr" into
+ * "digest[MF_DIGEST_LEN]".
+ * Returns FAIL when there is none or the block was changed since then.
+ */
+    int
+mf_get_digest(memfile_T *mfp, blocknr_T nr, UINT32_T *digest)
+{
+    NR_DIGEST	*ndp;
+
+    if (mfp->mf_digest.mht_count == 0)
+	return FAIL;
+    ndp = (NR_DIGEST *)mf_hash_find(&mfp->mf_digest, nr);
+    if (ndp == NULL)
+	return FAIL;
+    mch_memmove(digest, ndp->nd_digest, sizeof(ndp->nd_digest));
+    return OK;
+}
+
+/*
+ * Forget the digest of block "nr", if there is one.  Used when the block was
+ * changed or freed.
+ */
+    static void
+mf_digest_forget(memfile_T *mfp, blocknr_T nr)
+{
+    NR_DIGEST	*ndp;
+
+    if (mfp->mf_digest.mht_count == 0)
+	return;
+    ndp = (NR_DIGEST *)mf_hash_find(&mfp->mf_digest, nr);
+    if (ndp != NULL)
+    {
+	mf_hash_rem_item(&mfp->mf_digest, (mf_hashitem_T *)ndp);
+	vim_free(ndp);
+    }
+}
+
 /*
  * Set mfp->mf_ffname according to mfp->mf_fname and some other things.
  * Only called when creating or renaming the swapfile.	Either way it's a new
@@ -1316,7 +2246,7 @@ mf_do_open(
  * MHT_GROWTH_FACTOR when the average number of items per bucket
  * exceeds 2 ^ MHT_LOG_LOAD_FACTOR.
  */
-#define MHT_LOG_LOAD_FACTOR 6
+#define MHT_LOG_LOAD_FACTOR 1
 #define MHT_GROWTH_FACTOR   2   /* must be a power of two */
 
 /*
@@ -1500,3 +2430,159 @@ mf_hash_grow(mf_hashtab_T *mht)
 
     return OK;
 }
+
+#ifdef FEAT_SWAP_THREAD
+/*
+ * Start the writer thread, if it's not running yet.
+ * Return FAIL when it can't be started.
+ */
+    static int
+mf_writer_start(void)
+{
+    pthread_t	    thread;
+    pthread_attr_t  attr;
+
+    if (!mf_wr_started && pthread_attr_init(&attr) == 0)
+    {
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, mf_writer, NULL) == 0)
+	    mf_wr_started = TRUE;
+	pthread_attr_destroy(&attr);
+    }
+    return mf_wr_started ? OK : FAIL;
+}
+
+/*
+ * Add a request for the writer thread to the queue: write "size" bytes of
+ * "data" at "offset" in the swap file of "mfp", or sync it, depending on
+ * "how".  A block that is still in the queue is overwritten with the new
+ * text.
+ * Return FAIL when out of memory.
+ */
+    static int
+mf_async_write(
+    memfile_T	*mfp,
+    char_u	*data,
+    off_T	offset,
+    unsigned	size,
+    int		how)
+{
+    mf_wreq_T	*wr;
+    mf_wreq_T	*nwr;
+
+    /* Not alloc(), the writer thread frees it and must not use any Vim
+     * functions. */
+    nwr = (mf_wreq_T *)malloc(sizeof(mf_wreq_T) + size);
+    if (nwr == NULL)
+	return FAIL;
+    nwr->wr_next = NULL;
+    nwr->wr_mfp = mfp;
+    nwr->wr_how = how;
+    nwr->wr_offset = offset;
+    nwr->wr_size = size;
+    if (size > 0)
+	mch_memmove(nwr->wr_data, data, (size_t)size);
+
+    pthread_mutex_lock(&mf_wr_mutex);
+    for (wr = mf_wr_first; wr != NULL; wr = wr->wr_next)
+	if (wr->wr_mfp == mfp && wr->wr_how == how
+		&& (how == MF_WR_WRITE
+		    ? wr->wr_offset == offset && wr->wr_size == size
+		    : wr == mf_wr_last))
+	    break;
+    if (wr != NULL)
+    {
+	/* Writing the same block again or syncing twice in a row. */
+	if (size > 0)
+	    mch_memmove(wr->wr_data, data, (size_t)size);
+	pthread_mutex_unlock(&mf_wr_mutex);
+	free(nwr);
+	return OK;
+    }
+    if (mf_wr_last == NULL)
+	mf_wr_first = nwr;
+    else
+	mf_wr_last->wr_next = nwr;
+    mf_wr_last = nwr;
+    ++mfp->mf_async_pending;
+    pthread_cond_signal(&mf_wr_work);
+    pthread_mutex_unlock(&mf_wr_mutex);
+    return OK;
+}
+
+/*
+ * The writer thread: handle requests from the queue until Vim exits.
+ * This runs in parallel with the main thread, thus it must not use Vim
+ * functions or variables, only the request and mf_fd.  The main thread
+ * doesn't change mf_fd while there are requests for the memfile.
+ */
+    static void *
+mf_writer(void *arg UNUSED)
+{
+    mf_wreq_T	*wr;
+    sigset_t	set;
+    int		fd;
+    int		ok;
+    char_u	*p;
+    unsigned	left;
+    off_T	offset;
+    ssize_t	n;
+
+    /* Signals are handled by the main thread. */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    pthread_mutex_lock(&mf_wr_mutex);
+    for (;;)
+    {
+	while (mf_wr_first == NULL)
+	    pthread_cond_wait(&mf_wr_work, &mf_wr_mutex);
+	wr = mf_wr_first;
+	mf_wr_first = wr->wr_next;
+	if (mf_wr_first == NULL)
+	    mf_wr_last = NULL;
+	fd = wr->wr_mfp->mf_fd;
+	pthread_mutex_unlock(&mf_wr_mutex);
+
+	if (mf_wr_abandon)
+	    /* Vim is exiting, the main thread writes the blocks. */
+	    ok = TRUE;
+	else if (wr->wr_how == MF_WR_WRITE)
+	{
+	    p = wr->wr_data;
+	    left = wr->wr_size;
+	    offset = wr->wr_offset;
+	    while (left > 0)
+	    {
+		n = pwrite(fd, p, (size_t)left, offset);
+		if (n < 0 && errno == EINTR)
+		    continue;
+		if (n <= 0)
+		    break;
+		p += n;
+		left -= (unsigned)n;
+		offset += n;
+	    }
+	    ok = (left == 0);
+	}
+# ifdef HAVE_FSYNC
+	else if (wr->wr_how == MF_WR_FSYNC)
+	    ok = (fsync(fd) == 0);
+# endif
+	else
+	{
+	    sync();
+	    ok = TRUE;
+	}
+
+	pthread_mutex_lock(&mf_wr_mutex);
+	if (!ok)
+	    wr->wr_mfp->mf_async_error = TRUE;
+	--wr->wr_mfp->mf_async_pending;
+	pthread_cond_broadcast(&mf_wr_done);
+	free(wr);
+    }
+    /*NOTREACHED*/
+    return NULL;
+}
+#endif
@@ -135,9 +135,56 @@ test_mf_hash(void)
     mf_hash_free_all(&ht);
 }
 
+/*
+ * Test mf_zip_compress() and mf_zip_expand().
+ */
+    static void
+test_mf_zip(void)
+{
+    char_u	src[3 * 4096];
+    char_u	dst[3 * 4096];
+    char_u	out[3 * 4096];
+    unsigned	len;
+    unsigned	size;
+    unsigned	i;
+    long_u	r = 1;
+
+    /* text like in a data block: some random bytes, repeated words and a
+     * run of zeros */
+    for (i = 0; i < sizeof(src); ++i)
+    {
+	r = (r * 1103515245 + 12345) & 0x7fffffff;
+	if (i < 200)
+	    src[i] = (char_u)(r >> 16);
+	else if (i < 2000)
+	    src[i] = 0;
+	else if (i % 50 == 0)
+	    src[i] = '0' + (r >> 16) % 10;
+	else
+	    src[i] = "line of text "[i % 13];
+    }
+
+    for (len = 0; len <= sizeof(src); len += len < 40 ? 1 : 997)
+    {
+	size = mf_zip_compress(src, len, dst, sizeof(dst));
+	assert(size > 0 || len == 0);
+	assert(mf_zip_expand(dst, size, out, len) == OK);
+	assert(memcmp(src, out, len) == 0);
+	if (len > 0)
+	    /* wrong size fails */
+	    assert(mf_zip_expand(dst, size, out, len - 1) == FAIL);
+    }
+
+    /* compressed text is much smaller, random bytes don't fit */
+    size = mf_zip_compress(src, sizeof(src), dst, sizeof(dst));
+    assert(size < sizeof(src) / 3);
+    assert(mf_zip_compress(src, 200, dst, 150) == 0);
+}
+
     int
 main(void)
 {
     test_mf_hash();
+    test_mf_zip();
     return 0;
 }
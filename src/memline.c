@@ -248,7 +248,9 @@ static void add_b0_fenc(ZERO_BL *b0p, buf_T *buf);
 static time_t swapfile_info(char_u *);
 static int recov_file_names(char_u **, char_u *, int prepend_dot);
 static int ml_append_int(buf_T *, linenr_T, char_u *, colnr_T, int, int);
-static int ml_delete_int(buf_T *, linenr_T, int);
+static long ml_append_fill(buf_T *, linenr_T, char_u **, long);
+static int ml_delete_int(buf_T *, linenr_T, long, int);
+static long ml_delete_block(buf_T *, linenr_T, long);
 static char_u *findswapname(buf_T *, char_u **, char_u *);
 static void ml_flush_line(buf_T *);
 static bhdr_T *ml_new_data(memfile_T *, int, int);
@@ -256,6 +258,21 @@ static bhdr_T *ml_new_ptr(memfile_T *);
 static bhdr_T *ml_find_line(buf_T *, linenr_T, int);
 static int ml_add_stack(buf_T *);
 static void ml_lineadd(buf_T *, int);
+static void ml_cache_add(buf_T *buf, bhdr_T *hp);
+static void ml_cache_clear(buf_T *buf);
+#ifdef UNIX
+static void ml_backing_flush(buf_T *buf);
+#endif
+static long_u ml_backing_sum(char_u *data);
+static int ml_backing_line(DATA_BL *dp, char_u *p, long len);
+#ifdef FEAT_PERSISTENT_UNDO
+static UINT32_T ml_digest_mod(UINT32_T x);
+static UINT32_T ml_digest_mul(UINT32_T a, UINT32_T b);
+static void ml_digest_init(UINT32_T *digest);
+static void ml_digest_append(UINT32_T *digest, UINT32_T *part);
+static void ml_digest_block(DATA_BL *dp, UINT32_T *digest);
+static int ml_digest_tree(buf_T *buf, blocknr_T bnum, int page_count, UINT32_T *digest);
+#endif
 static int b0_magic_wrong(ZERO_BL *);
 #ifdef CHECK_INODE
 static int fnamecmp_ino(char_u *, char_u *, long);
@@ -269,7 +286,10 @@ static char_u *make_percent_swname(char_u *dir, char_u *name);
 static cryptstate_T *ml_crypt_prepare(memfile_T *mfp, off_T offset, int reading);
 #endif
 #ifdef FEAT_BYTEOFF
-static void ml_updatechunk(buf_T *buf, long line, long len, int updtype);
+static void ml_updatechunk(buf_T *buf, long line, long len, int updtype, long count);
+static void ml_chunk_add(buf_T *buf, int ix, int lines, long size);
+static void ml_chunk_invalidate(buf_T *buf);
+static int ml_chunk_find(buf_T *buf, linenr_T lnum, long offset, int ffdos, linenr_T *linep, long *sizep);
 #endif
 
 /*
@@ -293,9 +313,15 @@ ml_open(buf_T *buf)
     buf->b_ml.ml_stack = NULL;	/* no stack yet */
     buf->b_ml.ml_stack_top = 0;	/* nothing in the stack */
     buf->b_ml.ml_locked = NULL;	/* no cached block */
+    buf->b_ml.ml_cache = NULL;
+    buf->b_ml.ml_cache_hits = 0;
+    buf->b_ml.ml_cache_misses = 0;
     buf->b_ml.ml_line_lnum = 0;	/* no cached line */
+    buf->b_ml.ml_backing_bnum = 0;	/* not reading the file */
+    buf->b_ml.ml_backing_next = -1;
 #ifdef FEAT_BYTEOFF
     buf->b_ml.ml_chunksize = NULL;
+    buf->b_ml.ml_chunktree = NULL;
 #endif
 
     if (cmdmod.noswapfile)
@@ -686,6 +712,7 @@ ml_setname(buf_T *buf)
 	/* need to close the swap file before renaming */
 	if (mfp->mf_fd >= 0)
 	{
+	    mf_sync_wait(mfp);
 	    close(mfp->mf_fd);
 	    mfp->mf_fd = -1;
 	}
@@ -806,6 +833,9 @@ ml_open_file(buf_T *buf)
 		 * Needed for when the 'swapfile' option was reset, so that
 		 * the swap file was deleted, and then on again. */
 		mf_set_dirty(mfp);
+		/* Text can't be read back from the original file anymore, the
+		 * swap file is used instead. */
+		mf_backing_clear(mfp);
 		break;
 	    }
 	    /* Writing block 0 failed: close the file and try another dir */
@@ -847,13 +877,20 @@ ml_close(buf_T *buf, int del_file)
 {
     if (buf->b_ml.ml_mfp == NULL)		/* not open */
 	return;
+#ifdef FEAT_ASYNC_WRITE
+    if (buf->b_write_async != NULL)
+	write_async_wait(buf, FALSE);
+#endif
     mf_close(buf->b_ml.ml_mfp, del_file);	/* close the .swp file */
     if (buf->b_ml.ml_line_lnum != 0 && (buf->b_ml.ml_flags & ML_LINE_DIRTY))
 	vim_free(buf->b_ml.ml_line_ptr);
     vim_free(buf->b_ml.ml_stack);
+    vim_free(buf->b_ml.ml_cache);	/* blocks were freed by mf_close() */
+    buf->b_ml.ml_cache = NULL;
 #ifdef FEAT_BYTEOFF
     vim_free(buf->b_ml.ml_chunksize);
     buf->b_ml.ml_chunksize = NULL;
+    ml_chunk_invalidate(buf);
 #endif
     buf->b_ml.ml_mfp = NULL;
 
@@ -2290,6 +2327,10 @@ ml_sync_all(int check_file, int check_char)
 		need_check_timestamps = TRUE;	/* give message later */
 	    }
 	}
+	/* When preserving files on a deadly signal the blocks the writer
+	 * thread may not have written yet are made dirty. */
+	if (really_exiting)
+	    mf_sync_wait(buf->b_ml.ml_mfp);
 	if (buf->b_ml.ml_mfp->mf_dirty)
 	{
 	    (void)mf_sync(buf->b_ml.ml_mfp, (check_char ? MFS_STOP : 0)
@@ -2465,6 +2506,18 @@ errorret:
     if (buf->b_ml.ml_mfp == NULL)	/* there are no lines */
 	return (char_u *)"";
 
+#ifdef FEAT_ASYNC_WRITE
+    /* The text is changed in place, the file being written must get the
+     * text from before the change.  Flush another changed line first, it
+     * may move lines. */
+    if (will_change && buf->b_write_async != NULL)
+    {
+	if (buf->b_ml.ml_line_lnum != lnum)
+	    ml_flush_line(buf);
+	write_async_change(buf, lnum, (linenr_T)1, 0L);
+    }
+#endif
+
     /*
      * See if it is the same line as requested last time.
      * Otherwise may need to flush last used line.
@@ -2516,6 +2569,42 @@ ml_line_alloced(void)
     return (curbuf->b_ml.ml_flags & ML_LINE_DIRTY);
 }
 
+/*
+ * Get pointers to the text of line "lnum" and the lines after it in the same
+ * data block of "buf", at most "max" lines, in "ptrs[]".  Avoids looking up
+ * every line when going through many lines, e.g. for writing them.
+ * The pointers are only valid until another line of "buf" is obtained or
+ * changed.
+ * Returns the number of lines, zero for an error.
+ */
+    int
+ml_get_buf_lines(
+    buf_T	*buf,
+    linenr_T	lnum,
+    int		max,
+    char_u	**ptrs)
+{
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    int		idx;
+    int		n;
+
+    if (lnum < 1 || lnum > buf->b_ml.ml_line_count
+						  || buf->b_ml.ml_mfp == NULL)
+	return 0;
+
+    /* Put a changed line back in its block, then lock the block. */
+    ml_flush_line(buf);
+    if ((hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+	return 0;
+
+    dp = (DATA_BL *)(hp->bh_data);
+    idx = lnum - buf->b_ml.ml_locked_low;
+    for (n = 0; n < max && lnum + n <= buf->b_ml.ml_locked_high; ++n)
+	ptrs[n] = (char_u *)dp + (dp->db_index[idx + n] & DB_INDEX_MASK);
+    return n;
+}
+
 /*
  * Append a line after lnum (may be 0 to insert a line in front of the file).
  * "line" does not need to be allocated, but can't be another line in a
@@ -2567,6 +2656,149 @@ ml_append_buf(
 }
 #endif
 
+/*
+ * Append "count" lines from "lines" after lnum (may be 0 to insert in front of
+ * the file) in the current buffer.  The lines do not need to be allocated.
+ * As many lines as fit are put in a data block at once, thus appending many
+ * lines does not move the text in the block for every line.
+ * Check: The caller of this function should probably also call
+ * appended_lines().
+ *
+ * return FAIL for failure, OK otherwise
+ */
+    int
+ml_append_range(
+    linenr_T	lnum,		/* append after this line (can be 0) */
+    char_u	**lines,	/* text of the new lines */
+    long	count)		/* number of lines */
+{
+    long	done = 0;
+
+    /* When starting up, we might still need to create the memfile */
+    if (curbuf->b_ml.ml_mfp == NULL && open_buffer(FALSE, NULL, 0) == FAIL)
+	return FAIL;
+
+    if (curbuf->b_ml.ml_line_lnum != 0)
+	ml_flush_line(curbuf);
+    while (done < count)
+    {
+	/* Append one line the normal way, this splits the data block when
+	 * needed, then fill up the block it ended up in. */
+	if (ml_append_int(curbuf, lnum + done, lines[done], (colnr_T)0,
+							FALSE, FALSE) == FAIL)
+	    return FAIL;
+	++done;
+	done += ml_append_fill(curbuf, lnum + done, lines + done,
+								count - done);
+    }
+    return OK;
+}
+
+/*
+ * Insert as many of the "count" lines in "lines" after line "lnum" as fit in
+ * the data block that contains "lnum".
+ * Returns the number of lines inserted.
+ */
+    static long
+ml_append_fill(
+    buf_T	*buf,
+    linenr_T	lnum,
+    char_u	**lines,
+    long	count)
+{
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    int		line_count;	/* number of indexes in current block */
+    int		db_idx;		/* index for lnum in data block */
+    int		offset;
+    long	len;
+    long	total = 0;
+    long	n;
+    int		i;
+
+    if (count <= 0 || lnum < 1)
+	return 0;
+    if ((hp = ml_find_line(buf, lnum, ML_FIND)) == NULL)
+	return 0;
+    dp = (DATA_BL *)(hp->bh_data);
+    db_idx = lnum - buf->b_ml.ml_locked_low;
+    line_count = buf->b_ml.ml_locked_high - buf->b_ml.ml_locked_low + 1;
+
+    /* Find out how many lines fit in the free space. */
+    for (n = 0; n < count; ++n)
+    {
+	len = (long)STRLEN(lines[n]) + 1;
+	if (total + len + (n + 1) * INDEX_SIZE > (long)dp->db_free)
+	    break;
+	total += len;
+    }
+    if (n == 0)
+	return 0;
+
+#ifdef FEAT_ASYNC_WRITE
+    if (buf->b_write_async != NULL)
+	write_async_change(buf, lnum + 1, (linenr_T)0, (long)n);
+#endif
+
+    if (lowest_marked && lowest_marked > lnum)
+	lowest_marked = lnum + 1;
+
+    /*
+     * Move the text of the lines that follow to the front and adjust their
+     * indexes, then copy the new lines in the gap.
+     */
+    offset = ((dp->db_index[db_idx]) & DB_INDEX_MASK);
+    if (line_count > db_idx + 1)
+    {
+	mch_memmove((char *)dp + dp->db_txt_start - total,
+				   (char *)dp + dp->db_txt_start,
+				   (size_t)(offset - dp->db_txt_start));
+	for (i = line_count - 1; i > db_idx; --i)
+	    dp->db_index[i + n] = dp->db_index[i] - total;
+    }
+    for (i = 0; i < n; ++i)
+    {
+	len = (long)STRLEN(lines[i]) + 1;
+	offset -= len;
+	mch_memmove((char *)dp + offset, lines[i], (size_t)len);
+	dp->db_index[db_idx + 1 + i] = offset;
+    }
+    dp->db_txt_start -= total;
+    dp->db_free -= total + n * INDEX_SIZE;
+    dp->db_line_count += n;
+
+    /* The pointer blocks are updated when the block is released.  The line
+     * numbers of other cached blocks are wrong now. */
+    if (buf->b_ml.ml_cache != NULL)
+	ml_cache_clear(buf);
+    buf->b_ml.ml_line_count += n;
+    buf->b_ml.ml_locked_high += n;
+    buf->b_ml.ml_locked_lineadd += n;
+    buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
+
+#ifdef FEAT_BYTEOFF
+    ml_updatechunk(buf, lnum + 1, total, ML_CHNK_ADDLINE, n);
+#endif
+#ifdef FEAT_NETBEANS_INTG
+    if (netbeans_active())
+	for (i = 0; i < n; ++i)
+	{
+	    len = (long)STRLEN(lines[i]);
+	    if (len > 0)
+		netbeans_inserted(buf, lnum + 1 + i, (colnr_T)0, lines[i],
+								   (int)len);
+	    netbeans_inserted(buf, lnum + 1 + i, (colnr_T)len,
+							   (char_u *)"\n", 1);
+	}
+#endif
+#ifdef FEAT_JOB_CHANNEL
+    if (buf->b_write_to_channel)
+	channel_write_new_lines(buf);
+#endif
+
+    return n;
+}
+
     static int
 ml_append_int(
     buf_T	*buf,
@@ -2594,6 +2826,12 @@ ml_append_int(
     if (lnum > buf->b_ml.ml_line_count || buf->b_ml.ml_mfp == NULL)
 	return FAIL;
 
+#ifdef FEAT_ASYNC_WRITE
+    /* The lines being written in the background move down. */
+    if (buf->b_write_async != NULL)
+	write_async_change(buf, lnum + 1, (linenr_T)0, 1L);
+#endif
+
     if (lowest_marked && lowest_marked > lnum)
 	lowest_marked = lnum + 1;
 
@@ -3051,7 +3289,7 @@ ml_append_int(
 
 #ifdef FEAT_BYTEOFF
     /* The line was inserted below 'lnum' */
-    ml_updatechunk(buf, lnum + 1, (long)len, ML_CHNK_ADDLINE);
+    ml_updatechunk(buf, lnum + 1, (long)len, ML_CHNK_ADDLINE, 1L);
 #endif
 #ifdef FEAT_NETBEANS_INTG
     if (netbeans_active())
@@ -3102,7 +3340,13 @@ ml_replace(linenr_T lnum, char_u *line, int copy)
 #endif
     if (curbuf->b_ml.ml_line_lnum != lnum)	    /* other line buffered */
 	ml_flush_line(curbuf);			    /* flush it */
-    else if (curbuf->b_ml.ml_flags & ML_LINE_DIRTY) /* same line allocated */
+#ifdef FEAT_ASYNC_WRITE
+    /* Save the text of the line for the file being written. */
+    if (curbuf->b_write_async != NULL)
+	write_async_change(curbuf, lnum, (linenr_T)1, 0L);
+#endif
+    if (curbuf->b_ml.ml_line_lnum == lnum	    /* same line allocated */
+				  && (curbuf->b_ml.ml_flags & ML_LINE_DIRTY))
 	vim_free(curbuf->b_ml.ml_line_ptr);	    /* free it */
     curbuf->b_ml.ml_line_ptr = line;
     curbuf->b_ml.ml_line_lnum = lnum;
@@ -3123,11 +3367,81 @@ ml_replace(linenr_T lnum, char_u *line, int copy)
 ml_delete(linenr_T lnum, int message)
 {
     ml_flush_line(curbuf);
-    return ml_delete_int(curbuf, lnum, message);
+    return ml_delete_int(curbuf, lnum, 1L, message);
+}
+
+/*
+ * Delete "count" lines starting at "lnum" in the current buffer.
+ * Lines in the same data block are deleted at once, a data block that
+ * becomes empty is freed without moving any text.
+ *
+ * Check: The caller of this function should probably also call
+ * deleted_lines() after this.
+ *
+ * return FAIL for failure, OK otherwise
+ */
+    int
+ml_delete_range(linenr_T lnum, long count, int message)
+{
+    ml_flush_line(curbuf);
+    return ml_delete_int(curbuf, lnum, count, message);
 }
 
     static int
-ml_delete_int(buf_T *buf, linenr_T lnum, int message)
+ml_delete_int(buf_T *buf, linenr_T lnum, long count, int message)
+{
+    long	n;
+    int		i;
+
+#ifdef FEAT_ASYNC_WRITE
+    /* Save the text of the lines for the file being written. */
+    if (buf->b_write_async != NULL)
+	write_async_change(buf, lnum, (linenr_T)count, -count);
+#endif
+
+    while (count > 0)
+    {
+	if (lnum < 1 || lnum > buf->b_ml.ml_line_count)
+	    return FAIL;
+
+	/*
+	 * If the file becomes empty the last line is replaced by an empty
+	 * line.
+	 */
+	if (buf->b_ml.ml_line_count == 1)	    /* file becomes empty */
+	{
+	    if (lowest_marked && lowest_marked > lnum)
+		lowest_marked--;
+
+	    if (message
+#ifdef FEAT_NETBEANS_INTG
+		    && !netbeansSuppressNoLines
+#endif
+	       )
+		set_keep_msg((char_u *)_(no_lines_msg), 0);
+
+	    /* FEAT_BYTEOFF already handled in there, don't worry 'bout it */
+	    i = ml_replace((linenr_T)1, (char_u *)"", TRUE);
+	    buf->b_ml.ml_flags |= ML_EMPTY;
+
+	    return i;
+	}
+
+	if ((n = ml_delete_block(buf, lnum, count)) == 0)
+	    return FAIL;
+	count -= n;
+    }
+    return OK;
+}
+
+/*
+ * Delete up to "nlines" lines starting at "lnum", as far as they are in the
+ * data block containing "lnum".  The last line of the buffer is never deleted
+ * here, see ml_delete_int().
+ * Returns the number of deleted lines, zero for failure.
+ */
+    static long
+ml_delete_block(buf_T *buf, linenr_T lnum, long nlines)
 {
     bhdr_T	*hp;
     memfile_T	*mfp;
@@ -3140,33 +3454,9 @@ ml_delete_int(buf_T *buf, linenr_T lnum, int message)
     int		text_start;
     int		line_start;
     long	line_size;
+    long	n;
     int		i;
 
-    if (lnum < 1 || lnum > buf->b_ml.ml_line_count)
-	return FAIL;
-
-    if (lowest_marked && lowest_marked > lnum)
-	lowest_marked--;
-
-/*
- * If the file becomes empty the last line is replaced by an empty line.
- */
-    if (buf->b_ml.ml_line_count == 1)	    /* file becomes empty */
-    {
-	if (message
-#ifdef FEAT_NETBEANS_INTG
-		&& !netbeansSuppressNoLines
-#endif
-	   )
-	    set_keep_msg((char_u *)_(no_lines_msg), 0);
-
-	/* FEAT_BYTEOFF already handled in there, don't worry 'bout it below */
-	i = ml_replace((linenr_T)1, (char_u *)"", TRUE);
-	buf->b_ml.ml_flags |= ML_EMPTY;
-
-	return i;
-    }
-
 /*
  * find the data block containing the line
  * This also fills the stack with the blocks from the root to the data block
@@ -3174,10 +3464,10 @@ ml_delete_int(buf_T *buf, linenr_T lnum, int message)
  */
     mfp = buf->b_ml.ml_mfp;
     if (mfp == NULL)
-	return FAIL;
+	return 0;
 
     if ((hp = ml_find_line(buf, lnum, ML_DELETE)) == NULL)
-	return FAIL;
+	return 0;
 
     dp = (DATA_BL *)(hp->bh_data);
     /* compute line count before the delete */
@@ -3185,28 +3475,56 @@ ml_delete_int(buf_T *buf, linenr_T lnum, int message)
 					- (long)(buf->b_ml.ml_locked_low) + 2;
     idx = lnum - buf->b_ml.ml_locked_low;
 
-    --buf->b_ml.ml_line_count;
+    /* Delete the following lines in this block as well.  ml_find_line()
+     * only accounted for one line. */
+    n = count - idx;
+    if (n > nlines)
+	n = nlines;
+    if (n > buf->b_ml.ml_line_count - 1)
+	n = buf->b_ml.ml_line_count - 1;
+    buf->b_ml.ml_locked_lineadd -= n - 1;
+    buf->b_ml.ml_locked_high -= n - 1;
+
+    if (lowest_marked && lowest_marked > lnum)
+	lowest_marked = lowest_marked - n > lnum ? lowest_marked - n : lnum;
+
+    buf->b_ml.ml_line_count -= n;
 
-    line_start = ((dp->db_index[idx]) & DB_INDEX_MASK);
+    line_start = ((dp->db_index[idx + n - 1]) & DB_INDEX_MASK);
     if (idx == 0)		/* first line in block, text at the end */
 	line_size = dp->db_txt_end - line_start;
     else
 	line_size = ((dp->db_index[idx - 1]) & DB_INDEX_MASK) - line_start;
 
-#ifdef FEAT_NETBEANS_INTG
-    if (netbeans_active())
-	netbeans_removed(buf, lnum, 0, (long)line_size);
+#if defined(FEAT_NETBEANS_INTG) || defined(FEAT_BYTEOFF)
+    for (i = idx; i < idx + n; ++i)
+    {
+	long	size;
+
+	if (i == 0)
+	    size = dp->db_txt_end - (dp->db_index[i] & DB_INDEX_MASK);
+	else
+	    size = (dp->db_index[i - 1] & DB_INDEX_MASK)
+					   - (dp->db_index[i] & DB_INDEX_MASK);
+# ifdef FEAT_NETBEANS_INTG
+	if (netbeans_active())
+	    netbeans_removed(buf, lnum, 0, size);
+# endif
+# ifdef FEAT_BYTEOFF
+	ml_updatechunk(buf, lnum, size, ML_CHNK_DELLINE, 1L);
+# endif
+    }
 #endif
 
 /*
- * special case: If there is only one line in the data block it becomes empty.
+ * special case: If all lines in the data block are deleted it becomes empty.
  * Then we have to remove the entry, pointing to this data block, from the
  * pointer block. If this pointer block also becomes empty, we go up another
  * block, and so on, up to the root if necessary.
  * The line counts in the pointer blocks have already been adjusted by
  * ml_find_line().
  */
-    if (count == 1)
+    if (count == n)
     {
 	mf_free(mfp, hp);	/* free the data block */
 	buf->b_ml.ml_locked = NULL;
@@ -3218,13 +3536,13 @@ ml_delete_int(buf_T *buf, linenr_T lnum, int message)
 	    ip = &(buf->b_ml.ml_stack[stack_idx]);
 	    idx = ip->ip_index;
 	    if ((hp = mf_get(mfp, ip->ip_bnum, 1)) == NULL)
-		return FAIL;
+		return 0;
 	    pp = (PTR_BL *)(hp->bh_data);   /* must be pointer block */
 	    if (pp->pb_id != PTR_ID)
 	    {
 		IEMSG(_("E317: pointer block id wrong 4"));
 		mf_put(mfp, hp, FALSE, FALSE);
-		return FAIL;
+		return 0;
 	    }
 	    count = --(pp->pb_count);
 	    if (count == 0)	    /* the pointer block becomes empty! */
@@ -3261,15 +3579,15 @@ ml_delete_int(buf_T *buf, linenr_T lnum, int message)
 		  (char *)dp + text_start, (size_t)(line_start - text_start));
 
 	/*
-	 * delete the index by moving the next indexes backwards
+	 * delete the indexes by moving the next indexes backwards
 	 * Adjust the indexes for the text movement.
 	 */
-	for (i = idx; i < count - 1; ++i)
-	    dp->db_index[i] = dp->db_index[i + 1] + line_size;
+	for (i = idx; i < count - n; ++i)
+	    dp->db_index[i] = dp->db_index[i + n] + line_size;
 
-	dp->db_free += line_size + INDEX_SIZE;
+	dp->db_free += line_size + n * INDEX_SIZE;
 	dp->db_txt_start += line_size;
-	--(dp->db_line_count);
+	dp->db_line_count -= n;
 
 	/*
 	 * mark the block dirty and make sure it is in the file (for recovery)
@@ -3277,10 +3595,7 @@ ml_delete_int(buf_T *buf, linenr_T lnum, int message)
 	buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
     }
 
-#ifdef FEAT_BYTEOFF
-    ml_updatechunk(buf, lnum, line_size, ML_CHNK_DELLINE);
-#endif
-    return OK;
+    return n;
 }
 
 /*
@@ -3477,7 +3792,7 @@ ml_flush_line(buf_T *buf)
 		buf->b_ml.ml_flags |= (ML_LOCKED_DIRTY | ML_LOCKED_POS);
 #ifdef FEAT_BYTEOFF
 		/* The else case is already covered by the insert and delete */
-		ml_updatechunk(buf, lnum, (long)extra, ML_CHNK_UPDLINE);
+		ml_updatechunk(buf, lnum, (long)extra, ML_CHNK_UPDLINE, 1L);
 #endif
 	    }
 	    else
@@ -3492,7 +3807,7 @@ ml_flush_line(buf_T *buf)
 		/* How about handling errors??? */
 		(void)ml_append_int(buf, lnum, new_line, new_len, FALSE,
 					     (dp->db_index[idx] & DB_MARKED));
-		(void)ml_delete_int(buf, lnum, FALSE);
+		(void)ml_delete_int(buf, lnum, 1L, FALSE);
 	    }
 	}
 	vim_free(new_line);
@@ -3578,6 +3893,11 @@ ml_find_line(buf_T *buf, linenr_T lnum, int action)
 
     mfp = buf->b_ml.ml_mfp;
 
+    /* Inserting or deleting lines changes the line numbers of the cached
+     * blocks, flushing may change the block numbers. */
+    if (action != ML_FIND && buf->b_ml.ml_cache != NULL)
+	ml_cache_clear(buf);
+
     /*
      * If there is a locked block check if the wanted line is in it.
      * If not, flush and release the locked block.
@@ -3603,24 +3923,72 @@ ml_find_line(buf_T *buf, linenr_T lnum, int action)
 		--(buf->b_ml.ml_locked_lineadd);
 		--(buf->b_ml.ml_locked_high);
 	    }
+	    else
+		++buf->b_ml.ml_cache_hits;
 	    return (buf->b_ml.ml_locked);
 	}
 
-	mf_put(mfp, buf->b_ml.ml_locked, buf->b_ml.ml_flags & ML_LOCKED_DIRTY,
+	hp = buf->b_ml.ml_locked;
+	mf_put(mfp, hp, buf->b_ml.ml_flags & ML_LOCKED_DIRTY,
 					    buf->b_ml.ml_flags & ML_LOCKED_POS);
 	buf->b_ml.ml_locked = NULL;
 
+	/* When only looking for a line lock the block again right away, to
+	 * keep it in the cache.  Not with mf_get(), it isn't used again. */
+	if (action == ML_FIND && !mf_dont_release)
+	    hp->bh_flags |= BH_LOCKED;
+	else
+	    hp = NULL;
+
 	/*
 	 * If lines have been added or deleted in the locked block, need to
 	 * update the line count in pointer blocks.
 	 */
 	if (buf->b_ml.ml_locked_lineadd != 0)
 	    ml_lineadd(buf, buf->b_ml.ml_locked_lineadd);
+
+	if (hp != NULL)
+	    ml_cache_add(buf, hp);
     }
 
     if (action == ML_FLUSH)	    /* nothing else to do */
 	return NULL;
 
+    /*
+     * Check if the line is in one of the cached blocks.  Then the stack is
+     * restored as if the block was found by searching the tree.
+     */
+    if (action == ML_FIND && buf->b_ml.ml_cache != NULL && !mf_dont_release)
+    {
+	mlcache_T   *mc;
+
+	for (idx = 0; idx < ML_CACHE_SIZE; ++idx)
+	{
+	    mc = &buf->b_ml.ml_cache[idx];
+	    if (mc->mc_hp != NULL && mc->mc_low <= lnum && mc->mc_high >= lnum
+			      && mc->mc_stack_top <= buf->b_ml.ml_stack_size)
+	    {
+		++buf->b_ml.ml_cache_hits;
+		hp = mc->mc_hp;
+		mc->mc_hp = NULL;
+		/* Let the memfile know the block is used again, it's already
+		 * locked. */
+		(void)mf_get(mfp, hp->bh_bnum, hp->bh_page_count);
+		mch_memmove(buf->b_ml.ml_stack, mc->mc_stack,
+			       (size_t)mc->mc_stack_top * sizeof(infoptr_T));
+		buf->b_ml.ml_stack_top = mc->mc_stack_top;
+		buf->b_ml.ml_locked = hp;
+		buf->b_ml.ml_locked_low = mc->mc_low;
+		buf->b_ml.ml_locked_high = mc->mc_high;
+		buf->b_ml.ml_locked_lineadd = 0;
+		buf->b_ml.ml_flags &= ~(ML_LOCKED_DIRTY | ML_LOCKED_POS);
+		return hp;
+	    }
+	}
+    }
+    if (action == ML_FIND)
+	++buf->b_ml.ml_cache_misses;
+
     bnum = 1;			    /* start at the root of the tree */
     page_count = 1;
     low = 1;
@@ -3757,6 +4125,83 @@ error_noblock:
     return NULL;
 }
 
+/*
+ * Add locked data block "hp", which was ml_locked, to the cache of recently
+ * used blocks.  When the cache is full the least recently used block in it
+ * is released.
+ */
+    static void
+ml_cache_add(buf_T *buf, bhdr_T *hp)
+{
+    mlcache_T	*mc;
+    mlcache_T	*oldest = NULL;
+    int		idx;
+
+    if (buf->b_ml.ml_cache == NULL)
+	buf->b_ml.ml_cache = (mlcache_T *)alloc_clear(
+			      (unsigned)(ML_CACHE_SIZE * sizeof(mlcache_T)));
+    if (buf->b_ml.ml_cache == NULL
+			       || buf->b_ml.ml_stack_top > ML_CACHE_DEPTH)
+    {
+	mf_put(buf->b_ml.ml_mfp, hp, FALSE, FALSE);
+	return;
+    }
+
+    for (idx = 0; idx < ML_CACHE_SIZE; ++idx)
+    {
+	mc = &buf->b_ml.ml_cache[idx];
+	if (mc->mc_hp == NULL)
+	{
+	    oldest = mc;
+	    break;
+	}
+	if (oldest == NULL || mc->mc_used < oldest->mc_used)
+	    oldest = mc;
+    }
+    if (oldest->mc_hp != NULL)
+	mf_put(buf->b_ml.ml_mfp, oldest->mc_hp, FALSE, FALSE);
+
+    oldest->mc_hp = hp;
+    oldest->mc_low = buf->b_ml.ml_locked_low;
+    oldest->mc_high = buf->b_ml.ml_locked_high;
+    oldest->mc_used = buf->b_ml.ml_cache_hits + buf->b_ml.ml_cache_misses;
+    oldest->mc_stack_top = buf->b_ml.ml_stack_top;
+    mch_memmove(oldest->mc_stack, buf->b_ml.ml_stack,
+			(size_t)buf->b_ml.ml_stack_top * sizeof(infoptr_T));
+}
+
+/*
+ * Release all blocks in the cache of recently used blocks.
+ */
+    static void
+ml_cache_clear(buf_T *buf)
+{
+    mlcache_T	*mc;
+    int		idx;
+
+    for (idx = 0; idx < ML_CACHE_SIZE; ++idx)
+    {
+	mc = &buf->b_ml.ml_cache[idx];
+	if (mc->mc_hp != NULL)
+	{
+	    mf_put(buf->b_ml.ml_mfp, mc->mc_hp, FALSE, FALSE);
+	    mc->mc_hp = NULL;
+	}
+    }
+}
+
+/*
+ * Get the number of times a line was found in a block that was kept in
+ * memory and the number of times the tree of blocks had to be searched, for
+ * "buf".
+ */
+    void
+ml_cache_stats(buf_T *buf, long *hits, long *misses)
+{
+    *hits = buf->b_ml.ml_cache_hits;
+    *misses = buf->b_ml.ml_cache_misses;
+}
+
 /*
  * add an entry to the info pointer stack
  *
@@ -3828,6 +4273,465 @@ ml_lineadd(buf_T *buf, int count)
     }
 }
 
+#if defined(UNIX) || defined(PROTO)
+/*
+ * Data blocks that hold the text of a file exactly as it was read can be
+ * dropped from memory and read back from the file later, see mf_backing_add().
+ * This is used for buffers that were read with 'readonly' set, to avoid
+ * writing the whole file into the swap file when it does not fit in
+ * 'maxmem'.
+ *
+ * While reading the file readfile() calls ml_backing_add() for every line,
+ * which finds out what range of bytes ends up in each data block.  The lines
+ * are appended one after another, thus each data block gets a contiguous
+ * range of bytes.  The last block is never used, it also contains the line
+ * that was in the empty buffer.
+ */
+
+/*
+ * Start remembering where the lines of "fname" end up in "buf".  "fd" is the
+ * file descriptor readfile() uses to read the file.  "dos" is TRUE when
+ * lines end in CR-NL.
+ * Returns FAIL when not possible.
+ */
+    int
+ml_backing_start(buf_T *buf, char_u *fname, int fd, int dos)
+{
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    int		orig_fd;
+    stat_T	st_read;
+    stat_T	st_orig;
+
+    if (mfp == NULL)
+	return FAIL;
+    mf_backing_clear(mfp);
+    buf->b_ml.ml_backing_bnum = 0;
+    buf->b_ml.ml_backing_next = -1;
+
+    /* Use a separate file descriptor, readfile() must not be disturbed when
+     * text is read back while reading further. */
+    orig_fd = mch_open((char *)fname, O_RDONLY | O_EXTRA, 0);
+    if (orig_fd < 0)
+	return FAIL;
+    if (mch_fstat(fd, &st_read) == -1 || mch_fstat(orig_fd, &st_orig) == -1
+	    || st_read.st_dev != st_orig.st_dev
+	    || st_read.st_ino != st_orig.st_ino)
+    {
+	/* File was renamed or replaced in the meantime. */
+	close(orig_fd);
+	return FAIL;
+    }
+# ifdef HAVE_FD_CLOEXEC
+    {
+	int fdflags = fcntl(orig_fd, F_GETFD);
+	if (fdflags >= 0 && (fdflags & FD_CLOEXEC) == 0)
+	    (void)fcntl(orig_fd, F_SETFD, fdflags | FD_CLOEXEC);
+    }
+# endif
+
+    mfp->mf_orig_fd = orig_fd;
+    mfp->mf_orig_dos = dos;
+    buf->b_ml.ml_backing_next = 0;
+    return OK;
+}
+
+/*
+ * Line "lnum" was appended to "buf" from the next "size" bytes of the file.
+ */
+    void
+ml_backing_add(buf_T *buf, linenr_T lnum, long size)
+{
+    memline_T	*ml = &buf->b_ml;
+    bhdr_T	*hp;
+
+    if (ml->ml_backing_next < 0)
+	return;
+
+    hp = ml->ml_locked;
+    if (hp == NULL || lnum < ml->ml_locked_low || lnum > ml->ml_locked_high)
+    {
+	hp = ml_find_line(buf, lnum, ML_FIND);
+	if (hp == NULL)
+	{
+	    /* Lost track, can't use the following blocks. */
+	    ml_backing_end(buf);
+	    return;
+	}
+    }
+
+    if (hp->bh_bnum != ml->ml_backing_bnum)
+    {
+	/* The previous block is complete, lines go into a new block now. */
+	ml_backing_flush(buf);
+	ml->ml_backing_bnum = hp->bh_bnum;
+	ml->ml_backing_start = ml->ml_backing_next;
+	ml->ml_backing_lines = 0;
+	ml->ml_backing_pages = hp->bh_page_count;
+    }
+    ++ml->ml_backing_lines;
+    ml->ml_backing_next += size;
+}
+
+/*
+ * Register the block that has been receiving lines with the memfile.
+ */
+    static void
+ml_backing_flush(buf_T *buf)
+{
+    memline_T	*ml = &buf->b_ml;
+
+    if (ml->ml_backing_bnum < 0 && ml->ml_backing_lines > 0)
+	mf_backing_add(ml->ml_mfp, ml->ml_backing_bnum, ml->ml_backing_start,
+		(long)(ml->ml_backing_next - ml->ml_backing_start),
+		ml->ml_backing_lines, ml->ml_backing_pages);
+}
+
+/*
+ * Stop remembering where the lines of the file end up.  Blocks that were
+ * completed can still be read back, the one receiving lines is not used.
+ */
+    void
+ml_backing_end(buf_T *buf)
+{
+    buf->b_ml.ml_backing_bnum = 0;
+    buf->b_ml.ml_backing_next = -1;
+    if (buf->b_ml.ml_mfp != NULL
+			 && buf->b_ml.ml_mfp->mf_backing.mht_count == 0)
+	mf_backing_clear(buf->b_ml.ml_mfp);
+}
+#endif
+
+/*
+ * Compute a checksum for the text in data block "data".  Used to verify that
+ * text read back from the original file is what was dropped from memory.
+ */
+    static long_u
+ml_backing_sum(char_u *data)
+{
+    DATA_BL	*dp = (DATA_BL *)data;
+    long_u	sum = (long_u)dp->db_line_count;
+    char_u	*p;
+
+    for (p = data + dp->db_txt_start; p < data + dp->db_txt_end; ++p)
+	sum = sum * 101 + *p;
+    return sum;
+}
+
+/*
+ * Called when memfile wants to drop block "hp" from memory, to be read back
+ * from the original file with ml_backing_read().
+ * Returns FAIL when the block doesn't hold the lines described by "nbp".
+ */
+    int
+ml_backing_drop(bhdr_T *hp, NR_BACKING *nbp)
+{
+    DATA_BL	*dp = (DATA_BL *)(hp->bh_data);
+
+    if (dp->db_id != DATA_ID || dp->db_line_count != nbp->nb_line_count
+				   || hp->bh_page_count != nbp->nb_page_count)
+	return FAIL;
+    nbp->nb_sum = ml_backing_sum(hp->bh_data);
+    nbp->nb_dropped = TRUE;
+    return OK;
+}
+
+/*
+ * Add line "p" of "len" bytes to data block "dp", before the lines it already
+ * has.  A NUL in the text becomes a NL.
+ * Returns FAIL when it doesn't fit.
+ */
+    static int
+ml_backing_line(DATA_BL *dp, char_u *p, long len)
+{
+    char_u	*s;
+
+    if ((long)dp->db_free < len + 1 + (long)INDEX_SIZE)
+	return FAIL;
+    dp->db_txt_start -= len + 1;
+    dp->db_free -= len + 1 + INDEX_SIZE;
+    dp->db_index[dp->db_line_count++] = dp->db_txt_start;
+    s = (char_u *)dp + dp->db_txt_start;
+    mch_memmove(s, p, (size_t)len);
+    s[len] = NUL;
+    for ( ; len > 0; --len, ++s)
+	if (*s == NUL)
+	    *s = NL;
+    return OK;
+}
+
+/*
+ * Fill data block "hp" with the text described by "nbp" from the original
+ * file.
+ * Returns FAIL when the file could not be read or was changed.  The block
+ * then gets the right number of lines, but the text is missing.
+ */
+    int
+ml_backing_read(memfile_T *mfp, bhdr_T *hp, NR_BACKING *nbp)
+{
+    DATA_BL	*dp = (DATA_BL *)(hp->bh_data);
+    char_u	*text;
+    char_u	*p;
+    char_u	*end;
+    char_u	*nl;
+    long	len;
+    int		retval = FAIL;
+
+    dp->db_id = DATA_ID;
+    dp->db_txt_start = dp->db_txt_end = hp->bh_page_count * mfp->mf_page_size;
+    dp->db_free = dp->db_txt_start - HEADER_SIZE;
+    dp->db_line_count = 0;
+
+    text = lalloc((long_u)nbp->nb_size, TRUE);
+    if (text != NULL
+	    && vim_lseek(mfp->mf_orig_fd, nbp->nb_offset, SEEK_SET)
+							     == nbp->nb_offset
+	    && read_eintr(mfp->mf_orig_fd, text, (size_t)nbp->nb_size)
+							       == nbp->nb_size)
+    {
+	/* Split the text in lines like readfile() does: the CR before a NL
+	 * is removed in DOS format.  The first line goes at the end of the
+	 * block. */
+	retval = OK;
+	end = text + nbp->nb_size;
+	for (p = text; p < end; p = nl + 1)
+	{
+	    nl = (char_u *)memchr(p, NL, (size_t)(end - p));
+	    if (nl == NULL)
+		nl = end;		/* last line without a NL */
+	    len = (long)(nl - p);
+	    if (mfp->mf_orig_dos && nl < end && len > 0 && p[len - 1] == CAR)
+		--len;
+	    if (dp->db_line_count >= nbp->nb_line_count
+				      || ml_backing_line(dp, p, len) == FAIL)
+	    {
+		retval = FAIL;
+		break;
+	    }
+	}
+	if (dp->db_line_count != nbp->nb_line_count
+			       || ml_backing_sum(hp->bh_data) != nbp->nb_sum)
+	    retval = FAIL;
+    }
+    vim_free(text);
+
+    if (retval == FAIL)
+    {
+	/* Each line used at least one byte, thus empty lines always fit. */
+	dp->db_txt_start = dp->db_txt_end;
+	dp->db_free = dp->db_txt_start - HEADER_SIZE;
+	dp->db_line_count = 0;
+	p = (char_u *)_("???LINES MISSING");
+	if (ml_backing_line(dp, p, (long)STRLEN(p)) == FAIL)
+	    (void)ml_backing_line(dp, (char_u *)"", 0L);
+	while (dp->db_line_count < nbp->nb_line_count)
+	    (void)ml_backing_line(dp, (char_u *)"", 0L);
+	EMSG(_("E948: Cannot read back text, the original file was changed"));
+    }
+    return retval;
+}
+
+#if defined(FEAT_PERSISTENT_UNDO) || defined(PROTO)
+/*
+ * The digest of the text is a polynomial hash over the lines, modulo the
+ * prime 2^31 - 1, for ML_DIGEST_BASES different bases.  Each line adds the
+ * sha256 of its text, split into one value for each base.  The digest of a
+ * sequence of lines can be computed from the digests of its parts.  Thus the
+ * digest of a data block can be kept until the block is changed, and it
+ * doesn't matter how the lines are divided over the blocks.
+ * A digest has the hash values for each base, followed by the base to the
+ * power of the number of lines.
+ */
+# define ML_DIGEST_PRIME	((UINT32_T)0x7fffffff)
+# define ML_DIGEST_BASES	(MF_DIGEST_LEN / 2)
+
+static UINT32_T ml_digest_base[ML_DIGEST_BASES] =
+			    {0x5bd1e995, 0x1b873593, 0x2c1b3c6d, 0x297a2d39};
+
+/*
+ * Return "x" modulo ML_DIGEST_PRIME.
+ */
+    static UINT32_T
+ml_digest_mod(UINT32_T x)
+{
+    x = (x & ML_DIGEST_PRIME) + (x >> 31);
+    return x >= ML_DIGEST_PRIME ? x - ML_DIGEST_PRIME : x;
+}
+
+/*
+ * Return "a" times "b" modulo ML_DIGEST_PRIME, both must be smaller than the
+ * prime.  Works with 16 bit halves, a 64 bit type may not be available.
+ */
+    static UINT32_T
+ml_digest_mul(UINT32_T a, UINT32_T b)
+{
+    UINT32_T	a1 = a >> 16;
+    UINT32_T	a0 = a & 0xffff;
+    UINT32_T	b1 = b >> 16;
+    UINT32_T	b0 = b & 0xffff;
+    UINT32_T	mid;
+    UINT32_T	r;
+
+    /* a * b = a1 * b1 * 2^32 + (a1 * b0 + a0 * b1) * 2^16 + a0 * b0
+     * and 2^31 is one modulo the prime. */
+    mid = a1 * b0 + a0 * b1;
+    r = ml_digest_mod((a1 * b1) << 1)
+		       + ml_digest_mod((mid >> 15) + ((mid & 0x7fff) << 16));
+    return ml_digest_mod(ml_digest_mod(r) + ml_digest_mod(a0 * b0));
+}
+
+/*
+ * Init "digest" to the digest of no lines.
+ */
+    static void
+ml_digest_init(UINT32_T *digest)
+{
+    int		k;
+
+    for (k = 0; k < ML_DIGEST_BASES; ++k)
+    {
+	digest[k] = 0;
+	digest[ML_DIGEST_BASES + k] = 1;
+    }
+}
+
+/*
+ * Change "digest" into the digest of its lines followed by the lines of
+ * "part".
+ */
+    static void
+ml_digest_append(UINT32_T *digest, UINT32_T *part)
+{
+    int		k;
+
+    for (k = 0; k < ML_DIGEST_BASES; ++k)
+    {
+	digest[k] = ml_digest_mod(
+		ml_digest_mul(digest[k], part[ML_DIGEST_BASES + k]) + part[k]);
+	digest[ML_DIGEST_BASES + k] = ml_digest_mul(
+		  digest[ML_DIGEST_BASES + k], part[ML_DIGEST_BASES + k]);
+    }
+}
+
+/*
+ * Compute the digest of the lines in data block "dp".
+ */
+    static void
+ml_digest_block(DATA_BL *dp, UINT32_T *digest)
+{
+    context_sha256_T	ctx;
+    char_u		sha[32];
+    char_u		*p;
+    linenr_T		i;
+    int			k;
+    UINT32_T		v;
+
+    ml_digest_init(digest);
+    for (i = 0; i < dp->db_line_count; ++i)
+    {
+	p = (char_u *)dp + (dp->db_index[i] & DB_INDEX_MASK);
+	sha256_start(&ctx);
+	sha256_update(&ctx, p, (UINT32_T)(STRLEN(p) + 1));
+	sha256_finish(&ctx, sha);
+	for (k = 0; k < ML_DIGEST_BASES; ++k)
+	{
+	    v = ((UINT32_T)sha[k * 4] << 24) + ((UINT32_T)sha[k * 4 + 1] << 16)
+			 + ((UINT32_T)sha[k * 4 + 2] << 8) + sha[k * 4 + 3];
+	    digest[k] = ml_digest_mod(
+			    ml_digest_mul(digest[k], ml_digest_base[k])
+					 + ml_digest_mod(v & ML_DIGEST_PRIME));
+	    digest[ML_DIGEST_BASES + k] = ml_digest_mul(
+			  digest[ML_DIGEST_BASES + k], ml_digest_base[k]);
+	}
+    }
+}
+
+/*
+ * Append the digest of the lines in block "bnum" and the blocks below it to
+ * "digest".  The digest of a data block is stored in the memfile, it is
+ * only computed again when the block was changed.
+ * Returns FAIL when a block can't be read.
+ */
+    static int
+ml_digest_tree(
+    buf_T	*buf,
+    blocknr_T	bnum,
+    int		page_count,
+    UINT32_T	*digest)
+{
+    memfile_T	*mfp = buf->b_ml.ml_mfp;
+    bhdr_T	*hp;
+    DATA_BL	*dp;
+    PTR_BL	*pp;
+    PTR_EN	*pe;
+    UINT32_T	part[MF_DIGEST_LEN];
+    blocknr_T	bnum2;
+    int		idx;
+    int		dirty = FALSE;
+    int		retval = OK;
+
+    if (mf_get_digest(mfp, bnum, part) == OK)
+    {
+	ml_digest_append(digest, part);
+	return OK;
+    }
+    if ((hp = mf_get(mfp, bnum, page_count)) == NULL)
+	return FAIL;
+
+    dp = (DATA_BL *)(hp->bh_data);
+    if (dp->db_id == DATA_ID)
+    {
+	ml_digest_block(dp, part);
+	mf_put(mfp, hp, FALSE, FALSE);
+	mf_set_digest(mfp, bnum, part);
+	ml_digest_append(digest, part);
+	return OK;
+    }
+
+    pp = (PTR_BL *)(dp);
+    if (pp->pb_id != PTR_ID)
+	retval = FAIL;
+    for (idx = 0; retval == OK && idx < (int)pp->pb_count; ++idx)
+    {
+	pe = &pp->pb_pointer[idx];
+
+	/* a negative block number may have been changed */
+	if (pe->pe_bnum < 0)
+	{
+	    bnum2 = mf_trans_del(mfp, pe->pe_bnum);
+	    if (pe->pe_bnum != bnum2)
+	    {
+		pe->pe_bnum = bnum2;
+		dirty = TRUE;
+	    }
+	}
+	retval = ml_digest_tree(buf, pe->pe_bnum, pe->pe_page_count, digest);
+    }
+    mf_put(mfp, hp, dirty, FALSE);
+    return retval;
+}
+
+/*
+ * Compute the digest of the text of buffer "buf" into
+ * "digest[MF_DIGEST_LEN]", see above.  Only the data blocks that were
+ * changed since the last time are read.
+ * Returns FAIL when a block can't be read.
+ */
+    int
+ml_digest(buf_T *buf, UINT32_T *digest)
+{
+    ml_digest_init(digest);
+    if (buf->b_ml.ml_mfp == NULL)
+	return FAIL;
+
+    /* Put the changed line in its block and release the locked block, that
+     * makes the memfile forget the digest of changed blocks. */
+    ml_flush_line(buf);
+    (void)ml_find_line(buf, (linenr_T)0, ML_FLUSH);
+
+    return ml_digest_tree(buf, (blocknr_T)1, 1, digest);
+}
+#endif
+
 #if defined(HAVE_READLINK) || defined(PROTO)
 /*
  * Resolve a symlink in the last component of a file name.
@@ -4910,10 +5814,118 @@ ml_crypt_prepare(memfile_T *mfp, off_T offset, int reading)
 #define MLCS_MAXL 800	/* max no of lines in chunk */
 #define MLCS_MINL 400   /* should be half of MLCS_MAXL */
 
+/*
+ * Besides the size of each chunk in ml_chunksize[], a Fenwick tree of their
+ * sums is kept in ml_chunktree[], so that finding the chunk for a line or
+ * byte offset and the size of the chunks before it takes O(log n) steps.
+ * ml_chunktree[i] holds the sum of the chunks i - (i & -i) up to i - 1.
+ * When chunks are inserted or removed the tree is freed, it is computed
+ * again the next time it is used.
+ */
+
+/*
+ * Add "lines" and "size" to chunk "ix".
+ */
+    static void
+ml_chunk_add(buf_T *buf, int ix, int lines, long size)
+{
+    chunksize_T	*tree = buf->b_ml.ml_chunktree;
+    int		i;
+
+    buf->b_ml.ml_chunksize[ix].mlcs_numlines += lines;
+    buf->b_ml.ml_chunksize[ix].mlcs_totalsize += size;
+    if (tree != NULL)
+	for (i = ix + 1; i <= buf->b_ml.ml_usedchunks; i += i & -i)
+	{
+	    tree[i].mlcs_numlines += lines;
+	    tree[i].mlcs_totalsize += size;
+	}
+}
+
+/*
+ * Called when chunks were inserted or removed.
+ */
+    static void
+ml_chunk_invalidate(buf_T *buf)
+{
+    vim_free(buf->b_ml.ml_chunktree);
+    buf->b_ml.ml_chunktree = NULL;
+}
+
+/*
+ * Find the chunk containing line "lnum", or, when "lnum" is zero, the chunk
+ * containing byte "offset".  When "ffdos" is TRUE a CR is counted for every
+ * line.  The last chunk is used when beyond the end.
+ * Sets "*linep" to the first line of the chunk and "*sizep" to the number of
+ * bytes in the chunks before it, not counting the CRs.
+ * Returns the index of the chunk, -1 when out of memory.
+ */
+    static int
+ml_chunk_find(
+    buf_T	*buf,
+    linenr_T	lnum,
+    long	offset,
+    int		ffdos,
+    linenr_T	*linep,
+    long	*sizep)
+{
+    chunksize_T	*tree = buf->b_ml.ml_chunktree;
+    int		used = buf->b_ml.ml_usedchunks;
+    int		ix;
+    int		i;
+    int		step;
+    linenr_T	line = 0;
+    long	size = 0;
+
+    if (tree == NULL)
+    {
+	tree = (chunksize_T *)alloc((unsigned)sizeof(chunksize_T)
+								* (used + 1));
+	if (tree == NULL)
+	    return -1;
+	for (ix = 1; ix <= used; ++ix)
+	    tree[ix] = buf->b_ml.ml_chunksize[ix - 1];
+	for (ix = 1; ix <= used; ++ix)
+	{
+	    i = ix + (ix & -ix);
+	    if (i <= used)
+	    {
+		tree[i].mlcs_numlines += tree[ix].mlcs_numlines;
+		tree[i].mlcs_totalsize += tree[ix].mlcs_totalsize;
+	    }
+	}
+	buf->b_ml.ml_chunktree = tree;
+    }
+
+    /* Skip over the largest number of chunks that end before the line or
+     * offset, but never skip the last chunk. */
+    for (step = 1; step * 2 <= used; step *= 2)
+	;
+    for (ix = 0; step > 0; step /= 2)
+    {
+	i = ix + step;
+	if (i >= used)
+	    continue;
+	if (lnum != 0 ? line + tree[i].mlcs_numlines < lnum
+		: size + tree[i].mlcs_totalsize
+		     + (ffdos ? line + tree[i].mlcs_numlines : 0) < offset)
+	{
+	    ix = i;
+	    line += tree[i].mlcs_numlines;
+	    size += tree[i].mlcs_totalsize;
+	}
+    }
+    *linep = line + 1;
+    *sizep = size;
+    return ix;
+}
+
 /*
  * Keep information for finding byte offset of a line, updtype may be one of:
  * ML_CHNK_ADDLINE: Add len to parent chunk, possibly splitting it
  *	   Careful: ML_CHNK_ADDLINE may cause ml_find_line() to be called.
+ *	   "linecount" lines were added starting at "line", "len" is their
+ *	   total size.  "linecount" must be 1 for the other types.
  * ML_CHNK_DELLINE: Subtract len from parent chunk, possibly deleting it
  * ML_CHNK_UPDLINE: Add len to parent chunk, as a signed entity.
  */
@@ -4922,7 +5934,8 @@ ml_updatechunk(
     buf_T	*buf,
     linenr_T	line,
     long	len,
-    int		updtype)
+    int		updtype,
+    long	linecount)
 {
     static buf_T	*ml_upd_lastbuf = NULL;
     static linenr_T	ml_upd_lastline;
@@ -4952,6 +5965,7 @@ ml_updatechunk(
 	buf->b_ml.ml_usedchunks = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize = 1;
+	ml_chunk_invalidate(buf);
     }
 
     if (updtype == ML_CHNK_UPDLINE && buf->b_ml.ml_line_count == 1)
@@ -4959,6 +5973,7 @@ ml_updatechunk(
 	/*
 	 * First line in empty buffer from ml_flush_line() -- reset
 	 */
+	ml_chunk_invalidate(buf);
 	buf->b_ml.ml_usedchunks = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_numlines = 1;
 	buf->b_ml.ml_chunksize[0].mlcs_totalsize =
@@ -4973,12 +5988,11 @@ ml_updatechunk(
     if (buf != ml_upd_lastbuf || line != ml_upd_lastline + 1
 	    || updtype != ML_CHNK_ADDLINE)
     {
-	for (curline = 1, curix = 0;
-	     curix < buf->b_ml.ml_usedchunks - 1
-	     && line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	     curix++)
+	curix = ml_chunk_find(buf, line, 0L, FALSE, &curline, &size);
+	if (curix < 0)
 	{
-	    curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
+	    buf->b_ml.ml_usedchunks = -1;
+	    return;
 	}
     }
     else if (line >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines
@@ -4988,21 +6002,26 @@ ml_updatechunk(
 	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
 	curix++;
     }
+    if (updtype == ML_CHNK_ADDLINE)
+	ml_chunk_add(buf, curix, (int)linecount, len);
+    else if (updtype == ML_CHNK_DELLINE)
+	ml_chunk_add(buf, curix, -1, -len);
+    else
+	ml_chunk_add(buf, curix, 0, len);
     curchnk = buf->b_ml.ml_chunksize + curix;
 
-    if (updtype == ML_CHNK_DELLINE)
-	len = -len;
-    curchnk->mlcs_totalsize += len;
     if (updtype == ML_CHNK_ADDLINE)
     {
-	curchnk->mlcs_numlines++;
 
-	/* May resize here so we don't have to do it in both cases below */
-	if (buf->b_ml.ml_usedchunks + 1 >= buf->b_ml.ml_numchunks)
+	/* May resize here so we don't have to do it in both cases below.
+	 * Each split adds a chunk, adding many lines may need many splits. */
+	if (buf->b_ml.ml_usedchunks + 1 + linecount / MLCS_MINL
+						     >= buf->b_ml.ml_numchunks)
 	{
 	    chunksize_T *t_chunksize = buf->b_ml.ml_chunksize;
 
-	    buf->b_ml.ml_numchunks = buf->b_ml.ml_numchunks * 3 / 2;
+	    buf->b_ml.ml_numchunks = (buf->b_ml.ml_usedchunks + 1
+					 + linecount / MLCS_MINL) * 3 / 2;
 	    buf->b_ml.ml_chunksize = (chunksize_T *)
 		vim_realloc(buf->b_ml.ml_chunksize,
 			    sizeof(chunksize_T) * buf->b_ml.ml_numchunks);
@@ -5017,68 +6036,80 @@ ml_updatechunk(
 
 	if (buf->b_ml.ml_chunksize[curix].mlcs_numlines >= MLCS_MAXL)
 	{
-	    int	    count;	    /* number of entries in block */
-	    int	    idx;
-	    int	    text_end;
-	    int	    linecnt;
-
-	    mch_memmove(buf->b_ml.ml_chunksize + curix + 1,
+	    int		count;	    /* number of entries in block */
+	    int		idx;
+	    int		text_end;
+	    int		linecnt;
+	    linenr_T	startline;
+
+	    /* Split off chunks of MLCS_MINL lines until the rest is small
+	     * enough. */
+	    ml_chunk_invalidate(buf);
+	    do
+	    {
+		mch_memmove(buf->b_ml.ml_chunksize + curix + 1,
 			buf->b_ml.ml_chunksize + curix,
 			(buf->b_ml.ml_usedchunks - curix) *
 			sizeof(chunksize_T));
-	    /* Compute length of first half of lines in the split chunk */
-	    size = 0;
-	    linecnt = 0;
-	    while (curline < buf->b_ml.ml_line_count
+		/* Compute length of first half of lines in the split chunk */
+		startline = curline;
+		size = 0;
+		linecnt = 0;
+		while (curline < buf->b_ml.ml_line_count
 			&& linecnt < MLCS_MINL)
-	    {
-		if ((hp = ml_find_line(buf, curline, ML_FIND)) == NULL)
 		{
-		    buf->b_ml.ml_usedchunks = -1;
-		    return;
-		}
-		dp = (DATA_BL *)(hp->bh_data);
-		count = (long)(buf->b_ml.ml_locked_high) -
-			(long)(buf->b_ml.ml_locked_low) + 1;
-		idx = curline - buf->b_ml.ml_locked_low;
-		curline = buf->b_ml.ml_locked_high + 1;
-		if (idx == 0)/* first line in block, text at the end */
-		    text_end = dp->db_txt_end;
-		else
-		    text_end = ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
-		/* Compute index of last line to use in this MEMLINE */
-		rest = count - idx;
-		if (linecnt + rest > MLCS_MINL)
-		{
-		    idx += MLCS_MINL - linecnt - 1;
-		    linecnt = MLCS_MINL;
-		}
-		else
-		{
-		    idx = count - 1;
-		    linecnt += rest;
+		    if ((hp = ml_find_line(buf, curline, ML_FIND)) == NULL)
+		    {
+			buf->b_ml.ml_usedchunks = -1;
+			return;
+		    }
+		    dp = (DATA_BL *)(hp->bh_data);
+		    count = (long)(buf->b_ml.ml_locked_high) -
+			    (long)(buf->b_ml.ml_locked_low) + 1;
+		    idx = curline - buf->b_ml.ml_locked_low;
+		    curline = buf->b_ml.ml_locked_high + 1;
+		    if (idx == 0)/* first line in block, text at the end */
+			text_end = dp->db_txt_end;
+		    else
+			text_end = ((dp->db_index[idx - 1]) & DB_INDEX_MASK);
+		    /* Compute index of last line to use in this MEMLINE */
+		    rest = count - idx;
+		    if (linecnt + rest > MLCS_MINL)
+		    {
+			idx += MLCS_MINL - linecnt - 1;
+			linecnt = MLCS_MINL;
+		    }
+		    else
+		    {
+			idx = count - 1;
+			linecnt += rest;
+		    }
+		    size += text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
 		}
-		size += text_end - ((dp->db_index[idx]) & DB_INDEX_MASK);
-	    }
-	    buf->b_ml.ml_chunksize[curix].mlcs_numlines = linecnt;
-	    buf->b_ml.ml_chunksize[curix + 1].mlcs_numlines -= linecnt;
-	    buf->b_ml.ml_chunksize[curix].mlcs_totalsize = size;
-	    buf->b_ml.ml_chunksize[curix + 1].mlcs_totalsize -= size;
-	    buf->b_ml.ml_usedchunks++;
+		buf->b_ml.ml_chunksize[curix].mlcs_numlines = linecnt;
+		buf->b_ml.ml_chunksize[curix + 1].mlcs_numlines -= linecnt;
+		buf->b_ml.ml_chunksize[curix].mlcs_totalsize = size;
+		buf->b_ml.ml_chunksize[curix + 1].mlcs_totalsize -= size;
+		buf->b_ml.ml_usedchunks++;
+		curline = startline + linecnt;
+		++curix;
+	    } while (linecnt == MLCS_MINL
+		    && buf->b_ml.ml_chunksize[curix].mlcs_numlines >= MLCS_MAXL);
 	    ml_upd_lastbuf = NULL;   /* Force recalc of curix & curline */
 	    return;
 	}
 	else if (buf->b_ml.ml_chunksize[curix].mlcs_numlines >= MLCS_MINL
 		     && curix == buf->b_ml.ml_usedchunks - 1
-		     && buf->b_ml.ml_line_count - line <= 1)
+		     && buf->b_ml.ml_line_count - (line + linecount - 1) <= 1)
 	{
 	    /*
 	     * We are in the last chunk and it is cheap to crate a new one
 	     * after this. Do it now to avoid the loop above later on
 	     */
+	    ml_chunk_invalidate(buf);
 	    curchnk = buf->b_ml.ml_chunksize + curix + 1;
 	    buf->b_ml.ml_usedchunks++;
-	    if (line == buf->b_ml.ml_line_count)
+	    if (line + linecount - 1 == buf->b_ml.ml_line_count)
 	    {
 		curchnk->mlcs_numlines = 0;
 		curchnk->mlcs_totalsize = 0;
@@ -5111,7 +6142,6 @@ ml_updatechunk(
     }
     else if (updtype == ML_CHNK_DELLINE)
     {
-	curchnk->mlcs_numlines--;
 	ml_upd_lastbuf = NULL;   /* Force recalc of curix & curline */
 	if (curix < (buf->b_ml.ml_usedchunks - 1)
 		&& (curchnk->mlcs_numlines + curchnk[1].mlcs_numlines)
@@ -5122,6 +6152,7 @@ ml_updatechunk(
 	}
 	else if (curix == 0 && curchnk->mlcs_numlines <= 0)
 	{
+	    ml_chunk_invalidate(buf);
 	    buf->b_ml.ml_usedchunks--;
 	    mch_memmove(buf->b_ml.ml_chunksize, buf->b_ml.ml_chunksize + 1,
 			buf->b_ml.ml_usedchunks * sizeof(chunksize_T));
@@ -5135,6 +6166,7 @@ ml_updatechunk(
 	}
 
 	/* Collapse chunks */
+	ml_chunk_invalidate(buf);
 	curchnk[-1].mlcs_numlines += curchnk->mlcs_numlines;
 	curchnk[-1].mlcs_totalsize += curchnk->mlcs_totalsize;
 	buf->b_ml.ml_usedchunks--;
@@ -5148,7 +6180,7 @@ ml_updatechunk(
 	return;
     }
     ml_upd_lastbuf = buf;
-    ml_upd_lastline = line;
+    ml_upd_lastline = line + linecount - 1;
     ml_upd_lastcurline = curline;
     ml_upd_lastcurix = curix;
 }
@@ -5163,7 +6195,6 @@ ml_updatechunk(
 ml_find_line_or_offset(buf_T *buf, linenr_T lnum, long *offp)
 {
     linenr_T	curline;
-    int		curix;
     long	size;
     bhdr_T	*hp;
     DATA_BL	*dp;
@@ -5191,24 +6222,13 @@ ml_find_line_or_offset(buf_T *buf, linenr_T lnum, long *offp)
     if (lnum == 0 && offset <= 0)
 	return 1;   /* Not a "find offset" and offset 0 _must_ be in line 1 */
     /*
-     * Find the last chunk before the one containing our line. Last chunk is
-     * special because it will never qualify
+     * Find the chunk containing our line or offset. Last chunk is special
+     * because the line may be beyond it.
      */
-    curline = 1;
-    curix = size = 0;
-    while (curix < buf->b_ml.ml_usedchunks - 1
-	    && ((lnum != 0
-	     && lnum >= curline + buf->b_ml.ml_chunksize[curix].mlcs_numlines)
-		|| (offset != 0
-	       && offset > size + buf->b_ml.ml_chunksize[curix].mlcs_totalsize
-		      + ffdos * buf->b_ml.ml_chunksize[curix].mlcs_numlines)))
-    {
-	curline += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	size += buf->b_ml.ml_chunksize[curix].mlcs_totalsize;
-	if (offset && ffdos)
-	    size += buf->b_ml.ml_chunksize[curix].mlcs_numlines;
-	curix++;
-    }
+    if (ml_chunk_find(buf, lnum, offset, ffdos, &curline, &size) < 0)
+	return -1;
+    if (lnum == 0 && ffdos)
+	size += curline - 1;
 
     while ((lnum != 0 && curline < lnum) || (offset != 0 && size < offset))
     {
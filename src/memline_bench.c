@@ -0,0 +1,375 @@
+/* vi:set ts=8 sts=4 sw=4 noet:
+ *
+ * VIM - Vi IMproved	by Bram Moolenaar
+ *
+ * Do ":help uganda"  in Vim to read copying and usage conditions.
+ * Do ":help credits" in Vim to see a list of people who contributed.
+ * See README.txt for an overview of the Vim source code.
+ */
+
+/*
+ * memline_bench.c: Benchmark for appending, deleting, replacing and getting
+ * lines in a large buffer with the functions in memline.c.
+ *
+ * Usage: memline_bench [-n lines] [-m maxmem] [-d directory]
+ *
+ *   -n lines	    number of lines in the buffer, default 1000000
+ *   -m maxmem	    value for 'maxmem' and 'maxmemtot' in Kbyte, default is
+ *		    the default of the options
+ *   -d directory   value for 'directory', where the swap file is created
+ *
+ * Each operation is done with three access patterns: going through the lines
+ * in sequence ("seq"), at random lines ("random") and at the last line of a
+ * block and the first line of the next block ("boundary").
+ * The result is printed with one line for each operation and pattern, the
+ * fields are separated with a Tab:
+ *	operation pattern lines ops ns/op peak-RSS-in-Kbyte
+ */
+
+/* Must include main.c because it contains much more than just main() */
+#define NO_VIM_MAIN
+#include "main.c"
+
+#ifdef HAVE_SYS_RESOURCE_H
+# include <sys/resource.h>
+#endif
+
+#define POOL_SIZE	1024	/* number of different lines used */
+#define MAX_OPS		1000000L
+
+static char_u	*pool[POOL_SIZE];	/* lines to append and replace with */
+static long	bench_lines = 1000000L;	/* number of lines in the buffer */
+static long_u	rand_seed = 1;
+
+/*
+ * Return a pseudo random line number from 1 to "count".
+ */
+    static linenr_T
+rand_lnum(linenr_T count)
+{
+    rand_seed = (rand_seed * 1103515245 + 12345) & 0x7fffffff;
+    return (linenr_T)((rand_seed >> 4) % count) + 1;
+}
+
+/*
+ * Return the time in seconds.
+ */
+    static double
+now(void)
+{
+    struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Return the peak resident set size in Kbyte, zero when unknown.
+ */
+    static long
+peak_rss(void)
+{
+#if defined(HAVE_SYS_RESOURCE_H) && defined(RUSAGE_SELF)
+    struct rusage   ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+# ifdef MACOS_X
+	return (long)(ru.ru_maxrss / 1024);	/* in bytes */
+# else
+	return (long)ru.ru_maxrss;
+# endif
+#endif
+    return 0L;
+}
+
+/*
+ * Output the result of one measurement.
+ */
+    static void
+report(char *op, char *pattern, long ops, double start)
+{
+    double	elapsed = now() - start;
+
+    printf("%s\t%s\t%ld\t%ld\t%.1f\t%ld\n", op, pattern, bench_lines, ops,
+		       ops == 0 ? 0.0 : elapsed * 1e9 / ops, peak_rss());
+    fflush(stdout);
+}
+
+/*
+ * Make the buffer empty and fill it with "bench_lines" lines.
+ * Returns FAIL when running out of memory.
+ */
+    static int
+fill_buffer(void)
+{
+    long	lnum;
+    long	n;
+
+    ml_close(curbuf, TRUE);
+    if (ml_open(curbuf) == FAIL)
+	return FAIL;
+    for (lnum = 0; lnum < bench_lines; lnum += n)
+    {
+	n = bench_lines - lnum;
+	if (n > POOL_SIZE)
+	    n = POOL_SIZE;
+	if (ml_append_range((linenr_T)lnum, pool, n) == FAIL)
+	    return FAIL;
+    }
+    /* remove the empty line the buffer started with */
+    ml_delete(curbuf->b_ml.ml_line_count, FALSE);
+    return OK;
+}
+
+/*
+ * Get the last line number of every block in the buffer, except the last
+ * block.  Returns the number of them in "*countp".
+ */
+    static linenr_T *
+get_boundaries(long *countp)
+{
+    linenr_T	*bounds;
+    linenr_T	lnum;
+    long	count = 0;
+    long	size = 1000;
+
+    bounds = (linenr_T *)alloc((unsigned)(size * sizeof(linenr_T)));
+    for (lnum = 1; bounds != NULL && lnum <= curbuf->b_ml.ml_line_count; )
+    {
+	(void)ml_get(lnum);
+	lnum = curbuf->b_ml.ml_locked_high;
+	if (lnum >= curbuf->b_ml.ml_line_count)
+	    break;
+	if (count == size)
+	{
+	    linenr_T	*p;
+
+	    size *= 2;
+	    p = (linenr_T *)vim_realloc(bounds,
+					  (size_t)(size * sizeof(linenr_T)));
+	    if (p == NULL)
+		vim_free(bounds);
+	    bounds = p;
+	    if (bounds == NULL)
+		break;
+	}
+	bounds[count++] = lnum++;
+    }
+    *countp = count;
+    return bounds;
+}
+
+/*
+ * Append lines: building the buffer line by line, after random lines and
+ * after and before block boundaries.
+ */
+    static void
+bench_append(linenr_T *bounds, long nbounds)
+{
+    double	start;
+    long	ops;
+    long	i;
+
+    ml_close(curbuf, TRUE);
+    if (ml_open(curbuf) == FAIL)
+	return;
+    start = now();
+    for (i = 0; i < bench_lines; ++i)
+	ml_append((linenr_T)i, pool[i % POOL_SIZE], (colnr_T)0, FALSE);
+    report("ml_append", "seq", bench_lines, start);
+
+    ops = bench_lines < MAX_OPS ? bench_lines / 10 : MAX_OPS / 10;
+    start = now();
+    for (i = 0; i < ops; ++i)
+	ml_append(rand_lnum(curbuf->b_ml.ml_line_count), pool[i % POOL_SIZE],
+							  (colnr_T)0, FALSE);
+    report("ml_append", "random", ops, start);
+
+    /* Start at the end, appending doesn't move the boundaries before it. */
+    if (fill_buffer() == FAIL)
+	return;
+    start = now();
+    for (i = nbounds - 1; i >= 0; --i)
+    {
+	ml_append(bounds[i], pool[i % POOL_SIZE], (colnr_T)0, FALSE);
+	ml_append(bounds[i] - 1, pool[i % POOL_SIZE], (colnr_T)0, FALSE);
+    }
+    report("ml_append", "boundary", nbounds * 2, start);
+}
+
+/*
+ * Get lines: all of them in sequence, random lines and the lines at both
+ * sides of each block boundary.
+ */
+    static void
+bench_get(linenr_T *bounds, long nbounds)
+{
+    double	start;
+    long	ops;
+    long	i;
+    long	sum = 0;
+
+    if (fill_buffer() == FAIL)
+	return;
+    start = now();
+    for (i = 1; i <= bench_lines; ++i)
+	sum += *ml_get((linenr_T)i);
+    report("ml_get", "seq", bench_lines, start);
+
+    ops = bench_lines < MAX_OPS ? bench_lines : MAX_OPS;
+    start = now();
+    for (i = 0; i < ops; ++i)
+	sum += *ml_get(rand_lnum(curbuf->b_ml.ml_line_count));
+    report("ml_get", "random", ops, start);
+
+    ops = 0;
+    start = now();
+    while (nbounds > 0 && ops < MAX_OPS)
+    {
+	for (i = 0; i < nbounds; ++i)
+	{
+	    sum += *ml_get(bounds[i]);
+	    sum += *ml_get(bounds[i] + 1);
+	}
+	ops += nbounds * 2;
+    }
+    report("ml_get", "boundary", ops, start);
+
+    if (sum == 0)	/* only to use "sum" */
+	printf("# empty lines\n");
+}
+
+/*
+ * Replace lines, with text that is longer or shorter: all of them in
+ * sequence, random lines and the lines at both sides of block boundaries.
+ */
+    static void
+bench_replace(linenr_T *bounds, long nbounds)
+{
+    double	start;
+    long	ops;
+    long	i;
+
+    if (fill_buffer() == FAIL)
+	return;
+    start = now();
+    for (i = 1; i <= bench_lines; ++i)
+	ml_replace((linenr_T)i, pool[(i * 7) % POOL_SIZE], TRUE);
+    report("ml_replace", "seq", bench_lines, start);
+
+    ops = bench_lines < MAX_OPS ? bench_lines : MAX_OPS;
+    start = now();
+    for (i = 0; i < ops; ++i)
+	ml_replace(rand_lnum(curbuf->b_ml.ml_line_count),
+					   pool[(i * 7) % POOL_SIZE], TRUE);
+    report("ml_replace", "random", ops, start);
+
+    if (fill_buffer() == FAIL)
+	return;
+    start = now();
+    for (i = 0; i < nbounds; ++i)
+    {
+	ml_replace(bounds[i], pool[(i * 7) % POOL_SIZE], TRUE);
+	ml_replace(bounds[i] + 1, pool[(i * 7 + 1) % POOL_SIZE], TRUE);
+    }
+    report("ml_replace", "boundary", nbounds * 2, start);
+}
+
+/*
+ * Delete lines: from the start, random lines and the lines at both sides of
+ * block boundaries.
+ */
+    static void
+bench_delete(linenr_T *bounds, long nbounds)
+{
+    double	start;
+    long	ops;
+    long	i;
+
+    ops = bench_lines / 2 < MAX_OPS ? bench_lines / 2 : MAX_OPS;
+    if (fill_buffer() == FAIL)
+	return;
+    start = now();
+    for (i = 0; i < ops; ++i)
+	ml_delete((linenr_T)1, FALSE);
+    report("ml_delete", "seq", ops, start);
+
+    if (fill_buffer() == FAIL)
+	return;
+    start = now();
+    for (i = 0; i < ops; ++i)
+	ml_delete(rand_lnum(curbuf->b_ml.ml_line_count), FALSE);
+    report("ml_delete", "random", ops, start);
+
+    /* Start at the end, deleting doesn't move the boundaries before it. */
+    if (fill_buffer() == FAIL)
+	return;
+    start = now();
+    for (i = nbounds - 1; i >= 0; --i)
+    {
+	ml_delete(bounds[i] + 1, FALSE);
+	ml_delete(bounds[i], FALSE);
+    }
+    report("ml_delete", "boundary", nbounds * 2, start);
+}
+
+    int
+main(int argc, char **argv)
+{
+    int		i;
+    long	nbounds;
+    linenr_T	*bounds;
+    char	buf[100];
+
+    vim_memset(&params, 0, sizeof(params));
+    params.argc = argc;
+    params.argv = argv;
+    common_init(&params);
+    init_chartab();
+
+    for (i = 1; i < argc; ++i)
+    {
+	if (i + 1 < argc && STRCMP(argv[i], "-n") == 0)
+	    bench_lines = atol(argv[++i]);
+	else if (i + 1 < argc && STRCMP(argv[i], "-m") == 0)
+	{
+	    p_mm = atol(argv[++i]);
+	    p_mmt = p_mm;
+	}
+	else if (i + 1 < argc && STRCMP(argv[i], "-d") == 0)
+	    set_option_value((char_u *)"dir", 0L, (char_u *)argv[++i], 0);
+	else
+	{
+	    fprintf(stderr,
+		  "Usage: %s [-n lines] [-m maxmem] [-d directory]\n", argv[0]);
+	    return 1;
+	}
+    }
+    if (bench_lines < 2)
+	bench_lines = 2;
+
+    /* Lines from 10 to about 100 bytes long. */
+    for (i = 0; i < POOL_SIZE; ++i)
+    {
+	vim_snprintf(buf, sizeof(buf), "%d %.*s", i, 5 + (i * 37) % 90,
+	    "text text text text text text text text text text text text "
+	    "text text text text text text text text text text text text");
+	pool[i] = vim_strsave((char_u *)buf);
+    }
+    curbuf->b_p_swf = TRUE;
+
+    printf("# operation\tpattern\tlines\tops\tns/op\tpeak_rss_kb\n");
+    if (fill_buffer() == FAIL)
+	return 1;
+    bounds = get_boundaries(&nbounds);
+    if (bounds == NULL)
+	return 1;
+
+    bench_append(bounds, nbounds);
+    bench_get(bounds, nbounds);
+    bench_replace(bounds, nbounds);
+    bench_delete(bounds, nbounds);
+
+    ml_close(curbuf, TRUE);	/* also deletes the swap file */
+    return 0;
+}
@@ -3235,6 +3235,10 @@ call_shell(char_u *cmd, int opt)
 #endif
 	/* The external command may update a tags file, clear cached tags. */
 	tag_freematch();
+#ifdef FEAT_ASYNC_WRITE
+	/* The external command may read a file that is being written. */
+	write_async_wait_all();
+#endif
 
 	if (cmd == NULL || *p_sxq == NUL)
 	    retval = mch_call_shell(cmd, opt);
@@ -6338,6 +6342,10 @@ parse_queued_messages(void)
     /* Check if any jobs have ended. */
     job_check_ended();
 # endif
+# ifdef FEAT_ASYNC_WRITE
+    /* Continue writing buffers in the background. */
+    write_async_check();
+# endif
 }
 #endif
 
@@ -3891,6 +3891,28 @@ do_put(
 		    i = 1;
 		}
 
+		/* Without fixing the indent all lines are appended at once. */
+		if (!(flags & PUT_FIXINDENT) && i < y_size)
+		{
+		    linenr_T	old_lcount = curbuf->b_ml.ml_line_count;
+		    int		r;
+
+		    /* The last line of a characterwise register was inserted
+		     * above. */
+		    r = ml_append_range(lnum, y_array + i,
+			     (long)(y_size - i - (y_type == MCHAR ? 1 : 0)));
+		    nr_lines += curbuf->b_ml.ml_line_count - old_lcount;
+		    lnum += curbuf->b_ml.ml_line_count - old_lcount;
+		    if (r == FAIL)
+			goto error;
+		    if (y_type == MCHAR)
+		    {
+			++lnum;
+			++nr_lines;
+		    }
+		    i = y_size;
+		}
+
 		for (; i < y_size; ++i)
 		{
 		    if ((y_type != MCHAR || i < y_size - 1)
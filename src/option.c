@@ -99,6 +99,7 @@
 #endif
 #define PV_EOL		OPT_BUF(BV_EOL)
 #define PV_FIXEOL	OPT_BUF(BV_FIXEOL)
+#define PV_FOT		OPT_BUF(BV_FOT)
 #define PV_EP		OPT_BOTH(OPT_BUF(BV_EP))
 #define PV_ET		OPT_BUF(BV_ET)
 #ifdef FEAT_MBYTE
@@ -317,6 +318,7 @@ static char_u	*p_ofu;
 #endif
 static int	p_eol;
 static int	p_fixeol;
+static int	p_fot;
 static int	p_et;
 #ifdef FEAT_MBYTE
 static char_u	*p_fenc;
@@ -575,6 +577,13 @@ static struct vimoption options[] =
 			    {(char_u *)0L, (char_u *)0L}
 #endif
 			    SCRIPTID_INIT},
+    {"asyncwrite",  "asw",  P_NUM|P_VI_DEF,
+#ifdef FEAT_ASYNC_WRITE
+			    (char_u *)&p_asw, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
     {"autochdir",  "acd",   P_BOOL|P_VI_DEF,
 #ifdef FEAT_AUTOCHDIR
 			    (char_u *)&p_acd, PV_NONE,
@@ -1210,6 +1219,15 @@ static struct vimoption options[] =
 #else
 			    (char_u *)NULL, PV_NONE,
 			    {(char_u *)0L, (char_u *)0L}
+#endif
+			    SCRIPTID_INIT},
+    {"filewatch",   "fw",   P_STRING|P_VI_DEF,
+#ifdef FEAT_FILEWATCH
+			    (char_u *)&p_fw, PV_NONE,
+			    {(char_u *)"", (char_u *)0L}
+#else
+			    (char_u *)NULL, PV_NONE,
+			    {(char_u *)0L, (char_u *)0L}
 #endif
 			    SCRIPTID_INIT},
     {"fillchars",   "fcs",  P_STRING|P_VI_DEF|P_RALL|P_ONECOMMA|P_NODUP,
@@ -1353,6 +1371,9 @@ static struct vimoption options[] =
 			    {(char_u *)NULL, (char_u *)0L}
 #endif
 			    SCRIPTID_INIT},
+    {"followtail",  "fot",  P_BOOL|P_VI_DEF,
+			    (char_u *)&p_fot, PV_FOT,
+			    {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
     {"formatexpr", "fex",   P_STRING|P_ALLOCED|P_VI_DEF|P_VIM,
 #ifdef FEAT_EVAL
 			    (char_u *)&p_fex, PV_FEX,
@@ -2757,6 +2778,13 @@ static struct vimoption options[] =
     {"swapsync",    "sws",  P_STRING|P_VI_DEF,
 			    (char_u *)&p_sws, PV_NONE,
 			    {(char_u *)"fsync", (char_u *)0L} SCRIPTID_INIT},
+    {"swapthread",  "swt",  P_BOOL|P_VI_DEF,
+#ifdef FEAT_SWAP_THREAD
+			    (char_u *)&p_swt, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)FALSE, (char_u *)0L} SCRIPTID_INIT},
     {"switchbuf",   "swb",  P_STRING|P_VI_DEF|P_ONECOMMA|P_NODUP,
 			    (char_u *)&p_swb, PV_NONE,
 			    {(char_u *)"", (char_u *)0L} SCRIPTID_INIT},
@@ -3021,6 +3049,13 @@ static struct vimoption options[] =
 			    (char_u *)100L,
 #endif
 				(char_u *)0L} SCRIPTID_INIT},
+    {"undomemory",  "umm",  P_NUM|P_VI_DEF,
+#ifdef FEAT_PERSISTENT_UNDO
+			    (char_u *)&p_umm, PV_NONE,
+#else
+			    (char_u *)NULL, PV_NONE,
+#endif
+			    {(char_u *)0L, (char_u *)0L} SCRIPTID_INIT},
     {"undoreload",  "ur",   P_NUM|P_VI_DEF,
 			    (char_u *)&p_ur, PV_NONE,
 			    { (char_u *)10000L, (char_u *)0L} SCRIPTID_INIT},
@@ -3340,6 +3375,9 @@ static char *(p_debug_values[]) = {"msg", "throw", "beep", NULL};
 #ifdef FEAT_WINDOWS
 static char *(p_ead_values[]) = {"both", "ver", "hor", NULL};
 #endif
+#ifdef FEAT_FILEWATCH
+static char *(p_fw_values[]) = {"local", "all", NULL};
+#endif
 #ifdef FEAT_AUTOCMD
 static char *(p_buftype_values[]) = {"nofile", "nowrite", "quickfix", "help", "terminal", "acwrite", NULL};
 #else
@@ -6649,6 +6687,17 @@ did_set_string_option(
 	}
     }
 
+#ifdef FEAT_FILEWATCH
+    /* 'filewatch' */
+    else if (varp == &p_fw)
+    {
+	if (check_opt_strings(p_fw, p_fw_values, FALSE) != OK)
+	    errmsg = e_invarg;
+	else
+	    mch_watch_option();
+    }
+#endif
+
 #if defined(FEAT_CRYPT)
     /* 'cryptkey' */
     else if (gvarp == &p_key)
@@ -8315,7 +8364,6 @@ set_bool_option(
 	 * any changes in between. */
 	if (curbuf->b_p_udf || p_udf)
 	{
-	    char_u	hash[UNDO_HASH_SIZE];
 	    buf_T	*save_curbuf = curbuf;
 
 	    FOR_ALL_BUFFERS(curbuf)
@@ -8327,10 +8375,7 @@ set_bool_option(
 		if ((curbuf == save_curbuf
 				|| (opt_flags & OPT_GLOBAL) || opt_flags == 0)
 			&& !curbufIsChanged() && curbuf->b_ml.ml_mfp != NULL)
-		{
-		    u_compute_hash(hash);
-		    u_read_undo(NULL, hash, curbuf->b_fname);
-		}
+		    u_read_undo(NULL, NULL, curbuf->b_fname);
 	    }
 	    curbuf = save_curbuf;
 	}
@@ -9268,6 +9313,27 @@ set_num_option(
 	u_sync(TRUE);
 	curbuf->b_p_ul = value;
     }
+#ifdef FEAT_PERSISTENT_UNDO
+    else if (pp == &p_umm)
+    {
+	if (p_umm < 0)
+	{
+	    errmsg = e_positive;
+	    p_umm = 0;
+	}
+	u_spill_check(curbuf);
+    }
+#endif
+#ifdef FEAT_ASYNC_WRITE
+    else if (pp == &p_asw)
+    {
+	if (p_asw < 0)
+	{
+	    errmsg = e_positive;
+	    p_asw = 0;
+	}
+    }
+#endif
 
 #ifdef FEAT_LINEBREAK
     /* 'numberwidth' must be positive */
@@ -9428,7 +9494,7 @@ set_num_option(
 	errmsg = e_invarg;
 	p_hi = 10000;
     }
-    if (p_re < 0 || p_re > 2)
+    if (p_re < 0 || p_re > 3)
     {
 	errmsg = e_invarg;
 	p_re = 0;
@@ -10975,6 +11041,7 @@ get_varp(struct vimoption *p)
 #endif
 	case PV_EOL:	return (char_u *)&(curbuf->b_p_eol);
 	case PV_FIXEOL:	return (char_u *)&(curbuf->b_p_fixeol);
+	case PV_FOT:	return (char_u *)&(curbuf->b_p_fot);
 	case PV_ET:	return (char_u *)&(curbuf->b_p_et);
 #ifdef FEAT_MBYTE
 	case PV_FENC:	return (char_u *)&(curbuf->b_p_fenc);
@@ -11366,6 +11433,7 @@ buf_copy_options(buf_T *buf, int flags)
 	    buf->b_p_bomb = p_bomb;
 #endif
 	    buf->b_p_fixeol = p_fixeol;
+	    buf->b_p_fot = p_fot;
 	    buf->b_p_et = p_et;
 	    buf->b_p_et_nobin = p_et_nobin;
 	    buf->b_p_et_nopaste = p_et_nopaste;
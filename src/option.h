@@ -320,6 +320,9 @@ EXTERN char_u	*p_emoji;	/* 'emoji' */
 EXTERN int	p_antialias;	/* 'antialias' */
 #endif
 EXTERN int	p_ar;		/* 'autoread' */
+#ifdef FEAT_ASYNC_WRITE
+EXTERN long	p_asw;		/* 'asyncwrite' */
+#endif
 EXTERN int	p_aw;		/* 'autowrite' */
 EXTERN int	p_awa;		/* 'autowriteall' */
 EXTERN char_u	*p_bs;		/* 'backspace' */
@@ -482,6 +485,9 @@ EXTERN char_u	*p_fencs;	/* 'fileencodings' */
 #endif
 EXTERN char_u	*p_ffs;		/* 'fileformats' */
 EXTERN long	p_fic;		/* 'fileignorecase' */
+#ifdef FEAT_FILEWATCH
+EXTERN char_u	*p_fw;		/* 'filewatch' */
+#endif
 #ifdef FEAT_FOLDING
 EXTERN char_u	*p_fcl;		/* 'foldclose' */
 EXTERN long	p_fdls;		/* 'foldlevelstart' */
@@ -827,6 +833,9 @@ EXTERN int	p_spr;		/* 'splitright' */
 EXTERN int	p_sol;		/* 'startofline' */
 EXTERN char_u	*p_su;		/* 'suffixes' */
 EXTERN char_u	*p_sws;		/* 'swapsync' */
+#ifdef FEAT_SWAP_THREAD
+EXTERN int	p_swt;		/* 'swapthread' */
+#endif
 EXTERN char_u	*p_swb;		/* 'switchbuf' */
 EXTERN unsigned	swb_flags;
 #ifdef IN_OPTION_C
@@ -928,6 +937,9 @@ static char *(p_ttym_values[]) = {"xterm", "xterm2", "dec", "netterm", "jsbterm"
 #endif
 EXTERN char_u	*p_udir;	/* 'undodir' */
 EXTERN long	p_ul;		/* 'undolevels' */
+#ifdef FEAT_PERSISTENT_UNDO
+EXTERN long	p_umm;		/* 'undomemory' */
+#endif
 EXTERN long	p_ur;		/* 'undoreload' */
 EXTERN long	p_uc;		/* 'updatecount' */
 EXTERN long	p_ut;		/* 'updatetime' */
@@ -1047,6 +1059,7 @@ enum
 #endif
     , BV_EOL
     , BV_FIXEOL
+    , BV_FOT
     , BV_EP
     , BV_ET
     , BV_FENC
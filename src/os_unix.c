@@ -257,6 +257,26 @@ typedef struct
 static xsmp_config_T xsmp;
 #endif
 
+#ifdef FEAT_FILEWATCH
+# include <sys/inotify.h>
+# ifdef HAVE_SYS_STATFS_H
+#  include <sys/statfs.h>
+# endif
+typedef struct
+{
+    int	    wd_wd;	    /* inotify watch descriptor of a directory */
+    int	    wd_count;	    /* number of buffers using it */
+} watchdir_T;
+
+static int	watch_fd = -1;	    /* inotify file descriptor */
+static garray_T	watch_dirs;	    /* watched directories, watchdir_T */
+static int	watch_autoread = FALSE; /* a file for 'autoread' changed */
+
+static int watch_dir_idx(int wd);
+static int watch_is_remote(char_u *dir);
+static void watch_mark_changed(buf_T *buf);
+#endif
+
 #ifdef SYS_SIGLIST_DECLARED
 /*
  * I have seen
@@ -415,6 +435,11 @@ mch_inchar(
 	/* If input was put directly in typeahead buffer bail out here. */
 	if (typebuf_changed(tb_change_cnt))
 	    return 0;
+#endif
+#ifdef FEAT_FILEWATCH
+	/* Reload a buffer with 'autoread' when inotify reported its file was
+	 * changed. */
+	check_timestamps_watched();
 #endif
 	if (wtime < 0 && did_start_blocking)
 	    /* blocking and already waited for p_ut */
@@ -470,6 +495,12 @@ mch_inchar(
 	if ((wait_time < 0 || wait_time > 100L) && channel_any_readahead())
 	    wait_time = 10L;
 #endif
+#ifdef FEAT_ASYNC_WRITE
+	/* Copying the text of a buffer that is written in the background is
+	 * done in steps, while waiting for a character. */
+	if (write_async_pending() && (wait_time < 0 || wait_time > 10L))
+	    wait_time = 10L;
+#endif
 #ifdef FEAT_BEVAL
 	if (p_beval && wait_time > 100L)
 	    /* The 'balloonexpr' may indirectly invoke a callback while waiting
@@ -510,7 +541,7 @@ mch_inchar(
 #if defined(FEAT_CLIENTSERVER) && !defined(MAC_CLIENTSERVER)
 		|| server_waiting()
 #endif
-#ifdef MESSAGE_QUEUE
+#if defined(MESSAGE_QUEUE) || defined(FEAT_FILEWATCH)
 		|| interrupted
 #endif
 		|| wait_time > 0
@@ -5836,7 +5867,7 @@ RealWaitForChar(int fd, long msec, int *check_for_gpm UNUSED, int *interrupted)
 #endif
 #ifndef HAVE_SELECT
 			/* each channel may use in, out and err */
-	struct pollfd   fds[6 + 3 * MAX_OPEN_CHANNELS];
+	struct pollfd   fds[7 + 3 * MAX_OPEN_CHANNELS];
 	int		nfd;
 # ifdef FEAT_XCLIPBOARD
 	int		xterm_idx = -1;
@@ -5846,6 +5877,9 @@ RealWaitForChar(int fd, long msec, int *check_for_gpm UNUSED, int *interrupted)
 # endif
 # ifdef USE_XSMP
 	int		xsmp_idx = -1;
+# endif
+# ifdef FEAT_FILEWATCH
+	int		watch_idx = -1;
 # endif
 	int		towait = (int)msec;
 
@@ -5889,6 +5923,15 @@ RealWaitForChar(int fd, long msec, int *check_for_gpm UNUSED, int *interrupted)
 	    nfd++;
 	}
 # endif
+# ifdef FEAT_FILEWATCH
+	if (watch_fd >= 0)
+	{
+	    watch_idx = nfd;
+	    fds[nfd].fd = watch_fd;
+	    fds[nfd].events = POLLIN;
+	    nfd++;
+	}
+# endif
 #ifdef FEAT_JOB_CHANNEL
 	nfd = channel_poll_setup(nfd, &fds);
 #endif
@@ -5941,6 +5984,15 @@ RealWaitForChar(int fd, long msec, int *check_for_gpm UNUSED, int *interrupted)
 		finished = FALSE;	/* Try again */
 	}
 # endif
+# ifdef FEAT_FILEWATCH
+	/* Changed files are handled in mch_inchar(), "interrupted" was
+	 * set to get there. */
+	if (watch_idx >= 0 && (fds[watch_idx].revents & POLLIN))
+	{
+	    mch_watch_read();
+	    --ret;
+	}
+# endif
 #ifdef FEAT_JOB_CHANNEL
 	if (ret > 0)
 	    ret = channel_poll_check(ret, &fds);
@@ -6017,6 +6069,14 @@ select_eintr:
 		maxfd = xsmp_icefd;
 	}
 # endif
+# ifdef FEAT_FILEWATCH
+	if (watch_fd >= 0)
+	{
+	    FD_SET(watch_fd, &rfds);
+	    if (maxfd < watch_fd)
+		maxfd = watch_fd;
+	}
+# endif
 # ifdef FEAT_JOB_CHANNEL
 	maxfd = channel_select_setup(maxfd, &rfds, &wfds);
 # endif
@@ -6103,6 +6163,13 @@ select_eintr:
 	    }
 	}
 # endif
+# ifdef FEAT_FILEWATCH
+	if (ret > 0 && watch_fd >= 0 && FD_ISSET(watch_fd, &rfds))
+	{
+	    mch_watch_read();
+	    --ret;
+	}
+# endif
 #ifdef FEAT_JOB_CHANNEL
 	if (ret > 0)
 	    ret = channel_select_check(ret, &rfds, &wfds);
@@ -7804,6 +7871,273 @@ xsmp_close(void)
 }
 #endif /* USE_XSMP */
 
+#if defined(FEAT_FILEWATCH) || defined(PROTO)
+/*
+ * Watching files with inotify for 'filewatch'.
+ * The directory of the file is watched, so that a file that is written by
+ * renaming a new file over it is noticed, and also when it is deleted and
+ * created again.  A directory is watched only once for all buffers in it,
+ * "watch_dirs" holds how many buffers use each watch.
+ */
+    static int
+watch_dir_idx(int wd)
+{
+    int i;
+
+    for (i = 0; i < watch_dirs.ga_len; ++i)
+	if (((watchdir_T *)watch_dirs.ga_data)[i].wd_wd == wd)
+	    return i;
+    return -1;
+}
+
+/*
+ * Return TRUE when directory "dir" is on a file system where a change made
+ * by another machine is not reported by inotify.
+ */
+    static int
+watch_is_remote(char_u *dir)
+{
+# ifdef HAVE_SYS_STATFS_H
+    struct statfs	st;
+
+    if (statfs((char *)dir, &st) != 0)
+	return TRUE;
+    switch ((unsigned long)st.f_type)
+    {
+	case 0x6969UL:		/* NFS */
+	case 0x517BUL:		/* SMB */
+	case 0xFF534D42UL:	/* CIFS */
+	case 0xFE534D42UL:	/* SMB2 */
+	case 0x65735546UL:	/* FUSE */
+	case 0x73757245UL:	/* CODA */
+	case 0x5346414FUL:	/* AFS */
+	case 0x01021997UL:	/* 9P */
+	case 0x00C36400UL:	/* CEPH */
+	case 0x47504653UL:	/* GPFS */
+	    return TRUE;
+    }
+# endif
+    return FALSE;
+}
+
+/*
+ * Start watching the file of buffer "buf" for changes, if 'filewatch' says
+ * so.  Called after the timestamps of the file were stored.
+ * Files that are a symbolic link or have more than one name are not watched,
+ * a change through another name would not be noticed.
+ */
+    void
+mch_watch_buf(buf_T *buf)
+{
+    char_u	*dir;
+    stat_T	st;
+    int		wd;
+    int		idx;
+    watchdir_T	*wdp;
+
+    if (*p_fw == NUL || buf->b_ffname == NULL)
+    {
+	mch_unwatch_buf(buf);
+	return;
+    }
+    if (watch_fd < 0)
+    {
+	watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watch_fd < 0)
+	{
+	    /* Don't try again. */
+	    set_string_option_direct((char_u *)"fw", -1, (char_u *)"",
+							   OPT_FREE, SID_NONE);
+	    return;
+	}
+	ga_init2(&watch_dirs, (int)sizeof(watchdir_T), 10);
+    }
+
+    if (mch_lstat((char *)buf->b_ffname, &st) < 0
+	    || S_ISLNK(st.st_mode) || st.st_nlink > 1
+	    || (dir = vim_strnsave(buf->b_ffname,
+			  (int)(gettail(buf->b_ffname) - buf->b_ffname))) == NULL)
+    {
+	mch_unwatch_buf(buf);
+	return;
+    }
+    wd = inotify_add_watch(watch_fd, (char *)dir, IN_MODIFY | IN_ATTRIB
+		    | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM
+		    | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    if (wd < 0 || wd == buf->b_watch_wd)
+    {
+	vim_free(dir);
+	if (wd < 0)
+	    mch_unwatch_buf(buf);
+	return;
+    }
+
+    idx = watch_dir_idx(wd);
+    if (idx < 0)
+    {
+	if ((STRCMP(p_fw, "local") == 0 && watch_is_remote(dir))
+		|| ga_grow(&watch_dirs, 1) == FAIL)
+	{
+	    inotify_rm_watch(watch_fd, wd);
+	    vim_free(dir);
+	    mch_unwatch_buf(buf);
+	    return;
+	}
+	idx = watch_dirs.ga_len++;
+	wdp = (watchdir_T *)watch_dirs.ga_data + idx;
+	wdp->wd_wd = wd;
+	wdp->wd_count = 0;
+    }
+    vim_free(dir);
+
+    mch_unwatch_buf(buf);
+    ++((watchdir_T *)watch_dirs.ga_data)[watch_dir_idx(wd)].wd_count;
+    buf->b_watch_wd = wd;
+    /* The file may have changed between storing the timestamps and adding
+     * the watch, check it once. */
+    buf->b_watch_changed = TRUE;
+}
+
+/*
+ * Stop watching the file of buffer "buf".
+ */
+    void
+mch_unwatch_buf(buf_T *buf)
+{
+    int		idx;
+    watchdir_T	*wdp;
+
+    if (buf->b_watch_wd <= 0)
+	return;
+    idx = watch_dir_idx(buf->b_watch_wd);
+    if (idx >= 0)
+    {
+	wdp = (watchdir_T *)watch_dirs.ga_data + idx;
+	if (--wdp->wd_count <= 0)
+	{
+	    inotify_rm_watch(watch_fd, wdp->wd_wd);
+	    *wdp = ((watchdir_T *)watch_dirs.ga_data)[--watch_dirs.ga_len];
+	}
+    }
+    buf->b_watch_wd = 0;
+    buf->b_watch_changed = FALSE;
+}
+
+/*
+ * Remember that the file of buffer "buf" may have been changed.
+ */
+    static void
+watch_mark_changed(buf_T *buf)
+{
+    buf->b_watch_changed = TRUE;
+    if (buf->b_nwindows > 0 && !bufIsChanged(buf)
+			     && (buf->b_p_ar >= 0 ? buf->b_p_ar : p_ar))
+	watch_autoread = TRUE;
+}
+
+/*
+ * Read the events from the inotify file descriptor, without waiting, and
+ * mark the buffers of files that were changed.
+ */
+    void
+mch_watch_read(void)
+{
+    union {
+	struct inotify_event	ev;
+	char			buf[4096];
+    } u;
+    struct inotify_event	*ev;
+    char			*p;
+    int				len;
+    int				idx;
+    buf_T			*buf;
+
+    if (watch_fd < 0)
+	return;
+    while ((len = read(watch_fd, u.buf, sizeof(u.buf))) > 0)
+    {
+	for (p = u.buf; p < u.buf + len;
+			      p += sizeof(struct inotify_event) + ev->len)
+	{
+	    ev = (struct inotify_event *)p;
+	    if (ev->mask & IN_Q_OVERFLOW)
+	    {
+		/* Events were lost, all files may have changed. */
+		FOR_ALL_BUFFERS(buf)
+		    if (buf->b_watch_wd > 0)
+			watch_mark_changed(buf);
+	    }
+	    else if (ev->len > 0)
+	    {
+		FOR_ALL_BUFFERS(buf)
+		    if (buf->b_watch_wd == ev->wd && STRCMP(ev->name,
+						  gettail(buf->b_ffname)) == 0)
+			watch_mark_changed(buf);
+	    }
+	    else if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED
+								| IN_UNMOUNT))
+	    {
+		/* The directory is gone: stop watching, the files in it need
+		 * to be checked the normal way from now on. */
+		idx = watch_dir_idx(ev->wd);
+		if (idx < 0)
+		    continue;
+		if ((ev->mask & IN_IGNORED) == 0)
+		    inotify_rm_watch(watch_fd, ev->wd);
+		((watchdir_T *)watch_dirs.ga_data)[idx] =
+			 ((watchdir_T *)watch_dirs.ga_data)[--watch_dirs.ga_len];
+		FOR_ALL_BUFFERS(buf)
+		    if (buf->b_watch_wd == ev->wd)
+		    {
+			watch_mark_changed(buf);
+			buf->b_watch_wd = 0;
+		    }
+	    }
+	}
+    }
+}
+
+/*
+ * Return TRUE once after a file was changed that is to be reloaded because
+ * of 'autoread'.
+ */
+    int
+mch_watch_autoread(void)
+{
+    int	    ret = watch_autoread;
+
+    watch_autoread = FALSE;
+    return ret;
+}
+
+/*
+ * Called when 'filewatch' was set: stop watching all files and start again
+ * with the new value.
+ */
+    void
+mch_watch_option(void)
+{
+    buf_T	*buf;
+
+    if (watch_fd >= 0)
+    {
+	FOR_ALL_BUFFERS(buf)
+	{
+	    buf->b_watch_wd = 0;
+	    buf->b_watch_changed = FALSE;
+	}
+	close(watch_fd);
+	watch_fd = -1;
+	ga_clear(&watch_dirs);
+	watch_autoread = FALSE;
+    }
+    if (*p_fw != NUL)
+	FOR_ALL_BUFFERS(buf)
+	    if (buf->b_ml.ml_mfp != NULL && buf->b_mtime != 0)
+		mch_watch_buf(buf);
+}
+#endif /* FEAT_FILEWATCH */
+
 
 #ifdef EBCDIC
 /* Translate character to its CTRL- value */
@@ -7,6 +7,12 @@ void set_file_options(int set_options, exarg_T *eap);
 void set_forced_fenc(exarg_T *eap);
 int check_file_readonly(char_u *fname, int perm);
 int buf_write(buf_T *buf, char_u *fname, char_u *sfname, linenr_T start, linenr_T end, exarg_T *eap, int append, int forceit, int reset_changed, int filtering);
+void write_async_change(buf_T *buf, linenr_T lnum, linenr_T count, long extra);
+void write_async_wait(buf_T *buf, int normal);
+void write_async_wait_all(void);
+int write_async_pending(void);
+int write_async_percent(buf_T *buf);
+void write_async_check(void);
 void msg_add_fname(buf_T *buf, char_u *fname);
 void msg_add_lines(int insert_space, long lnum, off_T nchars);
 char_u *shorten_fname1(char_u *full_path);
@@ -19,6 +25,7 @@ int vim_fgets(char_u *buf, int size, FILE *fp);
 int tag_fgets(char_u *buf, int size, FILE *fp);
 int vim_rename(char_u *from, char_u *to);
 int check_timestamps(int focus);
+void check_timestamps_watched(void);
 int buf_check_timestamp(buf_T *buf, int focus);
 void buf_reload(buf_T *buf, int orig_mode);
 void buf_store_time(buf_T *buf, stat_T *st, char_u *fname);
@@ -55,6 +62,8 @@ void block_autocmds(void);
 void unblock_autocmds(void);
 int is_autocmd_blocked(void);
 char_u *getnextac(int c, void *cookie, int indent);
+void ex_autocmdtime(exarg_T *eap);
+void autocmdtime_list(list_T *list);
 int has_autocmd(event_T event, char_u *sfname, buf_T *buf);
 char_u *get_augroup_name(expand_T *xp, int idx);
 char_u *set_context_in_autocmd(expand_T *xp, char_u *arg, int doautocmd);
@@ -10,8 +10,15 @@ void mf_put(memfile_T *mfp, bhdr_T *hp, int dirty, int infile);
 void mf_free(memfile_T *mfp, bhdr_T *hp);
 int mf_sync(memfile_T *mfp, int flags);
 void mf_set_dirty(memfile_T *mfp);
+void mf_sync_wait(memfile_T *mfp);
 int mf_release_all(void);
+void mf_stats(long *hits, long *reads, long *evictions, long_u *used);
+void mf_zip_stats(long *unzips, long_u *text, long_u *size);
 blocknr_T mf_trans_del(memfile_T *mfp, blocknr_T old_nr);
+void mf_backing_add(memfile_T *mfp, blocknr_T nr, off_T offset, long size, linenr_T line_count, int page_count);
+void mf_backing_clear(memfile_T *mfp);
+void mf_set_digest(memfile_T *mfp, blocknr_T nr, UINT32_T *digest);
+int mf_get_digest(memfile_T *mfp, blocknr_T nr, UINT32_T *digest);
 void mf_set_ffname(memfile_T *mfp);
 void mf_fullname(memfile_T *mfp);
 int mf_need_trans(memfile_T *mfp);
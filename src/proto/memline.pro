@@ -19,13 +19,23 @@ char_u *ml_get_curline(void);
 char_u *ml_get_cursor(void);
 char_u *ml_get_buf(buf_T *buf, linenr_T lnum, int will_change);
 int ml_line_alloced(void);
+int ml_get_buf_lines(buf_T *buf, linenr_T lnum, int max, char_u **ptrs);
 int ml_append(linenr_T lnum, char_u *line, colnr_T len, int newfile);
 int ml_append_buf(buf_T *buf, linenr_T lnum, char_u *line, colnr_T len, int newfile);
+int ml_append_range(linenr_T lnum, char_u **lines, long count);
 int ml_replace(linenr_T lnum, char_u *line, int copy);
 int ml_delete(linenr_T lnum, int message);
+int ml_delete_range(linenr_T lnum, long count, int message);
 void ml_setmarked(linenr_T lnum);
 linenr_T ml_firstmarked(void);
 void ml_clearmarked(void);
+void ml_cache_stats(buf_T *buf, long *hits, long *misses);
+int ml_backing_start(buf_T *buf, char_u *fname, int fd, int dos);
+void ml_backing_add(buf_T *buf, linenr_T lnum, long size);
+void ml_backing_end(buf_T *buf);
+int ml_backing_drop(bhdr_T *hp, NR_BACKING *nbp);
+int ml_backing_read(memfile_T *mfp, bhdr_T *hp, NR_BACKING *nbp);
+int ml_digest(buf_T *buf, UINT32_T *digest);
 int resolve_symlink(char_u *fname, char_u *buf);
 char_u *makeswapname(char_u *fname, char_u *ffname, buf_T *buf, char_u *dir_name);
 char_u *get_file_in_dir(char_u *fname, char_u *dname);
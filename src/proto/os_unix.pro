@@ -83,4 +83,9 @@ void clip_xterm_set_selection(VimClipboard *cbd);
 int xsmp_handle_requests(void);
 void xsmp_init(void);
 void xsmp_close(void);
+void mch_watch_buf(buf_T *buf);
+void mch_unwatch_buf(buf_T *buf);
+void mch_watch_read(void);
+int mch_watch_autoread(void);
+void mch_watch_option(void);
 /* vim: set ft=c : */
@@ -13,6 +13,8 @@ char_u *reg_submatch(int no);
 list_T *reg_submatch_list(int no);
 regprog_T *vim_regcomp(char_u *expr_arg, int re_flags);
 void vim_regfree(regprog_T *prog);
+void regcache_clear(void);
+void regcache_stats(dict_T *dict);
 int vim_regexec_prog(regprog_T **prog, int ignore_case, char_u *line, colnr_T col);
 int vim_regexec(regmatch_T *rmp, char_u *line, colnr_T col);
 int vim_regexec_nl(regmatch_T *rmp, char_u *line, colnr_T col);
@@ -21,6 +21,7 @@ void screen_line(int row, int coloff, int endcol, int clear_width, int rlflag);
 void rl_mirror(char_u *str);
 void status_redraw_all(void);
 void status_redraw_curbuf(void);
+void status_redraw_buf(buf_T *buf);
 void redraw_statuslines(void);
 void win_redraw_last_status(frame_T *frp);
 void win_redr_status_matches(expand_T *xp, int num_matches, char_u **matches, int match, int showtail);
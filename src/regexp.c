@@ -731,6 +731,9 @@ static void	regoptail(char_u *, char_u *);
 
 static regengine_T bt_regengine;
 static regengine_T nfa_regengine;
+#ifdef EXITFREE
+static void nfa_free_lists(void);
+#endif
 
 /*
  * Return TRUE if compiled regular expression "prog" can match a line break.
@@ -3676,6 +3679,8 @@ free_regexp_stuff(void)
     ga_clear(&backpos);
     vim_free(reg_tofree);
     vim_free(reg_prev_sub);
+    regcache_clear();
+    nfa_free_lists();
 }
 #endif
 
@@ -8099,11 +8104,14 @@ static regengine_T nfa_regengine =
  * Must match with 'regexpengine'. */
 static int regexp_engine = 0;
 
+static regprog_T *regcache_comp(char_u *expr, int re_flags);
+
 #ifdef DEBUG
 static char_u regname[][30] = {
 		    "AUTOMATIC Regexp Engine",
 		    "BACKTRACKING Regexp Engine",
-		    "NFA Regexp Engine"
+		    "NFA Regexp Engine",
+		    "Lazy DFA Regexp Engine"
 			    };
 #endif
 
@@ -8119,6 +8127,9 @@ vim_regcomp(char_u *expr_arg, int re_flags)
     regprog_T   *prog = NULL;
     char_u	*expr = expr_arg;
 
+    if (re_flags & RE_CACHE)
+	return regcache_comp(expr_arg, re_flags - RE_CACHE);
+
     regexp_engine = p_re;
 
     /* Check for prefix "\%#=", that sets the regexp engine */
@@ -8128,7 +8139,8 @@ vim_regcomp(char_u *expr_arg, int re_flags)
 
 	if (newengine == AUTOMATIC_ENGINE
 	    || newengine == BACKTRACKING_ENGINE
-	    || newengine == NFA_ENGINE)
+	    || newengine == NFA_ENGINE
+	    || newengine == LAZY_DFA_ENGINE)
 	{
 	    regexp_engine = expr[4] - '0';
 	    expr += 5;
@@ -8139,7 +8151,7 @@ vim_regcomp(char_u *expr_arg, int re_flags)
 	}
 	else
 	{
-	    EMSG(_("E864: \\%#= can only be followed by 0, 1, or 2. The automatic engine will be used "));
+	    EMSG(_("E864: \\%#= can only be followed by 0, 1, 2 or 3. The automatic engine will be used "));
 	    regexp_engine = AUTOMATIC_ENGINE;
 	}
     }
@@ -8149,7 +8161,9 @@ vim_regcomp(char_u *expr_arg, int re_flags)
     /*
      * First try the NFA engine, unless backtracking was requested.
      */
-    if (regexp_engine != BACKTRACKING_ENGINE)
+    if (regexp_engine == LAZY_DFA_ENGINE)
+	prog = nfa_regengine.regcomp(expr, re_flags + RE_AUTO + RE_DFA);
+    else if (regexp_engine != BACKTRACKING_ENGINE)
         prog = nfa_regengine.regcomp(expr,
 		re_flags + (regexp_engine == AUTOMATIC_ENGINE ? RE_AUTO : 0));
     else
@@ -8178,7 +8192,8 @@ vim_regcomp(char_u *expr_arg, int re_flags)
 	 * The NFA engine also fails for patterns that it can't handle well
 	 * but are still valid patterns, thus a retry should work.
 	 */
-	if (regexp_engine == AUTOMATIC_ENGINE)
+	if (regexp_engine == AUTOMATIC_ENGINE
+				       || regexp_engine == LAZY_DFA_ENGINE)
 	{
 	    regexp_engine = BACKTRACKING_ENGINE;
 	    prog = bt_regengine.regcomp(expr, re_flags);
@@ -8191,6 +8206,8 @@ vim_regcomp(char_u *expr_arg, int re_flags)
 	 * out to be very slow when executing it. */
 	prog->re_engine = regexp_engine;
 	prog->re_flags  = re_flags;
+	prog->re_refcount = 1;
+	prog->re_in_cache = FALSE;
     }
 
     return prog;
@@ -8198,14 +8215,211 @@ vim_regcomp(char_u *expr_arg, int re_flags)
 
 /*
  * Free a compiled regexp program, returned by vim_regcomp().
+ * A program that is shared through the cache is only freed when it is not
+ * used and no longer in the cache.
  */
     void
 vim_regfree(regprog_T *prog)
 {
-    if (prog != NULL)
+    if (prog != NULL && --prog->re_refcount <= 0 && !prog->re_in_cache)
 	prog->engine->regfree(prog);
 }
 
+/*
+ * Cache of compiled patterns, for vim_regcomp() with RE_CACHE.  Callers that
+ * compile the same pattern over and over, such as searching and the
+ * match() and substitute() functions, get the same program back.
+ * The key is made of the flags that influence compiling and the pattern.
+ * The entries are in a hashtable and in a list with the most recently used
+ * one first; when there are more than REGCACHE_SIZE the last one is removed.
+ */
+#define REGCACHE_SIZE	64
+
+typedef struct regcache_S regcache_T;
+struct regcache_S
+{
+    regcache_T	*rc_prev;	/* more recently used entry */
+    regcache_T	*rc_next;	/* less recently used entry */
+    regprog_T	*rc_prog;
+    char_u	rc_key[1];	/* flags and pattern, actually longer */
+};
+
+#define RC_KEY_OFF  offsetof(regcache_T, rc_key)
+#define HI2RC(hi)   ((regcache_T *)((hi)->hi_key - RC_KEY_OFF))
+
+static hashtab_T    regcache_ht;
+static int	    regcache_init = FALSE;
+static regcache_T   *regcache_first = NULL;	/* most recently used */
+static regcache_T   *regcache_last = NULL;	/* least recently used */
+static int	    regcache_count = 0;
+static long	    regcache_hits = 0;
+static long	    regcache_misses = 0;
+
+static void regcache_unlink(regcache_T *rc);
+static void regcache_remove(regcache_T *rc);
+
+/*
+ * Remove "rc" from the list of cached patterns.
+ */
+    static void
+regcache_unlink(regcache_T *rc)
+{
+    if (rc->rc_prev == NULL)
+	regcache_first = rc->rc_next;
+    else
+	rc->rc_prev->rc_next = rc->rc_next;
+    if (rc->rc_next == NULL)
+	regcache_last = rc->rc_prev;
+    else
+	rc->rc_next->rc_prev = rc->rc_prev;
+}
+
+/*
+ * Remove "rc" from the cache and free it.  The program is freed when it is
+ * not being used.
+ */
+    static void
+regcache_remove(regcache_T *rc)
+{
+    hashitem_T	*hi;
+
+    hi = hash_find(&regcache_ht, rc->rc_key);
+    if (!HASHITEM_EMPTY(hi))
+	hash_remove(&regcache_ht, hi);
+    regcache_unlink(rc);
+    --regcache_count;
+    rc->rc_prog->re_in_cache = FALSE;
+    if (rc->rc_prog->re_refcount <= 0)
+	rc->rc_prog->engine->regfree(rc->rc_prog);
+    vim_free(rc);
+}
+
+/*
+ * vim_regcomp() for a pattern that can be shared with other callers.
+ * Returns the cached program when the same pattern was compiled before with
+ * the same flags.
+ */
+    static regprog_T *
+regcache_comp(char_u *expr, int re_flags)
+{
+    char_u	buf[256];
+    char_u	*key = buf;
+    int		len;
+    int		keylen;
+    hash_T	hash;
+    hashitem_T	*hi;
+    regcache_T	*rc;
+    regprog_T	*prog;
+
+    /* Patterns using the previous substitute string and patterns for
+     * syntax highlighting that use "\z(" are not cached, the result also
+     * depends on other state. */
+    if (reg_do_extmatch != 0 || vim_strchr(expr, '~') != NULL)
+	return vim_regcomp(expr, re_flags);
+
+    if (!regcache_init)
+    {
+	hash_init(&regcache_ht);
+	regcache_init = TRUE;
+    }
+
+    /* The key: the engine, the flags, the 'cpoptions' flags used when
+     * compiling, the kind of encoding and the pattern. */
+    len = (int)STRLEN(expr);
+    keylen = len + 40;
+    if (keylen > (int)sizeof(buf))
+    {
+	key = alloc((unsigned)keylen);
+	if (key == NULL)
+	    return vim_regcomp(expr, re_flags);
+    }
+    vim_snprintf((char *)key, 40, "%ld/%d/%d%d/%d%d/",
+	    p_re, re_flags,
+	    vim_strchr(p_cpo, CPO_LITERAL) != NULL,
+	    vim_strchr(p_cpo, CPO_BACKSL) != NULL,
+	    has_mbyte, enc_utf8);
+    keylen = (int)STRLEN(key);
+    mch_memmove(key + keylen, expr, (size_t)len + 1);
+    keylen += len;
+
+    hash = hash_hash(key);
+    hi = hash_lookup(&regcache_ht, key, hash);
+    if (!HASHITEM_EMPTY(hi))
+    {
+	/* Found it: move it to the front of the list. */
+	rc = HI2RC(hi);
+	if (rc != regcache_first)
+	{
+	    regcache_unlink(rc);
+	    rc->rc_prev = NULL;
+	    rc->rc_next = regcache_first;
+	    regcache_first->rc_prev = rc;
+	    regcache_first = rc;
+	}
+	++regcache_hits;
+	prog = rc->rc_prog;
+	++prog->re_refcount;
+    }
+    else
+    {
+	++regcache_misses;
+	prog = vim_regcomp(expr, re_flags);
+	if (prog != NULL)
+	{
+	    rc = (regcache_T *)alloc((unsigned)(sizeof(regcache_T) + keylen));
+	    if (rc != NULL)
+	    {
+		mch_memmove(rc->rc_key, key, (size_t)keylen + 1);
+		rc->rc_prog = prog;
+		rc->rc_prev = NULL;
+		rc->rc_next = regcache_first;
+		if (regcache_first == NULL)
+		    regcache_last = rc;
+		else
+		    regcache_first->rc_prev = rc;
+		regcache_first = rc;
+		prog->re_in_cache = TRUE;
+		hash_add_item(&regcache_ht, hi, rc->rc_key, hash);
+		if (++regcache_count > REGCACHE_SIZE)
+		    regcache_remove(regcache_last);
+	    }
+	}
+    }
+
+    if (key != buf)
+	vim_free(key);
+    return prog;
+}
+
+/*
+ * Remove all entries from the cache of compiled patterns.
+ */
+    void
+regcache_clear(void)
+{
+    while (regcache_last != NULL)
+	regcache_remove(regcache_last);
+    if (regcache_init)
+    {
+	hash_clear(&regcache_ht);
+	regcache_init = FALSE;
+    }
+}
+
+#if defined(FEAT_EVAL) || defined(PROTO)
+/*
+ * Add the statistics of the cache of compiled patterns to "dict".
+ */
+    void
+regcache_stats(dict_T *dict)
+{
+    dict_add_nr_str(dict, "hits", regcache_hits, NULL);
+    dict_add_nr_str(dict, "misses", regcache_misses, NULL);
+    dict_add_nr_str(dict, "entries", (long)regcache_count, NULL);
+    dict_add_nr_str(dict, "size", (long)REGCACHE_SIZE, NULL);
+}
+#endif
+
 #ifdef FEAT_EVAL
 static void report_re_switch(char_u *pat);
 
@@ -8254,7 +8468,8 @@ vim_regexec_string(
     result = rmp->regprog->engine->regexec_nl(rmp, line, col, nl);
 
     /* NFA engine aborted because it's very slow. */
-    if (rmp->regprog->re_engine == AUTOMATIC_ENGINE
+    if ((rmp->regprog->re_engine == AUTOMATIC_ENGINE
+		|| rmp->regprog->re_engine == LAZY_DFA_ENGINE)
 					       && result == NFA_TOO_EXPENSIVE)
     {
 	int    save_p_re = p_re;
@@ -8361,7 +8576,8 @@ vim_regexec_multi(
 				      rmp, win, buf, lnum, col, tm, timed_out);
 
     /* NFA engine aborted because it's very slow. */
-    if (rmp->regprog->re_engine == AUTOMATIC_ENGINE
+    if ((rmp->regprog->re_engine == AUTOMATIC_ENGINE
+		|| rmp->regprog->re_engine == LAZY_DFA_ENGINE)
 					       && result == NFA_TOO_EXPENSIVE)
     {
 	int    save_p_re = p_re;
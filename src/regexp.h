@@ -38,6 +38,7 @@
 #define	    AUTOMATIC_ENGINE	0
 #define	    BACKTRACKING_ENGINE	1
 #define	    NFA_ENGINE		2
+#define	    LAZY_DFA_ENGINE	3   /* automatic, NFA with a lazy DFA */
 
 typedef struct regengine regengine_T;
 
@@ -52,6 +53,8 @@ typedef struct regprog
     unsigned		regflags;
     unsigned		re_engine;   /* automatic, backtracking or nfa engine */
     unsigned		re_flags;    /* second argument for vim_regcomp() */
+    int			re_refcount; /* number of users, see vim_regfree() */
+    int			re_in_cache; /* in the cache of compiled patterns */
 } regprog_T;
 
 /*
@@ -61,11 +64,13 @@ typedef struct regprog
  */
 typedef struct
 {
-    /* These four members implement regprog_T */
+    /* These six members implement regprog_T */
     regengine_T		*engine;
     unsigned		regflags;
     unsigned		re_engine;
     unsigned		re_flags;    /* second argument for vim_regcomp() */
+    int			re_refcount;
+    int			re_in_cache;
 
     int			regstart;
     char_u		reganch;
@@ -89,25 +94,35 @@ struct nfa_state
     nfa_state_T		*out1;
     int			id;
     int			lastlist[2]; /* 0: normal, 1: recursive */
+    int			lastidx[2];  /* index in the list for lastlist */
     int			val;
 };
 
+/* Lazy DFA used by the NFA matcher, defined in regexp_nfa.c. */
+typedef struct nfa_dfa_S nfa_dfa_T;
+
 /*
  * Structure used by the NFA matcher.
  */
 typedef struct
 {
-    /* These three members implement regprog_T */
+    /* These six members implement regprog_T */
     regengine_T		*engine;
     unsigned		regflags;
     unsigned		re_engine;
     unsigned		re_flags;    /* second argument for vim_regcomp() */
+    int			re_refcount;
+    int			re_in_cache;
 
     nfa_state_T		*start;		/* points into state[] */
 
     int			reganch;	/* pattern starts with ^ */
     int			regstart;	/* char at start of pattern */
     char_u		*match_text;	/* plain text to match with */
+    char_u		*regmust;	/* text every match contains or NULL */
+    int			regmlen;	/* length of regmust */
+    int			regmust_start;	/* every match starts with regmust */
+    nfa_dfa_T		*dfa;		/* lazy DFA or NULL */
 
     int			has_zend;	/* pattern contains \ze */
     int			has_backref;	/* pattern contains \1 .. \9 */
@@ -0,0 +1,487 @@
+/* vi:set ts=8 sts=4 sw=4 noet:
+ *
+ * VIM - Vi IMproved	by Bram Moolenaar
+ *
+ * Do ":help uganda"  in Vim to read copying and usage conditions.
+ * Do ":help credits" in Vim to see a list of people who contributed.
+ * See README.txt for an overview of the Vim source code.
+ */
+
+/*
+ * regexp_bench.c: Benchmark for the regexp engines in regexp.c and
+ * regexp_nfa.c, which also checks that they find the same matches.
+ *
+ * Usage: regexp_bench [-n lines] [-f file] [-p pattern]
+ *
+ *   -n lines	    number of lines of generated text, default 100000
+ *   -f file	    use the lines of "file" instead of generated text, can be
+ *		    given more than once
+ *   -p pattern	    use "pattern" instead of the builtin patterns, can be
+ *		    given more than once
+ *
+ * The builtin patterns are taken from syntax files and typical searches.
+ * The generated text is a mix of C code, Vim script and prose.
+ * Each pattern is matched against every line with the backtracking engine
+ * ("bt"), the NFA engine ("nfa") and the NFA engine with the lazy DFA
+ * ("dfa"), finding all matches in the line like ":s///g" does.
+ * The result is printed with one line for each pattern and engine, the
+ * fields are separated with a Tab:
+ *	engine pattern lines matches msec MB/s worst-usec worst-line
+ * "worst" is the line that took the longest to match.
+ * The matches found by the NFA engine and the lazy DFA are compared with the
+ * backtracking engine.  Differences are reported with lines starting with
+ * "MISMATCH" and make the exit code one.
+ */
+
+/* Must include main.c because it contains much more than just main() */
+#define NO_VIM_MAIN
+#include "main.c"
+
+#define MAX_PATTERNS	100
+#define MAX_LINE_MATCHES 1000	/* stop looking for matches in a line */
+
+static char *engine_name[] = {"", "bt", "nfa", "dfa"};
+#define FIRST_ENGINE	BACKTRACKING_ENGINE
+#define LAST_ENGINE	LAZY_DFA_ENGINE
+
+/*
+ * Patterns from the syntax files and ones used for searching.
+ */
+static char *builtin_patterns[] = {
+    /* syntax/c.vim */
+    "\\<\\(if\\|else\\|while\\|for\\|do\\|switch\\|return\\)\\>",
+    "\"\\([^\"\\\\]\\|\\\\.\\)*\"",
+    "\\<\\d\\+\\(u\\=l\\{0,2}\\|ll\\=u\\)\\>",
+    "\\<0x\\x\\+\\(u\\=l\\{0,2}\\|ll\\=u\\)\\>",
+    "\\d\\+\\.\\d*\\(e[-+]\\=\\d\\+\\)\\=[fl]\\=",
+    "/\\*\\_.\\{-}\\*/",
+    "//.*$",
+    "^\\s*#\\s*\\(define\\|undef\\|include\\)\\>",
+    "\\<\\h\\w*\\s*(",
+    "\\(\\h\\w*\\)\\@<=->\\h\\w*",
+    /* syntax/vim.vim */
+    "\\<fu\\%[nction]!\\=\\s\\+\\%([sSgGbBwWtTlL]:\\)\\=\\%(\\i\\|[#.]\\)*\\ze\\s*(",
+    "^\\s*\"\\(.*\\)$",
+    "\\<[sgbwtl]:\\h\\w*",
+    "'[^']*'",
+    /* syntax/help.vim and others */
+    "\\<\\(TODO\\|FIXME\\|XXX\\)\\>",
+    "\\<\\u\\l\\+\\>",
+    "[[:upper:]][[:lower:]]\\+",
+    /* searches */
+    "foo.*barBaz",
+    "\\cnull",
+    "\\s\\+$",
+    "\\<\\(\\k\\+\\)\\s\\+\\1\\>",
+    "\\(foo\\)\\@<!bar",
+    "a\\{-1,}b",
+    "^.\\{80,}$",
+    "\\%(alpha\\|beta\\|gamma\\|delta\\)\\s\\+\\%(zeta\\|eta\\|theta\\)",
+    "\\<\\w\\+\\ze(",
+    "[0-9]\\+x",
+    "\\v<(\\w+)\\s*\\=\\s*\\w+>",
+    NULL
+};
+
+static char *words[] = {
+    "alpha", "beta", "gamma", "delta", "zeta", "eta", "theta", "foo",
+    "bar", "baz", "food", "barBaz", "NULL", "the", "quick", "brown", "fox",
+    "jumps", "over", "lazy", "dog", "buffer", "window", "line", "count",
+    "Vim", "Error", "TODO", "value", "index", "result", "xyz", "a", "ab"
+};
+#define WORD_COUNT ((int)(sizeof(words) / sizeof(char *)))
+
+/*
+ * Position of a match, the end line is relative to the start line.
+ */
+typedef struct
+{
+    linenr_T	m_lnum;
+    colnr_T	m_scol;
+    linenr_T	m_elnum;
+    colnr_T	m_ecol;
+} bmatch_T;
+
+static long	bench_lines = 100000L;	/* number of generated lines */
+static long_u	rand_seed = 1;
+static long	total_bytes = 0;	/* bytes in all lines */
+static int	mismatches = 0;
+
+/*
+ * Return a pseudo random number from 0 to "count" - 1.
+ */
+    static int
+rand_nr(int count)
+{
+    rand_seed = (rand_seed * 1103515245 + 12345) & 0x7fffffff;
+    return (int)((rand_seed >> 4) % count);
+}
+
+    static char *
+rand_word(void)
+{
+    return words[rand_nr(WORD_COUNT)];
+}
+
+/*
+ * Return the time in seconds.
+ */
+    static double
+now(void)
+{
+    struct timeval  tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*
+ * Put a generated line in "buf": C code, Vim script or prose.
+ */
+    static void
+generate_line(char *buf, int len)
+{
+    int		n;
+    int		i;
+    size_t	l;
+
+    switch (rand_nr(16))
+    {
+	case 0: vim_snprintf(buf, len, "    if (%s != NULL && %s->%s > %d)",
+			    rand_word(), rand_word(), rand_word(), rand_nr(999));
+		break;
+	case 1: vim_snprintf(buf, len, "\tfor (i = 0; i < %dUL; ++i)",
+								rand_nr(100));
+		break;
+	case 2: vim_snprintf(buf, len, "    %s = %s(%s, \"%s \\\"%s\\\"\", 0x%x);",
+			       rand_word(), rand_word(), rand_word(),
+			       rand_word(), rand_word(), rand_nr(0xffff));
+		break;
+	case 3: vim_snprintf(buf, len, "/* %s %s %s */", rand_word(),
+						      rand_word(), rand_word());
+		break;
+	case 4: vim_snprintf(buf, len, "/* %s %s", rand_word(), rand_word());
+		break;
+	case 5: vim_snprintf(buf, len, "   %s %s */", rand_word(), rand_word());
+		break;
+	case 6: vim_snprintf(buf, len, "#define %s_%s %d.%de-%d",
+			      rand_word(), rand_word(), rand_nr(100),
+			      rand_nr(100), rand_nr(10));
+		break;
+	case 7: vim_snprintf(buf, len, "\treturn %s; // TODO %s %s",
+				       rand_word(), rand_word(), rand_word());
+		break;
+	case 8: vim_snprintf(buf, len, "function! s:%s(%s, %s)",
+				       rand_word(), rand_word(), rand_word());
+		break;
+	case 9: vim_snprintf(buf, len, "  let l:%s = g:%s . '%s %s'",
+			     rand_word(), rand_word(), rand_word(), rand_word());
+		break;
+	case 10: vim_snprintf(buf, len, "  \" %s %s %s", rand_word(),
+						      rand_word(), rand_word());
+		break;
+	default:
+		/* prose, sometimes with trailing space, a repeated word or a
+		 * long line */
+		n = 4 + rand_nr(rand_nr(8) == 0 ? 30 : 12);
+		buf[0] = NUL;
+		for (i = 0; i < n; ++i)
+		{
+		    l = STRLEN(buf);
+		    vim_snprintf(buf + l, len - l, "%s%s", i == 0 ? "" : " ",
+							       rand_word());
+		}
+		if (rand_nr(10) == 0)
+		{
+		    l = STRLEN(buf);
+		    vim_snprintf(buf + l, len - l, " %s %s", words[3], words[3]);
+		}
+		l = STRLEN(buf);
+		vim_snprintf(buf + l, len - l, rand_nr(8) == 0 ? ".  " : ".");
+		if (buf[0] >= 'a' && buf[0] <= 'z')
+		    buf[0] -= 'a' - 'A';
+		break;
+    }
+}
+
+/*
+ * Append a line to the buffer.
+ */
+    static void
+add_line(char_u *line)
+{
+    ml_append(curbuf->b_ml.ml_line_count, line, (colnr_T)0, FALSE);
+    total_bytes += (long)STRLEN(line) + 1;
+}
+
+/*
+ * Append the lines of file "fname" to the buffer.
+ * Returns FAIL when it can't be read.
+ */
+    static int
+read_file(char *fname)
+{
+    FILE	*fd;
+    char	buf[4096];
+    size_t	len;
+
+    fd = mch_fopen(fname, "r");
+    if (fd == NULL)
+    {
+	fprintf(stderr, "Cannot read %s\n", fname);
+	return FAIL;
+    }
+    while (fgets(buf, (int)sizeof(buf), fd) != NULL)
+    {
+	len = STRLEN(buf);
+	if (len > 0 && buf[len - 1] == '\n')
+	    buf[--len] = NUL;
+	add_line((char_u *)buf);
+    }
+    fclose(fd);
+    return OK;
+}
+
+/*
+ * Find all the matches that start in line "lnum" and add them to "ga".
+ */
+    static void
+find_matches(regmmatch_T *rmm, linenr_T lnum, garray_T *ga)
+{
+    colnr_T	col = 0;
+    bmatch_T	*m;
+    char_u	*line;
+
+    while (ga->ga_len < MAX_LINE_MATCHES && rmm->regprog != NULL
+	    && vim_regexec_multi(rmm, NULL, curbuf, lnum, col, NULL, NULL) > 0)
+    {
+	if (ga_grow(ga, 1) == FAIL)
+	    break;
+	m = (bmatch_T *)ga->ga_data + ga->ga_len++;
+	m->m_lnum = lnum;
+	m->m_scol = rmm->startpos[0].col;
+	m->m_elnum = rmm->endpos[0].lnum;
+	m->m_ecol = rmm->endpos[0].col;
+	if (m->m_elnum > 0)
+	    break;
+	col = m->m_ecol;
+	if (col == m->m_scol)
+	{
+	    /* empty match, advance one character */
+	    line = ml_get(lnum);
+	    if (line[col] == NUL)
+		break;
+#ifdef FEAT_MBYTE
+	    if (has_mbyte)
+		col += (*mb_ptr2len)(line + col);
+	    else
+#endif
+		++col;
+	}
+    }
+}
+
+/*
+ * Report a difference between the matches of an engine and the backtracking
+ * engine in line "lnum".
+ */
+    static void
+report_mismatch(
+    int		engine,
+    int		patidx,
+    linenr_T	lnum,
+    bmatch_T	*ref,
+    int		nref,
+    bmatch_T	*found,
+    int		nfound)
+{
+    int		i;
+
+    ++mismatches;
+    printf("MISMATCH\t%s\t%d\tline %ld:", engine_name[engine], patidx,
+								 (long)lnum);
+    for (i = 0; i < nref || i < nfound; ++i)
+    {
+	if (i < nref)
+	    printf(" bt %d-%ld:%d", (int)ref[i].m_scol, (long)ref[i].m_elnum,
+							   (int)ref[i].m_ecol);
+	else
+	    printf(" bt none");
+	if (i < nfound)
+	    printf(" %s %d-%ld:%d", engine_name[engine], (int)found[i].m_scol,
+				 (long)found[i].m_elnum, (int)found[i].m_ecol);
+	else
+	    printf(" %s none", engine_name[engine]);
+    }
+    printf("\n");
+}
+
+/*
+ * Match pattern "pat" against all lines with each engine and output the
+ * results.  "ms" gets the time used by each engine added.
+ */
+    static void
+bench_pattern(int patidx, char_u *pat, double *ms)
+{
+    int		engine;
+    regmmatch_T	rmm;
+    garray_T	ref;	    /* matches of the backtracking engine */
+    garray_T	cur;	    /* matches in one line */
+    int		ri;
+    int		nref;
+    long	count;
+    linenr_T	lnum;
+    linenr_T	worst_lnum;
+    double	start;
+    double	elapsed;
+    double	total;
+    double	worst;
+    int		reported;
+
+    printf("# pattern %d: %s\n", patidx, pat);
+    ga_init2(&ref, (int)sizeof(bmatch_T), 1000);
+    ga_init2(&cur, (int)sizeof(bmatch_T), 100);
+    for (engine = FIRST_ENGINE; engine <= LAST_ENGINE; ++engine)
+    {
+	p_re = engine;
+	rmm.regprog = vim_regcomp(pat, RE_MAGIC);
+	rmm.rmm_ic = FALSE;
+	rmm.rmm_maxcol = 0;
+	if (rmm.regprog == NULL)
+	{
+	    printf("%s\t%d\tcannot compile\n", engine_name[engine], patidx);
+	    if (engine == FIRST_ENGINE)
+		break;
+	    continue;
+	}
+
+	count = 0;
+	total = 0.0;
+	worst = 0.0;
+	worst_lnum = 0;
+	ri = 0;
+	reported = FALSE;
+	for (lnum = 1; lnum <= curbuf->b_ml.ml_line_count; ++lnum)
+	{
+	    cur.ga_len = 0;
+	    start = now();
+	    find_matches(&rmm, lnum, &cur);
+	    elapsed = now() - start;
+	    total += elapsed;
+	    if (elapsed > worst)
+	    {
+		worst = elapsed;
+		worst_lnum = lnum;
+	    }
+	    count += cur.ga_len;
+
+	    if (engine == FIRST_ENGINE)
+	    {
+		if (cur.ga_len > 0 && ga_grow(&ref, cur.ga_len) == OK)
+		{
+		    mch_memmove((bmatch_T *)ref.ga_data + ref.ga_len,
+			      cur.ga_data, cur.ga_len * sizeof(bmatch_T));
+		    ref.ga_len += cur.ga_len;
+		}
+		continue;
+	    }
+
+	    /* Compare with the matches of the backtracking engine. */
+	    for (nref = 0; ri + nref < ref.ga_len
+		    && ((bmatch_T *)ref.ga_data)[ri + nref].m_lnum == lnum;
+								       ++nref)
+		;
+	    if (nref != cur.ga_len || (nref > 0
+			&& memcmp((bmatch_T *)ref.ga_data + ri, cur.ga_data,
+					       nref * sizeof(bmatch_T)) != 0))
+	    {
+		if (!reported)
+		    report_mismatch(engine, patidx, lnum,
+				   (bmatch_T *)ref.ga_data + ri, nref,
+				   (bmatch_T *)cur.ga_data, cur.ga_len);
+		else
+		    ++mismatches;
+		reported = TRUE;
+	    }
+	    ri += nref;
+	}
+	vim_regfree(rmm.regprog);
+
+	ms[engine] += total * 1000.0;
+	printf("%s\t%d\t%ld\t%ld\t%.1f\t%.1f\t%.1f\t%ld\n",
+		engine_name[engine], patidx,
+		(long)curbuf->b_ml.ml_line_count, count, total * 1000.0,
+		total == 0.0 ? 0.0 : total_bytes / total / (1024.0 * 1024.0),
+		worst * 1000000.0, (long)worst_lnum);
+	fflush(stdout);
+    }
+    ga_clear(&ref);
+    ga_clear(&cur);
+}
+
+    int
+main(int argc, char **argv)
+{
+    int		i;
+    char_u	*patterns[MAX_PATTERNS];
+    int		npatterns = 0;
+    int		nfiles = 0;
+    char	buf[300];
+    double	ms[LAST_ENGINE + 1];
+
+    vim_memset(&params, 0, sizeof(params));
+    params.argc = argc;
+    params.argv = argv;
+    common_init(&params);
+    init_chartab();
+    if (ml_open(curbuf) == FAIL)
+	return 1;
+
+    for (i = 1; i < argc; ++i)
+    {
+	if (i + 1 < argc && STRCMP(argv[i], "-n") == 0)
+	    bench_lines = atol(argv[++i]);
+	else if (i + 1 < argc && STRCMP(argv[i], "-f") == 0)
+	{
+	    if (read_file(argv[++i]) == FAIL)
+		return 1;
+	    ++nfiles;
+	}
+	else if (i + 1 < argc && STRCMP(argv[i], "-p") == 0
+						 && npatterns < MAX_PATTERNS)
+	    patterns[npatterns++] = (char_u *)argv[++i];
+	else
+	{
+	    fprintf(stderr,
+		 "Usage: %s [-n lines] [-f file] [-p pattern]\n", argv[0]);
+	    return 1;
+	}
+    }
+
+    if (nfiles == 0)
+	for (i = 0; i < bench_lines; ++i)
+	{
+	    generate_line(buf, (int)sizeof(buf));
+	    add_line((char_u *)buf);
+	}
+    /* remove the empty line the buffer started with */
+    ml_delete((linenr_T)1, FALSE);
+
+    if (npatterns == 0)
+	for (i = 0; builtin_patterns[i] != NULL; ++i)
+	    patterns[npatterns++] = (char_u *)builtin_patterns[i];
+
+    for (i = 0; i <= LAST_ENGINE; ++i)
+	ms[i] = 0.0;
+    printf("# engine\tpattern\tlines\tmatches\tmsec\tMB/s\tworst_usec\tworst_line\n");
+    for (i = 0; i < npatterns; ++i)
+	bench_pattern(i, patterns[i], ms);
+
+    printf("# total msec:");
+    for (i = FIRST_ENGINE; i <= LAST_ENGINE; ++i)
+	printf(" %s %.0f", engine_name[i], ms[i]);
+    printf("\n# mismatches: %d\n", mismatches);
+
+    ml_close(curbuf, TRUE);
+    return mismatches > 0 ? 1 : 0;
+}
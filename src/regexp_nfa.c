@@ -282,10 +282,21 @@ static int nfa_alt_listid;
 /* 0 for first call to nfa_regmatch(), 1 for recursive call. */
 static int nfa_ll_index = 0;
 
+/* The two lists of threads used by nfa_regmatch() are kept for the next call,
+ * so that they don't need to be allocated for every line.  There is a pair
+ * for each level of recursion, up to NFA_KEEP_DEPTH.  Lists bigger than
+ * NFA_KEEP_MAXSIZE bytes are freed. */
+#define NFA_KEEP_DEPTH	    4
+#define NFA_KEEP_MAXSIZE    (1024L * 1024L)
+static void *nfa_keep_list[NFA_KEEP_DEPTH][2];
+static int  nfa_keep_len[NFA_KEEP_DEPTH][2];
+static int  nfa_regmatch_depth = 0;
+
 static int nfa_regcomp_start(char_u *expr, int re_flags);
 static int nfa_get_reganch(nfa_state_T *start, int depth);
 static int nfa_get_regstart(nfa_state_T *start, int depth);
 static char_u *nfa_get_match_text(nfa_state_T *start);
+static char_u *nfa_get_regmust(int *postfix, int *end, int *startp);
 static int realloc_post_list(void);
 static int nfa_recognize_char_class(char_u *start, char_u *end, int extra_newl);
 static int nfa_emit_equi_class(int c);
@@ -554,6 +565,240 @@ nfa_get_match_text(nfa_state_T *start)
     return ret;
 }
 
+/*
+ * Maximum number of bytes kept for each text in nfa_lit_T.  Longer literal
+ * text is truncated, which makes it less selective but still correct.
+ */
+#define NFA_LIT_MAX 32
+
+/*
+ * Literal text found for a part of the postfix form by nfa_get_regmust().
+ */
+typedef struct
+{
+    int		exact;		    /* only matches the text in "pre" */
+    int		prelen;
+    char_u	pre[NFA_LIT_MAX];   /* text every match starts with */
+    int		suflen;
+    char_u	suf[NFA_LIT_MAX];   /* text every match ends with */
+    int		mustlen;
+    char_u	must[NFA_LIT_MAX];  /* text every match contains */
+} nfa_lit_T;
+
+/*
+ * Concatenate "len1" bytes at "s1" and "len2" bytes at "s2" into "to", which
+ * has room for NFA_LIT_MAX bytes.  When "keep_tail" is TRUE and the result
+ * does not fit the start is dropped, otherwise the end.
+ * Returns the resulting length.
+ */
+    static int
+nfa_lit_join(
+    char_u	*to,
+    char_u	*s1,
+    int		len1,
+    char_u	*s2,
+    int		len2,
+    int		keep_tail)
+{
+    char_u	buf[NFA_LIT_MAX * 2];
+    int		len = len1 + len2;
+
+    mch_memmove(buf, s1, (size_t)len1);
+    mch_memmove(buf + len1, s2, (size_t)len2);
+    if (len > NFA_LIT_MAX)
+    {
+	if (keep_tail)
+	    mch_memmove(buf, buf + len - NFA_LIT_MAX, (size_t)NFA_LIT_MAX);
+	len = NFA_LIT_MAX;
+    }
+    mch_memmove(to, buf, (size_t)len);
+    return len;
+}
+
+/*
+ * Find the longest literal text that every match of the postfix form
+ * "postfix" to "end" must contain, also when it is not at the start, e.g.
+ * "barBaz" for "foo.*barBaz".  It is used to quickly reject a line before
+ * running the NFA.  Return it in allocated memory, NULL when there is none.
+ * "*startp" is set to TRUE when every match starts with the text.
+ * With multi-byte encodings only ASCII characters are used, other characters
+ * may match an illegal byte that is not the same text.
+ */
+    static char_u *
+nfa_get_regmust(int *postfix, int *end, int *startp)
+{
+    nfa_lit_T	*stack;
+    nfa_lit_T	*sp;
+    nfa_lit_T	*a;
+    nfa_lit_T	*b;
+    nfa_lit_T	r;
+    int		*p;
+    int		n;
+    char_u	*ret = NULL;
+
+    *startp = FALSE;
+    stack = (nfa_lit_T *)alloc((unsigned)((end - postfix + 1)
+							 * sizeof(nfa_lit_T)));
+    if (stack == NULL)
+	return NULL;
+    sp = stack;
+
+    for (p = postfix; p < end; ++p)
+    {
+	vim_memset(&r, 0, sizeof(r));
+	switch (*p)
+	{
+	    case NFA_NEWL:
+		/* The text may be in another line. */
+		goto theend;
+
+	    case NFA_CONCAT:
+		if (sp - stack < 2)
+		    goto theend;
+		b = --sp;
+		a = sp - 1;
+		r.exact = a->exact && b->exact
+				       && a->prelen + b->prelen <= NFA_LIT_MAX;
+		/* The text at the end of "a" and the start of "b" join. */
+		r.prelen = nfa_lit_join(r.pre, a->pre, a->prelen,
+				b->pre, a->exact ? b->prelen : 0, FALSE);
+		r.suflen = nfa_lit_join(r.suf, a->suf, b->exact ? a->suflen : 0,
+						     b->suf, b->suflen, TRUE);
+		r.mustlen = nfa_lit_join(r.must, a->suf, a->suflen,
+						 b->pre, b->prelen, FALSE);
+		if (a->mustlen > r.mustlen)
+		    r.mustlen = nfa_lit_join(r.must, a->must, a->mustlen,
+						       b->must, 0, FALSE);
+		if (b->mustlen > r.mustlen)
+		    r.mustlen = nfa_lit_join(r.must, b->must, b->mustlen,
+						       a->must, 0, FALSE);
+		*a = r;
+		continue;
+
+	    case NFA_OR:
+	    case NFA_RANGE:
+		if (sp - stack < 2)
+		    goto theend;
+		--sp;
+		break;
+
+	    case NFA_STAR:
+	    case NFA_STAR_NONGREEDY:
+	    case NFA_QUEST:
+	    case NFA_QUEST_NONGREEDY:
+	    case NFA_END_COLL:
+	    case NFA_END_NEG_COLL:
+	    case NFA_COMPOSING:
+	    case NFA_PREV_ATOM_NO_WIDTH:
+	    case NFA_PREV_ATOM_NO_WIDTH_NEG:
+	    case NFA_PREV_ATOM_LIKE_PATTERN:
+		if (sp == stack)
+		    goto theend;
+		--sp;
+		break;
+
+	    case NFA_PREV_ATOM_JUST_BEFORE:
+	    case NFA_PREV_ATOM_JUST_BEFORE_NEG:
+		if (sp == stack)
+		    goto theend;
+		--sp;
+		++p;	/* skip the count */
+		break;
+
+	    case NFA_OPT_CHARS:
+		n = *++p;
+		if (sp - stack < n)
+		    goto theend;
+		sp -= n;
+		break;
+
+	    case NFA_MOPEN:
+	    case NFA_MOPEN1:
+	    case NFA_MOPEN2:
+	    case NFA_MOPEN3:
+	    case NFA_MOPEN4:
+	    case NFA_MOPEN5:
+	    case NFA_MOPEN6:
+	    case NFA_MOPEN7:
+	    case NFA_MOPEN8:
+	    case NFA_MOPEN9:
+#ifdef FEAT_SYN_HL
+	    case NFA_ZOPEN:
+	    case NFA_ZOPEN1:
+	    case NFA_ZOPEN2:
+	    case NFA_ZOPEN3:
+	    case NFA_ZOPEN4:
+	    case NFA_ZOPEN5:
+	    case NFA_ZOPEN6:
+	    case NFA_ZOPEN7:
+	    case NFA_ZOPEN8:
+	    case NFA_ZOPEN9:
+#endif
+	    case NFA_NOPEN:
+		/* A group matches the same text as what is inside. */
+		if (sp == stack)
+		    goto theend;
+		continue;
+
+	    case NFA_LNUM:
+	    case NFA_LNUM_GT:
+	    case NFA_LNUM_LT:
+	    case NFA_VCOL:
+	    case NFA_VCOL_GT:
+	    case NFA_VCOL_LT:
+	    case NFA_COL:
+	    case NFA_COL_GT:
+	    case NFA_COL_LT:
+	    case NFA_MARK:
+	    case NFA_MARK_GT:
+	    case NFA_MARK_LT:
+		++p;	/* skip the lnum, col or mark name */
+		/* FALLTHROUGH */
+	    case NFA_BOL:
+	    case NFA_EOL:
+	    case NFA_BOW:
+	    case NFA_EOW:
+	    case NFA_BOF:
+	    case NFA_EOF:
+	    case NFA_ZSTART:
+	    case NFA_ZEND:
+	    case NFA_CURSOR:
+	    case NFA_VISUAL:
+	    case NFA_EMPTY:
+		/* Zero-width items do not separate the text around them. */
+		r.exact = TRUE;
+		break;
+
+	    default:
+		if (*p > 0
+#ifdef FEAT_MBYTE
+			&& (has_mbyte ? *p < 0x80 : *p < 0x100)
+#else
+			&& *p < 0x100
+#endif
+			)
+		{
+		    r.exact = TRUE;
+		    r.pre[0] = r.suf[0] = r.must[0] = *p;
+		    r.prelen = r.suflen = r.mustlen = 1;
+		}
+		break;
+	}
+	*sp++ = r;
+    }
+
+    if (sp - stack == 1 && stack->mustlen > 0)
+    {
+	ret = vim_strnsave(stack->must, stack->mustlen);
+	*startp = stack->prelen == stack->mustlen
+			&& STRNCMP(stack->pre, stack->must, stack->mustlen) == 0;
+    }
+
+theend:
+    vim_free(stack);
+    return ret;
+}
+
 /*
  * Allocate more space for post_start.  Called when
  * running above the estimated number of states.
@@ -2788,6 +3033,9 @@ nfa_dump(nfa_regprog_T *prog)
 					      prog->regstart, prog->regstart);
 	if (prog->match_text != NULL)
 	    fprintf(debugf, "match_text: \"%s\"\n", prog->match_text);
+	if (prog->regmust != NULL)
+	    fprintf(debugf, "regmust: \"%s\"%s\n", prog->regmust,
+				     prog->regmust_start ? " (at start)" : "");
 
 	fclose(debugf);
     }
@@ -2840,6 +3088,8 @@ alloc_state(int c, nfa_state_T *out, nfa_state_T *out1)
     s->id   = istate;
     s->lastlist[0] = 0;
     s->lastlist[1] = 0;
+    s->lastidx[0] = 0;
+    s->lastidx[1] = 0;
 
     return s;
 }
@@ -4480,12 +4730,20 @@ addstate(
 		     * existing states. */
 		    if (add_here)
 		    {
-			for (k = 0; k < l->n && k < listindex; ++k)
-			    if (l->t[k].state->id == state->id)
-			    {
-				found = TRUE;
-				break;
-			    }
+			/* "lastidx" is where the state was added to the list,
+			 * it is the first one when it is there more than
+			 * once.  Only when that thread was replaced the list
+			 * needs to be searched. */
+			k = state->lastidx[nfa_ll_index];
+			if (k < l->n && l->t[k].state == state)
+			    found = k < listindex;
+			else
+			    for (k = 0; k < l->n && k < listindex; ++k)
+				if (l->t[k].state->id == state->id)
+				{
+				    found = TRUE;
+				    break;
+				}
 		    }
 		    if (!add_here || found)
 		    {
@@ -4531,6 +4789,7 @@ skip_add:
 
 	    /* add the state to the list */
 	    state->lastlist[nfa_ll_index] = l->id;
+	    state->lastidx[nfa_ll_index] = l->n;
 	    thread = &l->t[l->n++];
 	    thread->state = state;
 	    if (pim == NULL)
@@ -4804,6 +5063,7 @@ addstate_here(
     int tlen = l->n;
     int count;
     int listidx = *ip;
+    int i;
 
     /* First add the state(s) at the end, so that we know how many there are.
      * Pass the listidx as offset (avoids adding another argument to
@@ -4858,6 +5118,26 @@ addstate_here(
 		    &(l->t[l->n - 1]),
 		    sizeof(nfa_thread_T) * count);
 	}
+
+	/* Adjust "lastidx" of the states that moved up.  Go backwards, so
+	 * that for a state that is in the list twice only the first one is
+	 * used. */
+	for (i = l->n - 2; i >= listidx + count; --i)
+	{
+	    state = l->t[i].state;
+	    if (state->lastlist[nfa_ll_index] == l->id
+			       && state->lastidx[nfa_ll_index] == i - count + 1)
+		state->lastidx[nfa_ll_index] = i;
+	}
+    }
+
+    /* Adjust "lastidx" of the states that were added. */
+    for (i = 0; i < count; ++i)
+    {
+	state = l->t[listidx + i].state;
+	if (state->lastlist[nfa_ll_index] == l->id
+				    && state->lastidx[nfa_ll_index] == tlen + i)
+	    state->lastidx[nfa_ll_index] = listidx + i;
     }
     --l->n;
     *ip = listidx - 1;
@@ -5041,7 +5321,8 @@ match_zref(
 #endif
 
 /*
- * Save list IDs for all NFA states of "prog" into "list".
+ * Save list IDs and indexes for all NFA states of "prog" into "list", which
+ * has room for twice the number of states.
  * Also reset the IDs to zero.
  * Only used for the recursive value lastlist[1].
  */
@@ -5056,6 +5337,7 @@ nfa_save_listids(nfa_regprog_T *prog, int *list)
     for (i = prog->nstate; --i >= 0; )
     {
 	list[i] = p->lastlist[1];
+	list[i + prog->nstate] = p->lastidx[1];
 	p->lastlist[1] = 0;
 	++p;
     }
@@ -5074,6 +5356,7 @@ nfa_restore_listids(nfa_regprog_T *prog, int *list)
     for (i = prog->nstate; --i >= 0; )
     {
 	p->lastlist[1] = list[i];
+	p->lastidx[1] = list[i + prog->nstate];
 	++p;
     }
 }
@@ -5205,7 +5488,7 @@ recursive_regmatch(
 	 * values and clear them. */
 	if (*listids == NULL)
 	{
-	    *listids = (int *)lalloc(sizeof(int) * nstate, TRUE);
+	    *listids = (int *)lalloc(sizeof(int) * nstate * 2, TRUE);
 	    if (*listids == NULL)
 	    {
 		EMSG(_("E878: (NFA) Could not allocate memory for branch traversal!"));
@@ -5271,6 +5554,7 @@ recursive_regmatch(
 }
 
 static int skip_to_start(int c, colnr_T *colp);
+static int skip_to_regmust(nfa_regprog_T *prog, colnr_T *colp);
 static long find_match_text(colnr_T startcol, int regstart, char_u *match_text);
 
 /*
@@ -5459,6 +5743,89 @@ skip_to_start(int c, colnr_T *colp)
     return OK;
 }
 
+/*
+ * Find "prog->regmust" in the line at or after "*colp".  Uses strstr() and
+ * strchr(), which the C library implements with fast (vectorized) scanning.
+ * When found set "*colp" to its column and return OK.  When it may be there
+ * but can't be found quickly leave "*colp" unchanged and return OK.  Return
+ * FAIL when it is not in the line, thus there is no match.
+ */
+    static int
+skip_to_regmust(nfa_regprog_T *prog, colnr_T *colp)
+{
+    char_u	*must = prog->regmust;
+    char_u	*s = regline + *colp;
+    char_u	*p;
+    char_u	*p1;
+    char_u	*p2;
+    int		lc;
+    int		uc;
+    int		i;
+    int		fold_to_ascii = FALSE;
+
+#ifdef FEAT_MBYTE
+    /* With "\Z" composing characters in the text are ignored. */
+    if (rex.reg_icombine)
+	return OK;
+#endif
+    if (!rex.reg_ic)
+    {
+	p = (char_u *)strstr((char *)s, (char *)must);
+	if (p == NULL)
+	    return FAIL;
+    }
+    else
+    {
+	/* Ignoring case: only ASCII folding is done here.  Some non-ASCII
+	 * characters fold to "i" or "k" (Turkish dotted I, Kelvin sign). */
+	for (i = 0; i < prog->regmlen; ++i)
+	{
+	    if (must[i] >= 0x80)
+		return OK;
+	    if (TOLOWER_ASC(must[i]) == 'i' || TOLOWER_ASC(must[i]) == 'k')
+		fold_to_ascii = TRUE;
+	}
+
+	/* Look for the first character in both cases, check the rest. */
+	lc = TOLOWER_ASC(must[0]);
+	uc = TOUPPER_ASC(must[0]);
+	p1 = (char_u *)strchr((char *)s, lc);
+	p2 = lc == uc ? NULL : (char_u *)strchr((char *)s, uc);
+	for (;;)
+	{
+	    p = (p1 == NULL || (p2 != NULL && p2 < p1)) ? p2 : p1;
+	    if (p == NULL)
+		break;
+	    for (i = 1; i < prog->regmlen
+			     && TOLOWER_ASC(p[i]) == TOLOWER_ASC(must[i]); ++i)
+		;
+	    if (i == prog->regmlen)
+		break;
+	    if (p == p1)
+		p1 = (char_u *)strchr((char *)p1 + 1, lc);
+	    else
+		p2 = (char_u *)strchr((char *)p2 + 1, uc);
+	}
+	if (p == NULL)
+	{
+	    if (fold_to_ascii)
+		for (p = s; *p != NUL; ++p)
+		    if (*p >= 0x80)
+			return OK;
+	    return FAIL;
+	}
+    }
+
+#ifdef FEAT_MBYTE
+    /* With a double-byte encoding the text may be found halfway a
+     * character, don't use it as a start column. */
+    if (enc_dbcs != 0)
+	return OK;
+#endif
+    *colp = (colnr_T)(p - regline);
+    return OK;
+}
+
 /*
  * Check for a match with match_text.
  * Called after skip_to_start() has found regstart.
@@ -5533,6 +5900,25 @@ nfa_did_time_out()
 }
 #endif
 
+#if defined(EXITFREE) || defined(PROTO)
+/*
+ * Free the lists kept by nfa_regmatch().
+ */
+    static void
+nfa_free_lists(void)
+{
+    int	    depth;
+
+    for (depth = 0; depth < NFA_KEEP_DEPTH; ++depth)
+    {
+	vim_free(nfa_keep_list[depth][0]);
+	vim_free(nfa_keep_list[depth][1]);
+	nfa_keep_list[depth][0] = NULL;
+	nfa_keep_list[depth][1] = NULL;
+    }
+}
+#endif
+
 /*
  * Main matching routine.
  *
@@ -5566,6 +5952,8 @@ nfa_regmatch(
     int		add_count;
     int		add_off = 0;
     int		toplevel = start->c == NFA_MOPEN;
+    int		depth;
+    int		i;
 #ifdef NFA_REGEXP_DEBUG_LOG
     FILE	*debug;
 #endif
@@ -5590,13 +5978,25 @@ nfa_regmatch(
 #endif
     nfa_match = FALSE;
 
-    /* Allocate memory for the lists of nodes. */
+    /* Get memory for the lists of nodes, use the lists kept from a previous
+     * call when they are big enough. */
     size = (nstate + 1) * sizeof(nfa_thread_T);
-
-    list[0].t = (nfa_thread_T *)lalloc(size, TRUE);
-    list[0].len = nstate + 1;
-    list[1].t = (nfa_thread_T *)lalloc(size, TRUE);
-    list[1].len = nstate + 1;
+    depth = nfa_regmatch_depth++;
+    for (i = 0; i < 2; ++i)
+    {
+	if (depth < NFA_KEEP_DEPTH && nfa_keep_list[depth][i] != NULL
+				   && nfa_keep_len[depth][i] >= nstate + 1)
+	{
+	    list[i].t = (nfa_thread_T *)nfa_keep_list[depth][i];
+	    list[i].len = nfa_keep_len[depth][i];
+	    nfa_keep_list[depth][i] = NULL;
+	}
+	else
+	{
+	    list[i].t = (nfa_thread_T *)lalloc(size, TRUE);
+	    list[i].len = nstate + 1;
+	}
+    }
     if (list[0].t == NULL || list[1].t == NULL)
 	goto theend;
 
@@ -5683,7 +6083,9 @@ nfa_regmatch(
 	nextlist->n = 0;	    /* clear nextlist */
 	nextlist->has_pim = FALSE;
 	++nfa_listid;
-	if (prog->re_engine == AUTOMATIC_ENGINE && nfa_listid >= NFA_MAX_STATES)
+	if ((prog->re_engine == AUTOMATIC_ENGINE
+		    || prog->re_engine == LAZY_DFA_ENGINE)
+					       && nfa_listid >= NFA_MAX_STATES)
 	{
 	    /* too many states, retry with old engine */
 	    nfa_match = NFA_TOO_EXPENSIVE;
@@ -6886,6 +7288,11 @@ nfa_regmatch(
 			 * character that must appear at the start. */
 			if (skip_to_start(prog->regstart, &col) == FAIL)
 			    break;
+			/* When the match starts with longer text, skip ahead
+			 * to where that text is. */
+			if (prog->regmust_start && prog->regmlen > 1
+				     && skip_to_regmust(prog, &col) == FAIL)
+			    break;
 #ifdef ENABLE_LOG
 			fprintf(log_fd, "  Skipping ahead %d bytes to regstart\n",
 				col - ((colnr_T)(reginput - regline) + clen));
@@ -6966,9 +7373,20 @@ nextchar:
 #endif
 
 theend:
-    /* Free memory */
-    vim_free(list[0].t);
-    vim_free(list[1].t);
+    /* Keep the lists for the next call or free them. */
+    for (i = 0; i < 2; ++i)
+    {
+	if (depth < NFA_KEEP_DEPTH && list[i].t != NULL
+		  && (long)list[i].len * sizeof(nfa_thread_T) <= NFA_KEEP_MAXSIZE)
+	{
+	    vim_free(nfa_keep_list[depth][i]);
+	    nfa_keep_list[depth][i] = list[i].t;
+	    nfa_keep_len[depth][i] = list[i].len;
+	}
+	else
+	    vim_free(list[i].t);
+    }
+    --nfa_regmatch_depth;
     vim_free(listids);
 #undef ADD_STATE_IF_MATCH
 #ifdef NFA_REGEXP_DEBUG_LOG
@@ -7117,6 +7535,522 @@ nfa_regtry(
     return 1 + reglnum;
 }
 
+/*
+ * Lazy DFA, used with 'regexpengine' set to 3.
+ *
+ * Simulating the NFA recomputes the same sets of states over and over for
+ * every position in every line.  For patterns that only use characters,
+ * character classes, collections, alternatives, multis and the zero-width
+ * items "^", "$", "\<" and "\>" a DFA state is built the first time a set
+ * of NFA states is reached and the transition for each character is
+ * remembered.  The DFA only tells whether the line has a match, the NFA is
+ * then used to find where it is and the submatches.  Most lines don't match,
+ * those are rejected at the cost of one table lookup per byte.
+ *
+ * The DFA only handles ASCII characters with multi-byte encodings.  When
+ * another character is found the NFA is used for the line.  The memory used
+ * for the states is limited, when it is full all the states are flushed.
+ * When that happens too often the DFA is not used for the pattern.
+ */
+
+#define NFA_DFA_MAXMEM	    (256L * 1024L)  /* memory for states of one DFA */
+#define NFA_DFA_MAXFLUSH    20	/* stop using the DFA after this many flushes */
+#define NFA_DFA_HASHSIZE    256	/* number of buckets in the hash table */
+
+/* Class of the character before the current position, needed for "^", "\<"
+ * and "\>". */
+#define DFA_PREV_BOL	0	/* at the start of the line */
+#define DFA_PREV_OTHER	1	/* not a word character */
+#define DFA_PREV_WORD	2	/* word character */
+
+typedef struct nfa_dstate_S nfa_dstate_T;
+
+/*
+ * A state of the DFA: the set of NFA states that are active after matching a
+ * character.  The start state is always active, it is not included.
+ */
+struct nfa_dstate_S
+{
+    nfa_dstate_T *ds_hash_next;	/* next state in the same hash bucket */
+    nfa_dstate_T **ds_next;	/* next state for each character, NULL when
+				 * not computed yet */
+    char_u	ds_matched[32];	/* bit set for a character that has a match
+				 * just before it */
+    int		ds_prev;	/* DFA_PREV_ value */
+    int		ds_len;		/* number of items in ds_states[] */
+    int		*ds_states;	/* indexes in prog->state[], sorted */
+};
+
+struct nfa_dfa_S
+{
+    int		dfa_failed;	/* too many flushes, don't use the DFA */
+    int		dfa_use_word;	/* pattern uses "\<", "\>" or "\k" */
+    int		dfa_ic;		/* value of rex.reg_ic the states are for */
+    char_u	dfa_chartab[32]; /* 'iskeyword' the states are for */
+    int		dfa_nchars;	/* number of characters in ds_next[] */
+    nfa_dstate_T *dfa_start[3];	/* start state for each DFA_PREV_ value */
+    nfa_dstate_T *dfa_hash[NFA_DFA_HASHSIZE];
+    long	dfa_mem;	/* memory used for the states */
+    int		dfa_flushes;	/* number of times the states were flushed */
+    int		*dfa_mark;	/* for each NFA state: dfa_markid when done */
+    int		dfa_markid;
+    int		*dfa_work;	/* NFA states for a new DFA state */
+    nfa_state_T	**dfa_stack;	/* used when computing the next state */
+};
+
+static nfa_dfa_T *nfa_dfa_new(nfa_regprog_T *prog);
+static void nfa_dfa_flush(nfa_dfa_T *dfa);
+static void nfa_dfa_free(nfa_dfa_T *dfa);
+static int nfa_dfa_word(nfa_dfa_T *dfa, int c);
+static int nfa_dfa_char_match(nfa_state_T *state, int c);
+static int nfa_dfa_compare(const void *s1, const void *s2);
+static nfa_dstate_T *nfa_dfa_find_state(nfa_dfa_T *dfa, int prev, int *states, int len);
+static nfa_dstate_T *nfa_dfa_step(nfa_regprog_T *prog, nfa_dstate_T *ds, int c, int *matched);
+static int nfa_dfa_exec(nfa_regprog_T *prog, colnr_T col);
+
+/*
+ * Create the DFA for "prog".
+ * Returns NULL when the pattern contains something the DFA doesn't handle.
+ */
+    static nfa_dfa_T *
+nfa_dfa_new(nfa_regprog_T *prog)
+{
+    nfa_dfa_T	*dfa;
+    int		use_word = FALSE;
+    int		i;
+
+#ifdef FEAT_MBYTE
+    if (prog->regflags & RF_ICOMBINE)
+	return NULL;
+#endif
+    for (i = 0; i < prog->nstate; ++i)
+    {
+	int c = prog->state[i].c;
+
+	if (c > 0)
+	    continue;
+	switch (c)
+	{
+	    case NFA_BOW:
+	    case NFA_EOW:
+	    case NFA_KWORD:
+	    case NFA_SKWORD:
+		use_word = TRUE;
+		break;
+
+	    case NFA_SPLIT:
+	    case NFA_EMPTY:
+	    case NFA_MATCH:
+	    case NFA_BOL:
+	    case NFA_EOL:
+	    case NFA_ZSTART:
+	    case NFA_ZEND:
+	    case NFA_NOPEN:
+	    case NFA_NCLOSE:
+	    case NFA_START_COLL:
+	    case NFA_START_NEG_COLL:
+	    case NFA_END_COLL:
+	    case NFA_RANGE_MIN:
+	    case NFA_RANGE_MAX:
+	    case NFA_ANY:
+		break;
+
+	    default:
+		if ((c >= NFA_MOPEN && c <= NFA_MCLOSE9)
+#ifdef FEAT_SYN_HL
+			|| (c >= NFA_ZOPEN && c <= NFA_ZCLOSE9)
+#endif
+			|| (c >= NFA_WHITE && c <= NFA_NUPPER_IC)
+			|| (c >= NFA_CLASS_ALNUM && c <= NFA_CLASS_ESCAPE))
+		    break;
+		/* Backreference, look-around, position, newline, etc. */
+		return NULL;
+	}
+    }
+
+    dfa = (nfa_dfa_T *)alloc_clear((unsigned)sizeof(nfa_dfa_T));
+    if (dfa == NULL)
+	return NULL;
+    dfa->dfa_use_word = use_word;
+#ifdef FEAT_MBYTE
+    dfa->dfa_nchars = has_mbyte ? 0x80 : 0x100;
+#else
+    dfa->dfa_nchars = 0x100;
+#endif
+    dfa->dfa_mark = (int *)alloc_clear((unsigned)(prog->nstate * sizeof(int)));
+    dfa->dfa_work = (int *)alloc((unsigned)((prog->nstate + 1) * sizeof(int)));
+    dfa->dfa_stack = (nfa_state_T **)alloc((unsigned)
+			       ((prog->nstate * 3 + 2) * sizeof(nfa_state_T *)));
+    if (dfa->dfa_mark == NULL || dfa->dfa_work == NULL
+						    || dfa->dfa_stack == NULL)
+    {
+	nfa_dfa_free(dfa);
+	return NULL;
+    }
+    return dfa;
+}
+
+/*
+ * Free all the states of "dfa".
+ */
+    static void
+nfa_dfa_flush(nfa_dfa_T *dfa)
+{
+    nfa_dstate_T    *ds;
+    int		    i;
+
+    for (i = 0; i < NFA_DFA_HASHSIZE; ++i)
+	while (dfa->dfa_hash[i] != NULL)
+	{
+	    ds = dfa->dfa_hash[i];
+	    dfa->dfa_hash[i] = ds->ds_hash_next;
+	    vim_free(ds);
+	}
+    for (i = 0; i < 3; ++i)
+	dfa->dfa_start[i] = NULL;
+    dfa->dfa_mem = 0;
+}
+
+    static void
+nfa_dfa_free(nfa_dfa_T *dfa)
+{
+    if (dfa != NULL)
+    {
+	nfa_dfa_flush(dfa);
+	vim_free(dfa->dfa_mark);
+	vim_free(dfa->dfa_work);
+	vim_free(dfa->dfa_stack);
+	vim_free(dfa);
+    }
+}
+
+/*
+ * Return TRUE if "c" is a word character for "\<", "\>" and "\k".
+ */
+    static int
+nfa_dfa_word(nfa_dfa_T *dfa, int c)
+{
+    return dfa->dfa_use_word && vim_iswordc_buf(c, rex.reg_buf);
+}
+
+/*
+ * Return TRUE if "state", which consumes a character, matches "c".
+ * "c" is not NUL.  Must do the same as nfa_regmatch().
+ */
+    static int
+nfa_dfa_char_match(nfa_state_T *state, int c)
+{
+    nfa_state_T	*s;
+    int		c1, c2;
+
+    switch (state->c)
+    {
+	case NFA_ANY:	    return TRUE;
+	case NFA_KWORD:	    return vim_iswordc_buf(c, rex.reg_buf);
+	case NFA_SKWORD:    return !VIM_ISDIGIT(c)
+					       && vim_iswordc_buf(c, rex.reg_buf);
+	case NFA_WHITE:	    return VIM_ISWHITE(c);
+	case NFA_NWHITE:    return !VIM_ISWHITE(c);
+	case NFA_DIGIT:	    return ri_digit(c);
+	case NFA_NDIGIT:    return !ri_digit(c);
+	case NFA_HEX:	    return ri_hex(c);
+	case NFA_NHEX:	    return !ri_hex(c);
+	case NFA_OCTAL:	    return ri_octal(c);
+	case NFA_NOCTAL:    return !ri_octal(c);
+	case NFA_WORD:	    return ri_word(c);
+	case NFA_NWORD:	    return !ri_word(c);
+	case NFA_HEAD:	    return ri_head(c);
+	case NFA_NHEAD:	    return !ri_head(c);
+	case NFA_ALPHA:	    return ri_alpha(c);
+	case NFA_NALPHA:    return !ri_alpha(c);
+	case NFA_LOWER:	    return ri_lower(c);
+	case NFA_NLOWER:    return !ri_lower(c);
+	case NFA_UPPER:	    return ri_upper(c);
+	case NFA_NUPPER:    return !ri_upper(c);
+	case NFA_LOWER_IC:  return ri_lower(c) || (rex.reg_ic && ri_upper(c));
+	case NFA_NLOWER_IC: return !(ri_lower(c)
+					       || (rex.reg_ic && ri_upper(c)));
+	case NFA_UPPER_IC:  return ri_upper(c) || (rex.reg_ic && ri_lower(c));
+	case NFA_NUPPER_IC: return !(ri_upper(c)
+					       || (rex.reg_ic && ri_lower(c)));
+
+	case NFA_START_COLL:
+	case NFA_START_NEG_COLL:
+	    for (s = state->out; s->c != NFA_END_COLL; s = s->out)
+	    {
+		if (s->c == NFA_RANGE_MIN)
+		{
+		    c1 = s->val;
+		    s = s->out;	    /* advance to NFA_RANGE_MAX */
+		    c2 = s->val;
+		    if (c >= c1 && c <= c2)
+			return state->c == NFA_START_COLL;
+		    if (rex.reg_ic)
+			for ( ; c1 <= c2; ++c1)
+			    if (MB_TOLOWER(c1) == MB_TOLOWER(c))
+				return state->c == NFA_START_COLL;
+		}
+		else if (s->c < 0 ? check_char_class(s->c, c)
+			: (c == s->c
+			    || (rex.reg_ic && MB_TOLOWER(c) == MB_TOLOWER(s->c))))
+		    return state->c == NFA_START_COLL;
+	    }
+	    return state->c != NFA_START_COLL;
+    }
+
+    /* regular character */
+    return c == state->c
+		    || (rex.reg_ic && MB_TOLOWER(c) == MB_TOLOWER(state->c));
+}
+
+/*
+ * qsort() compare function for NFA state indexes.
+ */
+    static int
+nfa_dfa_compare(const void *s1, const void *s2)
+{
+    return *(int *)s1 - *(int *)s2;
+}
+
+/*
+ * Find the DFA state for "prev" and the sorted NFA state indexes "states"
+ * with "len" items.  Create it when it doesn't exist yet.  When the memory
+ * limit is reached all states are flushed first.
+ * Returns NULL when out of memory.
+ */
+    static nfa_dstate_T *
+nfa_dfa_find_state(nfa_dfa_T *dfa, int prev, int *states, int len)
+{
+    nfa_dstate_T    *ds;
+    long_u	    hash = prev;
+    long	    size;
+    int		    i;
+
+    for (i = 0; i < len; ++i)
+	hash = hash * 101 + states[i];
+    hash %= NFA_DFA_HASHSIZE;
+
+    for (ds = dfa->dfa_hash[hash]; ds != NULL; ds = ds->ds_hash_next)
+	if (ds->ds_prev == prev && ds->ds_len == len
+		&& memcmp(ds->ds_states, states, len * sizeof(int)) == 0)
+	    return ds;
+
+    size = (long)(sizeof(nfa_dstate_T)
+			      + dfa->dfa_nchars * sizeof(nfa_dstate_T *)
+			      + len * sizeof(int));
+    if (dfa->dfa_mem + size > NFA_DFA_MAXMEM)
+    {
+	nfa_dfa_flush(dfa);
+	if (++dfa->dfa_flushes > NFA_DFA_MAXFLUSH)
+	{
+	    dfa->dfa_failed = TRUE;
+	    return NULL;
+	}
+    }
+
+    ds = (nfa_dstate_T *)alloc_clear((unsigned)size);
+    if (ds == NULL)
+	return NULL;
+    ds->ds_next = (nfa_dstate_T **)(ds + 1);
+    ds->ds_states = (int *)(ds->ds_next + dfa->dfa_nchars);
+    ds->ds_prev = prev;
+    ds->ds_len = len;
+    mch_memmove(ds->ds_states, states, len * sizeof(int));
+    ds->ds_hash_next = dfa->dfa_hash[hash];
+    dfa->dfa_hash[hash] = ds;
+    dfa->dfa_mem += size;
+    return ds;
+}
+
+/*
+ * Compute the DFA state that follows "ds" when the next character is "c".
+ * When there is a match before "c" set "*matched" and return "ds".
+ * When "c" is NUL and there is no match also return "ds".
+ * Returns NULL when out of memory.
+ * "ds" may have been freed when another state is returned.
+ */
+    static nfa_dstate_T *
+nfa_dfa_step(
+    nfa_regprog_T   *prog,
+    nfa_dstate_T    *ds,
+    int		    c,
+    int		    *matched)
+{
+    nfa_dfa_T	    *dfa = prog->dfa;
+    nfa_state_T	    **sp = dfa->dfa_stack;
+    nfa_state_T	    *state;
+    nfa_dstate_T    *next;
+    int		    word = c != NUL && nfa_dfa_word(dfa, c);
+    int		    len = 0;
+    int		    flushes = dfa->dfa_flushes;
+    int		    i, j;
+
+    *matched = FALSE;
+    if (++dfa->dfa_markid <= 0)
+    {
+	vim_memset(dfa->dfa_mark, 0, prog->nstate * sizeof(int));
+	dfa->dfa_markid = 1;
+    }
+
+    /* Follow the zero-width states from the active ones and the start state
+     * and find the states that "c" leads to. */
+    *sp++ = prog->start;
+    for (i = 0; i < ds->ds_len; ++i)
+	*sp++ = &prog->state[ds->ds_states[i]];
+    while (sp > dfa->dfa_stack)
+    {
+	state = *--sp;
+	if (dfa->dfa_mark[state - prog->state] == dfa->dfa_markid)
+	    continue;
+	dfa->dfa_mark[state - prog->state] = dfa->dfa_markid;
+
+	switch (state->c)
+	{
+	    case NFA_MATCH:
+		*matched = TRUE;
+		ds->ds_matched[c >> 3] |= 1 << (c & 7);
+		return ds;
+
+	    case NFA_SPLIT:
+		*sp++ = state->out1;
+		*sp++ = state->out;
+		break;
+
+	    case NFA_BOL:
+		if (ds->ds_prev == DFA_PREV_BOL)
+		    *sp++ = state->out;
+		break;
+
+	    case NFA_EOL:
+		if (c == NUL)
+		    *sp++ = state->out;
+		break;
+
+	    case NFA_BOW:
+		if (word && ds->ds_prev != DFA_PREV_WORD)
+		    *sp++ = state->out;
+		break;
+
+	    case NFA_EOW:
+		if (!word && ds->ds_prev == DFA_PREV_WORD)
+		    *sp++ = state->out;
+		break;
+
+	    default:
+		if (state->c > 0
+			|| state->c == NFA_START_COLL
+			|| state->c == NFA_START_NEG_COLL
+			|| (state->c >= NFA_ANY && state->c <= NFA_NUPPER_IC))
+		{
+		    if (c != NUL && nfa_dfa_char_match(state, c))
+			/* The next state of a collection is after the end. */
+			dfa->dfa_work[len++] = (int)((state->c == NFA_START_COLL
+				    || state->c == NFA_START_NEG_COLL
+				    ? state->out1->out : state->out)
+								- prog->state);
+		}
+		else
+		    /* NFA_EMPTY, NFA_MOPEN, NFA_MCLOSE, NFA_ZSTART, etc. */
+		    *sp++ = state->out;
+		break;
+	}
+    }
+
+    if (c == NUL)
+    {
+	ds->ds_next[c] = ds;
+	return ds;
+    }
+
+    /* Sort and remove duplicates, so that the same set gets the same
+     * state. */
+    qsort((void *)dfa->dfa_work, (size_t)len, sizeof(int), nfa_dfa_compare);
+    for (i = j = 0; i < len; ++i)
+	if (j == 0 || dfa->dfa_work[i] != dfa->dfa_work[j - 1])
+	    dfa->dfa_work[j++] = dfa->dfa_work[i];
+
+    next = nfa_dfa_find_state(dfa, word ? DFA_PREV_WORD : DFA_PREV_OTHER,
+							   dfa->dfa_work, j);
+    if (next != NULL && dfa->dfa_flushes == flushes)
+	ds->ds_next[c] = next;
+    return next;
+}
+
+/*
+ * Use the DFA of "prog" to check if there is a match in the line at or after
+ * "col".  Returns FAIL when there is no match, OK when there is one or the
+ * DFA can't tell.
+ */
+    static int
+nfa_dfa_exec(nfa_regprog_T *prog, colnr_T col)
+{
+    nfa_dfa_T	    *dfa = prog->dfa;
+    nfa_dstate_T    *ds;
+    nfa_dstate_T    *next;
+    char_u	    *p;
+    int		    nchars = dfa->dfa_nchars;
+    int		    prev;
+    int		    matched;
+    int		    c;
+
+    if (rex.reg_line_lbr
+#ifdef FEAT_MBYTE
+	    || rex.reg_icombine
+#endif
+	    )
+	return OK;
+#ifdef FEAT_MBYTE
+    if (has_mbyte && nchars > 0x80)
+	nchars = 0x80;
+#endif
+
+    /* The states depend on 'ignorecase' and 'iskeyword'. */
+    if (dfa->dfa_ic != rex.reg_ic || (dfa->dfa_use_word
+		&& memcmp(dfa->dfa_chartab, rex.reg_buf->b_chartab, 32) != 0))
+    {
+	nfa_dfa_flush(dfa);
+	dfa->dfa_ic = rex.reg_ic;
+	mch_memmove(dfa->dfa_chartab, rex.reg_buf->b_chartab, 32);
+    }
+
+    if (col == 0)
+	prev = DFA_PREV_BOL;
+    else
+    {
+	c = regline[col - 1];
+	if (c >= nchars)
+	    return OK;
+	prev = nfa_dfa_word(dfa, c) ? DFA_PREV_WORD : DFA_PREV_OTHER;
+    }
+    ds = dfa->dfa_start[prev];
+    if (ds == NULL)
+    {
+	ds = nfa_dfa_find_state(dfa, prev, dfa->dfa_work, 0);
+	if (ds == NULL)
+	    return OK;
+	dfa->dfa_start[prev] = ds;
+    }
+
+    for (p = regline + col; ; ++p)
+    {
+	c = *p;
+	if (c >= nchars)
+	    return OK;
+	if (ds->ds_matched[c >> 3] & (1 << (c & 7)))
+	    return OK;
+	next = ds->ds_next[c];
+	if (next == NULL)
+	{
+	    next = nfa_dfa_step(prog, ds, c, &matched);
+	    if (next == NULL || matched)
+		return OK;
+	}
+	if (c == NUL)
+	    return FAIL;
+	ds = next;
+    }
+}
+
 /*
  * Match a regexp against a string ("line" points to the string) or multiple
  * lines ("line" is NULL, use reg_getline()).
@@ -7181,6 +8115,19 @@ nfa_regexec_both(
     if (prog->reganch && col > 0)
 	return 0L;
 
+    /* If there is text that every match must contain and it is not in the
+     * line there is no match.  When every match starts with it skip ahead
+     * to where it is. */
+    if (prog->regmust != NULL)
+    {
+	colnr_T mustcol = col;
+
+	if (skip_to_regmust(prog, &mustcol) == FAIL)
+	    return 0L;
+	if (prog->regmust_start)
+	    col = mustcol;
+    }
+
     need_clear_subexpr = TRUE;
 #ifdef FEAT_SYN_HL
     /* Clear the external match subpointers if necessary. */
@@ -7222,6 +8169,11 @@ nfa_regexec_both(
 	prog->state[i].lastlist[1] = 0;
     }
 
+    /* The lazy DFA quickly finds out when there is no match. */
+    if (prog->dfa != NULL && !prog->dfa->dfa_failed
+					   && nfa_dfa_exec(prog, col) == FAIL)
+	goto theend;
+
     retval = nfa_regtry(prog, col, tm, timed_out);
 
     nfa_regengine.expr = NULL;
@@ -7309,10 +8261,14 @@ nfa_regcomp(char_u *expr, int re_flags)
     prog->nsubexp = regnpar;
 
     nfa_postprocess(prog);
+    prog->dfa = (re_flags & RE_DFA) ? nfa_dfa_new(prog) : NULL;
 
     prog->reganch = nfa_get_reganch(prog->start, 0);
     prog->regstart = nfa_get_regstart(prog->start, 0);
     prog->match_text = nfa_get_match_text(prog->start);
+    prog->regmust = nfa_get_regmust(postfix, post_ptr, &prog->regmust_start);
+    if (prog->regmust != NULL)
+	prog->regmlen = (int)STRLEN(prog->regmust);
 
 #ifdef ENABLE_LOG
     nfa_postfix_dump(expr, OK);
@@ -7350,6 +8306,8 @@ nfa_regfree(regprog_T *prog)
     if (prog != NULL)
     {
 	vim_free(((nfa_regprog_T *)prog)->match_text);
+	vim_free(((nfa_regprog_T *)prog)->regmust);
+	nfa_dfa_free(((nfa_regprog_T *)prog)->dfa);
 	vim_free(((nfa_regprog_T *)prog)->pattern);
 	vim_free(prog);
     }
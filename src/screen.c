@@ -6488,6 +6488,22 @@ status_redraw_curbuf(void)
 	}
 }
 
+/*
+ * mark all status lines of buffer "buf" for redraw
+ */
+    void
+status_redraw_buf(buf_T *buf)
+{
+    win_T	*wp;
+
+    FOR_ALL_WINDOWS(wp)
+	if (wp->w_status_height != 0 && wp->w_buffer == buf)
+	{
+	    wp->w_redr_status = TRUE;
+	    redraw_later(VALID);
+	}
+}
+
 /*
  * Redraw all status lines that need to be redrawn.
  */
@@ -6918,6 +6934,14 @@ win_redr_status(win_T *wp)
 	    STRCPY(p + len, _("[RO]"));
 	    len += (int)STRLEN(p + len);
 	}
+#ifdef FEAT_ASYNC_WRITE
+	if (write_async_percent(wp->w_buffer) >= 0)
+	{
+	    vim_snprintf((char *)p + len, MAXPATHL - len, _("[writing %d%%]"),
+					   write_async_percent(wp->w_buffer));
+	    len += (int)STRLEN(p + len);
+	}
+#endif
 
 	this_ru_col = ru_col - (Columns - W_WIDTH(wp));
 	if (this_ru_col < (W_WIDTH(wp) + 1) / 2)
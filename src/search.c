@@ -220,7 +220,7 @@ search_regcomp(
 
     regmatch->rmm_ic = ignorecase(pat);
     regmatch->rmm_maxcol = 0;
-    regmatch->regprog = vim_regcomp(pat, magic ? RE_MAGIC : 0);
+    regmatch->regprog = vim_regcomp(pat, (magic ? RE_MAGIC : 0) + RE_CACHE);
     if (regmatch->regprog == NULL)
 	return FAIL;
     return OK;
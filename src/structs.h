@@ -342,6 +342,11 @@ struct u_entry
     linenr_T	ue_lcount;	/* linecount when u_save called */
     char_u	**ue_array;	/* array of lines in undo block */
     long	ue_size;	/* number of lines in ue_array */
+    int		ue_delta;	/* when TRUE ue_array[0] only holds the bytes
+				   that differ from the line in the buffer */
+    colnr_T	ue_prefix;	/* when ue_delta is TRUE: number of bytes at
+				   the start of the buffer line to use */
+    colnr_T	ue_suffix;	/* idem, at the end of the buffer line */
 #ifdef U_DEBUG
     int		ue_magic;	/* magic number to check allocation */
 #endif
@@ -381,6 +386,14 @@ struct u_header
     time_T	uh_time;	/* timestamp when the change was made */
     long	uh_save_nr;	/* set when the file was saved after the
 				   changes in this block */
+    int		uh_dirty;	/* changed since writing the undo file, see
+				   below */
+#ifdef FEAT_PERSISTENT_UNDO
+    long	uh_size;	/* bytes used for the entries in memory */
+    off_T	uh_spill_off;	/* offset of the entries in the spill file */
+    long	uh_spill_len;	/* bytes used in the spill file, zero when the
+				   entries are in memory */
+#endif
 #ifdef U_DEBUG
     int		uh_magic;	/* magic number to check allocation */
 #endif
@@ -390,6 +403,10 @@ struct u_header
 #define UH_CHANGED  0x01	/* b_changed flag before undo/after redo */
 #define UH_EMPTYBUF 0x02	/* buffer was empty */
 
+/* values for uh_dirty */
+#define UH_DIRTY_LINKS 0x01	/* uh_next, uh_prev, etc. changed */
+#define UH_DIRTY_ALL   0x02	/* anything else changed */
+
 /*
  * structures used in undo.c
  */
@@ -463,6 +480,12 @@ typedef struct mf_hashtab_S
  * The used list is a doubly linked list, most recently used block first.
  *	The blocks in the used list have a block of memory allocated.
  *	mf_used_count is the number of pages in the used list.
+ *	The list has two parts: first the "hot" blocks, that were used again
+ *	while in memory, then the "cold" blocks, starting at mf_used_cold.
+ *	A block that is read or created goes to the front of the cold part,
+ *	thus reading many blocks only once doesn't push out the hot blocks.
+ *	A block that was uncompressed is hot, it was used again soon after
+ *	it was released.
  * The hash lists are used to quickly find a block in the used list.
  * The free list is a single linked list, not sorted.
  *	The blocks in the free list have no block of memory allocated and
@@ -478,10 +501,12 @@ struct block_hdr
     bhdr_T	*bh_prev;	    /* previous block_hdr in used list */
     char_u	*bh_data;	    /* pointer to memory (for used block) */
     int		bh_page_count;	    /* number of pages in this block */
+    long_u	bh_used;	    /* when the block was last used */
 
 #define BH_DIRTY    1
 #define BH_LOCKED   2
-    char	bh_flags;	    /* BH_DIRTY or BH_LOCKED */
+#define BH_HOT	    4		    /* block is in the hot part of used list */
+    char	bh_flags;	    /* BH_DIRTY, BH_LOCKED and BH_HOT */
 };
 
 /*
@@ -500,6 +525,69 @@ struct nr_trans
     blocknr_T	nt_new_bnum;		/* new, positive, number */
 };
 
+/*
+ * A data block with a negative number that was filled when reading the
+ * edited file and was not changed since then holds exactly the text of a
+ * range of bytes in that file.  Such a block can be dropped from memory
+ * instead of writing it to the swap file, it is read back from the original
+ * file when needed.  This is remembered in the backing lists, with the same
+ * structure as the hash lists.
+ */
+typedef struct nr_backing NR_BACKING;
+
+struct nr_backing
+{
+    mf_hashitem_T nb_hashitem;		/* header for hash table and key */
+#define nb_bnum nb_hashitem.mhi_key	/* negative block number */
+
+    off_T	nb_offset;		/* offset of the text in the file */
+    long	nb_size;		/* number of bytes in the file */
+    linenr_T	nb_line_count;		/* number of lines in the block */
+    int		nb_page_count;		/* number of pages in the block */
+    int		nb_dropped;		/* TRUE when not in memory */
+    long_u	nb_sum;			/* checksum of the text when dropped */
+};
+
+/*
+ * A block that was released from memory can be kept in memory compressed,
+ * so that it doesn't need to be read back from the swap file or the original
+ * file.  The compressed blocks are in the zip lists, with the same structure
+ * as the hash lists, and in a list with the most recently released one
+ * first.
+ */
+typedef struct nr_zipped NR_ZIPPED;
+
+struct nr_zipped
+{
+    mf_hashitem_T nz_hashitem;		/* header for hash table and key */
+#define nz_bnum nz_hashitem.mhi_key	/* block number */
+
+    NR_ZIPPED	*nz_next;		/* next (older) compressed block */
+    NR_ZIPPED	*nz_prev;		/* previous (newer) compressed block */
+    int		nz_page_count;		/* number of pages in the block */
+    unsigned	nz_size;		/* number of bytes in nz_data */
+    char_u	nz_data[1];		/* compressed block, actually longer */
+};
+
+/*
+ * The user of a memfile can store a digest computed from the contents of a
+ * block, so that it doesn't need to be computed again while the block does
+ * not change.  The digests are in the digest lists, with the same structure
+ * as the hash lists.  A digest is forgotten when the block is changed or
+ * freed.
+ */
+#define MF_DIGEST_LEN	8		/* nr of values in a digest */
+
+typedef struct nr_digest NR_DIGEST;
+
+struct nr_digest
+{
+    mf_hashitem_T nd_hashitem;		/* header for hash table and key */
+#define nd_bnum nd_hashitem.mhi_key	/* block number */
+
+    UINT32_T	nd_digest[MF_DIGEST_LEN];
+};
+
 
 typedef struct buffblock buffblock_T;
 typedef struct buffheader buffheader_T;
@@ -600,7 +688,9 @@ struct memfile
     bhdr_T	*mf_free_first;		/* first block_hdr in free list */
     bhdr_T	*mf_used_first;		/* mru block_hdr in used list */
     bhdr_T	*mf_used_last;		/* lru block_hdr in used list */
+    bhdr_T	*mf_used_cold;		/* mru cold block_hdr in used list */
     unsigned	mf_used_count;		/* number of pages in used list */
+    unsigned	mf_hot_count;		/* number of hot pages in used list */
     unsigned	mf_used_count_max;	/* maximum number of pages in memory */
     mf_hashtab_T mf_hash;		/* hash lists */
     mf_hashtab_T mf_trans;		/* trans lists */
@@ -610,6 +700,20 @@ struct memfile
     blocknr_T	mf_infile_count;	/* number of pages in the file */
     unsigned	mf_page_size;		/* number of bytes in a page */
     int		mf_dirty;		/* TRUE if there are dirty blocks */
+    mf_hashtab_T mf_backing;		/* backing lists */
+    mf_hashtab_T mf_zip;		/* zip lists */
+    NR_ZIPPED	*mf_zip_first;		/* most recently compressed block */
+    NR_ZIPPED	*mf_zip_last;		/* least recently compressed block */
+    long_u	mf_zip_size;		/* bytes used for compressed blocks */
+    int		mf_orig_fd;		/* original file for mf_backing or -1 */
+    int		mf_orig_dos;		/* original file has CR-NL line breaks */
+    mf_hashtab_T mf_digest;		/* digest lists */
+#ifdef FEAT_SWAP_THREAD
+    int		mf_async_pending;	/* nr of requests for writer thread */
+    int		mf_async_error;		/* writer thread failed to write */
+    int		mf_async_abandoned;	/* blocks marked dirty when exiting on
+					   a signal */
+#endif
 #ifdef FEAT_CRYPT
     buf_T	*mf_buffer;		/* buffer this memfile is for */
     char_u	mf_seed[MF_SEED_LEN];	/* seed for encryption */
@@ -638,6 +742,25 @@ typedef struct info_pointer
     int		ip_index;	/* index for block with current lnum */
 } infoptr_T;	/* block/index pair */
 
+/*
+ * Data blocks that were used recently are kept locked in memory, together
+ * with the stack of pointer blocks leading to them.  Going back to a line in
+ * one of them then does not require walking the tree of pointer blocks.
+ */
+#define ML_CACHE_SIZE	8	/* number of cached data blocks */
+#define ML_CACHE_DEPTH	8	/* max stack depth of a cached block */
+
+typedef struct mlcache_S
+{
+    bhdr_T	*mc_hp;		/* locked data block, NULL if entry not used */
+    linenr_T	mc_low;		/* first line in mc_hp */
+    linenr_T	mc_high;	/* last line in mc_hp */
+    long	mc_used;	/* value of ml_cache_hits + ml_cache_misses
+				   when last used */
+    int		mc_stack_top;	/* number of entries in mc_stack */
+    infoptr_T	mc_stack[ML_CACHE_DEPTH];   /* ml_stack for mc_hp */
+} mlcache_T;
+
 #ifdef FEAT_BYTEOFF
 typedef struct ml_chunksize
 {
@@ -678,10 +801,24 @@ typedef struct memline
     linenr_T	ml_locked_low;	/* first line in ml_locked */
     linenr_T	ml_locked_high;	/* last line in ml_locked */
     int		ml_locked_lineadd;  /* number of lines inserted in ml_locked */
+
+    mlcache_T	*ml_cache;	/* ML_CACHE_SIZE entries, NULL if not used yet */
+    long	ml_cache_hits;	/* line found in ml_locked or ml_cache */
+    long	ml_cache_misses; /* had to search the tree for a line */
+
+    /* Used while reading the original file to find out which bytes of it
+     * end up in which data block, see ml_backing_add(). */
+    blocknr_T	ml_backing_bnum;    /* block receiving lines, zero if none */
+    off_T	ml_backing_start;   /* file offset of first line in it */
+    off_T	ml_backing_next;    /* file offset of next line */
+    linenr_T	ml_backing_lines;   /* number of lines added to it */
+    int		ml_backing_pages;   /* page count of that block */
 #ifdef FEAT_BYTEOFF
     chunksize_T *ml_chunksize;
     int		ml_numchunks;
     int		ml_usedchunks;
+    chunksize_T *ml_chunktree;	/* sums of ml_chunksize[], NULL if not
+				   computed yet */
 #endif
 } memline_T;
 
@@ -1956,6 +2093,9 @@ struct file_buffer
 
     int		b_saving;	/* Set to TRUE if we are in the middle of
 				   saving the buffer. */
+#ifdef FEAT_ASYNC_WRITE
+    struct write_async_S *b_write_async; /* writing in the background */
+#endif
 
     /*
      * Changes to a buffer require updating of the display.  To minimize the
@@ -1975,6 +2115,12 @@ struct file_buffer
     long	b_mtime_read;	/* last change time when reading */
     off_T	b_orig_size;	/* size of original file in bytes */
     int		b_orig_mode;	/* mode of original file */
+#ifdef FEAT_FILEWATCH
+    int		b_watch_wd;	/* inotify watch of the directory of the file,
+				   zero when not watched */
+    int		b_watch_changed; /* TRUE when the file may have changed since
+				   the timestamps were stored */
+#endif
 #ifdef FEAT_VIMINFO
     time_T	b_last_used;	/* time when the buffer was last used; used
 				 * for viminfo */
@@ -2044,6 +2190,20 @@ struct file_buffer
     long	b_u_seq_cur;	/* hu_seq of header below which we are now */
     time_T	b_u_time_cur;	/* uh_time of header below which we are now */
     long	b_u_save_nr_cur; /* file write nr after which we are now */
+#ifdef FEAT_PERSISTENT_UNDO
+    char_u	*b_u_jname;	/* undo file that changes can be appended to,
+				   NULL when it must be written completely */
+    off_T	b_u_jbase;	/* size of b_u_jname without appended changes */
+    off_T	b_u_jsize;	/* size of b_u_jname when last written */
+    time_t	b_u_jmtime;	/* modification time of b_u_jname */
+    int		b_u_junchanged;	/* u_unchanged() called since writing */
+    garray_T	b_u_jfreed;	/* uh_seq of headers freed since writing */
+    long_u	b_u_size;	/* bytes used for entries in memory */
+    char_u	*b_u_sname;	/* spill file for 'undomemory' or NULL */
+    FILE	*b_u_sfp;	/* idem, open for reading and writing */
+    off_T	b_u_ssize;	/* bytes written to the spill file */
+    off_T	b_u_sdead;	/* bytes in it that are no longer used */
+#endif
 
     /*
      * variables for "U" command in undo.c
@@ -2127,6 +2287,7 @@ struct file_buffer
 #endif
     int		b_p_eol;	/* 'endofline' */
     int		b_p_fixeol;	/* 'fixendofline' */
+    int		b_p_fot;	/* 'followtail' */
     int		b_p_et;		/* 'expandtab' */
     int		b_p_et_nobin;	/* b_p_et saved for binary mode */
     int	        b_p_et_nopaste; /* b_p_et saved for paste mode */
@@ -161,6 +161,7 @@ NEW_TESTS = test_arabic.res \
 	    test_man.res \
 	    test_marks.res \
 	    test_matchadd_conceal.res \
+	    test_memline.res \
 	    test_mksession.res \
 	    test_mksession_utf8.res \
 	    test_nested_function.res \
@@ -632,3 +632,136 @@ func Test_BufleaveWithDelete()
   new
   bwipe! Xfile1
 endfunc
+
+" Simple patterns are matched without a regexp, check they work like one.
+func Test_autocmd_simple_patterns()
+  let g:matched = []
+  augroup test_simple_patterns
+    au!
+    au User *.ext call add(g:matched, 'ext')
+    au User *.tar.gz call add(g:matched, 'tar.gz')
+    au User Makefile call add(g:matched, 'name')
+    au User * call add(g:matched, 'any')
+    au User *.[ch] call add(g:matched, 'regex')
+    au User <buffer> call add(g:matched, 'buffer')
+  augroup END
+
+  doautocmd User foo.ext
+  call assert_equal(['ext', 'any', 'buffer'], g:matched)
+  let g:matched = []
+  doautocmd User foo.tar.gz
+  call assert_equal(['tar.gz', 'any', 'buffer'], g:matched)
+  let g:matched = []
+  doautocmd User Makefile
+  call assert_equal(['name', 'any', 'buffer'], g:matched)
+  let g:matched = []
+  doautocmd User xMakefile
+  call assert_equal(['any', 'buffer'], g:matched)
+  let g:matched = []
+  doautocmd User foo.h
+  call assert_equal(['any', 'regex', 'buffer'], g:matched)
+
+  " Without the patterns that match anything the index is used.
+  au! test_simple_patterns User *
+  au! test_simple_patterns User *.[ch]
+  au! test_simple_patterns User <buffer>
+  let g:matched = []
+  doautocmd User foo.c
+  doautocmd User ext
+  call assert_equal([], g:matched)
+  doautocmd User dir/foo.ext
+  call assert_equal(['ext'], g:matched)
+
+  let save_fic = &fileignorecase
+  set fileignorecase
+  let g:matched = []
+  doautocmd User FOO.EXT
+  doautocmd User makefile
+  call assert_equal(['ext', 'name'], g:matched)
+  set nofileignorecase
+  let g:matched = []
+  doautocmd User FOO.EXT
+  doautocmd User makefile
+  call assert_equal([], g:matched)
+  let &fileignorecase = save_fic
+
+  " A pattern with a directory matches the end of the path, or a suffix.
+  augroup test_simple_patterns
+    au User */sub/file.txt call add(g:matched, 'path')
+    au User *log call add(g:matched, 'suffix')
+  augroup END
+  let g:matched = []
+  doautocmd User dir/sub/file.txt
+  doautocmd User dir/xsub/file.txt
+  doautocmd User file.txt
+  doautocmd User changelog
+  call assert_equal(['path', 'suffix'], g:matched)
+  au! test_simple_patterns User */sub/file.txt
+  au! test_simple_patterns User *log
+
+  " Removed patterns don't match.
+  au! test_simple_patterns User *.ext
+  let g:matched = []
+  doautocmd User foo.ext
+  call assert_equal([], g:matched)
+  call assert_false(exists('#User#*.ext'))
+  call assert_true(exists('#User#Makefile'))
+
+  au! test_simple_patterns
+  augroup! test_simple_patterns
+  unlet g:matched
+endfunc
+
+func Test_autocmdtime()
+  if !has('profile')
+    return
+  endif
+  augroup test_autocmdtime
+    au!
+    au User Xslow sleep 10m
+    au User Xslow,Xfast let g:count_fast += 1
+    au User Xnested doautocmd User Xslow
+  augroup END
+  let g:count_fast = 0
+
+  autocmdtime clear
+  doautocmd User Xslow
+  call assert_equal([], autocmdtime())
+
+  autocmdtime on
+  doautocmd User Xslow
+  doautocmd User Xfast
+  doautocmd User Xfast
+  doautocmd User Xnested
+  autocmdtime off
+  doautocmd User Xfast
+
+  let l = autocmdtime()
+  call assert_equal(4, len(l))
+  call assert_equal('sleep 10m', l[0].cmd)
+  call assert_equal(2, l[0].count)
+  call assert_equal('User', l[0].event)
+  call assert_equal('test_autocmdtime', l[0].group)
+  call assert_equal('Xslow', l[0].pattern)
+  call assert_true(l[0].total >= 0.02)
+  call assert_true(l[0].max >= 0.01)
+  call assert_true(l[0].max <= l[0].total)
+  " The nested autocommand includes the time of the one it triggers.
+  call assert_equal('doautocmd User Xslow', l[1].cmd)
+  call assert_equal(1, l[1].count)
+  call assert_true(l[1].total >= 0.01)
+  call assert_equal(['Xfast', 'Xslow'], sort(map(l[2:], 'v:val.pattern')))
+
+  let lines = split(execute('autocmdtime report count'), "\n")
+  call assert_match('TOTAL\s*COUNT\s*SLOWEST', lines[0])
+  call assert_equal(7, len(lines))
+  call assert_match('^\s*[0-9.]\+\s\+1\s.*User  test_autocmdtime  Xnested  doautocmd User Xslow', lines[4])
+  call assert_fails('autocmdtime report xxx', 'E475:')
+  call assert_fails('autocmdtime xxx', 'E475:')
+
+  autocmdtime clear
+  call assert_equal([], autocmdtime())
+  au! test_autocmdtime
+  augroup! test_autocmdtime
+  unlet g:count_fast
+endfunc
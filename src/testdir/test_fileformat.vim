@@ -31,3 +31,29 @@ func Test_fileformat_autocommand()
   au! BufReadPre Xfile
   bw!
 endfunc
+
+" Test splitting the text in lines when reading a file
+func Test_fileformat_read_lines()
+  " NUL bytes are written as NL and read back as NL.
+  let lines = ["one\ntwo", "\n\n", "", "three\r", repeat('x', 70000) . "\n"]
+  call writefile(lines, 'Xfile')
+  new Xfile
+  call assert_equal('unix', &ff)
+  call assert_equal(lines, getline(1, '$'))
+  bw!
+
+  call writefile(map(copy(lines), 'v:val . "\r"') + ['last'], 'Xfile', 'b')
+  new Xfile
+  call assert_equal('dos', &ff)
+  call assert_equal(lines + ['last'], getline(1, '$'))
+  call assert_equal(0, &eol)
+  bw!
+
+  " Latin1 text with and without non-ASCII characters.
+  call writefile(["abc", "d\xe9f", repeat('a', 100000), "g\xe8h"], 'Xfile')
+  exe "new ++enc=latin1 Xfile"
+  call assert_equal(["abc", "déf", repeat('a', 100000), "gèh"],
+	\ getline(1, '$'))
+  bw!
+  call delete('Xfile')
+endfunc
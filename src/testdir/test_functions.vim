@@ -595,6 +595,50 @@ func Test_byte2line_line2byte()
   bw!
 endfunc
 
+" Many chunks of lines are used for the byte offsets in a large buffer, also
+" after changing lines all over the buffer.
+func Test_byte2line_line2byte_large()
+  new
+  let lines = map(range(1, 20000), 'v:val . repeat("x", v:val % 13)')
+  call setline(1, lines)
+  for i in range(1, 100)
+    let lnum = (i * 7919) % len(lines) + 1
+    if i % 3 == 0
+      exe lnum . 'delete'
+      call remove(lines, lnum - 1)
+    elseif i % 3 == 1
+      call append(lnum, ['new ' . i, 'more'])
+      call extend(lines, ['new ' . i, 'more'], lnum)
+    else
+      call setline(lnum, repeat('y', i))
+      let lines[lnum - 1] = repeat('y', i)
+    endif
+  endfor
+  call assert_equal(lines, getline(1, '$'))
+
+  for ff in ['unix', 'dos']
+    let &fileformat = ff
+    let eol = ff == 'dos' ? 2 : 1
+    let offset = 1
+    for lnum in range(1, len(lines))
+      if lnum % 97 == 1
+	call assert_equal(offset, line2byte(lnum))
+	call assert_equal(lnum, byte2line(offset))
+	call assert_equal(lnum, byte2line(offset + len(lines[lnum - 1])))
+	exe 'goto ' . (offset + 1)
+	call assert_equal([lnum, len(lines[lnum - 1]) > 0 ? 2 : 1],
+	      \ [line('.'), col('.')])
+      endif
+      let offset += len(lines[lnum - 1]) + eol
+    endfor
+    call assert_equal(offset, line2byte(len(lines) + 1))
+    call assert_equal(-1, byte2line(offset))
+  endfor
+
+  set fileformat&
+  bw!
+endfunc
+
 func Test_count()
   let l = ['a', 'a', 'A', 'b']
   call assert_equal(2, count(l, 'a'))
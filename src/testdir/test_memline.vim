@@ -0,0 +1,211 @@
+" Tests for the memline and memfile, keeping text in blocks.
+
+func s:ViewWithLittleMemory(fname)
+  let s:save_mm = &maxmem
+  " A new buffer's memfile uses the 'maxmem' value when it's created.
+  set maxmem=1
+  exe 'view ' . a:fname
+endfunc
+
+func s:RestoreMemory()
+  let &maxmem = s:save_mm
+endfunc
+
+" Text of a read-only buffer that doesn't fit in 'maxmem' is read back from
+" the file when needed.
+func Test_view_large_file()
+  let lines = []
+  for i in range(1, 20000)
+    call add(lines, 'line ' . i . repeat(' text', i % 17))
+  endfor
+  call writefile(lines, 'Xmemline')
+
+  call s:ViewWithLittleMemory('Xmemline')
+  call assert_equal(20000, line('$'))
+  call assert_equal(lines, getline(1, '$'))
+  " Read everything again, now the start was dropped from memory.
+  call assert_equal(lines, getline(1, '$'))
+  call assert_equal(lines[12345], getline(12346))
+
+  " Changing the buffer creates a swap file, text is kept there from now on.
+  call setline(5000, 'changed')
+  let lines[4999] = 'changed'
+  call assert_equal(lines, getline(1, '$'))
+  call assert_equal(lines, getline(1, '$'))
+
+  bwipe!
+  call s:RestoreMemory()
+  call delete('Xmemline')
+endfunc
+
+func Test_view_large_file_dos()
+  let lines = []
+  for i in range(1, 10000)
+    call add(lines, 'line ' . i . "\<C-M>" . "\n" . repeat('x', i % 23) . "\r")
+  endfor
+  call writefile(lines + [''], 'Xmemline', 'b')
+
+  call s:ViewWithLittleMemory('Xmemline')
+  call assert_equal('dos', &fileformat)
+  let lines = map(lines, 'v:val[:-2]')
+  call assert_equal(lines, getline(1, '$'))
+  call assert_equal(lines, getline(1, '$'))
+
+  bwipe!
+  call s:RestoreMemory()
+  call delete('Xmemline')
+endfunc
+
+func Test_view_changed_file()
+  if !has('unix')
+    return
+  endif
+  let lines = []
+  for i in range(1, 20000)
+    call add(lines, printf('line %05d', i))
+  endfor
+  call writefile(lines, 'Xmemline')
+
+  call s:ViewWithLittleMemory('Xmemline')
+  call assert_equal(lines, getline(1, '$'))
+
+  " Overwrite the file in place, the text read back doesn't match.
+  call writefile(map(copy(lines), 'toupper(v:val)'), 'Xmemline')
+  call assert_fails('call getline(1, "$")', 'E948:')
+  call assert_equal(20000, line('$'))
+  call assert_true(index(getline(1, '$'), '???LINES MISSING') >= 0)
+
+  bwipe!
+  call s:RestoreMemory()
+  call delete('Xmemline')
+endfunc
+
+" Putting, deleting and undoing many lines at once fills and frees whole
+" blocks, check the text and the byte offsets.
+func Test_append_delete_many_lines()
+  new
+  let lines = []
+  for i in range(1, 5000)
+    call add(lines, i . repeat('-', i % 73))
+  endfor
+  call setline(1, ['first', 'last'])
+  call setreg('a', lines, 'l')
+  1put a
+  let &undolevels = &undolevels
+  call assert_equal(['first'] + lines + ['last'], getline(1, '$'))
+  call assert_equal(6 + len(join(lines, "\n")) + 2, line2byte(line('$')))
+  call assert_equal(6 + len(join(lines[:2999], "\n")) + 2, line2byte(3002))
+
+  100,4000d
+  let &undolevels = &undolevels
+  call assert_equal(['first'] + lines[:97] + lines[3999:] + ['last'],
+	\ getline(1, '$'))
+  call assert_equal(6 + len(join(lines[:97] + lines[3999:], "\n")) + 2,
+	\ line2byte(line('$')))
+  undo
+  call assert_equal(['first'] + lines + ['last'], getline(1, '$'))
+  call assert_equal(6 + len(join(lines, "\n")) + 2, line2byte(line('$')))
+
+  2,$-1sort! n
+  let &undolevels = &undolevels
+  call assert_equal(['first'] + reverse(copy(lines)) + ['last'],
+	\ getline(1, '$'))
+  2,1001m $
+  let &undolevels = &undolevels
+  call assert_equal(['first'] + reverse(lines[:3999]) + ['last']
+	\ + reverse(lines[4000:]), getline(1, '$'))
+  undo
+  undo
+  call assert_equal(['first'] + lines + ['last'], getline(1, '$'))
+
+  %d
+  let &undolevels = &undolevels
+  call assert_equal([''], getline(1, '$'))
+  undo
+  call assert_equal(['first'] + lines + ['last'], getline(1, '$'))
+  bwipe!
+endfunc
+
+" Going back and forth between lines in a few blocks finds them in the cache.
+func Test_memstats_cache()
+  new
+  call setline(1, map(range(1, 30000), '"line " . v:val'))
+  call assert_equal({}, memstats(9999))
+  let before = memstats()
+  for i in range(20)
+    for lnum in [1, 10000, 20000, 30000]
+      call assert_equal('line ' . lnum, getline(lnum))
+    endfor
+  endfor
+  let after = memstats('%')
+  call assert_inrange(before.cachemisses, before.cachemisses + 8,
+	\ after.cachemisses)
+  call assert_true(after.cachehits >= before.cachehits + 70)
+
+  " Deleting lines updates the line numbers of the cached blocks.
+  5000,5099d
+  call assert_equal('line 20100', getline(20000))
+  call assert_equal('line 30000', getline(29900))
+  call assert_equal('line 10100', getline(10000))
+  bwipe!
+endfunc
+
+" Blocks that are used again stay in memory when going over all the text once.
+func Test_memstats_hot_blocks()
+  let save_mm = &maxmem
+  set maxmem=256
+  new
+  call setline(1, map(range(1, 40000),
+	\ 'printf("line %05d %s", v:val, repeat("x", 30))'))
+  let hot = map(range(1, 12), 'v:val * 3000 + 500')
+  for round in range(3)
+    for lnum in hot
+      call assert_equal(printf('line %05d', lnum), getline(lnum)[:9])
+    endfor
+  endfor
+  let before = memstats()
+  call assert_true(before.used > 0)
+
+  call assert_equal(40000, len(getline(1, '$')))
+  let after = memstats()
+  call assert_true(after.reads >= before.reads + 300)
+  call assert_true(after.evictions >= before.evictions + 300)
+
+  for lnum in hot
+    call assert_equal(printf('line %05d', lnum), getline(lnum)[:9])
+  endfor
+  call assert_equal(after.reads, memstats().reads)
+  bwipe!
+  let &maxmem = save_mm
+endfunc
+
+" Blocks released from memory are kept compressed, text that fits in 'maxmem'
+" that way doesn't need to be read back.
+func Test_memstats_zipped_blocks()
+  let save_mm = &maxmem
+  set maxmem=256
+  " Reading blocks from the swap file is fast, compress them anyway.
+  call test_override('memzip', 1)
+  new
+  let lines = map(range(1, 10000), 'printf("line %05d %s", v:val, repeat("x", 30))')
+  call setline(1, lines)
+  call assert_equal(lines, getline(1, '$'))
+  let before = memstats()
+  call assert_true(before.zipped > 0)
+  call assert_inrange(200, 10000, before.zipratio)
+
+  call assert_equal(lines, getline(1, '$'))
+  let after = memstats()
+  call assert_equal(before.reads, after.reads)
+  call assert_true(after.unzips >= before.unzips + 30)
+  call assert_true(after.used < 300 * 1024)
+
+  " Changing the text doesn't use the compressed copy.
+  call setline(5000, 'changed')
+  let lines[4999] = 'changed'
+  call assert_equal(lines, getline(1, '$'))
+  call assert_equal(lines, getline(1, '$'))
+  bwipe!
+  call test_override('memzip', 0)
+  let &maxmem = save_mm
+endfunc
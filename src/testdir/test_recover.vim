@@ -15,4 +15,32 @@ func Test_recover_root_dir()
   set dir&
 endfunc
 
+" With 'swapthread' typed text is written to the swap file in the background.
+func Test_swapthread()
+  if !has('swapthread')
+    return
+  endif
+  set swapthread updatecount=1
+  new Xswapthread
+  call feedkeys("ifirst line typed\<CR>second line typed\<Esc>", 'xt')
+  let swname = substitute(execute('swapname'), '\n', '', 'g')
+  for i in range(100)
+    let text = join(readfile(swname, 'b'))
+    if text =~ 'second line typed'
+      break
+    endif
+    sleep 10m
+  endfor
+  call assert_true(text =~ 'first line typed', 'first line not in swap file')
+  call assert_true(text =~ 'second line typed', 'second line not in swap file')
+
+  call setline(3, 'third line set')
+  preserve
+  call assert_true(join(readfile(swname, 'b')) =~ 'third line set',
+	\ 'text not preserved')
+  bwipe!
+  call assert_false(filereadable(swname))
+  set noswapthread updatecount&
+endfunc
+
 " TODO: move recover tests from test78.in to here.
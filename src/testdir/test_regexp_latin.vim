@@ -72,3 +72,124 @@ func Test_backref()
   call assert_fails('call search("\\%#=2\\(e\\1\\)")', 'E65:')
   bwipe!
 endfunc
+
+func Test_required_literal()
+  " The NFA engine rejects lines without text that every match contains.
+  let lines = ['foo x barBaz', 'foo x barbaz', 'barBaz foo', 'xbarBazfoo',
+	\ 'foo barB az', 'FOO BARBAZ']
+  for re in range(0, 2)
+    exe 'set re=' . re
+    call assert_equal(['foo x barBaz'],
+	  \ filter(copy(lines), 'v:val =~# "foo.*barBaz"'))
+    call assert_equal(['foo x barBaz', 'foo x barbaz', 'FOO BARBAZ'],
+	  \ filter(copy(lines), 'v:val =~? "foo.*barBaz"'))
+    call assert_equal(['barBaz foo', 'xbarBazfoo'],
+	  \ filter(copy(lines), 'v:val =~# "bar\\(B\\)a\\%(z\\)\\zsfoo\\|barBaz foo"'))
+    call assert_equal(['xbarBazfoo'],
+	  \ filter(copy(lines), 'v:val =~# "\\(x\\)\\@<=barBaz\\<\\?foo"'))
+    call assert_equal([1, 7, 6], [match('xx fooabc', 'x.\?fooa'),
+	  \ matchend('a foo x', '\<fo\+ x'), match('fo fo foobar', 'foob')])
+    call assert_equal('barbaz', matchstr('foo x barbaz', '\cBAR\%[B]AZ'))
+    call assert_equal(-1, match("foo\nbar", 'foo\nbar\n'))
+  endfor
+  set re=0
+endfunc
+
+func Test_lazy_dfa()
+  " 'regexpengine' 3 must give the same results as the NFA engine.
+  let pats = ['\<\(foo\|bar\)\s\+baz\>', '^\a\+\d$', '[^a-z ]\+', 'x\zsy\>',
+	\ '\v(ab|cd)+e', 'a\{2,3}b', '\%[abc]x', '\u\l\+', '\(a\)\1', '.$']
+  let lines = ['foo  baz', 'xbar baz', 'abc1', 'ab 12', 'xy xyz',
+	\ 'cdabe', 'aaab', 'bcx', 'Word', 'aa', '', 'é x']
+  for ic in [0, 1]
+    let &ignorecase = ic
+    for pat in pats
+      for line in lines
+	for col in [0, 1, 3]
+	  call assert_equal([match(line, '\%#=2' . pat, col),
+		\ matchend(line, '\%#=2' . pat, col)],
+		\ [match(line, '\%#=3' . pat, col),
+		\ matchend(line, '\%#=3' . pat, col)], pat . ' ' . line)
+	endfor
+      endfor
+    endfor
+  endfor
+  set ignorecase&
+
+  " The DFA states depend on 'iskeyword'.
+  new
+  set re=3
+  call setline(1, ['a-b c', 'x a-b'])
+  call assert_equal(2, len(filter(getline(1, '$'), 'v:val =~ "\\<b\\>"')))
+  setlocal iskeyword+=-
+  call assert_equal([], filter(getline(1, '$'), 'v:val =~ "\\<b\\>"'))
+  call assert_equal(['x a-b'], filter(getline(1, '$'), 'v:val =~ "\\<a-b$"'))
+  setlocal iskeyword-=-
+  call assert_equal(['x a-b'], filter(getline(1, '$'), 'v:val =~ "\\<a\\>.\\<b$"'))
+  " Changing 'iskeyword' while the pattern is used.
+  setlocal iskeyword+=-
+  call setline(1, ['a-b c', 'a-b', 'a-b'])
+  %s/\<\(b\|c\)\>/\=execute('setlocal iskeyword-=-') . 'X'/
+  call assert_equal(['a-b X', 'a-X', 'a-X'], getline(1, '$'))
+  set re=0
+  bwipe!
+endfunc
+
+func Test_regexp_cache()
+  let pat = 'cache\(d\|s\) \(\w\+\)'
+  let before = regcachestats()
+  call assert_equal(64, before.size)
+  for i in range(10)
+    call assert_equal('s', substitute('caches text', pat, '\1', ''))
+    call assert_equal(['cached x', 'd', 'x'],
+	  \ matchlist('a cached x', pat)[:2])
+  endfor
+  let after = regcachestats()
+  call assert_equal(1, after.misses - before.misses)
+  call assert_equal(19, after.hits - before.hits)
+
+  " Different flags use a different program.
+  new
+  call setline(1, ['abc', 'a.c'])
+  call assert_equal(1, search('a.c', 'nwc'))
+  set nomagic
+  call assert_equal(2, search('a.c', 'nwc'))
+  set magic
+  call assert_equal(1, search('a.c', 'nwc'))
+  bwipe!
+
+  " More patterns than fit in the cache.
+  for i in range(100)
+    call assert_equal(1, ('x' . i) =~ '^x' . i . '$')
+  endfor
+  call assert_equal(64, regcachestats().entries)
+  call assert_equal(['cached x', 'd', 'x'], matchlist('a cached x', pat)[:2])
+
+  " A program in use by a match is kept when it is dropped from the cache.
+  new
+  call setline(1, 'one two')
+  let id = matchadd('Search', 'two')
+  for i in range(100)
+    call assert_equal(1, ('y' . i) =~ '^y' . i . '$')
+  endfor
+  redraw
+  call assert_equal(['two'], map(getmatches(), 'v:val.pattern'))
+  call assert_equal(['two'], split('one two', ' ')[1:])
+  call matchdelete(id)
+  bwipe!
+endfunc
+
+func Test_nfa_thread_lists()
+  " Zero-width items in many alternatives, nested look-behind and a pattern
+  " too big for the kept lists give the same result as the old engine.
+  let words = map(range(300), '"w" . v:val . "q"')
+  let big = '\<\(' . join(words, '\|') . '\)\>'
+  for pat in ['\<\(\<a\|\<ab\|\<abc\)\>', '\(\<b\)\@<=cd\|\<cd',
+	\ '\(\(x\)\@<=\(y\)\@<=z\|yz\)\>', big]
+    for str in ['x ab abc', 'bcd cd xyz', 'w1q w299q w300q']
+      call assert_equal(matchlist(str, '\%#=1' . pat),
+	    \ matchlist(str, '\%#=2' . pat), pat . ' on ' . str)
+    endfor
+  endfor
+  call assert_equal('w299q', matchstr('w300q w299q', '\%#=2' . big))
+endfunc
@@ -47,6 +47,179 @@ func Test_checktime()
   call delete(fname)
 endfunc
 
+func Test_checktime_filewatch()
+  if !has('filewatch')
+    return
+  endif
+  call assert_fails('set filewatch=xxx', 'E474:')
+
+  let fname = 'Xtest.tmp'
+  call writefile(['Hello World!'], fname)
+  set autoread filewatch=all
+  exec 'e' fname
+  sleep 1
+  call writefile(['Hello World! - filewatch'], fname)
+  checktime
+  call assert_equal('Hello World! - filewatch', getline(1))
+
+  " Writing a new file and renaming it over the file is noticed.
+  call writefile(['renamed'], 'Xtest2.tmp')
+  call rename('Xtest2.tmp', fname)
+  checktime
+  call assert_equal('renamed', getline(1))
+
+  " Watching stops when the option is reset.
+  set filewatch=
+  call writefile(['not watched'], fname)
+  checktime
+  call assert_equal('not watched', getline(1))
+
+  set autoread&
+  bwipe!
+  call delete(fname)
+endfunc
+
+func Test_checktime_tail()
+  let fname = 'Xtest.tmp'
+  call writefile(['one', 'two'], fname)
+  set autoread
+  exec 'e' fname
+  call setline(1, 'ONE')
+  write
+  2mark a
+
+  " Text appended to the file is appended to the buffer, undo and marks
+  " are kept.
+  call writefile(['three', 'four'], fname, 'a')
+  checktime
+  call assert_equal(['ONE', 'two', 'three', 'four'], getline(1, '$'))
+  call assert_equal(2, line("'a"))
+  call assert_false(&modified)
+  undo
+  call assert_equal(['ONE', 'two'], getline(1, '$'))
+  undo
+  call assert_equal(['one', 'two'], getline(1, '$'))
+  redo
+  redo
+
+  " An incomplete last line is completed by the next append.
+  call writefile(['fi'], fname, 'ab')
+  checktime
+  call assert_equal('fi', getline('$'))
+  call assert_false(&eol)
+  call writefile(['ve', 'six'], fname, 'a')
+  checktime
+  call assert_equal(['four', 'five', 'six'], getline(4, '$'))
+  call assert_true(&eol)
+
+  " With 'followtail' the cursor stays on the last line.
+  setlocal followtail
+  normal! G
+  call writefile(['seven'], fname, 'a')
+  checktime
+  call assert_equal(7, line('.'))
+  normal! gg
+  call writefile(['eight'], fname, 'a')
+  checktime
+  call assert_equal(1, line('.'))
+  setlocal nofollowtail
+
+  " BufReadPost autocommands are triggered and modelines applied.
+  let g:n = 0
+  augroup Xreload
+    au BufReadPost Xtest.tmp let g:n += 1
+  augroup END
+  set modeline
+  call writefile(['nine', 'vim: sw=5'], fname, 'a')
+  checktime
+  call assert_equal(['eight', 'nine', 'vim: sw=5'], getline(8, '$'))
+  call assert_equal(1, g:n)
+  call assert_equal(5, &sw)
+  augroup Xreload
+    au!
+  augroup END
+  set modeline& sw&
+  unlet g:n
+
+  " When the text before the old end changed the whole file is read.
+  call writefile(['1', '2', '3', '4', '5', '6', '7', '8', '9'], fname)
+  checktime
+  call assert_equal(['1', '2', '3', '4', '5', '6', '7', '8', '9'],
+	\ getline(1, '$'))
+
+  " A CR-NL line break is removed.
+  bwipe!
+  call writefile(["a\r", "b\r"], fname)
+  exec 'e' fname
+  call assert_equal('dos', &fileformat)
+  call writefile(["c\r", "\r", "d\r"], fname, 'a')
+  checktime
+  call assert_equal(['a', 'b', 'c', '', 'd'], getline(1, '$'))
+
+  set autoread&
+  bwipe!
+  call delete(fname)
+endfunc
+
+func Test_checktime_diff()
+  let fname = 'Xtest.tmp'
+  call writefile(['1', '2', '3', '4', '5', '6', '7', '8'], fname)
+  set autoread
+  exec 'e' fname
+  2mark a
+  7mark b
+  5mark c
+  call cursor(8, 1)
+
+  " Only the lines that differ are changed, marks below them move along.
+  call writefile(['0', '1', '2', 'three', '4', '6', '7', '8'], fname)
+  checktime
+  call assert_equal(['0', '1', '2', 'three', '4', '6', '7', '8'],
+	\ getline(1, '$'))
+  call assert_equal(3, line("'a"))
+  call assert_equal(7, line("'b"))
+  call assert_equal(0, line("'c"))
+  call assert_equal(8, line('.'))
+  call assert_false(&modified)
+
+  " The reload can be undone.
+  undo
+  call assert_equal(['1', '2', '3', '4', '5', '6', '7', '8'], getline(1, '$'))
+  call assert_true(&modified)
+  redo
+  call assert_false(&modified)
+
+  " Without 'undoreload' the undo history is cleared.
+  set undoreload=0
+  call writefile(['0', '1', '2', '3', '4', '6', '7', '8'], fname)
+  checktime
+  call assert_equal('3', getline(4))
+  call assert_equal(7, line("'b"))
+  call assert_equal([], undotree().entries)
+  set undoreload&
+
+  " BufReadPost autocommands are triggered and modelines applied.
+  let g:n = 0
+  augroup Xreload
+    au BufReadPost Xtest.tmp let g:n += 1
+  augroup END
+  set modeline
+  call writefile(['zero', '1', '2', '3', '4', '6', '7', '8', 'vim: sw=5'], fname)
+  checktime
+  call assert_equal('vim: sw=5', getline('$'))
+  call assert_equal(1, g:n)
+  call assert_equal(5, &sw)
+  augroup Xreload
+    au!
+  augroup END
+  set modeline& sw&
+  unlet g:n
+
+  set autoread&
+  bwipe!
+  call delete(fname)
+endfunc
+
 func Test_nonexistent_file()
   let fname = 'Xtest.tmp'
 
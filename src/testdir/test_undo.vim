@@ -247,6 +247,70 @@ func Test_insert_expr()
   close!
 endfunc
 
+" The hash of the text must not depend on how the lines are stored in blocks.
+func Test_undofile_blocks()
+  set undofile undodir=.
+  new Xfile
+  call setline(1, map(range(3000), '"line " . v:val'))
+  w
+  bwipe!
+
+  new Xfile
+  " Split the blocks in a different way than when reading the file.
+  call append(1500, map(range(500), '"new line " . v:val'))
+  set ul=100
+  call setline(10, 'changed')
+  w
+  bwipe!
+
+  new Xfile
+  call assert_equal(3500, line('$'))
+  undo
+  call assert_equal('line 9', getline(10))
+  undo
+  call assert_equal(3000, line('$'))
+  bwipe!
+  set undofile& undodir&
+  call delete(undofile('Xfile'))
+  call delete('Xfile')
+endfunc
+
+" When writing again only the changes are appended to the undo file.
+func Test_undofile_append()
+  set undofile undodir=.
+  new Xfile
+  set ul=-1
+  call setline(1, map(range(100), 'repeat(v:val, 50)'))
+  set ul=100
+  %s/$/x/
+  w
+  let ufile = undofile('Xfile')
+  let size = getfsize(ufile)
+  call assert_true(size > 5000)
+  call setline(1, 'one')
+  set ul=100
+  w
+  call assert_true(getfsize(ufile) > size)
+  call assert_true(getfsize(ufile) < size + 1000)
+  call setline(2, 'two')
+  set ul=100
+  undo
+  w
+  bwipe!
+
+  new Xfile
+  call assert_equal(['one', repeat('1', 50) . 'x'], getline(1, 2))
+  redo
+  call assert_equal(['one', 'two'], getline(1, 2))
+  undo 0
+  call assert_equal(repeat('0', 50), getline(1))
+  call assert_equal(100, line('$'))
+  bwipe!
+  set undofile& undodir&
+  call delete('Xfile')
+  call delete(ufile)
+endfunc
+
 func Test_undofile_earlier()
   " Issue #1254
   " create undofile with timestamps older than Vim startup time.
@@ -274,3 +338,99 @@ func Test_undofile_earlier()
   call delete('Xfile')
   call delete('Xundofile')
 endfunc
+
+" Undo and redo changes in long lines, for which only the changed bytes are
+" kept, also after writing and reading the undo file.
+func Test_undo_long_line()
+  new Xfile
+  set ul=100
+  let text = [repeat('abcdefghij', 100), 'short', repeat('0123456789', 100)]
+  call setline(1, text)
+  w
+  for i in range(1, 10)
+    call feedkeys((i * 70) . "|ix\<Esc>", 'xt')
+    set ul=100
+    call feedkeys("3G" . (i * 90) . "|iyy\<Esc>1G", 'xt')
+    set ul=100
+  endfor
+  call feedkeys("2GAzz\<Esc>", 'xt')
+  set ul=100
+  let changed = getline(1, '$')
+  call assert_equal(1010, strlen(changed[0]))
+  call assert_equal(1020, strlen(changed[2]))
+
+  for i in range(21)
+    undo
+  endfor
+  call assert_equal(text, getline(1, '$'))
+  for i in range(21)
+    redo
+  endfor
+  call assert_equal(changed, getline(1, '$'))
+
+  " Joining a change to the last undo block undoes both.
+  undo
+  let expected = [changed[0], 'short', changed[2]]
+  call feedkeys("1G$x", 'xt')
+  set ul=100
+  undojoin
+  call setline(3, 'new')
+  undo
+  call assert_equal(expected, getline(1, '$'))
+
+  w
+  wundo Xundofile
+  bwipe!
+  new Xfile
+  rundo Xundofile
+  for i in range(20)
+    undo
+  endfor
+  call assert_equal(text, getline(1, '$'))
+  for i in range(20)
+    redo
+  endfor
+  call assert_equal(expected, getline(1, '$'))
+  bwipe!
+  call delete('Xfile')
+  call delete('Xundofile')
+endfunc
+
+" With 'undomemory' the entries of old changes are written to a spill file.
+func Test_undomemory()
+  new
+  set undomemory=1
+  setlocal ul=100
+  for i in range(1, 20)
+    call setline(1, map(range(50), 'repeat(i . " ", 30) . v:val'))
+    " break the undo sequence
+    setlocal ul=100
+  endfor
+  let text = getline(1, '$')
+  undo 5
+  call assert_equal(repeat('5 ', 30) . '0', getline(1))
+  " make a new branch
+  call setline(1, 'new')
+  undo 3
+  call assert_equal(repeat('3 ', 30) . '0', getline(1))
+  undo 0
+  call assert_equal([''], getline(1, '$'))
+  undo 20
+  call assert_equal(text, getline(1, '$'))
+  undo 21
+  call assert_equal('new', getline(1))
+
+  " Writing and reading the undo file includes spilled changes.
+  let text = getline(1, '$')
+  wundo Xundofile
+  enew!
+  call setline(1, text)
+  rundo Xundofile
+  call assert_equal(21, changenr())
+  undo 9
+  call assert_equal(repeat('9 ', 30) . '0', getline(1))
+
+  set undomemory&
+  bwipe!
+  call delete('Xundofile')
+endfunc
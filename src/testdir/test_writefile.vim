@@ -49,3 +49,108 @@ func Test_writefile_fails_conversion()
   bwipe!
   set backup& writebackup&
 endfunc
+
+" Writing NULs and, for "mac", CRs in lines longer than the write buffer, and
+" making a copy of the original file as backup.
+func Test_write_buffer_translate()
+  new
+  let long = repeat('x', 70000)
+  let lines = ["a\nb", long . "\n" . long . "\r" . long, "c\rd", '']
+  call setline(1, lines)
+  w! Xfile
+  call assert_equal(lines, readfile('Xfile', 'b')[:-2])
+  call assert_equal(3 * 70000 + 12, getfsize('Xfile'))
+
+  set ff=mac
+  w! Xfile
+  bwipe!
+  exe 'edit ++ff=mac Xfile'
+  call assert_equal(lines, getline(1, '$'))
+
+  set backup backupcopy=yes backupdir=. backupskip=
+  call setline(1, 'changed')
+  w
+  exe 'edit ++ff=mac Xfile~'
+  call assert_equal(lines, getline(1, '$'))
+  bwipe!
+  exe 'edit ++ff=mac Xfile'
+  call assert_equal('changed', getline(1))
+
+  bwipe!
+  set backup& backupcopy& backupdir& backupskip&
+  call delete('Xfile')
+  call delete('Xfile~')
+endfunc
+
+" Writing a buffer in the background, while it is changed.
+func Test_write_async()
+  if !has('asyncwrite')
+    return
+  endif
+  source shared.vim
+  call writefile(['old'], 'Xasync')
+  set asyncwrite=1 nobackup writebackup backupdir=. backupskip=
+  edit Xasync
+  let lines = map(range(1000), '"line " . v:val')
+  call setline(1, lines)
+  let g:written = 0
+  au BufWritePost Xasync let g:written += 1
+
+  call feedkeys(":w\<CR>", 'xt')
+  call assert_match('^writing', b:writestatus)
+  call assert_equal(1, &modified)
+  call assert_equal(0, g:written)
+  " The file gets the text from before this change.
+  call append('$', 'added')
+  call WaitFor('b:writestatus !~ "^writing"')
+  call assert_equal('written', b:writestatus)
+  call assert_equal(1, g:written)
+  call assert_equal(1, &modified)
+  call assert_equal(lines, readfile('Xasync'))
+  call assert_false(filereadable('Xasync~'))
+
+  call feedkeys(":w\<CR>", 'xt')
+  " Writing again waits for the previous write.
+  write
+  call assert_equal(3, g:written)
+  call assert_equal(0, &modified)
+  call assert_equal(lines + ['added'], readfile('Xasync'))
+
+  " Changing a character in place doesn't change the file being written.
+  " With a single-byte 'encoding' "r" changes the text in place.
+  let save_enc = &encoding
+  set encoding=latin1
+  setlocal fileencoding=latin1
+  call feedkeys(":w\<CR>", 'xt')
+  call assert_match('^writing', b:writestatus)
+  normal! GrX
+  call WaitFor('b:writestatus !~ "^writing"')
+  call assert_equal('written', b:writestatus)
+  call assert_equal(1, &modified)
+  call assert_equal(lines + ['added'], readfile('Xasync'))
+  call assert_equal('Xdded', getline('$'))
+  let &encoding = save_enc
+  setlocal fileencoding=
+
+  " Only the changed lines are saved, deleting, inserting and changing lines
+  " in the middle doesn't change the file being written.
+  let lines = getline(1, '$')
+  call feedkeys(":w\<CR>", 'xt')
+  call assert_match('^writing', b:writestatus)
+  10,19delete
+  call append(500, ['new 1', 'new 2'])
+  call setline(600, 'changed')
+  5,7join
+  $delete
+  call WaitFor('b:writestatus !~ "^writing"')
+  call assert_equal('written', b:writestatus)
+  call assert_equal(lines, readfile('Xasync'))
+  write
+  call assert_equal(getline(1, '$'), readfile('Xasync'))
+
+  au! BufWritePost Xasync
+  unlet g:written
+  bwipe!
+  set asyncwrite& backup& writebackup& backupdir& backupskip&
+  call delete('Xasync')
+endfunc
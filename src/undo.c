@@ -113,6 +113,7 @@ static void u_freebranch(buf_T *buf, u_header_T *uhp, u_header_T **uhpp);
 static void u_freeentries(buf_T *buf, u_header_T *uhp, u_header_T **uhpp);
 static void u_freeentry(u_entry_T *, long);
 #ifdef FEAT_PERSISTENT_UNDO
+static void u_compute_text_hash(char_u *hash);
 static void corruption_error(char *mesg, char_u *file_name);
 static void u_free_uhp(u_header_T *uhp);
 static int undo_write(bufinfo_T *bi, char_u *ptr, size_t len);
@@ -129,18 +130,42 @@ static time_t undo_read_time(bufinfo_T *bi);
 static int undo_read(bufinfo_T *bi, char_u *buffer, size_t size);
 static char_u *read_string_decrypt(bufinfo_T *bi, int len);
 static int serialize_header(bufinfo_T *bi, char_u *hash);
+static int serialize_state(bufinfo_T *bi, char_u *hash, int all_changed);
+static u_header_T *u_walk_next(u_header_T *uhp, int mark);
+static int u_append_undo(buf_T *buf, char_u *file_name, char_u *hash);
+static void u_journal_set(buf_T *buf, char_u *file_name, off_T base);
+static void u_journal_clear(buf_T *buf);
 static int serialize_uhp(bufinfo_T *bi, u_header_T *uhp);
 static u_header_T *unserialize_uhp(bufinfo_T *bi, char_u *file_name);
 static int serialize_uep(bufinfo_T *bi, u_entry_T *uep);
-static u_entry_T *unserialize_uep(bufinfo_T *bi, int *error, char_u *file_name);
+static u_entry_T *unserialize_uep(bufinfo_T *bi, int delta, int *error, char_u *file_name);
 static void serialize_pos(bufinfo_T *bi, pos_T pos);
 static void unserialize_pos(bufinfo_T *bi, pos_T *pos);
 static void serialize_visualinfo(bufinfo_T *bi, visualinfo_T *info);
 static void unserialize_visualinfo(bufinfo_T *bi, visualinfo_T *info);
+static void u_size_update(buf_T *buf, u_header_T *uhp);
+static int u_spill(buf_T *buf, u_header_T *uhp);
+static u_entry_T *u_spill_read(buf_T *buf, u_header_T *uhp);
+static int u_spill_load(buf_T *buf, u_header_T *uhp);
+static int u_spill_collect(buf_T *buf, u_header_T *uhp, garray_T *gap, int spilled);
+static void u_spill_compact(buf_T *buf);
+static void u_spill_close(buf_T *buf);
+static int
+# ifdef __BORLANDC__
+_RTLENTRYF
+# endif
+	u_spill_compare(const void *s1, const void *s2);
 #endif
 
 #define U_ALLOC_LINE(size) lalloc((long_u)(size), FALSE)
+
+/* Only keep the changed bytes of a line when this many bytes are saved. */
+#define UE_DELTA_MIN	64
+
 static char_u *u_save_line(linenr_T);
+static void u_delta_entries(u_header_T *uhp);
+static void u_delta_entry(u_entry_T *uep);
+static int u_expand_entries(u_header_T *uhp);
 
 /* used in undo_end() to report number of added and deleted lines */
 static long	u_newcount, u_oldcount;
@@ -526,15 +551,22 @@ u_savecommon(
 	{
 	    uhp->uh_alt_prev.ptr = old_curhead->uh_alt_prev.ptr;
 	    if (uhp->uh_alt_prev.ptr != NULL)
+	    {
 		uhp->uh_alt_prev.ptr->uh_alt_next.ptr = uhp;
+		uhp->uh_alt_prev.ptr->uh_dirty |= UH_DIRTY_LINKS;
+	    }
 	    old_curhead->uh_alt_prev.ptr = uhp;
+	    old_curhead->uh_dirty |= UH_DIRTY_LINKS;
 	    if (curbuf->b_u_oldhead == old_curhead)
 		curbuf->b_u_oldhead = uhp;
 	}
 	else
 	    uhp->uh_alt_prev.ptr = NULL;
 	if (curbuf->b_u_newhead != NULL)
+	{
 	    curbuf->b_u_newhead->uh_prev.ptr = uhp;
+	    curbuf->b_u_newhead->uh_dirty |= UH_DIRTY_LINKS;
+	}
 
 	uhp->uh_seq = ++curbuf->b_u_seq_last;
 	curbuf->b_u_seq_cur = uhp->uh_seq;
@@ -543,6 +575,12 @@ u_savecommon(
 	curbuf->b_u_time_cur = uhp->uh_time + 1;
 
 	uhp->uh_walk = 0;
+	uhp->uh_dirty = UH_DIRTY_ALL;
+#ifdef FEAT_PERSISTENT_UNDO
+	uhp->uh_size = 0;
+	uhp->uh_spill_off = 0;
+	uhp->uh_spill_len = 0;
+#endif
 	uhp->uh_entry = NULL;
 	uhp->uh_getbot_entry = NULL;
 	uhp->uh_cursor = curwin->w_cursor;	/* save cursor pos. for undo */
@@ -570,6 +608,7 @@ u_savecommon(
     {
 	if (get_undolevel() < 0)	/* no undo at all */
 	    return OK;
+	curbuf->b_u_newhead->uh_dirty |= UH_DIRTY_ALL;
 
 	/*
 	 * When saving a single line, and it has been saved just before, it
@@ -735,12 +774,21 @@ nomem:
 # define UF_HEADER_MAGIC	0x5fd0	/* magic at start of header */
 # define UF_HEADER_END_MAGIC	0xe7aa	/* magic after last header */
 # define UF_ENTRY_MAGIC		0xf518	/* magic at start of entry */
+# define UF_ENTRY_DELTA_MAGIC	0xf519	/* idem, entry with changed bytes */
 # define UF_ENTRY_END_MAGIC	0x3581	/* magic after last entry */
-# define UF_VERSION		2	/* 2-byte undofile version number */
-# define UF_VERSION_CRYPT	0x8002	/* idem, encrypted */
+# define UF_JOURNAL_MAGIC	0x6ab2	/* magic at start of appended changes */
+# define UF_FREED_MAGIC		0x9f1e	/* magic before seq of freed header */
+# define UF_LINKS_MAGIC		0x3c57	/* magic before links of a header */
+# define UF_VERSION		4	/* 2-byte undofile version number */
+# define UF_VERSION_CRYPT	0x8004	/* idem, encrypted */
+# define UF_VERSION_PREV	3	/* version with sha256 of the text */
+# define UF_VERSION_CRYPT_PREV	0x8003	/* idem, encrypted */
+# define UF_VERSION_PREV2	2	/* idem, without delta entries */
+# define UF_VERSION_CRYPT_PREV2	0x8002	/* idem, encrypted */
 
 /* extra fields for header */
 # define UF_LAST_SAVE_NR	1
+# define UF_ALL_CHANGED		2	/* set UH_CHANGED in earlier headers */
 
 /* extra fields for uhp */
 # define UHP_SAVE_NR		1
@@ -749,9 +797,40 @@ static char_u e_not_open[] = N_("E828: Cannot open undo file for writing: %s");
 
 /*
  * Compute the hash for the current buffer text into hash[UNDO_HASH_SIZE].
+ * This is the sha256 of the digest of the memline, which only reads the
+ * blocks that were changed since the last time.
  */
     void
 u_compute_hash(char_u *hash)
+{
+    context_sha256_T	ctx;
+    UINT32_T		digest[MF_DIGEST_LEN];
+    char_u		buf[4];
+    int			i;
+
+    if (ml_digest(curbuf, digest) == FAIL)
+    {
+	u_compute_text_hash(hash);
+	return;
+    }
+    sha256_start(&ctx);
+    for (i = 0; i < MF_DIGEST_LEN; ++i)
+    {
+	buf[0] = (char_u)(digest[i] >> 24);
+	buf[1] = (char_u)(digest[i] >> 16);
+	buf[2] = (char_u)(digest[i] >> 8);
+	buf[3] = (char_u)digest[i];
+	sha256_update(&ctx, buf, 4);
+    }
+    sha256_finish(&ctx, hash);
+}
+
+/*
+ * Compute the sha256 of the current buffer text into hash[UNDO_HASH_SIZE].
+ * This was the hash before version 4 of the undo file.
+ */
+    static void
+u_compute_text_hash(char_u *hash)
 {
     context_sha256_T	ctx;
     linenr_T		lnum;
@@ -1146,10 +1225,11 @@ read_string_decrypt(bufinfo_T *bi, int len)
     static int
 serialize_header(bufinfo_T *bi, char_u *hash)
 {
+#ifdef FEAT_CRYPT
     int		len;
     buf_T	*buf = bi->bi_buf;
+#endif
     FILE	*fp = bi->bi_fp;
-    char_u	time_buf[8];
 
     /* Start writing, first the magic marker and undo info version. */
     if (fwrite(UF_START_MAGIC, (size_t)UF_START_MAGIC_LEN, (size_t)1, fp) != 1)
@@ -1193,6 +1273,21 @@ serialize_header(bufinfo_T *bi, char_u *hash)
 #endif
 	undo_write_bytes(bi, (long_u)UF_VERSION, 2);
 
+    return serialize_state(bi, hash, FALSE);
+}
+
+/*
+ * Write the info about the buffer and the undo tree that is not in the
+ * headers.  This is also done for every list of changes appended to the undo
+ * file.  When "all_changed" is TRUE the UH_CHANGED flag is to be set in all
+ * headers written before.
+ */
+    static int
+serialize_state(bufinfo_T *bi, char_u *hash, int all_changed)
+{
+    int		len;
+    buf_T	*buf = bi->bi_buf;
+    char_u	time_buf[8];
 
     /* Write a hash of the buffer text, so that we can verify it is still the
      * same when reading the buffer text. */
@@ -1223,6 +1318,12 @@ serialize_header(bufinfo_T *bi, char_u *hash)
     undo_write_bytes(bi, 4, 1);
     undo_write_bytes(bi, UF_LAST_SAVE_NR, 1);
     undo_write_bytes(bi, (long_u)buf->b_u_save_nr_last, 4);
+    if (all_changed)
+    {
+	undo_write_bytes(bi, 1, 1);
+	undo_write_bytes(bi, UF_ALL_CHANGED, 1);
+	undo_write_bytes(bi, 1, 1);
+    }
 
     undo_write_bytes(bi, 0, 1);  /* end marker */
 
@@ -1233,8 +1334,10 @@ serialize_header(bufinfo_T *bi, char_u *hash)
 serialize_uhp(bufinfo_T *bi, u_header_T *uhp)
 {
     int		i;
-    u_entry_T	*uep;
+    u_entry_T	*uep, *nuep;
+    u_entry_T	*first_uep = uhp->uh_entry;
     char_u	time_buf[8];
+    int		retval = OK;
 
     if (undo_write_bytes(bi, (long_u)UF_HEADER_MAGIC, 2) == FAIL)
 	return FAIL;
@@ -1265,15 +1368,35 @@ serialize_uhp(bufinfo_T *bi, u_header_T *uhp)
 
     undo_write_bytes(bi, 0, 1);  /* end marker */
 
+    /* When the entries are in the spill file read them temporarily. */
+    if (uhp->uh_spill_len > 0)
+    {
+	first_uep = u_spill_read(bi->bi_buf, uhp);
+	if (first_uep == NULL)
+	    return FAIL;
+    }
+
     /* Write all the entries. */
-    for (uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next)
+    for (uep = first_uep; uep != NULL; uep = uep->ue_next)
     {
-	undo_write_bytes(bi, (long_u)UF_ENTRY_MAGIC, 2);
+	undo_write_bytes(bi, (long_u)(uep->ue_delta
+			       ? UF_ENTRY_DELTA_MAGIC : UF_ENTRY_MAGIC), 2);
 	if (serialize_uep(bi, uep) == FAIL)
-	    return FAIL;
+	{
+	    retval = FAIL;
+	    break;
+	}
     }
-    undo_write_bytes(bi, (long_u)UF_ENTRY_END_MAGIC, 2);
-    return OK;
+    if (retval == OK)
+	undo_write_bytes(bi, (long_u)UF_ENTRY_END_MAGIC, 2);
+
+    if (first_uep != uhp->uh_entry)
+	for (uep = first_uep; uep != NULL; uep = nuep)
+	{
+	    nuep = uep->ue_next;
+	    u_freeentry(uep, uep->ue_size);
+	}
+    return retval;
 }
 
     static u_header_T *
@@ -1338,10 +1461,12 @@ unserialize_uhp(bufinfo_T *bi, char_u *file_name)
 
     /* Unserialize the uep list. */
     last_uep = NULL;
-    while ((c = undo_read_2c(bi)) == UF_ENTRY_MAGIC)
+    while ((c = undo_read_2c(bi)) == UF_ENTRY_MAGIC
+						|| c == UF_ENTRY_DELTA_MAGIC)
     {
 	error = FALSE;
-	uep = unserialize_uep(bi, &error, file_name);
+	uep = unserialize_uep(bi, c == UF_ENTRY_DELTA_MAGIC, &error,
+								   file_name);
 	if (last_uep == NULL)
 	    uhp->uh_entry = uep;
 	else
@@ -1378,6 +1503,11 @@ serialize_uep(
     undo_write_bytes(bi, (long_u)uep->ue_bot, 4);
     undo_write_bytes(bi, (long_u)uep->ue_lcount, 4);
     undo_write_bytes(bi, (long_u)uep->ue_size, 4);
+    if (uep->ue_delta)
+    {
+	undo_write_bytes(bi, (long_u)uep->ue_prefix, 4);
+	undo_write_bytes(bi, (long_u)uep->ue_suffix, 4);
+    }
     for (i = 0; i < uep->ue_size; ++i)
     {
 	len = STRLEN(uep->ue_array[i]);
@@ -1389,8 +1519,16 @@ serialize_uep(
     return OK;
 }
 
+/*
+ * Unserialize an entry.  When "delta" is TRUE it only has the changed bytes
+ * of one line.
+ */
     static u_entry_T *
-unserialize_uep(bufinfo_T *bi, int *error, char_u *file_name)
+unserialize_uep(
+    bufinfo_T	*bi,
+    int		delta,
+    int		*error,
+    char_u	*file_name)
 {
     int		i;
     u_entry_T	*uep;
@@ -1409,6 +1547,19 @@ unserialize_uep(bufinfo_T *bi, int *error, char_u *file_name)
     uep->ue_bot = undo_read_4c(bi);
     uep->ue_lcount = undo_read_4c(bi);
     uep->ue_size = undo_read_4c(bi);
+    if (delta)
+    {
+	uep->ue_prefix = undo_read_4c(bi);
+	uep->ue_suffix = undo_read_4c(bi);
+	if (uep->ue_size != 1 || uep->ue_prefix < 0 || uep->ue_suffix < 0)
+	{
+	    corruption_error("delta entry", file_name);
+	    uep->ue_size = 0;
+	    *error = TRUE;
+	    return uep;
+	}
+	uep->ue_delta = TRUE;
+    }
     if (uep->ue_size > 0)
     {
 	if (uep->ue_size < LONG_MAX / (int)sizeof(char_u *))
@@ -1528,6 +1679,8 @@ u_write_undo(
     FILE	*fp = NULL;
     int		perm;
     int		write_ok = FALSE;
+    int		journal_ok = FALSE;
+    stat_T	st_undo;
 #ifdef UNIX
     int		st_old_valid = FALSE;
     stat_T	st_old;
@@ -1555,6 +1708,31 @@ u_write_undo(
     else
 	file_name = name;
 
+    /*
+     * When the undo file is what was written before, only append the changes
+     * made since then.  Write the whole undo tree when the appended changes
+     * have become bigger than the rest of the file, so that it's compacted
+     * once in a while.
+     */
+    if (name == NULL && buf->b_u_jname != NULL
+	    && fnamecmp(buf->b_u_jname, file_name) == 0
+#ifdef FEAT_CRYPT
+	    && *buf->b_p_key == NUL
+#endif
+	    && (buf->b_u_numhead > 0 || buf->b_u_line_ptr != NULL)
+	    && mch_stat((char *)file_name, &st_undo) >= 0
+	    && st_undo.st_size == buf->b_u_jsize
+	    && st_undo.st_mtime == buf->b_u_jmtime
+	    && buf->b_u_jsize - buf->b_u_jbase <= buf->b_u_jbase
+	    && u_append_undo(buf, file_name, hash) == OK)
+    {
+	u_journal_set(buf, file_name, buf->b_u_jbase);
+	goto theend;
+    }
+    if (name == NULL || (buf->b_u_jname != NULL
+				  && fnamecmp(buf->b_u_jname, file_name) == 0))
+	u_journal_clear(buf);
+
     /*
      * Decide about the permission to use for the undo file.  If the buffer
      * has a name use the permission of the original file.  Otherwise only
@@ -1713,25 +1891,15 @@ u_write_undo(
 #endif
 	    if (serialize_uhp(&bi, uhp) == FAIL)
 		goto write_error;
+	    if (name == NULL)
+		uhp->uh_dirty = 0;
 	}
-
-	/* Now walk through the tree - algorithm from undo_time(). */
-	if (uhp->uh_prev.ptr != NULL && uhp->uh_prev.ptr->uh_walk != mark)
-	    uhp = uhp->uh_prev.ptr;
-	else if (uhp->uh_alt_next.ptr != NULL
-				     && uhp->uh_alt_next.ptr->uh_walk != mark)
-	    uhp = uhp->uh_alt_next.ptr;
-	else if (uhp->uh_next.ptr != NULL && uhp->uh_alt_prev.ptr == NULL
-					 && uhp->uh_next.ptr->uh_walk != mark)
-	    uhp = uhp->uh_next.ptr;
-	else if (uhp->uh_alt_prev.ptr != NULL)
-	    uhp = uhp->uh_alt_prev.ptr;
-	else
-	    uhp = uhp->uh_next.ptr;
+	uhp = u_walk_next(uhp, mark);
     }
 
     if (undo_write_bytes(&bi, (long_u)UF_HEADER_END_MAGIC, 2) == OK)
 	write_ok = TRUE;
+    journal_ok = write_ok && name == NULL;
 #ifdef U_DEBUG
     if (headers_written != buf->b_u_numhead)
     {
@@ -1746,7 +1914,8 @@ u_write_undo(
 #endif
 
 write_error:
-    fclose(fp);
+    if (fclose(fp) != 0)
+	journal_ok = FALSE;
     if (!write_ok)
 	EMSG2(_("E829: write error in undo file: %s"), file_name);
 
@@ -1768,6 +1937,15 @@ write_error:
     }
 #endif
 
+    /* Following writes can append the changes, unless the undo file is
+     * encrypted. */
+#ifdef FEAT_CRYPT
+    if (bi.bi_state != NULL)
+	journal_ok = FALSE;
+#endif
+    if (journal_ok)
+	u_journal_set(buf, file_name, (off_T)-1);
+
 theend:
 #ifdef FEAT_CRYPT
     if (bi.bi_state != NULL)
@@ -1778,12 +1956,147 @@ theend:
 	vim_free(file_name);
 }
 
+/*
+ * Return the header after "uhp" when walking through the whole undo tree,
+ * NULL when done.  Headers that were visited must have uh_walk set to "mark".
+ * Algorithm from undo_time().
+ */
+    static u_header_T *
+u_walk_next(u_header_T *uhp, int mark)
+{
+    if (uhp->uh_prev.ptr != NULL && uhp->uh_prev.ptr->uh_walk != mark)
+	return uhp->uh_prev.ptr;
+    if (uhp->uh_alt_next.ptr != NULL && uhp->uh_alt_next.ptr->uh_walk != mark)
+	return uhp->uh_alt_next.ptr;
+    if (uhp->uh_next.ptr != NULL && uhp->uh_alt_prev.ptr == NULL
+					 && uhp->uh_next.ptr->uh_walk != mark)
+	return uhp->uh_next.ptr;
+    if (uhp->uh_alt_prev.ptr != NULL)
+	return uhp->uh_alt_prev.ptr;
+    return uhp->uh_next.ptr;
+}
+
+/*
+ * Append the changes to the undo tree of "buf" since the undo file
+ * "file_name" was written: the info about the buffer, the headers that were
+ * freed and the headers that were added or changed.
+ * Returns FAIL when writing failed.
+ */
+    static int
+u_append_undo(buf_T *buf, char_u *file_name, char_u *hash)
+{
+    bufinfo_T	bi;
+    u_header_T	*uhp;
+    int		mark;
+    int		i;
+    int		ok;
+
+    vim_memset(&bi, 0, sizeof(bi));
+    bi.bi_buf = buf;
+    bi.bi_fp = mch_fopen((char *)file_name, "a");
+    if (bi.bi_fp == NULL)
+	return FAIL;
+    if (p_verbose > 0)
+    {
+	verbose_enter();
+	smsg((char_u *)_("Appending to undo file: %s"), file_name);
+	verbose_leave();
+    }
+
+    /* Undo must be synced. */
+    u_sync(TRUE);
+
+    undo_write_bytes(&bi, (long_u)UF_JOURNAL_MAGIC, 2);
+    ok = serialize_state(&bi, hash, buf->b_u_junchanged) == OK;
+    for (i = 0; ok && i < buf->b_u_jfreed.ga_len; ++i)
+    {
+	undo_write_bytes(&bi, (long_u)UF_FREED_MAGIC, 2);
+	ok = undo_write_bytes(&bi,
+		      (long_u)((long *)buf->b_u_jfreed.ga_data)[i], 4) == OK;
+    }
+
+    mark = ++lastmark;
+    uhp = buf->b_u_oldhead;
+    while (ok && uhp != NULL)
+    {
+	if (uhp->uh_walk != mark)
+	{
+	    uhp->uh_walk = mark;
+	    if (uhp->uh_dirty & UH_DIRTY_ALL)
+		ok = serialize_uhp(&bi, uhp) == OK;
+	    else if (uhp->uh_dirty & UH_DIRTY_LINKS)
+	    {
+		/* Only the links changed, no need to write the entries. */
+		undo_write_bytes(&bi, (long_u)UF_LINKS_MAGIC, 2);
+		undo_write_bytes(&bi, (long_u)uhp->uh_seq, 4);
+		put_header_ptr(&bi, uhp->uh_next.ptr);
+		put_header_ptr(&bi, uhp->uh_prev.ptr);
+		put_header_ptr(&bi, uhp->uh_alt_next.ptr);
+		put_header_ptr(&bi, uhp->uh_alt_prev.ptr);
+	    }
+	    uhp->uh_dirty = 0;
+	}
+	uhp = u_walk_next(uhp, mark);
+    }
+    if (ok)
+	ok = undo_write_bytes(&bi, (long_u)UF_HEADER_END_MAGIC, 2) == OK;
+
+    if (fclose(bi.bi_fp) != 0)
+	ok = FALSE;
+    return ok ? OK : FAIL;
+}
+
+/*
+ * Remember that the changes to the undo tree of "buf" can be appended to undo
+ * file "file_name", which was just written or read.  "base" is the size of
+ * the file without appended changes, -1 for the whole file.
+ */
+    static void
+u_journal_set(buf_T *buf, char_u *file_name, off_T base)
+{
+    stat_T	st;
+
+    if (mch_stat((char *)file_name, &st) < 0)
+    {
+	u_journal_clear(buf);
+	return;
+    }
+    if (buf->b_u_jname == NULL || fnamecmp(buf->b_u_jname, file_name) != 0)
+    {
+	vim_free(buf->b_u_jname);
+	buf->b_u_jname = vim_strsave(file_name);
+    }
+    buf->b_u_jsize = st.st_size;
+    buf->b_u_jmtime = st.st_mtime;
+    buf->b_u_jbase = base < 0 ? (off_T)st.st_size : base;
+    buf->b_u_junchanged = FALSE;
+    ga_clear(&buf->b_u_jfreed);
+    ga_init2(&buf->b_u_jfreed, (int)sizeof(long), 20);
+}
+
+/*
+ * Forget about appending changes to the undo file of "buf", the next write
+ * must write the whole undo tree.
+ */
+    static void
+u_journal_clear(buf_T *buf)
+{
+    vim_free(buf->b_u_jname);
+    buf->b_u_jname = NULL;
+    buf->b_u_junchanged = FALSE;
+    ga_clear(&buf->b_u_jfreed);
+}
+
+/* Header "i" in the table of headers read from the undo file. */
+# define UHP_TABLE(i) (((u_header_T **)uhp_ga.ga_data)[i])
+
 /*
  * Load the undo tree from an undo file.
  * If "name" is not NULL use it as the undo file name.  This also means being
  * a bit more verbose.
  * Otherwise use curbuf->b_ffname to generate the undo file name.
- * "hash[UNDO_HASH_SIZE]" must be the hash value of the buffer text.
+ * "hash[UNDO_HASH_SIZE]" must be the hash value of the buffer text, or NULL
+ * to compute it only when an undo file was found.
  */
     void
 u_read_undo(char_u *name, char_u *hash, char_u *orig_name)
@@ -1805,8 +2118,11 @@ u_read_undo(char_u *name, char_u *hash, char_u *orig_name)
     int		i, j;
     int		c;
     u_header_T	*uhp;
+    garray_T	uhp_ga;
     u_header_T	**uhp_table = NULL;
+    off_T	journal_base = -1;
     char_u	read_hash[UNDO_HASH_SIZE];
+    char_u	buf_hash[UNDO_HASH_SIZE];
     char_u	magic_buf[UF_START_MAGIC_LEN];
 #ifdef U_DEBUG
     int		*uhp_table_used;
@@ -1818,6 +2134,7 @@ u_read_undo(char_u *name, char_u *hash, char_u *orig_name)
     bufinfo_T	bi;
 
     vim_memset(&bi, 0, sizeof(bi));
+    ga_init2(&uhp_ga, (int)sizeof(u_header_T *), 100);
     if (name == NULL)
     {
 	file_name = u_get_undo_file_name(curbuf->b_ffname, TRUE);
@@ -1873,7 +2190,8 @@ u_read_undo(char_u *name, char_u *hash, char_u *orig_name)
 	goto error;
     }
     version = get2c(fp);
-    if (version == UF_VERSION_CRYPT)
+    if (version == UF_VERSION_CRYPT || version == UF_VERSION_CRYPT_PREV
+					   || version == UF_VERSION_CRYPT_PREV2)
     {
 #ifdef FEAT_CRYPT
 	if (*curbuf->b_p_key == NUL)
@@ -1905,115 +2223,199 @@ u_read_undo(char_u *name, char_u *hash, char_u *orig_name)
 	goto error;
 #endif
     }
-    else if (version != UF_VERSION)
+    else if (version != UF_VERSION && version != UF_VERSION_PREV
+					       && version != UF_VERSION_PREV2)
     {
 	EMSG2(_("E824: Incompatible undo file: %s"), file_name);
 	goto error;
     }
 
-    if (undo_read(&bi, read_hash, (size_t)UNDO_HASH_SIZE) == FAIL)
-    {
-	corruption_error("hash", file_name);
-	goto error;
-    }
-    line_count = (linenr_T)undo_read_4c(&bi);
-    if (memcmp(hash, read_hash, UNDO_HASH_SIZE) != 0
-				  || line_count != curbuf->b_ml.ml_line_count)
+    /*
+     * Read the info about the buffer and the undo tree and the headers.  Then
+     * apply the lists of changes that were appended, each starting with the
+     * info at the time of writing.
+     */
+    for (;;)
     {
-	if (p_verbose > 0 || name != NULL)
+	if (undo_read(&bi, read_hash, (size_t)UNDO_HASH_SIZE) == FAIL)
 	{
-	    if (name == NULL)
-		verbose_enter();
-	    give_warning((char_u *)
-		      _("File contents changed, cannot use undo info"), TRUE);
-	    if (name == NULL)
-		verbose_leave();
+	    corruption_error("hash", file_name);
+	    goto error;
 	}
-	goto error;
-    }
-
-    /* Read undo data for "U" command. */
-    str_len = undo_read_4c(&bi);
-    if (str_len < 0)
-	goto error;
-    if (str_len > 0)
-	line_ptr = read_string_decrypt(&bi, str_len);
-    line_lnum = (linenr_T)undo_read_4c(&bi);
-    line_colnr = (colnr_T)undo_read_4c(&bi);
-    if (line_lnum < 0 || line_colnr < 0)
-    {
-	corruption_error("line lnum/col", file_name);
-	goto error;
-    }
+	line_count = (linenr_T)undo_read_4c(&bi);
 
-    /* Begin general undo data */
-    old_header_seq = undo_read_4c(&bi);
-    new_header_seq = undo_read_4c(&bi);
-    cur_header_seq = undo_read_4c(&bi);
-    num_head = undo_read_4c(&bi);
-    seq_last = undo_read_4c(&bi);
-    seq_cur = undo_read_4c(&bi);
-    seq_time = undo_read_time(&bi);
-
-    /* Optional header fields. */
-    for (;;)
-    {
-	int len = undo_read_byte(&bi);
-	int what;
+	/* Read undo data for "U" command. */
+	str_len = undo_read_4c(&bi);
+	if (str_len < 0)
+	    goto error;
+	vim_free(line_ptr);
+	line_ptr = NULL;
+	if (str_len > 0)
+	    line_ptr = read_string_decrypt(&bi, str_len);
+	line_lnum = (linenr_T)undo_read_4c(&bi);
+	line_colnr = (colnr_T)undo_read_4c(&bi);
+	if (line_lnum < 0 || line_colnr < 0)
+	{
+	    corruption_error("line lnum/col", file_name);
+	    goto error;
+	}
 
-	if (len == 0 || len == EOF)
-	    break;
-	what = undo_read_byte(&bi);
-	switch (what)
+	/* Begin general undo data */
+	old_header_seq = undo_read_4c(&bi);
+	new_header_seq = undo_read_4c(&bi);
+	cur_header_seq = undo_read_4c(&bi);
+	num_head = undo_read_4c(&bi);
+	seq_last = undo_read_4c(&bi);
+	seq_cur = undo_read_4c(&bi);
+	seq_time = undo_read_time(&bi);
+
+	/* Optional header fields. */
+	for (;;)
 	{
-	    case UF_LAST_SAVE_NR:
-		last_save_nr = undo_read_4c(&bi);
+	    int len = undo_read_byte(&bi);
+	    int what;
+
+	    if (len == 0 || len == EOF)
 		break;
-	    default:
-		/* field not supported, skip */
-		while (--len >= 0)
+	    what = undo_read_byte(&bi);
+	    switch (what)
+	    {
+		case UF_LAST_SAVE_NR:
+		    last_save_nr = undo_read_4c(&bi);
+		    break;
+		case UF_ALL_CHANGED:
 		    (void)undo_read_byte(&bi);
+		    for (i = 0; i < uhp_ga.ga_len; ++i)
+			if (UHP_TABLE(i) != NULL)
+			    UHP_TABLE(i)->uh_flags |= UH_CHANGED;
+		    break;
+		default:
+		    /* field not supported, skip */
+		    while (--len >= 0)
+			(void)undo_read_byte(&bi);
+	    }
 	}
-    }
 
-    /* uhp_table will store the freshly created undo headers we allocate
-     * until we insert them into curbuf. The table remains sorted by the
-     * sequence numbers of the headers.
-     * When there are no headers uhp_table is NULL. */
-    if (num_head > 0)
-    {
-	if (num_head < LONG_MAX / (long)sizeof(u_header_T *))
-	    uhp_table = (u_header_T **)U_ALLOC_LINE(
-					     num_head * sizeof(u_header_T *));
-	if (uhp_table == NULL)
-	    goto error;
-    }
+	/* Headers that were freed since the previous write. */
+	while ((c = undo_read_2c(&bi)) == UF_FREED_MAGIC)
+	{
+	    long seq = undo_read_4c(&bi);
 
-    while ((c = undo_read_2c(&bi)) == UF_HEADER_MAGIC)
-    {
-	if (num_read_uhps >= num_head)
+	    for (i = 0; i < uhp_ga.ga_len; ++i)
+		if (UHP_TABLE(i) != NULL && UHP_TABLE(i)->uh_seq == seq)
+		{
+		    u_free_uhp(UHP_TABLE(i));
+		    UHP_TABLE(i) = NULL;
+		    --num_read_uhps;
+		    break;
+		}
+	}
+
+	/* Headers that were added, or changed since the previous write. */
+	for ( ; c == UF_HEADER_MAGIC || c == UF_LINKS_MAGIC;
+						      c = undo_read_2c(&bi))
+	{
+	    if (c == UF_LINKS_MAGIC)
+	    {
+		long seq = undo_read_4c(&bi);
+
+		for (i = 0; i < uhp_ga.ga_len; ++i)
+		    if (UHP_TABLE(i) != NULL && UHP_TABLE(i)->uh_seq == seq)
+			break;
+		if (i == uhp_ga.ga_len)
+		{
+		    corruption_error("links", file_name);
+		    goto error;
+		}
+		uhp = UHP_TABLE(i);
+		uhp->uh_next.seq = undo_read_4c(&bi);
+		uhp->uh_prev.seq = undo_read_4c(&bi);
+		uhp->uh_alt_next.seq = undo_read_4c(&bi);
+		uhp->uh_alt_prev.seq = undo_read_4c(&bi);
+		continue;
+	    }
+	    uhp = unserialize_uhp(&bi, file_name);
+	    if (uhp == NULL)
+		goto error;
+	    for (i = 0; i < uhp_ga.ga_len; ++i)
+		if (UHP_TABLE(i) != NULL
+				     && UHP_TABLE(i)->uh_seq == uhp->uh_seq)
+		    break;
+	    if (i < uhp_ga.ga_len)
+		u_free_uhp(UHP_TABLE(i));
+	    else if (ga_grow(&uhp_ga, 1) == FAIL)
+	    {
+		u_free_uhp(uhp);
+		goto error;
+	    }
+	    else
+	    {
+		++uhp_ga.ga_len;
+		++num_read_uhps;
+	    }
+	    UHP_TABLE(i) = uhp;
+	}
+	if (c != UF_HEADER_END_MAGIC)
 	{
-	    corruption_error("num_head too small", file_name);
+	    corruption_error("end marker", file_name);
 	    goto error;
 	}
 
-	uhp = unserialize_uhp(&bi, file_name);
-	if (uhp == NULL)
+	/* An encrypted undo file is always written completely. */
+#ifdef FEAT_CRYPT
+	if (bi.bi_state != NULL)
+	    break;
+#endif
+	if (journal_base < 0)
+	    journal_base = (off_T)vim_ftell(fp);
+	c = undo_read_byte(&bi);
+	if (c == EOF)
+	    break;
+	if (((c << 8) + undo_read_byte(&bi)) != UF_JOURNAL_MAGIC)
+	{
+	    corruption_error("appended changes", file_name);
 	    goto error;
-	uhp_table[num_read_uhps++] = uhp;
+	}
     }
 
-    if (num_read_uhps != num_head)
+    /* Older versions have the sha256 of the whole text. */
+    if (version != UF_VERSION && version != UF_VERSION_CRYPT)
     {
-	corruption_error("num_head", file_name);
+	u_compute_text_hash(buf_hash);
+	hash = buf_hash;
+    }
+    else if (hash == NULL)
+    {
+	u_compute_hash(buf_hash);
+	hash = buf_hash;
+    }
+    if (memcmp(hash, read_hash, UNDO_HASH_SIZE) != 0
+				  || line_count != curbuf->b_ml.ml_line_count)
+    {
+	if (p_verbose > 0 || name != NULL)
+	{
+	    if (name == NULL)
+		verbose_enter();
+	    give_warning((char_u *)
+		      _("File contents changed, cannot use undo info"), TRUE);
+	    if (name == NULL)
+		verbose_leave();
+	}
 	goto error;
     }
-    if (c != UF_HEADER_END_MAGIC)
+    if (num_read_uhps != num_head)
     {
-	corruption_error("end marker", file_name);
+	corruption_error("num_head", file_name);
 	goto error;
     }
 
+    /* Put the headers that are still used at the start of the table. */
+    uhp_table = (u_header_T **)uhp_ga.ga_data;
+    for (i = 0, j = 0; i < uhp_ga.ga_len; ++i)
+	if (uhp_table[i] != NULL)
+	    uhp_table[j++] = uhp_table[i];
+    uhp_ga.ga_len = j;
+
 #ifdef U_DEBUG
     uhp_table_used = (int *)alloc_clear(
 				     (unsigned)(sizeof(int) * num_head + 1));
@@ -2103,7 +2505,20 @@ u_read_undo(char_u *name, char_u *hash, char_u *orig_name)
     curbuf->b_u_save_nr_cur = last_save_nr;
 
     curbuf->b_u_synced = TRUE;
+    for (i = 0; i < num_head; i++)
+	if (uhp_table[i] != NULL)
+	    u_size_update(curbuf, uhp_table[i]);
     vim_free(uhp_table);
+    u_spill_check(curbuf);
+
+    /* When writing the undo file the changes can be appended, unless it has
+     * an older version. */
+    if (name == NULL && version == UF_VERSION
+#ifdef FEAT_CRYPT
+	    && bi.bi_state == NULL
+#endif
+	    )
+	u_journal_set(curbuf, file_name, journal_base);
 
 #ifdef U_DEBUG
     for (i = 0; i < num_head; ++i)
@@ -2119,13 +2534,10 @@ u_read_undo(char_u *name, char_u *hash, char_u *orig_name)
 
 error:
     vim_free(line_ptr);
-    if (uhp_table != NULL)
-    {
-	for (i = 0; i < num_read_uhps; i++)
-	    if (uhp_table[i] != NULL)
-		u_free_uhp(uhp_table[i]);
-	vim_free(uhp_table);
-    }
+    for (i = 0; i < uhp_ga.ga_len; i++)
+	if (UHP_TABLE(i) != NULL)
+	    u_free_uhp(UHP_TABLE(i));
+    ga_clear(&uhp_ga);
 
 theend:
 #ifdef FEAT_CRYPT
@@ -2140,6 +2552,312 @@ theend:
     return;
 }
 
+/*
+ * Update the number of bytes used for the entries of "uhp" and the total for
+ * "buf".  Entries in the spill file don't count.
+ */
+    static void
+u_size_update(buf_T *buf, u_header_T *uhp)
+{
+    u_entry_T	*uep;
+    long	size = 0;
+    long	i;
+
+    for (uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next)
+    {
+	size += (long)(sizeof(u_entry_T) + uep->ue_size * sizeof(char_u *));
+	for (i = 0; i < uep->ue_size; ++i)
+	    size += (long)STRLEN(uep->ue_array[i]) + 1;
+    }
+    buf->b_u_size += size - uhp->uh_size;
+    uhp->uh_size = size;
+}
+
+/*
+ * Write the entries of "uhp" to the spill file of "buf" and free them.
+ * The spill file is created when needed.
+ * Returns FAIL when the file can't be created or written, the entries are
+ * then kept in memory.
+ */
+    static int
+u_spill(buf_T *buf, u_header_T *uhp)
+{
+    bufinfo_T	bi;
+    u_entry_T	*uep, *nuep;
+    off_T	end;
+
+    if (buf->b_u_sfp == NULL)
+    {
+	buf->b_u_sname = vim_tempname('u', FALSE);
+	if (buf->b_u_sname == NULL)
+	    return FAIL;
+	buf->b_u_sfp = mch_fopen((char *)buf->b_u_sname, "w+b");
+	if (buf->b_u_sfp == NULL)
+	{
+	    vim_free(buf->b_u_sname);
+	    buf->b_u_sname = NULL;
+	    return FAIL;
+	}
+	buf->b_u_ssize = 0;
+	buf->b_u_sdead = 0;
+    }
+
+    if (vim_fseek(buf->b_u_sfp, buf->b_u_ssize, SEEK_SET) != 0)
+	return FAIL;
+    vim_memset(&bi, 0, sizeof(bi));
+    bi.bi_buf = buf;
+    bi.bi_fp = buf->b_u_sfp;
+    if (serialize_uhp(&bi, uhp) == FAIL || fflush(buf->b_u_sfp) != 0
+						     || ferror(buf->b_u_sfp))
+    {
+	clearerr(buf->b_u_sfp);
+	return FAIL;
+    }
+    end = vim_ftell(buf->b_u_sfp);
+    if (end <= buf->b_u_ssize)
+	return FAIL;
+
+    for (uep = uhp->uh_entry; uep != NULL; uep = nuep)
+    {
+	nuep = uep->ue_next;
+	u_freeentry(uep, uep->ue_size);
+    }
+    uhp->uh_entry = NULL;
+    uhp->uh_spill_off = buf->b_u_ssize;
+    uhp->uh_spill_len = (long)(end - buf->b_u_ssize);
+    buf->b_u_ssize = end;
+    u_size_update(buf, uhp);
+    return OK;
+}
+
+/*
+ * Read the entries of "uhp" from the spill file of "buf".
+ * Returns NULL when reading fails.
+ */
+    static u_entry_T *
+u_spill_read(buf_T *buf, u_header_T *uhp)
+{
+    bufinfo_T	bi;
+    u_header_T	*tmp;
+    u_entry_T	*uep;
+
+    vim_memset(&bi, 0, sizeof(bi));
+    bi.bi_buf = buf;
+    bi.bi_fp = buf->b_u_sfp;
+    if (bi.bi_fp == NULL
+	    || vim_fseek(bi.bi_fp, uhp->uh_spill_off, SEEK_SET) != 0
+	    || undo_read_2c(&bi) != UF_HEADER_MAGIC)
+    {
+	corruption_error("spill", buf->b_u_sname);
+	return NULL;
+    }
+    tmp = unserialize_uhp(&bi, buf->b_u_sname);
+    if (tmp == NULL)
+	return NULL;
+    uep = tmp->uh_entry;
+    tmp->uh_entry = NULL;
+    u_free_uhp(tmp);
+    return uep;
+}
+
+/*
+ * Make sure the entries of "uhp" are in memory, read them from the spill
+ * file of "buf" when needed.
+ * Returns FAIL when reading the spill file fails.
+ */
+    static int
+u_spill_load(buf_T *buf, u_header_T *uhp)
+{
+    u_entry_T	*uep;
+
+    if (uhp == NULL || uhp->uh_spill_len == 0)
+	return OK;
+    uep = u_spill_read(buf, uhp);
+    if (uep == NULL)
+	return FAIL;
+    uhp->uh_entry = uep;
+    buf->b_u_sdead += uhp->uh_spill_len;
+    uhp->uh_spill_off = 0;
+    uhp->uh_spill_len = 0;
+    u_size_update(buf, uhp);
+    return OK;
+}
+
+/*
+ * Add the headers of the branch starting at "uhp", and of the branches
+ * below it, to "gap".  When "spilled" is TRUE the ones with entries in the
+ * spill file, otherwise the ones of which the entries can be spilled.
+ * Returns FAIL when out of memory.
+ */
+    static int
+u_spill_collect(
+    buf_T	*buf,
+    u_header_T	*uhp,
+    garray_T	*gap,
+    int		spilled)
+{
+    for ( ; uhp != NULL; uhp = uhp->uh_prev.ptr)
+    {
+	if (uhp->uh_alt_next.ptr != NULL && u_spill_collect(buf,
+				uhp->uh_alt_next.ptr, gap, spilled) == FAIL)
+	    return FAIL;
+	if (spilled ? uhp->uh_spill_len > 0
+		    : (uhp->uh_size > 0 && uhp != buf->b_u_newhead
+						  && uhp != buf->b_u_curhead))
+	{
+	    if (ga_grow(gap, 1) == FAIL)
+		return FAIL;
+	    ((u_header_T **)gap->ga_data)[gap->ga_len++] = uhp;
+	}
+    }
+    return OK;
+}
+
+/*
+ * Sort headers on sequence number, oldest first.
+ */
+    static int
+#ifdef __BORLANDC__
+_RTLENTRYF
+#endif
+u_spill_compare(const void *s1, const void *s2)
+{
+    long	seq1 = (*(u_header_T **)s1)->uh_seq;
+    long	seq2 = (*(u_header_T **)s2)->uh_seq;
+
+    return seq1 == seq2 ? 0 : seq1 > seq2 ? 1 : -1;
+}
+
+/*
+ * When more than half of the spill file of "buf" is no longer used, copy the
+ * entries that are still used to a new spill file.
+ */
+    static void
+u_spill_compact(buf_T *buf)
+{
+    garray_T	ga;
+    char_u	*name;
+    FILE	*fp = NULL;
+    char_u	*iobuf;
+    u_header_T	*uhp;
+    off_T	size = 0;
+    long	todo;
+    long	n;
+    int		i;
+    int		ok;
+
+    if (buf->b_u_sfp == NULL || buf->b_u_sdead * 2 <= buf->b_u_ssize)
+	return;
+    if (buf->b_u_sdead >= buf->b_u_ssize)
+    {
+	/* Nothing is used, start at the beginning again. */
+	buf->b_u_ssize = 0;
+	buf->b_u_sdead = 0;
+	return;
+    }
+
+    name = vim_tempname('u', FALSE);
+    if (name != NULL)
+	fp = mch_fopen((char *)name, "w+b");
+    iobuf = alloc(IOSIZE);
+    ga_init2(&ga, (int)sizeof(u_header_T *), 100);
+    ok = fp != NULL && iobuf != NULL
+	    && u_spill_collect(buf, buf->b_u_oldhead, &ga, TRUE) == OK;
+    for (i = 0; ok && i < ga.ga_len; ++i)
+    {
+	uhp = ((u_header_T **)ga.ga_data)[i];
+	if (vim_fseek(buf->b_u_sfp, uhp->uh_spill_off, SEEK_SET) != 0)
+	    ok = FALSE;
+	for (todo = uhp->uh_spill_len; ok && todo > 0; todo -= n)
+	{
+	    n = todo > IOSIZE ? IOSIZE : todo;
+	    if (fread(iobuf, (size_t)n, 1, buf->b_u_sfp) != 1
+				      || fwrite(iobuf, (size_t)n, 1, fp) != 1)
+		ok = FALSE;
+	}
+    }
+    if (ok && fflush(fp) == 0)
+    {
+	/* Everything was copied, switch to the new file. */
+	for (i = 0; i < ga.ga_len; ++i)
+	{
+	    uhp = ((u_header_T **)ga.ga_data)[i];
+	    uhp->uh_spill_off = size;
+	    size += uhp->uh_spill_len;
+	}
+	u_spill_close(buf);
+	buf->b_u_sfp = fp;
+	buf->b_u_sname = name;
+	buf->b_u_ssize = size;
+	fp = NULL;
+	name = NULL;
+    }
+    else
+	clearerr(buf->b_u_sfp);
+
+    if (fp != NULL)
+    {
+	fclose(fp);
+	mch_remove(name);
+    }
+    vim_free(name);
+    vim_free(iobuf);
+    ga_clear(&ga);
+}
+
+/*
+ * Called after the entries of "buf" changed.  When they use more memory than
+ * 'undomemory' write the entries of the oldest headers to the spill file,
+ * until they use a quarter less.  The headers stay in memory.
+ */
+    void
+u_spill_check(buf_T *buf)
+{
+    garray_T	ga;
+    long_u	limit = (long_u)p_umm * 1024;
+    int		i;
+
+    u_spill_compact(buf);
+    if (p_umm <= 0 || buf->b_u_size <= limit || buf->b_u_oldhead == NULL)
+	return;
+#ifdef FEAT_CRYPT
+    /* Don't write the text of an encrypted buffer to a file. */
+    if (*buf->b_p_key != NUL)
+	return;
+#endif
+
+    ga_init2(&ga, (int)sizeof(u_header_T *), 100);
+    if (u_spill_collect(buf, buf->b_u_oldhead, &ga, FALSE) == OK
+							    && ga.ga_len > 0)
+    {
+	qsort(ga.ga_data, (size_t)ga.ga_len, sizeof(u_header_T *),
+							     u_spill_compare);
+	limit -= limit / 4;
+	for (i = 0; i < ga.ga_len && buf->b_u_size > limit; ++i)
+	    if (u_spill(buf, ((u_header_T **)ga.ga_data)[i]) == FAIL)
+		break;
+    }
+    ga_clear(&ga);
+}
+
+/*
+ * Close and delete the spill file of "buf".
+ */
+    static void
+u_spill_close(buf_T *buf)
+{
+    if (buf->b_u_sfp != NULL)
+    {
+	fclose(buf->b_u_sfp);
+	buf->b_u_sfp = NULL;
+	mch_remove(buf->b_u_sname);
+    }
+    vim_free(buf->b_u_sname);
+    buf->b_u_sname = NULL;
+    buf->b_u_ssize = 0;
+    buf->b_u_sdead = 0;
+}
+
 #endif /* FEAT_PERSISTENT_UNDO */
 
 
@@ -2547,18 +3265,27 @@ undo_time(
 		while (uhp->uh_alt_prev.ptr != NULL)
 		    uhp = uhp->uh_alt_prev.ptr;
 		if (last->uh_alt_next.ptr != NULL)
+		{
 		    last->uh_alt_next.ptr->uh_alt_prev.ptr =
 							last->uh_alt_prev.ptr;
+		    last->uh_alt_next.ptr->uh_dirty |= UH_DIRTY_LINKS;
+		}
 		last->uh_alt_prev.ptr->uh_alt_next.ptr = last->uh_alt_next.ptr;
+		last->uh_alt_prev.ptr->uh_dirty |= UH_DIRTY_LINKS;
 		last->uh_alt_prev.ptr = NULL;
 		last->uh_alt_next.ptr = uhp;
+		last->uh_dirty |= UH_DIRTY_LINKS;
 		uhp->uh_alt_prev.ptr = last;
+		uhp->uh_dirty |= UH_DIRTY_LINKS;
 
 		if (curbuf->b_u_oldhead == uhp)
 		    curbuf->b_u_oldhead = last;
 		uhp = last;
 		if (uhp->uh_next.ptr != NULL)
+		{
 		    uhp->uh_next.ptr->uh_prev.ptr = uhp;
+		    uhp->uh_next.ptr->uh_dirty |= UH_DIRTY_LINKS;
+		}
 	    }
 	    curbuf->b_u_curhead = uhp;
 
@@ -2631,6 +3358,16 @@ u_undoredo(int undo)
     block_autocmds();
 #endif
 
+#ifdef FEAT_PERSISTENT_UNDO
+    if (u_spill_load(curbuf, curhead) == FAIL)
+    {
+# ifdef FEAT_AUTOCMD
+	unblock_autocmds();
+# endif
+	return;
+    }
+#endif
+
 #ifdef U_DEBUG
     u_check(FALSE);
 #endif
@@ -2639,6 +3376,17 @@ u_undoredo(int undo)
 	       ((curbuf->b_ml.ml_flags & ML_EMPTY) ? UH_EMPTYBUF : 0);
     setpcmark();
 
+    /* Get the full text of lines for which only the changed bytes were
+     * kept.  The lines they were made for are still in the buffer. */
+    if (u_expand_entries(curhead) == FAIL)
+    {
+	do_outofmem_msg((long_u)0);
+#ifdef FEAT_AUTOCMD
+	unblock_autocmds();
+#endif
+	return;
+    }
+
     /*
      * save marks before undo/redo
      */
@@ -2722,18 +3470,17 @@ u_undoredo(int undo)
 		}
 		break;
 	    }
-	    /* delete backwards, it goes faster in most cases */
-	    for (lnum = bot - 1, i = oldsize; --i >= 0; --lnum)
+	    for (lnum = top + 1, i = 0; i < oldsize; ++i, ++lnum)
 	    {
 		/* what can we do when we run out of memory? */
 		if ((newarray[i] = u_save_line(lnum)) == NULL)
 		    do_outofmem_msg((long_u)0);
-		/* remember we deleted the last line in the buffer, and a
-		 * dummy empty line will be inserted */
-		if (curbuf->b_ml.ml_line_count == 1)
-		    empty_buffer = TRUE;
-		ml_delete(lnum, FALSE);
 	    }
+	    /* remember we delete the last line in the buffer, and a
+	     * dummy empty line will be inserted */
+	    if (oldsize >= curbuf->b_ml.ml_line_count)
+		empty_buffer = TRUE;
+	    ml_delete_range(top + 1, oldsize, FALSE);
 	}
 	else
 	    newarray = NULL;
@@ -2741,18 +3488,16 @@ u_undoredo(int undo)
 	/* insert the lines in u_array between top and bot */
 	if (newsize)
 	{
-	    for (lnum = top, i = 0; i < newsize; ++i, ++lnum)
-	    {
-		/*
-		 * If the file is empty, there is an empty line 1 that we
-		 * should get rid of, by replacing it with the new line
-		 */
-		if (empty_buffer && lnum == 0)
-		    ml_replace((linenr_T)1, uep->ue_array[i], TRUE);
-		else
-		    ml_append(lnum, uep->ue_array[i], (colnr_T)0, FALSE);
+	    i = 0;
+	    /*
+	     * If the file is empty, there is an empty line 1 that we
+	     * should get rid of, by replacing it with the new line
+	     */
+	    if (empty_buffer && top == 0)
+		ml_replace((linenr_T)1, uep->ue_array[i++], TRUE);
+	    ml_append_range(top + i, uep->ue_array + i, newsize - i);
+	    for (i = 0; i < newsize; ++i)
 		vim_free(uep->ue_array[i]);
-	    }
 	    vim_free((char_u *)uep->ue_array);
 	}
 
@@ -2793,6 +3538,12 @@ u_undoredo(int undo)
 
     curhead->uh_entry = newlist;
     curhead->uh_flags = new_flags;
+    curhead->uh_dirty |= UH_DIRTY_ALL;
+    u_delta_entries(curhead);
+#ifdef FEAT_PERSISTENT_UNDO
+    u_size_update(curbuf, curhead);
+    u_spill_check(curbuf);
+#endif
     if ((old_flags & UH_EMPTYBUF) && BUFEMPTY())
 	curbuf->b_ml.ml_flags |= ML_EMPTY;
     if (old_flags & UH_CHANGED)
@@ -2993,6 +3744,14 @@ u_sync(
     {
 	u_getbot();		    /* compute ue_bot of previous u_save */
 	curbuf->b_u_curhead = NULL;
+	u_delta_entries(curbuf->b_u_newhead);
+#ifdef FEAT_PERSISTENT_UNDO
+	if (curbuf->b_u_newhead != NULL)
+	{
+	    u_size_update(curbuf, curbuf->b_u_newhead);
+	    u_spill_check(curbuf);
+	}
+#endif
     }
 }
 
@@ -3144,7 +3903,11 @@ ex_undojoin(exarg_T *eap UNUSED)
 	return;		    /* already unsynced */
     if (get_undolevel() < 0)
 	return;		    /* no entries, nothing to do */
-    else
+#ifdef FEAT_PERSISTENT_UNDO
+    if (u_spill_load(curbuf, curbuf->b_u_newhead) == FAIL)
+	return;
+#endif
+    if (u_expand_entries(curbuf->b_u_newhead) == OK)
 	/* Append next change to the last entry */
 	curbuf->b_u_synced = FALSE;
 }
@@ -3157,6 +3920,9 @@ ex_undojoin(exarg_T *eap UNUSED)
 u_unchanged(buf_T *buf)
 {
     u_unch_branch(buf->b_u_oldhead);
+#ifdef FEAT_PERSISTENT_UNDO
+    buf->b_u_junchanged = TRUE;
+#endif
     buf->b_did_warn = FALSE;
 }
 
@@ -3173,10 +3939,15 @@ u_find_first_changed(void)
 
     if (curbuf->b_u_curhead != NULL || uhp == NULL)
 	return;  /* undid something in an autocmd? */
+#ifdef FEAT_PERSISTENT_UNDO
+    if (u_spill_load(curbuf, uhp) == FAIL)
+	return;
+#endif
 
     /* Check that the last undo block was for the whole file. */
     uep = uhp->uh_entry;
-    if (uep->ue_top != 0 || uep->ue_bot != 0)
+    if (uep->ue_top != 0 || uep->ue_bot != 0
+					  || u_expand_entries(uhp) == FAIL)
 	return;
 
     for (lnum = 1; lnum < curbuf->b_ml.ml_line_count
@@ -3186,6 +3957,7 @@ u_find_first_changed(void)
 	{
 	    CLEAR_POS(&(uhp->uh_cursor));
 	    uhp->uh_cursor.lnum = lnum;
+	    uhp->uh_dirty |= UH_DIRTY_ALL;
 	    return;
 	}
     if (curbuf->b_ml.ml_line_count != uep->ue_size)
@@ -3193,6 +3965,7 @@ u_find_first_changed(void)
 	/* lines added or deleted at the end, put the cursor there */
 	CLEAR_POS(&(uhp->uh_cursor));
 	uhp->uh_cursor.lnum = lnum;
+	uhp->uh_dirty |= UH_DIRTY_ALL;
     }
 }
 
@@ -3213,7 +3986,10 @@ u_update_save_nr(buf_T *buf)
     else
 	uhp = buf->b_u_newhead;
     if (uhp != NULL)
+    {
 	uhp->uh_save_nr = buf->b_u_save_nr_last;
+	uhp->uh_dirty |= UH_DIRTY_ALL;
+    }
 }
 
     static void
@@ -3300,20 +4076,29 @@ u_freeheader(
 	u_freebranch(buf, uhp->uh_alt_next.ptr, uhpp);
 
     if (uhp->uh_alt_prev.ptr != NULL)
+    {
 	uhp->uh_alt_prev.ptr->uh_alt_next.ptr = NULL;
+	uhp->uh_alt_prev.ptr->uh_dirty |= UH_DIRTY_LINKS;
+    }
 
     /* Update the links in the list to remove the header. */
     if (uhp->uh_next.ptr == NULL)
 	buf->b_u_oldhead = uhp->uh_prev.ptr;
     else
+    {
 	uhp->uh_next.ptr->uh_prev.ptr = uhp->uh_prev.ptr;
+	uhp->uh_next.ptr->uh_dirty |= UH_DIRTY_LINKS;
+    }
 
     if (uhp->uh_prev.ptr == NULL)
 	buf->b_u_newhead = uhp->uh_next.ptr;
     else
 	for (uhap = uhp->uh_prev.ptr; uhap != NULL;
 						 uhap = uhap->uh_alt_next.ptr)
+	{
 	    uhap->uh_next.ptr = uhp->uh_next.ptr;
+	    uhap->uh_dirty |= UH_DIRTY_LINKS;
+	}
 
     u_freeentries(buf, uhp, uhpp);
 }
@@ -3339,7 +4124,10 @@ u_freebranch(
     }
 
     if (uhp->uh_alt_prev.ptr != NULL)
+    {
 	uhp->uh_alt_prev.ptr->uh_alt_next.ptr = NULL;
+	uhp->uh_alt_prev.ptr->uh_dirty |= UH_DIRTY_LINKS;
+    }
 
     next = uhp;
     while (next != NULL)
@@ -3372,6 +4160,20 @@ u_freeentries(
     if (uhpp != NULL && uhp == *uhpp)
 	*uhpp = NULL;
 
+#ifdef FEAT_PERSISTENT_UNDO
+    /* Remember the header is gone for appending to the undo file. */
+    if (buf->b_u_jname != NULL)
+    {
+	if (ga_grow(&buf->b_u_jfreed, 1) == OK)
+	    ((long *)buf->b_u_jfreed.ga_data)[buf->b_u_jfreed.ga_len++] =
+								  uhp->uh_seq;
+	else
+	    u_journal_clear(buf);
+    }
+    buf->b_u_size -= uhp->uh_size;
+    buf->b_u_sdead += uhp->uh_spill_len;
+#endif
+
     for (uep = uhp->uh_entry; uep != NULL; uep = nuep)
     {
 	nuep = uep->ue_next;
@@ -3409,6 +4211,9 @@ u_clearall(buf_T *buf)
     buf->b_u_newhead = buf->b_u_oldhead = buf->b_u_curhead = NULL;
     buf->b_u_synced = TRUE;
     buf->b_u_numhead = 0;
+#ifdef FEAT_PERSISTENT_UNDO
+    buf->b_u_size = 0;
+#endif
     buf->b_u_line_ptr = NULL;
     buf->b_u_line_lnum = 0;
 }
@@ -3499,8 +4304,14 @@ u_undoline(void)
     void
 u_blockfree(buf_T *buf)
 {
+#ifdef FEAT_PERSISTENT_UNDO
+    u_journal_clear(buf);
+#endif
     while (buf->b_u_oldhead != NULL)
 	u_freeheader(buf, buf->b_u_oldhead, NULL);
+#ifdef FEAT_PERSISTENT_UNDO
+    u_spill_close(buf);
+#endif
     vim_free(buf->b_u_line_ptr);
 }
 
@@ -3514,6 +4325,125 @@ u_save_line(linenr_T lnum)
     return vim_strsave(ml_get(lnum));
 }
 
+/*
+ * Only keep the bytes that differ from the buffer text for the entries in
+ * "uhp" that are for one line, when the buffer text is what it was right
+ * after the change.  Typing in a long line then doesn't keep a copy of the
+ * whole line for every undo step.
+ * Stops at the first entry that changes the number of lines, the line
+ * numbers of the entries after it are for another buffer text.
+ * Like u_savecommon() only checks the first ten entries.
+ */
+    static void
+u_delta_entries(u_header_T *uhp)
+{
+    u_entry_T	*uep;
+    u_entry_T	*prev_uep;
+    linenr_T	bot;
+    int		i;
+
+    if (uhp == NULL)
+	return;
+    for (uep = uhp->uh_entry, i = 0; uep != NULL && i < 10;
+						   uep = uep->ue_next, ++i)
+    {
+	bot = uep->ue_bot == 0 ? curbuf->b_ml.ml_line_count + 1
+							     : uep->ue_bot;
+	if (uep->ue_size != 1 || bot != uep->ue_top + 2
+				  || bot > curbuf->b_ml.ml_line_count + 1)
+	    break;
+
+	/* When an entry before it is for the same line, that line has
+	 * different text when this entry is used. */
+	for (prev_uep = uhp->uh_entry; prev_uep != uep;
+						  prev_uep = prev_uep->ue_next)
+	    if (prev_uep->ue_top == uep->ue_top)
+		break;
+	if (prev_uep == uep && !uep->ue_delta)
+	    u_delta_entry(uep);
+    }
+}
+
+/*
+ * Replace the line saved in "uep" with the bytes that differ from the line in
+ * the buffer below "uep->ue_top".  Nothing happens when only a few bytes
+ * would be saved.
+ */
+    static void
+u_delta_entry(u_entry_T *uep)
+{
+    char_u	*old = uep->ue_array[0];
+    char_u	*line = ml_get(uep->ue_top + 1);
+    colnr_T	old_len = (colnr_T)STRLEN(old);
+    colnr_T	len = (colnr_T)STRLEN(line);
+    colnr_T	prefix = 0;
+    colnr_T	suffix = 0;
+    char_u	*middle;
+
+    while (prefix < old_len && prefix < len && old[prefix] == line[prefix])
+	++prefix;
+    while (suffix < old_len - prefix && suffix < len - prefix
+		      && old[old_len - suffix - 1] == line[len - suffix - 1])
+	++suffix;
+    if (prefix + suffix < UE_DELTA_MIN)
+	return;
+
+    middle = vim_strnsave(old + prefix, old_len - prefix - suffix);
+    if (middle == NULL)
+	return;
+    vim_free(old);
+    uep->ue_array[0] = middle;
+    uep->ue_prefix = prefix;
+    uep->ue_suffix = suffix;
+    uep->ue_delta = TRUE;
+}
+
+/*
+ * Undo what u_delta_entries() did: put the whole line back in every entry of
+ * "uhp" that only has the changed bytes.  Must be done before using the
+ * entries, while the buffer has the text they were made for.
+ * Returns FAIL when out of memory.
+ */
+    static int
+u_expand_entries(u_header_T *uhp)
+{
+    u_entry_T	*uep;
+    char_u	*line;
+    char_u	*middle;
+    char_u	*newp;
+    colnr_T	len;
+    colnr_T	middle_len;
+    colnr_T	prefix;
+    colnr_T	suffix;
+
+    if (uhp == NULL)
+	return OK;
+    for (uep = uhp->uh_entry; uep != NULL; uep = uep->ue_next)
+    {
+	if (!uep->ue_delta || uep->ue_top >= curbuf->b_ml.ml_line_count)
+	    continue;
+	line = ml_get(uep->ue_top + 1);
+	len = (colnr_T)STRLEN(line);
+	middle = uep->ue_array[0];
+	middle_len = (colnr_T)STRLEN(middle);
+	prefix = uep->ue_prefix < len ? uep->ue_prefix : len;
+	suffix = uep->ue_suffix < len - prefix ? uep->ue_suffix : len - prefix;
+
+	newp = U_ALLOC_LINE(prefix + middle_len + suffix + 1);
+	if (newp == NULL)
+	    return FAIL;
+	mch_memmove(newp, line, (size_t)prefix);
+	mch_memmove(newp + prefix, middle, (size_t)middle_len);
+	mch_memmove(newp + prefix + middle_len, line + len - suffix,
+							     (size_t)suffix);
+	newp[prefix + middle_len + suffix] = NUL;
+	vim_free(middle);
+	uep->ue_array[0] = newp;
+	uep->ue_delta = FALSE;
+    }
+    return OK;
+}
+
 /*
  * Check if the 'modified' flag is set, or 'ff' has changed (only need to
  * check the first character, because it can only be "dos", "unix" or "mac").
@@ -78,6 +78,11 @@ static char *(features[]) =
 #else
 	"-arabic",
 #endif
+#ifdef FEAT_ASYNC_WRITE
+	"+asyncwrite",
+#else
+	"-asyncwrite",
+#endif
 #ifdef FEAT_AUTOCMD
 	"+autocmd",
 #else
@@ -238,6 +243,11 @@ static char *(features[]) =
 #else
 	"-file_in_path",
 #endif
+#ifdef FEAT_FILEWATCH
+	"+filewatch",
+#else
+	"-filewatch",
+#endif
 #ifdef FEAT_FIND_ID
 	"+find_in_path",
 #else
@@ -590,6 +600,11 @@ static char *(features[]) =
 #else
 	"-sun_workshop",
 #endif
+#ifdef FEAT_SWAP_THREAD
+	"+swapthread",
+#else
+	"-swapthread",
+#endif
 #ifdef FEAT_SYN_HL
 	"+syntax",
 #else
@@ -1050,6 +1050,8 @@ extern int (*dyn_libintl_putenv)(const char *envstring);
 #define RE_STRING	2	/* match in string instead of buffer text */
 #define RE_STRICT	4	/* don't allow [abc] without ] */
 #define RE_AUTO		8	/* automatic engine selection */
+#define RE_DFA		16	/* use a lazy DFA with the NFA engine */
+#define RE_CACHE	32	/* use the cache of compiled patterns */
 
 #ifdef FEAT_SYN_HL
 /* values for reg_do_extmatch */
@@ -6870,7 +6870,8 @@ match_add(
 	EMSG2(_(e_nogroup), grp);
 	return -1;
     }
-    if (pat != NULL && (regprog = vim_regcomp(pat, RE_MAGIC)) == NULL)
+    if (pat != NULL
+	       && (regprog = vim_regcomp(pat, RE_MAGIC + RE_CACHE)) == NULL)
     {
 	EMSG2(_(e_invarg2), pat);
 	return -1;